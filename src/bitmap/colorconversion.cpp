@@ -875,25 +875,11 @@ static uint32 GetDXTCEncodeType( ImageFormat imageFormat )
 	}
 }
 
-// Use AMD compressor to convert RGBA input to ATI1N, ATI2N or DXT5_GA format
-bool ConvertToATIxN(  const uint8 *src, ImageFormat srcImageFormat,
-					  uint8 *dst, ImageFormat dstImageFormat,
-					  int width, int height, int srcStride, int dstStride, bool bDXT5GA = false )
-{
-	Assert( !"ATIxN is no longer supported." );
-	return false;
-}
-
-
-bool ConvertToDXT(  const uint8 *src, ImageFormat srcImageFormat,
- 					uint8 *dst, ImageFormat dstImageFormat, 
-					int width, int height, int srcStride, int dstStride )
-{
 #if !defined( _X360 ) && !defined( POSIX )
-	// from rgb(a) to dxtN
-	if( srcStride != 0 || dstStride != 0 )
-		return false;
-
+static bool ConvertToDXTNvtc( const uint8 *src, ImageFormat srcImageFormat,
+							  uint8 *dst, ImageFormat dstImageFormat, 
+							  int width, int height )
+{
 	DDSURFACEDESC descIn;
 	DDSURFACEDESC descOut;
 	memset( &descIn, 0, sizeof(descIn) );
@@ -957,10 +943,50 @@ bool ConvertToDXT(  const uint8 *src, ImageFormat srcImageFormat,
 	// Encode the texture
 	S3TCencode( &descIn, NULL, &descOut, dst, dwEncodeType, weight );
 	return true;
-#else
-	Assert( 0 );
-	return false;
+}
 #endif
+
+//-----------------------------------------------------------------------------
+// Which encoder DXT1/3/5 go through
+//-----------------------------------------------------------------------------
+static bool s_bForceBuiltInDXT = false;
+static DXTEncodeQuality_t s_nDXTEncodeQuality = DXT_ENCODE_NORMAL;
+
+void SetDXTEncoder( bool bForceBuiltIn, DXTEncodeQuality_t nQuality )
+{
+	s_bForceBuiltInDXT = bForceBuiltIn;
+	s_nDXTEncodeQuality = nQuality;
+}
+
+
+// Converts RGBA input to ATI1N, ATI2N or DXT5_GA format with the built-in encoder
+bool ConvertToATIxN(  const uint8 *src, ImageFormat srcImageFormat,
+					  uint8 *dst, ImageFormat dstImageFormat,
+					  int width, int height, int srcStride, int dstStride, bool bDXT5GA = false )
+{
+	if( srcStride != 0 || dstStride != 0 )
+		return false;
+
+	return CompressDXT( src, srcImageFormat, dst, dstImageFormat, width, height, s_nDXTEncodeQuality, bDXT5GA );
+}
+
+
+bool ConvertToDXT(  const uint8 *src, ImageFormat srcImageFormat,
+ 					uint8 *dst, ImageFormat dstImageFormat, 
+					int width, int height, int srcStride, int dstStride )
+{
+	// from rgb(a) to dxtN
+	if( srcStride != 0 || dstStride != 0 )
+		return false;
+
+#if !defined( _X360 ) && !defined( POSIX )
+	if ( !s_bForceBuiltInDXT )
+	{
+		return ConvertToDXTNvtc( src, srcImageFormat, dst, dstImageFormat, width, height );
+	}
+#endif
+
+	return CompressDXT( src, srcImageFormat, dst, dstImageFormat, width, height, s_nDXTEncodeQuality );
 }
 
 bool ConvertToDXTRuntime(	const uint8 *src, ImageFormat srcImageFormat,
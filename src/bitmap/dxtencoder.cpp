@@ -0,0 +1,771 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Built-in DXT1/3/5, DXT5 GA, ATI1N and ATI2N block encoder
+//
+//			Each 4x4 block is held one channel per fltx4 row so the palette
+//			searches test four pixels at a time. Endpoints come from the
+//			block's bounding box (fast) or its principal axis (normal, high),
+//			and are then refitted by least squares to the indices they
+//			produced. Rows of blocks are compressed on the ImageLoader pool.
+//
+//=============================================================================//
+
+#include "bitmap/imageformat.h"
+#include "basetypes.h"
+#include "tier0/dbg.h"
+#include "mathlib/mathlib.h"
+#include "mathlib/ssemath.h"
+#include "vstdlib/jobthread.h"
+
+// Should be last include
+#include "tier0/memdbgon.h"
+
+
+namespace ImageLoader
+{
+
+//-----------------------------------------------------------------------------
+// A 4x4 block. m_Channel[c][q] holds channel c (r, g, b, a) of pixels 4q..4q+3
+//-----------------------------------------------------------------------------
+struct DXTEncodeBlock_t
+{
+	fltx4 m_Channel[4][4];
+	bi32x4 m_Transparent[4];	// ~0 where a pixel must use the transparent index
+	float m_flWeight[16];		// 0 for transparent pixels, which don't take part in the fit
+	int m_nOpaque;
+};
+
+struct DXTColorResult_t
+{
+	uint16 m_nColor0;
+	uint16 m_nColor1;
+	uint32 m_nIndices;
+	float m_flError;
+};
+
+static inline float BlockValue( const DXTEncodeBlock_t &block, int nChannel, int nPixel )
+{
+	return SubFloat( block.m_Channel[nChannel][nPixel >> 2], nPixel & 3 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Reads a 4x4 block in any of the supported source formats, replicating the
+// last row and column for images that aren't a multiple of 4
+//-----------------------------------------------------------------------------
+static void GatherBlock( const uint8 *pSrc, ImageFormat srcFormat, int nWidth, int nHeight, int bx, int by, DXTEncodeBlock_t &block )
+{
+	// Offsets of r, g, b, a in a source pixel; -1 means the channel is missing
+	int nOffset[4];
+	int nPixelSize = 4;
+	switch ( srcFormat )
+	{
+	case IMAGE_FORMAT_BGRA8888:
+		nOffset[0] = 2; nOffset[1] = 1; nOffset[2] = 0; nOffset[3] = 3;
+		break;
+	case IMAGE_FORMAT_BGRX8888:
+		nOffset[0] = 2; nOffset[1] = 1; nOffset[2] = 0; nOffset[3] = -1;
+		break;
+	case IMAGE_FORMAT_RGB888:
+		nOffset[0] = 0; nOffset[1] = 1; nOffset[2] = 2; nOffset[3] = -1;
+		nPixelSize = 3;
+		break;
+	case IMAGE_FORMAT_ARGB8888:
+		nOffset[0] = 1; nOffset[1] = 2; nOffset[2] = 3; nOffset[3] = 0;
+		break;
+	default:
+		Assert( srcFormat == IMAGE_FORMAT_RGBA8888 );
+		nOffset[0] = 0; nOffset[1] = 1; nOffset[2] = 2; nOffset[3] = 3;
+		break;
+	}
+
+	for ( int y = 0; y < 4; ++y )
+	{
+		int sy = MIN( by * 4 + y, nHeight - 1 );
+		for ( int x = 0; x < 4; ++x )
+		{
+			int sx = MIN( bx * 4 + x, nWidth - 1 );
+			const uint8 *pPixel = pSrc + ( sy * nWidth + sx ) * nPixelSize;
+			for ( int c = 0; c < 4; ++c )
+			{
+				SubFloat( block.m_Channel[c][y], x ) = ( nOffset[c] >= 0 ) ? pPixel[nOffset[c]] : 255.0f;
+			}
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Marks the pixels that have to come out transparent in a one-bit alpha block
+//-----------------------------------------------------------------------------
+static void ClassifyAlpha( DXTEncodeBlock_t &block, bool bOneBitAlpha )
+{
+	float flThreshold = bOneBitAlpha ? 128.0f : -1.0f;
+	block.m_nOpaque = 0;
+	for ( int q = 0; q < 4; ++q )
+	{
+		block.m_Transparent[q] = CmpLtSIMD( block.m_Channel[3][q], ReplicateX4( flThreshold ) );
+		for ( int i = 0; i < 4; ++i )
+		{
+			bool bTransparent = SubFloat( block.m_Channel[3][q], i ) < flThreshold;
+			block.m_flWeight[q * 4 + i] = bTransparent ? 0.0f : 1.0f;
+			block.m_nOpaque += bTransparent ? 0 : 1;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// 565 endpoints and the palette the decoder derives from them
+//-----------------------------------------------------------------------------
+static inline uint16 PackColor565( const float *pRGB )
+{
+	int r = clamp( (int)( pRGB[0] * ( 31.0f / 255.0f ) + 0.5f ), 0, 31 );
+	int g = clamp( (int)( pRGB[1] * ( 63.0f / 255.0f ) + 0.5f ), 0, 63 );
+	int b = clamp( (int)( pRGB[2] * ( 31.0f / 255.0f ) + 0.5f ), 0, 31 );
+	return (uint16)( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static inline void UnpackColor565( uint16 nColor, int *pRGB )
+{
+	int r = ( nColor >> 11 ) & 31;
+	int g = ( nColor >> 5 ) & 63;
+	int b = nColor & 31;
+	pRGB[0] = ( r << 3 ) | ( r >> 2 );
+	pRGB[1] = ( g << 2 ) | ( g >> 4 );
+	pRGB[2] = ( b << 3 ) | ( b >> 2 );
+}
+
+// Returns the number of usable palette entries; a 3 color block's fourth entry is transparent
+static int BuildColorPalette( uint16 nColor0, uint16 nColor1, float pPalette[4][3] )
+{
+	int c0[3], c1[3];
+	UnpackColor565( nColor0, c0 );
+	UnpackColor565( nColor1, c1 );
+	for ( int c = 0; c < 3; ++c )
+	{
+		pPalette[0][c] = c0[c];
+		pPalette[1][c] = c1[c];
+		if ( nColor0 > nColor1 )
+		{
+			pPalette[2][c] = ( 2 * c0[c] + c1[c] ) / 3;
+			pPalette[3][c] = ( c0[c] + 2 * c1[c] ) / 3;
+		}
+		else
+		{
+			pPalette[2][c] = ( c0[c] + c1[c] ) / 2;
+			pPalette[3][c] = 0.0f;
+		}
+	}
+	return ( nColor0 > nColor1 ) ? 4 : 3;
+}
+
+
+//-----------------------------------------------------------------------------
+// Picks the closest palette entry for every pixel, four pixels at a time
+//-----------------------------------------------------------------------------
+static float FindColorIndices( const DXTEncodeBlock_t &block, const float pPalette[4][3], int nColors, uint32 *pIndices )
+{
+	fltx4 flTotalError = Four_Zeros;
+	uint32 nIndices = 0;
+	for ( int q = 0; q < 4; ++q )
+	{
+		fltx4 flBestError = ReplicateX4( FLT_MAX );
+		fltx4 flBestIndex = Four_Zeros;
+		for ( int i = 0; i < nColors; ++i )
+		{
+			fltx4 dr = SubSIMD( block.m_Channel[0][q], ReplicateX4( pPalette[i][0] ) );
+			fltx4 dg = SubSIMD( block.m_Channel[1][q], ReplicateX4( pPalette[i][1] ) );
+			fltx4 db = SubSIMD( block.m_Channel[2][q], ReplicateX4( pPalette[i][2] ) );
+			fltx4 flError = MulSIMD( dr, dr );
+			flError = MaddSIMD( dg, dg, flError );
+			flError = MaddSIMD( db, db, flError );
+
+			bi32x4 bCloser = CmpLtSIMD( flError, flBestError );
+			flBestError = MinSIMD( flError, flBestError );
+			flBestIndex = MaskedAssign( bCloser, ReplicateX4( (float)i ), flBestIndex );
+		}
+
+		// Transparent pixels always use index 3 and don't count
+		flBestError = MaskedAssign( block.m_Transparent[q], Four_Zeros, flBestError );
+		flBestIndex = MaskedAssign( block.m_Transparent[q], ReplicateX4( 3.0f ), flBestIndex );
+		flTotalError = AddSIMD( flTotalError, flBestError );
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			nIndices |= (uint32)SubFloat( flBestIndex, i ) << ( 2 * ( q * 4 + i ) );
+		}
+	}
+
+	*pIndices = nIndices;
+	return SubFloat( flTotalError, 0 ) + SubFloat( flTotalError, 1 ) + SubFloat( flTotalError, 2 ) + SubFloat( flTotalError, 3 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Quantizes a pair of endpoints, orders them for the block mode and keeps the
+// result if it beats the best one so far
+//-----------------------------------------------------------------------------
+static bool TryColorEndpoints( const DXTEncodeBlock_t &block, const float *pEnd0, const float *pEnd1, bool bThreeColor, DXTColorResult_t &best )
+{
+	uint16 nColor0 = PackColor565( pEnd0 );
+	uint16 nColor1 = PackColor565( pEnd1 );
+
+	// 4 color blocks need color0 > color1, 3 color blocks color0 <= color1. Equal
+	// endpoints decode as a 3 color block, which is fine as long as only index 0 is used.
+	if ( ( nColor0 < nColor1 ) != bThreeColor && nColor0 != nColor1 )
+	{
+		V_swap( nColor0, nColor1 );
+	}
+
+	float palette[4][3];
+	int nColors = BuildColorPalette( nColor0, nColor1, palette );
+	if ( nColor0 == nColor1 )
+	{
+		nColors = 1;
+	}
+
+	DXTColorResult_t result;
+	result.m_nColor0 = nColor0;
+	result.m_nColor1 = nColor1;
+	result.m_flError = FindColorIndices( block, palette, MIN( nColors, 3 + !bThreeColor ), &result.m_nIndices );
+	if ( result.m_flError >= best.m_flError )
+		return false;
+
+	best = result;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Endpoints from the bounding box of the block, inset a little since the
+// extremes are rarely the best fit. The diagonal follows the sign of each
+// channel's covariance with green.
+//-----------------------------------------------------------------------------
+static void BoundingBoxEndpoints( const DXTEncodeBlock_t &block, float *pEnd0, float *pEnd1 )
+{
+	float flMin[3] = { 255.0f, 255.0f, 255.0f };
+	float flMax[3] = { 0.0f, 0.0f, 0.0f };
+	float flMean[3] = { 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < 16; ++i )
+	{
+		if ( block.m_flWeight[i] == 0.0f )
+			continue;
+
+		for ( int c = 0; c < 3; ++c )
+		{
+			float v = BlockValue( block, c, i );
+			flMin[c] = MIN( flMin[c], v );
+			flMax[c] = MAX( flMax[c], v );
+			flMean[c] += v;
+		}
+	}
+
+	float flCovRG = 0.0f, flCovBG = 0.0f;
+	for ( int c = 0; c < 3; ++c )
+	{
+		flMean[c] /= block.m_nOpaque;
+	}
+	for ( int i = 0; i < 16; ++i )
+	{
+		float dg = ( BlockValue( block, 1, i ) - flMean[1] ) * block.m_flWeight[i];
+		flCovRG += ( BlockValue( block, 0, i ) - flMean[0] ) * dg;
+		flCovBG += ( BlockValue( block, 2, i ) - flMean[2] ) * dg;
+	}
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		float flInset = ( flMax[c] - flMin[c] ) / 16.0f;
+		pEnd0[c] = flMax[c] - flInset;
+		pEnd1[c] = flMin[c] + flInset;
+	}
+	if ( flCovRG < 0.0f )
+	{
+		V_swap( pEnd0[0], pEnd1[0] );
+	}
+	if ( flCovBG < 0.0f )
+	{
+		V_swap( pEnd0[2], pEnd1[2] );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Endpoints at the extremes of the block's projection onto its principal axis
+//-----------------------------------------------------------------------------
+static void PrincipalAxisEndpoints( const DXTEncodeBlock_t &block, float *pEnd0, float *pEnd1 )
+{
+	float flMean[3] = { 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < 16; ++i )
+	{
+		for ( int c = 0; c < 3; ++c )
+		{
+			flMean[c] += BlockValue( block, c, i ) * block.m_flWeight[i];
+		}
+	}
+	for ( int c = 0; c < 3; ++c )
+	{
+		flMean[c] /= block.m_nOpaque;
+	}
+
+	float flCov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };		// rr rg rb gg gb bb
+	for ( int i = 0; i < 16; ++i )
+	{
+		float r = ( BlockValue( block, 0, i ) - flMean[0] ) * block.m_flWeight[i];
+		float g = ( BlockValue( block, 1, i ) - flMean[1] ) * block.m_flWeight[i];
+		float b = ( BlockValue( block, 2, i ) - flMean[2] ) * block.m_flWeight[i];
+		flCov[0] += r * r; flCov[1] += r * g; flCov[2] += r * b;
+		flCov[3] += g * g; flCov[4] += g * b; flCov[5] += b * b;
+	}
+
+	// Power iteration, starting from the largest variance
+	float flAxis[3] = { flCov[0], flCov[3], flCov[5] };
+	for ( int nIter = 0; nIter < 8; ++nIter )
+	{
+		float x = flAxis[0] * flCov[0] + flAxis[1] * flCov[1] + flAxis[2] * flCov[2];
+		float y = flAxis[0] * flCov[1] + flAxis[1] * flCov[3] + flAxis[2] * flCov[4];
+		float z = flAxis[0] * flCov[2] + flAxis[1] * flCov[4] + flAxis[2] * flCov[5];
+		float flLargest = MAX( fabs( x ), MAX( fabs( y ), fabs( z ) ) );
+		if ( flLargest < 1e-6f )
+			break;
+
+		flAxis[0] = x / flLargest;
+		flAxis[1] = y / flLargest;
+		flAxis[2] = z / flLargest;
+	}
+
+	float flLengthSq = flAxis[0] * flAxis[0] + flAxis[1] * flAxis[1] + flAxis[2] * flAxis[2];
+	if ( flLengthSq < 1e-6f )
+	{
+		// Solid block
+		for ( int c = 0; c < 3; ++c )
+		{
+			pEnd0[c] = pEnd1[c] = flMean[c];
+		}
+		return;
+	}
+
+	float flMinT = FLT_MAX, flMaxT = -FLT_MAX;
+	for ( int i = 0; i < 16; ++i )
+	{
+		if ( block.m_flWeight[i] == 0.0f )
+			continue;
+
+		float t = ( BlockValue( block, 0, i ) - flMean[0] ) * flAxis[0] +
+			( BlockValue( block, 1, i ) - flMean[1] ) * flAxis[1] +
+			( BlockValue( block, 2, i ) - flMean[2] ) * flAxis[2];
+		flMinT = MIN( flMinT, t );
+		flMaxT = MAX( flMaxT, t );
+	}
+
+	for ( int c = 0; c < 3; ++c )
+	{
+		pEnd0[c] = flMean[c] + flAxis[c] * flMaxT / flLengthSq;
+		pEnd1[c] = flMean[c] + flAxis[c] * flMinT / flLengthSq;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Solves for the endpoints that best reproduce the block with the given indices
+//-----------------------------------------------------------------------------
+static bool RefitColorEndpoints( const DXTEncodeBlock_t &block, const DXTColorResult_t &result, bool bThreeColor, float *pEnd0, float *pEnd1 )
+{
+	static const float s_flFourColorWeight[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	static const float s_flThreeColorWeight[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+	const float *pWeight = bThreeColor ? s_flThreeColorWeight : s_flFourColorWeight;
+
+	float flAA = 0.0f, flBB = 0.0f, flAB = 0.0f;
+	float flAX[3] = { 0.0f, 0.0f, 0.0f };
+	float flBX[3] = { 0.0f, 0.0f, 0.0f };
+	for ( int i = 0; i < 16; ++i )
+	{
+		if ( block.m_flWeight[i] == 0.0f )
+			continue;
+
+		int nIndex = ( result.m_nIndices >> ( 2 * i ) ) & 3;
+		float b = pWeight[nIndex];
+		float a = 1.0f - b;
+		flAA += a * a;
+		flBB += b * b;
+		flAB += a * b;
+		for ( int c = 0; c < 3; ++c )
+		{
+			float v = BlockValue( block, c, i );
+			flAX[c] += a * v;
+			flBX[c] += b * v;
+		}
+	}
+
+	float flDet = flAA * flBB - flAB * flAB;
+	if ( fabs( flDet ) < 1e-6f )
+		return false;
+
+	float flInvDet = 1.0f / flDet;
+	for ( int c = 0; c < 3; ++c )
+	{
+		pEnd0[c] = clamp( ( flBB * flAX[c] - flAB * flBX[c] ) * flInvDet, 0.0f, 255.0f );
+		pEnd1[c] = clamp( ( flAA * flBX[c] - flAB * flAX[c] ) * flInvDet, 0.0f, 255.0f );
+	}
+	return true;
+}
+
+
+static void FitColorBlock( const DXTEncodeBlock_t &block, DXTEncodeQuality_t nQuality, bool bThreeColor, DXTColorResult_t &best )
+{
+	float flEnd0[3], flEnd1[3];
+	if ( nQuality == DXT_ENCODE_FAST )
+	{
+		BoundingBoxEndpoints( block, flEnd0, flEnd1 );
+	}
+	else
+	{
+		PrincipalAxisEndpoints( block, flEnd0, flEnd1 );
+	}
+	TryColorEndpoints( block, flEnd0, flEnd1, bThreeColor, best );
+
+	int nRefinements = ( nQuality == DXT_ENCODE_HIGH ) ? 8 : ( nQuality == DXT_ENCODE_NORMAL ) ? 2 : 1;
+	for ( int i = 0; i < nRefinements; ++i )
+	{
+		if ( !RefitColorEndpoints( block, best, bThreeColor, flEnd0, flEnd1 ) )
+			break;
+		if ( !TryColorEndpoints( block, flEnd0, flEnd1, bThreeColor, best ) )
+			break;
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Encodes the color half of a block. DXT3 and DXT5 blocks are always decoded
+// as 4 color blocks, so only DXT1 may use 3 color mode.
+//-----------------------------------------------------------------------------
+static void EncodeColorBlock( const DXTEncodeBlock_t &block, bool bIsDXT1, DXTEncodeQuality_t nQuality, uint8 *pOut )
+{
+	DXTColorResult_t best;
+	best.m_nColor0 = best.m_nColor1 = 0;
+	best.m_nIndices = 0xFFFFFFFF;
+	best.m_flError = FLT_MAX;
+
+	if ( block.m_nOpaque == 0 )
+	{
+		// Everything is transparent
+		best.m_flError = 0.0f;
+	}
+	else if ( block.m_nOpaque < 16 )
+	{
+		FitColorBlock( block, nQuality, true, best );
+	}
+	else
+	{
+		FitColorBlock( block, nQuality, false, best );
+		if ( bIsDXT1 && nQuality == DXT_ENCODE_HIGH && best.m_flError > 0.0f )
+		{
+			FitColorBlock( block, nQuality, true, best );
+		}
+	}
+
+	pOut[0] = (uint8)( best.m_nColor0 & 0xFF );
+	pOut[1] = (uint8)( best.m_nColor0 >> 8 );
+	pOut[2] = (uint8)( best.m_nColor1 & 0xFF );
+	pOut[3] = (uint8)( best.m_nColor1 >> 8 );
+	pOut[4] = (uint8)( best.m_nIndices & 0xFF );
+	pOut[5] = (uint8)( ( best.m_nIndices >> 8 ) & 0xFF );
+	pOut[6] = (uint8)( ( best.m_nIndices >> 16 ) & 0xFF );
+	pOut[7] = (uint8)( best.m_nIndices >> 24 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Interpolated 3 bit alpha blocks (DXT5 alpha, ATI1N and both halves of ATI2N)
+//-----------------------------------------------------------------------------
+static int BuildAlphaPalette( int a0, int a1, float *pPalette )
+{
+	pPalette[0] = a0;
+	pPalette[1] = a1;
+	if ( a0 > a1 )
+	{
+		for ( int i = 1; i < 7; ++i )
+		{
+			pPalette[i + 1] = ( ( 7 - i ) * a0 + i * a1 ) / 7;
+		}
+		return 8;
+	}
+
+	for ( int i = 1; i < 5; ++i )
+	{
+		pPalette[i + 1] = ( ( 5 - i ) * a0 + i * a1 ) / 5;
+	}
+	pPalette[6] = 0.0f;
+	pPalette[7] = 255.0f;
+	return 8;
+}
+
+static float FindAlphaIndices( const fltx4 *pValues, const float *pPalette, uint64 *pIndices )
+{
+	fltx4 flTotalError = Four_Zeros;
+	uint64 nIndices = 0;
+	for ( int q = 0; q < 4; ++q )
+	{
+		fltx4 flBestError = ReplicateX4( FLT_MAX );
+		fltx4 flBestIndex = Four_Zeros;
+		for ( int i = 0; i < 8; ++i )
+		{
+			fltx4 d = SubSIMD( pValues[q], ReplicateX4( pPalette[i] ) );
+			fltx4 flError = MulSIMD( d, d );
+			bi32x4 bCloser = CmpLtSIMD( flError, flBestError );
+			flBestError = MinSIMD( flError, flBestError );
+			flBestIndex = MaskedAssign( bCloser, ReplicateX4( (float)i ), flBestIndex );
+		}
+		flTotalError = AddSIMD( flTotalError, flBestError );
+
+		for ( int i = 0; i < 4; ++i )
+		{
+			nIndices |= (uint64)SubFloat( flBestIndex, i ) << ( 3 * ( q * 4 + i ) );
+		}
+	}
+
+	*pIndices = nIndices;
+	return SubFloat( flTotalError, 0 ) + SubFloat( flTotalError, 1 ) + SubFloat( flTotalError, 2 ) + SubFloat( flTotalError, 3 );
+}
+
+static bool TryAlphaEndpoints( const fltx4 *pValues, int a0, int a1, int &nBest0, int &nBest1, uint64 &nBestIndices, float &flBestError )
+{
+	a0 = clamp( a0, 0, 255 );
+	a1 = clamp( a1, 0, 255 );
+
+	float palette[8];
+	BuildAlphaPalette( a0, a1, palette );
+
+	uint64 nIndices;
+	float flError = FindAlphaIndices( pValues, palette, &nIndices );
+	if ( flError >= flBestError )
+		return false;
+
+	nBest0 = a0;
+	nBest1 = a1;
+	nBestIndices = nIndices;
+	flBestError = flError;
+	return true;
+}
+
+static void EncodeAlphaBlock( const fltx4 *pValues, DXTEncodeQuality_t nQuality, uint8 *pOut )
+{
+	fltx4 flMin = MinSIMD( MinSIMD( pValues[0], pValues[1] ), MinSIMD( pValues[2], pValues[3] ) );
+	fltx4 flMax = MaxSIMD( MaxSIMD( pValues[0], pValues[1] ), MaxSIMD( pValues[2], pValues[3] ) );
+	int nMin = (int)MIN( MIN( SubFloat( flMin, 0 ), SubFloat( flMin, 1 ) ), MIN( SubFloat( flMin, 2 ), SubFloat( flMin, 3 ) ) );
+	int nMax = (int)MAX( MAX( SubFloat( flMax, 0 ), SubFloat( flMax, 1 ) ), MAX( SubFloat( flMax, 2 ), SubFloat( flMax, 3 ) ) );
+
+	int a0 = 0, a1 = 0;
+	uint64 nIndices = 0;
+	float flError = FLT_MAX;
+
+	// 8 value mode over the whole range
+	TryAlphaEndpoints( pValues, MAX( nMax, nMin + 1 ), nMin, a0, a1, nIndices, flError );
+
+	if ( nQuality != DXT_ENCODE_FAST && flError > 0.0f )
+	{
+		// 6 value mode spans everything but the 0s and 255s, which it has exact entries for
+		int nInnerMin = 255, nInnerMax = 0;
+		for ( int i = 0; i < 16; ++i )
+		{
+			int v = (int)SubFloat( pValues[i >> 2], i & 3 );
+			if ( v != 0 && v != 255 )
+			{
+				nInnerMin = MIN( nInnerMin, v );
+				nInnerMax = MAX( nInnerMax, v );
+			}
+		}
+		if ( nInnerMin <= nInnerMax )
+		{
+			TryAlphaEndpoints( pValues, nInnerMin, nInnerMax, a0, a1, nIndices, flError );
+		}
+	}
+
+	if ( nQuality == DXT_ENCODE_HIGH )
+	{
+		// Nudge each endpoint while that helps, keeping the mode the endpoints' order selects
+		static const int s_nSteps[] = { -4, -1, 1, 4 };
+		bool bImproved = true;
+		for ( int nIter = 0; bImproved && nIter < 16 && flError > 0.0f; ++nIter )
+		{
+			bImproved = false;
+			bool bEightValue = a0 > a1;
+			for ( int s = 0; s < ARRAYSIZE( s_nSteps ); ++s )
+			{
+				int n0 = a0 + s_nSteps[s];
+				if ( ( n0 > a1 ) == bEightValue )
+				{
+					bImproved |= TryAlphaEndpoints( pValues, n0, a1, a0, a1, nIndices, flError );
+				}
+				int n1 = a1 + s_nSteps[s];
+				if ( ( a0 > n1 ) == bEightValue )
+				{
+					bImproved |= TryAlphaEndpoints( pValues, a0, n1, a0, a1, nIndices, flError );
+				}
+			}
+		}
+	}
+
+	pOut[0] = (uint8)a0;
+	pOut[1] = (uint8)a1;
+	for ( int i = 0; i < 6; ++i )
+	{
+		pOut[i + 2] = (uint8)( ( nIndices >> ( 8 * i ) ) & 0xFF );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// DXT3 stores 4 bits of alpha per pixel
+//-----------------------------------------------------------------------------
+static void EncodeExplicitAlphaBlock( const fltx4 *pValues, uint8 *pOut )
+{
+	for ( int i = 0; i < 16; i += 2 )
+	{
+		int a0 = (int)( SubFloat( pValues[i >> 2], i & 3 ) * ( 15.0f / 255.0f ) + 0.5f );
+		int a1 = (int)( SubFloat( pValues[( i + 1 ) >> 2], ( i + 1 ) & 3 ) * ( 15.0f / 255.0f ) + 0.5f );
+		pOut[i >> 1] = (uint8)( a0 | ( a1 << 4 ) );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Compresses rows of blocks
+//-----------------------------------------------------------------------------
+struct DXTCompressContext_t
+{
+	const uint8 *m_pSrc;
+	ImageFormat m_SrcFormat;
+	uint8 *m_pDst;
+	ImageFormat m_DstFormat;
+	int m_nWidth;
+	int m_nHeight;
+	int m_nBlocksWide;
+	int m_nBlockSize;
+	DXTEncodeQuality_t m_nQuality;
+	bool m_bDXT5GA;
+};
+
+static void CompressBlockRows( DXTCompressContext_t *pContext, int nFirstRow, int nRowCount )
+{
+	const DXTCompressContext_t &ctx = *pContext;
+	bool bOneBitAlpha = ( ctx.m_DstFormat == IMAGE_FORMAT_DXT1_ONEBITALPHA );
+
+	DXTEncodeBlock_t block;
+	for ( int by = nFirstRow; by < nFirstRow + nRowCount; ++by )
+	{
+		uint8 *pOut = ctx.m_pDst + by * ctx.m_nBlocksWide * ctx.m_nBlockSize;
+		for ( int bx = 0; bx < ctx.m_nBlocksWide; ++bx, pOut += ctx.m_nBlockSize )
+		{
+			GatherBlock( ctx.m_pSrc, ctx.m_SrcFormat, ctx.m_nWidth, ctx.m_nHeight, bx, by, block );
+
+			switch ( ctx.m_DstFormat )
+			{
+			case IMAGE_FORMAT_DXT1:
+			case IMAGE_FORMAT_DXT1_ONEBITALPHA:
+				ClassifyAlpha( block, bOneBitAlpha );
+				EncodeColorBlock( block, true, ctx.m_nQuality, pOut );
+				break;
+
+			case IMAGE_FORMAT_DXT3:
+				EncodeExplicitAlphaBlock( block.m_Channel[3], pOut );
+				ClassifyAlpha( block, false );
+				EncodeColorBlock( block, false, ctx.m_nQuality, pOut + 8 );
+				break;
+
+			case IMAGE_FORMAT_DXT5:
+				if ( ctx.m_bDXT5GA )
+				{
+					// Normal map: x goes in alpha and y in green on its own
+					EncodeAlphaBlock( block.m_Channel[0], ctx.m_nQuality, pOut );
+					for ( int q = 0; q < 4; ++q )
+					{
+						block.m_Channel[0][q] = block.m_Channel[2][q] = Four_Zeros;
+					}
+				}
+				else
+				{
+					EncodeAlphaBlock( block.m_Channel[3], ctx.m_nQuality, pOut );
+				}
+				ClassifyAlpha( block, false );
+				EncodeColorBlock( block, false, ctx.m_nQuality, pOut + 8 );
+				break;
+
+			case IMAGE_FORMAT_ATI1N:
+				EncodeAlphaBlock( block.m_Channel[0], ctx.m_nQuality, pOut );
+				break;
+
+			case IMAGE_FORMAT_ATI2N:
+				// Matches ConvertFromATIxN: the first block is red, the second green
+				EncodeAlphaBlock( block.m_Channel[0], ctx.m_nQuality, pOut );
+				EncodeAlphaBlock( block.m_Channel[1], ctx.m_nQuality, pOut + 8 );
+				break;
+
+			default:
+				Assert( 0 );
+				break;
+			}
+		}
+	}
+}
+
+
+bool CompressDXT( const uint8 *pSrc, ImageFormat srcFormat, uint8 *pDst, ImageFormat dstFormat,
+				  int nWidth, int nHeight, DXTEncodeQuality_t nQuality, bool bDXT5GA )
+{
+	switch ( srcFormat )
+	{
+	case IMAGE_FORMAT_RGBA8888:
+	case IMAGE_FORMAT_BGRA8888:
+	case IMAGE_FORMAT_BGRX8888:
+	case IMAGE_FORMAT_RGB888:
+	case IMAGE_FORMAT_ARGB8888:
+		break;
+	default:
+		return false;
+	}
+
+	DXTCompressContext_t ctx;
+	switch ( dstFormat )
+	{
+	case IMAGE_FORMAT_DXT1:
+	case IMAGE_FORMAT_DXT1_ONEBITALPHA:
+	case IMAGE_FORMAT_ATI1N:
+		ctx.m_nBlockSize = 8;
+		break;
+	case IMAGE_FORMAT_DXT3:
+	case IMAGE_FORMAT_DXT5:
+	case IMAGE_FORMAT_ATI2N:
+		ctx.m_nBlockSize = 16;
+		break;
+	default:
+		return false;
+	}
+
+	if ( nWidth <= 0 || nHeight <= 0 )
+		return false;
+
+	ctx.m_pSrc = pSrc;
+	ctx.m_SrcFormat = srcFormat;
+	ctx.m_pDst = pDst;
+	ctx.m_DstFormat = dstFormat;
+	ctx.m_nWidth = nWidth;
+	ctx.m_nHeight = nHeight;
+	ctx.m_nBlocksWide = ( nWidth + 3 ) >> 2;
+	ctx.m_nQuality = nQuality;
+	ctx.m_bDXT5GA = bDXT5GA && ( dstFormat == IMAGE_FORMAT_DXT5 );
+
+	int nBlocksHigh = ( nHeight + 3 ) >> 2;
+	if ( !GetThreadPool() || ctx.m_nBlocksWide * nBlocksHigh < 256 )
+	{
+		// Runtime callers that never set a pool stay serial, and small mips aren't worth waking it for
+		CompressBlockRows( &ctx, 0, nBlocksHigh );
+	}
+	else
+	{
+		ParallelLoopProcessChunks( GetThreadPool(), &ctx, 0, nBlocksHigh, 64, CompressBlockRows );
+	}
+	return true;
+}
+
+} // ImageLoader namespace ends
@@ -17,8 +17,10 @@
 #include "mathlib/mathlib.h"
 #include "mathlib/vector.h"
 #include "tier1/utlmemory.h"
+#include "tier1/utlvector.h"
 #include "tier1/strtools.h"
 #include "mathlib/compressed_vector.h"
+#include "vstdlib/jobthread.h"
 
 // Should be last include
 #include "tier0/memdbgon.h"
@@ -27,6 +29,22 @@
 namespace ImageLoader
 {
 
+//-----------------------------------------------------------------------------
+// Thread pool the resampling and block compression are split across
+//-----------------------------------------------------------------------------
+static IThreadPool *s_pImageThreadPool = NULL;
+
+void SetThreadPool( IThreadPool *pPool )
+{
+	s_pImageThreadPool = pPool;
+}
+
+IThreadPool *GetThreadPool()
+{
+	return s_pImageThreadPool;
+}
+
+
 //-----------------------------------------------------------------------------
 // Gamma correction
 //-----------------------------------------------------------------------------
@@ -228,6 +246,17 @@ enum KernelType_t
 
 typedef void (*ApplyKernelFunc_t)( const KernelInfo_t &kernel, const ResampleInfo_t &info, int wratio, int hratio, int dratio, float* gammaToLinear, float *pAlphaResult );
 
+struct KernelRowContext_t
+{
+	const KernelInfo_t *m_pKernel;
+	const ResampleInfo_t *m_pInfo;
+	int m_nWRatio;
+	int m_nHRatio;
+	int m_nDRatio;
+	float *m_pGammaToLinear;
+	float *m_pAlphaResult;
+};
+
 //-----------------------------------------------------------------------------
 // Apply Kernel to an image
 //-----------------------------------------------------------------------------
@@ -454,8 +483,17 @@ public:
 		}
 	}
 
-	static void ApplyKernel( const KernelInfo_t &kernel, const ResampleInfo_t &info, int wratio, int hratio, int dratio, float* gammaToLinear, float *pAlphaResult )
+	// Rows are numbered through all the slices of the destination
+	static void ApplyKernelToRows( KernelRowContext_t *pContext, int nFirstRow, int nRowCount )
 	{
+		const KernelInfo_t &kernel = *pContext->m_pKernel;
+		const ResampleInfo_t &info = *pContext->m_pInfo;
+		int wratio = pContext->m_nWRatio;
+		int hratio = pContext->m_nHRatio;
+		int dratio = pContext->m_nDRatio;
+		float *gammaToLinear = pContext->m_pGammaToLinear;
+		float *pAlphaResult = pContext->m_pAlphaResult;
+
 		float invDstGamma = 1.0f / info.m_flDestGamma;
 
 		// Apply the kernel to the image
@@ -464,53 +502,79 @@ public:
 		int nInitialX = (wratio >> 1) - ((wratio * kernel.m_nDiameter) >> 1);
 
 		float flAlphaThreshhold = (info.m_flAlphaThreshhold >= 0 ) ? 255.0f * info.m_flAlphaThreshhold : 255.0f * 0.4f;
-		for ( int k = 0; k < info.m_nDestDepth; ++k )
+		for ( int nRow = nFirstRow; nRow < nFirstRow + nRowCount; ++nRow )
 		{
+			int k = nRow / info.m_nDestHeight;
+			int i = nRow - k * info.m_nDestHeight;
 			int startZ = dratio * k + nInitialZ;
+			int startY = hratio * i + nInitialY;
+			int dstPixel = (i * info.m_nDestWidth + k * info.m_nDestWidth * info.m_nDestHeight) << 2;
 
-			for ( int i = 0; i < info.m_nDestHeight; ++i )
+			for ( int j = 0; j < info.m_nDestWidth; ++j, dstPixel += 4 )
 			{
-				int startY = hratio * i + nInitialY;
-				int dstPixel = (i * info.m_nDestWidth + k * info.m_nDestWidth * info.m_nDestHeight) << 2;
-
-				for ( int j = 0; j < info.m_nDestWidth; ++j, dstPixel += 4 )
-				{
-					int startX = wratio * j + nInitialX;
+				int startX = wratio * j + nInitialX;
 
-					float total[4];
-					ComputeAveragedColor( kernel, info, startX, startY, startZ, gammaToLinear, total );
+				float total[4];
+				ComputeAveragedColor( kernel, info, startX, startY, startZ, gammaToLinear, total );
 
-					// NOTE: Can't use a table here, we lose too many bits
-					if( type == KERNEL_NORMALMAP )
-					{
-						for ( int ch = 0; ch < 4; ++ ch )
-							info.m_pDest[ dstPixel + ch ] = Clamp( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( total[ch] - info.m_flColorGoal[ch] ) ) );
-					}
-					else if ( type == KERNEL_ALPHATEST )
-					{
-						// If there's more than 40% coverage, then keep the pixel (renormalize the color based on coverage)
-						float flAlpha = ( total[3] >= flAlphaThreshhold ) ? 255 : 0; 
+				// NOTE: Can't use a table here, we lose too many bits
+				if( type == KERNEL_NORMALMAP )
+				{
+					for ( int ch = 0; ch < 4; ++ ch )
+						info.m_pDest[ dstPixel + ch ] = Clamp( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( total[ch] - info.m_flColorGoal[ch] ) ) );
+				}
+				else if ( type == KERNEL_ALPHATEST )
+				{
+					// If there's more than 40% coverage, then keep the pixel (renormalize the color based on coverage)
+					float flAlpha = ( total[3] >= flAlphaThreshhold ) ? 255 : 0; 
 
-						for ( int ch = 0; ch < 3; ++ ch )
-							info.m_pDest[ dstPixel + ch ] = Clamp( 255.0f * pow( ( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( ( total[ch] > 0 ? total[ch] : 0 ) - info.m_flColorGoal[ch] ) ) ) / 255.0f, invDstGamma ) );
-						info.m_pDest[ dstPixel + 3 ] = Clamp( flAlpha );
+					for ( int ch = 0; ch < 3; ++ ch )
+						info.m_pDest[ dstPixel + ch ] = Clamp( 255.0f * pow( ( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( ( total[ch] > 0 ? total[ch] : 0 ) - info.m_flColorGoal[ch] ) ) ) / 255.0f, invDstGamma ) );
+					info.m_pDest[ dstPixel + 3 ] = Clamp( flAlpha );
 
-						AddAlphaToAlphaResult( kernel, info, startX, startY, startZ, flAlpha, pAlphaResult );
-					}
-					else
-					{
-						for ( int ch = 0; ch < 3; ++ ch )
-							info.m_pDest[ dstPixel + ch ] = Clamp( 255.0f * pow( ( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( ( total[ch] > 0 ? total[ch] : 0 ) - info.m_flColorGoal[ch] ) ) ) / 255.0f, invDstGamma ) );
-						info.m_pDest[ dstPixel + 3 ] = Clamp( info.m_flColorGoal[3] + ( info.m_flColorScale[3] * ( total[3] - info.m_flColorGoal[3] ) ) );
-					}
+					AddAlphaToAlphaResult( kernel, info, startX, startY, startZ, flAlpha, pAlphaResult );
+				}
+				else
+				{
+					for ( int ch = 0; ch < 3; ++ ch )
+						info.m_pDest[ dstPixel + ch ] = Clamp( 255.0f * pow( ( info.m_flColorGoal[ch] + ( info.m_flColorScale[ch] * ( ( total[ch] > 0 ? total[ch] : 0 ) - info.m_flColorGoal[ch] ) ) ) / 255.0f, invDstGamma ) );
+					info.m_pDest[ dstPixel + 3 ] = Clamp( info.m_flColorGoal[3] + ( info.m_flColorScale[3] * ( total[3] - info.m_flColorGoal[3] ) ) );
 				}
 			}
+		}
+	}
 
-			if ( type == KERNEL_ALPHATEST )
+	static void ApplyKernel( const KernelInfo_t &kernel, const ResampleInfo_t &info, int wratio, int hratio, int dratio, float* gammaToLinear, float *pAlphaResult )
+	{
+		KernelRowContext_t ctx;
+		ctx.m_pKernel = &kernel;
+		ctx.m_pInfo = &info;
+		ctx.m_nWRatio = wratio;
+		ctx.m_nHRatio = hratio;
+		ctx.m_nDRatio = dratio;
+		ctx.m_pGammaToLinear = gammaToLinear;
+		ctx.m_pAlphaResult = pAlphaResult;
+
+		if ( type == KERNEL_ALPHATEST )
+		{
+			// Every pixel scatters into the alpha result, so this one stays serial
+			for ( int k = 0; k < info.m_nDestDepth; ++k )
 			{
+				ApplyKernelToRows( &ctx, k * info.m_nDestHeight, info.m_nDestHeight );
 				AdjustAlphaChannel( kernel, info, wratio, hratio, dratio, pAlphaResult );
 			}
+			return;
 		}
+
+		// Only tools that set a pool get the rows split, runtime callers stay on their own thread
+		int nRows = info.m_nDestDepth * info.m_nDestHeight;
+		if ( !GetThreadPool() || nRows * info.m_nDestWidth < 64 * 64 )
+		{
+			ApplyKernelToRows( &ctx, 0, nRows );
+			return;
+		}
+
+		ParallelLoopProcessChunks( GetThreadPool(), &ctx, 0, nRows, 64, ApplyKernelToRows );
 	}
 };
 
@@ -624,15 +688,9 @@ bool ResampleRGBA8888( const ResampleInfo_t& info )
 		return false;
 	}
 
-	// Compute gamma tables...
-	static float gammaToLinear[256];
-	static float lastSrcGamma = -1;
-
-	if (lastSrcGamma != info.m_flSrcGamma)
-	{
-		ConstructFloatGammaTable( gammaToLinear, info.m_flSrcGamma, 1.0f );
-		lastSrcGamma =  info.m_flSrcGamma;
-	}
+	// Compute gamma tables... (not cached, several resamples can run at once)
+	float gammaToLinear[256];
+	ConstructFloatGammaTable( gammaToLinear, info.m_flSrcGamma, 1.0f );
 
 	int wratio = info.m_nSrcWidth / info.m_nDestWidth;
 	int hratio = info.m_nSrcHeight / info.m_nDestHeight;
@@ -842,49 +900,86 @@ bool ResampleRGBA32323232F( const ResampleInfo_t& info )
 //-----------------------------------------------------------------------------
 // Generates mipmap levels
 //-----------------------------------------------------------------------------
-void GenerateMipmapLevels( unsigned char* pSrc, unsigned char* pDst, int width,
-	int height,	int depth, ImageFormat imageFormat, float srcGamma, float dstGamma, int numLevels )
+struct MipmapLevelJob_t
 {
-	int dstWidth = width;
-	int dstHeight = height;
-	int dstDepth = depth;
-
-	// temporary storage for the mipmaps
-	int tempMem = GetMemRequired( dstWidth, dstHeight, dstDepth, IMAGE_FORMAT_RGBA8888, false );
-	CUtlMemory<unsigned char> tmpImage;
-	tmpImage.EnsureCapacity( tempMem );
+	unsigned char *m_pSrc;
+	unsigned char *m_pDst;
+	int m_nSrcWidth;
+	int m_nSrcHeight;
+	int m_nSrcDepth;
+	int m_nWidth;
+	int m_nHeight;
+	int m_nDepth;
+	ImageFormat m_Format;
+	float m_flSrcGamma;
+	float m_flDstGamma;
+};
 
-	while( true )
+static void GenerateMipmapLevelJobs( MipmapLevelJob_t *pJobs, int nFirst, int nCount )
+{
+	for ( int i = nFirst; i < nFirst + nCount; ++i )
 	{
+		const MipmapLevelJob_t &job = pJobs[i];
+
+		// temporary storage for the mipmap
+		CUtlMemory<unsigned char> tmpImage;
+		tmpImage.EnsureCapacity( GetMemRequired( job.m_nWidth, job.m_nHeight, job.m_nDepth, IMAGE_FORMAT_RGBA8888, false ) );
+
 		// This generates a mipmap in RGBA8888, linear space
 		ResampleInfo_t info;
-		info.m_pSrc = pSrc;
+		info.m_pSrc = job.m_pSrc;
 		info.m_pDest = tmpImage.Base();
-		info.m_nSrcWidth = width;
-		info.m_nSrcHeight = height;
-		info.m_nSrcDepth = depth;
-		info.m_nDestWidth = dstWidth;
-		info.m_nDestHeight = dstHeight;
-		info.m_nDestDepth = dstDepth;
-		info.m_flSrcGamma = srcGamma;
-		info.m_flDestGamma = dstGamma;
+		info.m_nSrcWidth = job.m_nSrcWidth;
+		info.m_nSrcHeight = job.m_nSrcHeight;
+		info.m_nSrcDepth = job.m_nSrcDepth;
+		info.m_nDestWidth = job.m_nWidth;
+		info.m_nDestHeight = job.m_nHeight;
+		info.m_nDestDepth = job.m_nDepth;
+		info.m_flSrcGamma = job.m_flSrcGamma;
+		info.m_flDestGamma = job.m_flDstGamma;
 
 		ResampleRGBA8888( info );
 
 		// each mipmap level needs to be color converted separately
 		ConvertImageFormat( tmpImage.Base(), IMAGE_FORMAT_RGBA8888,
-			pDst, imageFormat, dstWidth, dstHeight, 0, 0 );
+			job.m_pDst, job.m_Format, job.m_nWidth, job.m_nHeight, 0, 0 );
+	}
+}
+
+void GenerateMipmapLevels( unsigned char* pSrc, unsigned char* pDst, int width,
+	int height,	int depth, ImageFormat imageFormat, float srcGamma, float dstGamma, int numLevels )
+{
+	// Every level is resampled from the source, so they don't depend on each other
+	CUtlVector<MipmapLevelJob_t> jobs;
+
+	int dstWidth = width;
+	int dstHeight = height;
+	int dstDepth = depth;
+	while( true )
+	{
+		MipmapLevelJob_t &job = jobs[ jobs.AddToTail() ];
+		job.m_pSrc = pSrc;
+		job.m_pDst = pDst;
+		job.m_nSrcWidth = width;
+		job.m_nSrcHeight = height;
+		job.m_nSrcDepth = depth;
+		job.m_nWidth = dstWidth;
+		job.m_nHeight = dstHeight;
+		job.m_nDepth = dstDepth;
+		job.m_Format = imageFormat;
+		job.m_flSrcGamma = srcGamma;
+		job.m_flDstGamma = dstGamma;
 
 		if (numLevels == 0)
 		{
 			// We're done after we've made the 1x1 mip level
 			if (dstWidth == 1 && dstHeight == 1 && dstDepth == 1)
-				return;
+				break;
 		}
 		else
 		{
 			if (--numLevels <= 0)
-				return;
+				break;
 		}
 
 		// Figure out where the next level goes
@@ -896,6 +991,10 @@ void GenerateMipmapLevels( unsigned char* pSrc, unsigned char* pDst, int width,
 		dstHeight = dstHeight > 1 ? dstHeight >> 1 : 1;
 		dstDepth = dstDepth > 1 ? dstDepth >> 1 : 1;
 	}
+
+	// One level at a time; each one splits its own rows across the pool, and a
+	// parallel loop inside another one would tie up the pool's threads waiting
+	GenerateMipmapLevelJobs( jobs.Base(), 0, jobs.Count() );
 }
 
 } // ImageLoader namespace ends
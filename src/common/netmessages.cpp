@@ -292,7 +292,7 @@ bool CmdEncryptedDataMessageCodec::SVCMsg_EncryptedData_Process( CSVCMsg_Encrypt
 					{
 						ConDMsg( "CmdEncryptedDataMessageCodec: netchannel failed processing embedded message %s.\n", pEmbeddedMessage->GetName() );
 						Assert ( 0 );
-						delete pEmbeddedMessage;
+						pEmbeddedMessage->Release();
 						return false;
 					}
 
@@ -300,7 +300,7 @@ bool CmdEncryptedDataMessageCodec::SVCMsg_EncryptedData_Process( CSVCMsg_Encrypt
 					pMsgBind = pProcessingChannel->FindMessageBinder( cmd, iMsgHandler++ );
 				} while ( pMsgBind );
 
-				delete pEmbeddedMessage;
+				pEmbeddedMessage->Release();
 			}
 		}
 	}
@@ -46,6 +46,9 @@
 #include "xbox/xboxstubs.h"
 #endif
 
+// Number of parsed messages of each type kept around for reuse
+#define NET_MESSAGE_POOL_SIZE	4
+
 template< int msgType, typename PB_OBJECT_TYPE, int groupType = INetChannelInfo::GENERIC, bool bReliable = true > 
 class CNetMessagePB : public INetMessage, public PB_OBJECT_TYPE
 {
@@ -194,6 +197,29 @@ public:
 		return m_bReliable; 
 	}
 
+	// Messages parsed off the wire come from a small per-type pool and go back
+	// to it on Release(). ParseFromArray() starts with Clear(), which keeps the
+	// storage of strings, bytes, repeated fields and sub-messages, so parsing
+	// into a message that has been used before doesn't allocate them again.
+	static MyType_t *CreateParsed()
+	{
+		MyType_t *pMsg = s_ParsedPool.Pop();
+		if ( pMsg )
+		{
+			pMsg->m_bReliable = bReliable;
+			return pMsg;
+		}
+		return new MyType_t;
+	}
+
+	virtual void Release()
+	{
+		if ( !s_ParsedPool.Push( this ) )
+		{
+			delete this;
+		}
+	}
+
 	virtual INetMessage *Clone() const
 	{
 		MyType_t *pClone = new MyType_t;
@@ -204,14 +230,62 @@ public:
 	}
 
 protected:
+	// At most NET_MESSAGE_POOL_SIZE messages. The count is taken before a push
+	// and given back after a pop, so it never falls below the list's length.
+	class CParsedPool
+	{
+	public:
+		~CParsedPool()
+		{
+			Purge();
+		}
+
+		MyType_t *Pop()
+		{
+			MyType_t *pMsg;
+			if ( !m_List.PopItem( &pMsg ) )
+				return NULL;
+			--m_nCount;
+			return pMsg;
+		}
+
+		bool Push( MyType_t *pMsg )
+		{
+			if ( ++m_nCount > NET_MESSAGE_POOL_SIZE )
+			{
+				--m_nCount;
+				return false;
+			}
+			m_List.PushItem( pMsg );
+			return true;
+		}
+
+		void Purge()
+		{
+			MyType_t *pMsg;
+			while ( ( pMsg = Pop() ) != NULL )
+			{
+				delete pMsg;
+			}
+		}
+
+	private:
+		CTSListWithFreeList< MyType_t * > m_List;
+		CInterlockedInt m_nCount;
+	};
+
 	bool m_bReliable; // true if message should be sent reliable
 	mutable std::string	m_toString; // cached copy of ToString()
 	static std::string s_typeName;
+	static CParsedPool s_ParsedPool;
 };
 
 template< int msgType, typename PB_OBJECT_TYPE, int groupType , bool bReliable > 
 std::string CNetMessagePB< msgType, PB_OBJECT_TYPE, groupType , bReliable >::s_typeName;
 
+template< int msgType, typename PB_OBJECT_TYPE, int groupType , bool bReliable > 
+typename CNetMessagePB< msgType, PB_OBJECT_TYPE, groupType , bReliable >::CParsedPool CNetMessagePB< msgType, PB_OBJECT_TYPE, groupType , bReliable >::s_ParsedPool;
+
 class CNetMessageBinder
 {
 public:
@@ -286,10 +360,10 @@ private:
 
 		virtual INetMessage *CreateFromBuffer( bf_read &buffer )
 		{
-			INetMessage *pMsg = new typename _N::MyType_t;
+			INetMessage *pMsg = _N::MyType_t::CreateParsed();
 			if ( !pMsg->ReadFromBuffer( buffer ) )
 			{
-				delete pMsg;
+				pMsg->Release();
 				return NULL;
 			}
 			return pMsg;
@@ -55,6 +55,7 @@ EXPOSE_SINGLE_INTERFACE_GLOBALVAR( CDataCache, IDataCache, DATACACHE_INTERFACE_V
 static ConVar mem_force_flush( "mem_force_flush", "0", 0, "Force cache flush of unlocked resources on every alloc" );
 static ConVar mem_force_flush_section( "mem_force_flush_section", "", 0, "Cache section to restrict mem_force_flush" );
 static int g_iDontForceFlush;
+static ConVar datacache_lockfree_get( "datacache_lockfree_get", "1", 0, "Resolve Get/GetNoTouch/IsPresent without the cache mutex, deferring LRU touches to eviction time" );
 
 //-----------------------------------------------------------------------------
 // DataCacheItem_t
@@ -351,6 +352,10 @@ DataCacheRemoveResult_t CDataCacheSection::Remove( DataCacheHandle_t handle, con
 //-----------------------------------------------------------------------------
 bool CDataCacheSection::IsPresent( DataCacheHandle_t handle )
 {
+	if ( datacache_lockfree_get.GetBool() )
+	{
+		return ( m_LRU.GetResource_LockFree( (memhandle_t)handle, false ) != NULL );
+	}
 	return ( m_LRU.GetResource_NoLockNoLRUTouch( (memhandle_t)handle ) != NULL );
 }
 
@@ -469,6 +474,21 @@ void CDataCacheSection::UnlockMutex()
 	m_mutex.Unlock();
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Item data without the mutex. The item may be freed while its data
+//			pointer is read, so the handle is checked again once it has been.
+//-----------------------------------------------------------------------------
+void *CDataCacheSection::GetItemData_LockFree( DataCacheHandle_t handle, bool bTouch )
+{
+	DataCacheItem_t *pItem = m_LRU.GetResource_LockFree( (memhandle_t)handle, bTouch );
+	if ( !pItem )
+		return NULL;
+
+	void *pData = const_cast<void *>( pItem->pItemData );
+	return ( m_LRU.IsHandleValid_LockFree( (memhandle_t)handle ) ) ? pData : NULL;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: Get without locking
 //-----------------------------------------------------------------------------
@@ -485,6 +505,11 @@ void *CDataCacheSection::Get( DataCacheHandle_t handle, bool bFrameLock )
 		if ( bFrameLock && IsFrameLocking() )
 			return FrameLock( handle );
 
+		if ( datacache_lockfree_get.GetBool() )
+		{
+			return GetItemData_LockFree( handle, true );
+		}
+
 		AUTO_LOCK( m_mutex );
 		DataCacheItem_t *pItem = m_LRU.GetResource_NoLock( (memhandle_t)handle );
 		if ( pItem )
@@ -509,6 +534,11 @@ void *CDataCacheSection::GetNoTouch( DataCacheHandle_t handle, bool bFrameLock )
 		if ( bFrameLock && IsFrameLocking() )
 			return FrameLock( handle );
 
+		if ( datacache_lockfree_get.GetBool() )
+		{
+			return GetItemData_LockFree( handle, false );
+		}
+
 		AUTO_LOCK( m_mutex );
 		DataCacheItem_t *pItem = m_LRU.GetResource_NoLockNoLRUTouch( (memhandle_t)handle );
 		if ( pItem )
@@ -574,6 +604,21 @@ void *CDataCacheSection::FrameLock( DataCacheHandle_t handle )
 	FrameLock_t *pFrameLock = m_FrameLocks[g_nThreadID];
 	if ( pFrameLock )
 	{
+		if ( datacache_lockfree_get.GetBool() )
+		{
+			// Already frame locked by this thread, so it holds a lock and can't be aged out.
+			// The second lookup catches the item being freed while we were reading it.
+			DataCacheItem_t *pItem = m_LRU.GetResource_LockFree( (memhandle_t)handle, false );
+			if ( pItem )
+			{
+				bool bFrameLocked = ( pItem->pNextFrameLocked[pFrameLock->m_iThread] != DC_NO_NEXT_LOCKED );
+				pResult = const_cast<void *>( pItem->pItemData );
+				if ( bFrameLocked && m_LRU.IsHandleValid_LockFree( (memhandle_t)handle ) )
+					return pResult;
+				pResult = NULL;
+			}
+		}
+
 		DataCacheItem_t *pItem = m_LRU.LockResource( (memhandle_t)handle );
 
 		if ( pItem )
@@ -667,6 +712,11 @@ int CDataCacheSection::BreakLock( DataCacheHandle_t handle )
 //-----------------------------------------------------------------------------
 bool CDataCacheSection::Touch( DataCacheHandle_t handle )
 {
+	if ( datacache_lockfree_get.GetBool() )
+	{
+		m_LRU.TouchResourceDeferred( (memhandle_t)handle );
+		return true;
+	}
 	m_LRU.TouchResource( (memhandle_t)handle );
 	return true;
 }
@@ -742,6 +792,7 @@ unsigned CDataCacheSection::Purge( unsigned nBytes )
 	VPROF( "CDataCacheSection::Purge" );
 
 	AUTO_LOCK( m_mutex );
+	m_LRU.CommitDeferredTouches();
 
 	unsigned nBytesPurged = 0;
 	unsigned nBytesCurrent = 0;
@@ -775,6 +826,7 @@ unsigned CDataCacheSection::Purge( unsigned nBytes )
 unsigned CDataCacheSection::PurgeItems( unsigned nItems )
 {
 	AUTO_LOCK( m_mutex );
+	m_LRU.CommitDeferredTouches();
 
 	unsigned nPurged = 0;
 
@@ -1533,3 +1585,116 @@ const char *CDataCache::GetSectionName( int iIndex )
 
 	return "";
 }
+
+
+//-----------------------------------------------------------------------------
+// Contention benchmark: threads hammering Get/GetNoTouch/IsPresent on a scratch
+// section, with and without the lock free lookups
+//-----------------------------------------------------------------------------
+class CDataCacheBenchClient : public IDataCacheClient
+{
+public:
+	virtual bool HandleCacheNotification( const DataCacheNotification_t &notification )
+	{
+		// items point into a static buffer, nothing to free
+		return ( notification.type != DC_NONE );
+	}
+
+	virtual bool GetItemName( DataCacheClientID_t clientId, const void *pItem, char *pDest, unsigned nMaxLen )
+	{
+		Q_snprintf( pDest, nMaxLen, "bench item %u", (unsigned)clientId );
+		return true;
+	}
+};
+
+struct DataCacheBenchThread_t
+{
+	IDataCacheSection				*m_pSection;
+	const CUtlVector< DataCacheHandle_t > *m_pHandles;
+	int								m_nIterations;
+	int								m_nSeed;
+	int64							m_nLookups;
+};
+
+static uintp DataCacheBenchThread( void *pParam )
+{
+	DataCacheBenchThread_t *pInfo = (DataCacheBenchThread_t *)pParam;
+	const CUtlVector< DataCacheHandle_t > &handles = *pInfo->m_pHandles;
+	unsigned nRand = pInfo->m_nSeed;
+
+	for ( int nIter = 0; nIter < pInfo->m_nIterations; ++nIter )
+	{
+		for ( int i = 0; i < handles.Count(); ++i )
+		{
+			nRand = nRand * 1103515245 + 12345;
+			DataCacheHandle_t hItem = handles[ ( nRand >> 8 ) % handles.Count() ];
+			pInfo->m_pSection->Get( hItem );
+			pInfo->m_pSection->GetNoTouch( hItem );
+			pInfo->m_pSection->IsPresent( hItem );
+		}
+		pInfo->m_nLookups += 3 * handles.Count();
+	}
+	return 0;
+}
+
+CON_COMMAND( datacache_contention_bench, "Times threads doing lookups in a scratch cache section, with and without lock free gets. Arguments: [threads] [iterations] [items]" )
+{
+	int nThreads = clamp( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 4, 1, MAX_THREADS_SUPPORTED - 2 );
+	int nIterations = ( args.ArgC() > 2 ) ? atoi( args[2] ) : 1000;
+	int nItems = clamp( ( args.ArgC() > 3 ) ? atoi( args[3] ) : 1024, 1, 16384 );
+
+	static char s_BenchData[64];
+	CDataCacheBenchClient client;
+	IDataCacheSection *pSection = g_DataCache.AddSection( &client, "datacache_bench" );
+
+	CUtlVector< DataCacheHandle_t > handles;
+	for ( int i = 0; i < nItems; ++i )
+	{
+		DataCacheHandle_t hItem;
+		if ( pSection->Add( i + 1, s_BenchData, sizeof( s_BenchData ), &hItem ) )
+		{
+			// locked so the shared budget can't age them out mid-run
+			pSection->Lock( hItem );
+			handles.AddToTail( hItem );
+		}
+	}
+
+	bool bSavedLockFree = datacache_lockfree_get.GetBool();
+	for ( int nLockFree = 0; nLockFree < 2; ++nLockFree )
+	{
+		datacache_lockfree_get.SetValue( nLockFree );
+
+		DataCacheBenchThread_t info[MAX_THREADS_SUPPORTED];
+		ThreadHandle_t hThreads[MAX_THREADS_SUPPORTED];
+
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			info[i].m_pSection = pSection;
+			info[i].m_pHandles = &handles;
+			info[i].m_nIterations = nIterations;
+			info[i].m_nSeed = i + 1;
+			info[i].m_nLookups = 0;
+			hThreads[i] = CreateSimpleThread( DataCacheBenchThread, &info[i] );
+		}
+
+		int64 nLookups = 0;
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			ThreadJoin( hThreads[i] );
+			ReleaseThreadHandle( hThreads[i] );
+			nLookups += info[i].m_nLookups;
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		Msg( "datacache_contention_bench: lock free %s, %d threads x %d iterations over %d items: %.1f ms, %.2f M lookups/sec\n",
+			nLockFree ? "on " : "off", nThreads, nIterations, handles.Count(), flElapsed * 1000.0, flElapsed > 0.0 ? ( nLookups / flElapsed ) * 1e-6 : 0.0 );
+	}
+	datacache_lockfree_get.SetValue( bSavedLockFree );
+
+	for ( int i = 0; i < handles.Count(); ++i )
+	{
+		pSection->Unlock( handles[i] );
+	}
+	g_DataCache.RemoveSection( "datacache_bench" );
+}
@@ -168,6 +168,7 @@ private:
 	memhandle_t GetFirstLockedItem();
 	memhandle_t GetNextItem( memhandle_t );
 	DataCacheItem_t *AccessItem( memhandle_t hCurrent );
+	void *GetItemData_LockFree( DataCacheHandle_t handle, bool bTouch );
 	bool DiscardItem( memhandle_t hItem, DataCacheNotificationType_t type );
 	bool DiscardItemData( DataCacheItem_t *pItem, DataCacheNotificationType_t type );
 	void NoteAdd( int size );
@@ -78,7 +78,7 @@ enum
 	STUDIODATA_ERROR_MODEL				= 0x0004,
 	STUDIODATA_FLAGS_NO_STUDIOMESH		= 0x0008,
 	STUDIODATA_FLAGS_NO_VERTEX_DATA		= 0x0010,
-//										= 0x0020,	// unused
+	STUDIODATA_FLAGS_RESIDENT			= 0x0020,	// unreferenced, kept alive across level transitions
 	STUDIODATA_FLAGS_PHYSICS2COLLISION_LOADED = 0x0040,
 	STUDIODATA_FLAGS_VCOLLISION_SCANNED	= 0x0080,
 
@@ -150,11 +150,15 @@ struct studiodata_t
 	vertexFileHeader_t	*m_pForceLockedVertexFileHeader;	// only non-null if mod_lock_meshs_on_load is set and not async loading
 	CInterlockedInt		m_iStudioHdrVirtualLock;			// keeps count while mdlcache lock is held, lock counts fixed up for transition
 	CThreadFastMutex	m_ForceLockMutex;
+	CThreadFastMutex	m_LoadMutex;						// one-time construction of the anim block table
 
 	MDLHandle_t			m_Handle;
 
 	TCombinedStudioData	*m_pCombinedStudioData;
 
+	// Serial of the last map load that referenced this model, used to age resident models
+	int					m_nLastMapSerial;
+
 	DECLARE_FIXEDSIZE_ALLOCATOR_MT( studiodata_t );
 };
 
@@ -394,6 +398,91 @@ static ConVar mod_dont_load_vertices("mod_dont_load_vertices", "1", 0, "For the
 static ConVar mod_dont_load_vertices("mod_dont_load_vertices", "0", 0, "For the dedicated server, supress loading model vertex data" );
 #endif
 
+#ifdef DEDICATED
+static ConVar mod_resident_budget( "mod_resident_budget", "256", 0, "Megabytes of unreferenced studio data, vcollides and animblocks kept resident across level transitions (0 disables)" );
+#else
+static ConVar mod_resident_budget( "mod_resident_budget", "0", 0, "Megabytes of unreferenced studio data, vcollides and animblocks kept resident across level transitions (0 disables)" );
+#endif
+static ConVar mod_framelock_memo( "mod_framelock_memo", "1", 0, "Remember data frame locked inside an MDLCACHE critical section so repeat lookups skip the datacache mutex" );
+static ConVar mod_resident_manifest( "mod_resident_manifest", "1", 0, "Record the models used by each map and prewarm them the next time that map loads" );
+
+//-----------------------------------------------------------------------------
+// Per-thread memo of data frame locked inside the current MDLCACHE_CRITICAL_SECTION.
+// Frame locked items stay locked until the outermost EndLock(), so once a thread
+// has looked a handle up inside a critical section it can hand the same pointer
+// back without going through the shared datacache mutex again.
+//-----------------------------------------------------------------------------
+#define MDLCACHE_FRAMELOCK_MEMO_SIZE	64		// must be a power of two
+
+struct MDLFrameLockMemo_t
+{
+	struct Entry_t
+	{
+		DataCacheHandle_t	m_hData;
+		void				*m_pData;
+		int					m_nGeneration;
+		int					m_nDiscardSerial;
+	};
+
+	MDLFrameLockMemo_t	*m_pNext;		// every memo ever made, so they can be freed at unload
+	int		m_nDepth;
+	int		m_nGeneration;			// bumped whenever this thread's frame locks are released
+	Entry_t	m_Entries[MDLCACHE_FRAMELOCK_MEMO_SIZE];
+};
+
+// Kept in real thread local storage: g_nThreadID is 0 for the main thread and
+// for every other thread tier0 didn't create, so it can't tell them apart
+static CTHREADLOCALPTR( MDLFrameLockMemo_t ) s_pFrameLockMemo;
+
+static class CMDLFrameLockMemoList
+{
+public:
+	~CMDLFrameLockMemoList()
+	{
+		while ( m_pHead )
+		{
+			MDLFrameLockMemo_t *pNext = m_pHead->m_pNext;
+			delete m_pHead;
+			m_pHead = pNext;
+		}
+	}
+
+	MDLFrameLockMemo_t * volatile m_pHead;
+} g_FrameLockMemoList;
+
+// bumped whenever locked data leaves the cache behind a frame lock's back
+static CInterlockedInt g_nFrameLockDiscardSerial;
+
+static MDLFrameLockMemo_t *AllocFrameLockMemo()
+{
+	MDLFrameLockMemo_t *pMemo = new MDLFrameLockMemo_t;
+	memset( pMemo, 0, sizeof( *pMemo ) );
+	s_pFrameLockMemo = pMemo;
+
+	MDLFrameLockMemo_t *pHead;
+	do
+	{
+		pHead = g_FrameLockMemoList.m_pHead;
+		pMemo->m_pNext = pHead;
+	}
+	while ( ThreadInterlockedCompareExchangePointer( (void * volatile *)&g_FrameLockMemoList.m_pHead, pMemo, pHead ) != pHead );
+
+	return pMemo;
+}
+
+static inline MDLFrameLockMemo_t *GetFrameLockMemo()
+{
+	MDLFrameLockMemo_t *pMemo = s_pFrameLockMemo;
+	return pMemo ? pMemo : AllocFrameLockMemo();
+}
+
+static inline MDLFrameLockMemo_t::Entry_t *GetFrameLockMemoEntry( MDLFrameLockMemo_t *pMemo, DataCacheHandle_t hData )
+{
+	uintp nHash = ( (uintp)hData ) ^ ( (uintp)hData >> 16 );
+	return &pMemo->m_Entries[ nHash & ( MDLCACHE_FRAMELOCK_MEMO_SIZE - 1 ) ];
+}
+
+
 //-----------------------------------------------------------------------------
 // Utility functions
 //-----------------------------------------------------------------------------
@@ -674,6 +763,13 @@ public:
 
 	virtual bool ReleaseAnimBlockAllocator();
 
+	// cross-map residency
+	virtual void BeginMapResidency( const char *pszMapName );
+	virtual void EndMapResidency();
+	void ResidentReport();
+
+	void ContentionBench( int nThreads, int nIterations );
+
 	virtual bool RestoreHardwareData( MDLHandle_t handle, FSAsyncControl_t *pAsyncVTXControl, FSAsyncControl_t *pAsyncVVDControl );
 	virtual bool ProcessPendingHardwareRestore();
 
@@ -714,7 +810,7 @@ private:
 	void FreeAnimBlocks( studiodata_t *pStudioData );
 
 	// Allocates/frees the virtual model
-	void AllocateVirtualModel( MDLHandle_t handle );
+	virtualmodel_t *AllocateVirtualModel( MDLHandle_t handle );
 	void FreeVirtualModel( studiodata_t *pStudioData );
 
 	// Purpose: Pulls all submodels/.ani file models into the cache
@@ -783,6 +879,12 @@ private:
 	bool				UnserializeCombinedHardwareData( MDLHandle_t handle );
 	void				FreeCombinedGeneratedData( studiodata_t *pStudioData );
 
+	// cross-map residency
+	bool				ShouldRetainResident( studiodata_t *pStudioData );
+	unsigned int		ComputeResidentSize( studiodata_t *pStudioData );
+	void				EvictResident( unsigned int nBudgetBytes );
+	void				ReleaseManifestModels();
+
 private:
 	IDataCacheSection *m_pModelCacheSection;
 	IDataCacheSection *m_pMeshCacheSection;
@@ -800,6 +902,7 @@ private:
 
 	CThreadFastMutex m_QueuedLoadingMutex;
 	CThreadFastMutex m_AsyncMutex;
+	CThreadFastMutex m_VirtualModelMutex;
 
 	CTSQueue< studiodata_t * > m_UnloadHandles;
 
@@ -824,6 +927,12 @@ private:
 
 	CTSQueue< AsyncHardwareLoad_t >	m_QueuedAsyncHardwareLoads;
 
+	// cross-map residency
+	CUtlVector< MDLHandle_t >	m_ResidentHandles;		// unreferenced models kept alive, LRU by m_nLastMapSerial
+	CUtlVector< MDLHandle_t >	m_ManifestHandles;		// references held on the current map's manifest during load
+	int							m_nMapSerial;
+	char						m_szResidentMapName[MAX_PATH];
+
 	friend class CMDLCacheData; // Needs to access ReadFileNative
 };
 
@@ -1100,6 +1209,8 @@ CMDLCache::CMDLCache()
 	m_pCombinedCompleted = NULL;
 	m_CombinerEvent.Reset();
 	m_CombinerShutdownEvent.Reset();
+	m_nMapSerial = 1;
+	m_szResidentMapName[0] = '\0';
 }
 
 
@@ -1272,6 +1383,8 @@ void CMDLCache::Shutdown()
 		}
 
 		m_MDLDict.Purge();
+		m_ResidentHandles.Purge();
+		m_ManifestHandles.Purge();
 
 		if ( m_pModelCacheSection )
 		{
@@ -1576,7 +1689,16 @@ MDLHandle_t CMDLCache::FindMDL( const char *pMDLRelativePath )
 //-----------------------------------------------------------------------------
 int CMDLCache::AddRef( MDLHandle_t handle )
 {
-	return ++m_MDLDict[handle]->m_nRefCount;
+	studiodata_t *pStudioData = m_MDLDict[handle];
+	if ( pStudioData->m_nFlags & STUDIODATA_FLAGS_RESIDENT )
+	{
+		// Picked up a model kept from a previous map, it's live again
+		Assert( pStudioData->m_nRefCount == 0 );
+		pStudioData->m_nFlags &= ~STUDIODATA_FLAGS_RESIDENT;
+		m_ResidentHandles.FindAndFastRemove( handle );
+	}
+	pStudioData->m_nLastMapSerial = m_nMapSerial;
+	return ++pStudioData->m_nRefCount;
 }
 
 int CMDLCache::Release( MDLHandle_t handle )
@@ -1595,6 +1717,17 @@ int CMDLCache::Release( MDLHandle_t handle )
 	int nRefCount = --m_MDLDict[handle]->m_nRefCount;
 	if ( nRefCount <= 0 )
 	{
+		if ( ShouldRetainResident( m_MDLDict[handle] ) )
+		{
+			// Keep the studio data around, the budget is enforced at the end of the next map load.
+			// The hardware and vertex data are rebuilt on demand and aren't counted against
+			// the budget, so they go now.
+			Flush( m_MDLDict[handle], (MDLCacheFlush_t)( MDLCACHE_FLUSH_STUDIOHWDATA | MDLCACHE_FLUSH_VERTEXES ) );
+			m_MDLDict[handle]->m_nFlags |= STUDIODATA_FLAGS_RESIDENT;
+			m_ResidentHandles.AddToTail( handle );
+			return 0;
+		}
+
 		ShutdownStudioData( handle, false );
 		m_MDLDict.RemoveAt( handle );
 	}
@@ -1981,7 +2114,7 @@ unsigned char *CMDLCache::GetAnimBlock( MDLHandle_t handle, int nBlock, bool pre
 	studiodata_t *pStudioData = m_MDLDict[handle];
 	if ( pStudioData->m_vecAnimBlocks.Count() == 0 )
 	{
-		AUTO_LOCK_FM( m_AsyncMutex );
+		AUTO_LOCK_FM( pStudioData->m_LoadMutex );
 		if ( pStudioData->m_vecAnimBlocks.Count() == 0 )
 		{
 			studiohdr_t *pStudioHdr = GetStudioHdr( handle );
@@ -2125,15 +2258,16 @@ int CMDLCache::GetAutoplayList( MDLHandle_t handle, unsigned short **pAutoplayLi
 //-----------------------------------------------------------------------------
 // Allocates/frees the virtual model
 //-----------------------------------------------------------------------------
-void CMDLCache::AllocateVirtualModel( MDLHandle_t handle )
+virtualmodel_t *CMDLCache::AllocateVirtualModel( MDLHandle_t handle )
 {
 	studiodata_t *pStudioData = m_MDLDict[handle];
 	Assert( pStudioData->m_pVirtualModel == NULL );
-	pStudioData->m_pVirtualModel = new virtualmodel_t;
 
 	// FIXME: The old code slammed these; could have leaked memory?
 	Assert( pStudioData->m_vecAnimBlocks.Count() == 0 );
-	Assert( pStudioData->m_vecAnimBlocks.Count() == 0 );
+
+	// NOTE: the caller publishes this into the studiodata once it's fully built
+	return new virtualmodel_t;
 }
 
 void CMDLCache::FreeVirtualModel( studiodata_t *pStudioData )
@@ -2190,21 +2324,31 @@ virtualmodel_t *CMDLCache::GetVirtualModelFast( const studiohdr_t *pStudioHdr, M
 	static const MDLHandle_t pDebugHandle = handle;
 	static const studiodata_t *pDebugStudioData = m_MDLDict[handle];
 
+	// Fast path, already built. The pointer is only published once the model is complete.
+	virtualmodel_t *pVirtualModel = pStudioData->m_pVirtualModel;
+	if ( pVirtualModel )
+		return pVirtualModel;
+
+	// virtualmodel_t::AppendModels() builds through a global lookup table, so construction is serialized
+	AUTO_LOCK_FM( m_VirtualModelMutex );
 	if ( !pStudioData->m_pVirtualModel )
 	{
 		DevMsg( 2, "Loading virtual model for %s\n", pStudioHdr->pszName() );
 
 		CMDLCacheCriticalSection criticalSection( this );
 
-		AllocateVirtualModel( handle );
+		pVirtualModel = AllocateVirtualModel( handle );
 
 		// Group has to be zero to ensure refcounting is correct
-		int nGroup = pStudioData->m_pVirtualModel->m_group.AddToTail( );
+		int nGroup = pVirtualModel->m_group.AddToTail( );
 		Assert( nGroup == 0 );
-		pStudioData->m_pVirtualModel->m_group[nGroup].cache = (void *)(uintp)handle;
+		pVirtualModel->m_group[nGroup].cache = (void *)(uintp)handle;
 
 		// Add all dependent data
-		pStudioData->m_pVirtualModel->AppendModels( 0, pStudioHdr );
+		pVirtualModel->AppendModels( 0, pStudioHdr );
+
+		ThreadMemoryBarrier();
+		pStudioData->m_pVirtualModel = pVirtualModel;
 	}
 
 	return pStudioData->m_pVirtualModel;
@@ -3169,6 +3313,8 @@ bool CMDLCache::HandleCacheNotification( const DataCacheNotification_t &notifica
 	case DC_FLUSH_DISCARD:
 	case DC_REMOVED:
 		{
+			++g_nFrameLockDiscardSerial;
+
 			// This message can cause a crash on debug builds with "mod_trace_load 1"
 			MdlCacheMsg( "MDLCache: Data cache discard %s %s\n", g_ppszTypes[TypeFromCacheID( notification.clientId )], GetModelName( HandleFromCacheID( notification.clientId ) ) );
 
@@ -3236,6 +3382,8 @@ void CMDLCache::EndCoarseLock()
 //-----------------------------------------------------------------------------
 void CMDLCache::BeginLock()
 {
+	++GetFrameLockMemo()->m_nDepth;
+
 	if ( !IsGameConsole() )
 	{
 		m_pModelCacheSection->BeginFrameLocking();
@@ -3249,6 +3397,13 @@ void CMDLCache::BeginLock()
 //-----------------------------------------------------------------------------
 void CMDLCache::EndLock()
 {
+	MDLFrameLockMemo_t *pMemo = GetFrameLockMemo();
+	if ( --pMemo->m_nDepth == 0 )
+	{
+		// the frame locks are about to go away, forget everything they covered
+		++pMemo->m_nGeneration;
+	}
+
 	if ( !IsGameConsole() )
 	{
 		m_pModelCacheSection->EndFrameLocking();
@@ -3263,6 +3418,8 @@ void CMDLCache::EndLock()
 //-----------------------------------------------------------------------------
 void CMDLCache::BreakFrameLock( bool bModels, bool bMesh, bool bAnimBlock )
 {
+	++GetFrameLockMemo()->m_nGeneration;
+
 	if ( bModels )
 	{
 		if ( m_pModelCacheSection->IsFrameLocking() )
@@ -3379,6 +3536,13 @@ void CMDLCache::BeginMapLoad()
 	while ( i != m_MDLDict.InvalidIndex() )
 	{
 		pStudioData = m_MDLDict[i];
+
+		// Everything still referenced was in use by the outgoing map
+		if ( pStudioData->m_nRefCount > 0 )
+		{
+			pStudioData->m_nLastMapSerial = m_nMapSerial;
+		}
+
 		if ( pStudioData->m_pForceLockedStudioHdr )
 		{
 			// Reset the lock counts to where they need to be while the mdlcache lock is not active
@@ -3404,6 +3568,8 @@ void CMDLCache::BeginMapLoad()
 		}
 		i = m_MDLDict.Next( i );
 	}
+
+	++m_nMapSerial;
 }
 
 //-----------------------------------------------------------------------------
@@ -3436,10 +3602,194 @@ void CMDLCache::EndMapLoad()
 		}
 	}
 
+	EndMapResidency();
+
 	RestoreFrameLock();
 }
 
 
+//-----------------------------------------------------------------------------
+// Cross-map residency
+//
+// Models released during a level transition are kept alive (studiohdr, vcollide,
+// animblocks) up to mod_resident_budget megabytes instead of being torn down, so
+// the next map that precaches them finds them warm. Eviction is LRU by the serial
+// of the last map load that referenced the model. Each map also records the models
+// it used; the next load of that map takes references on them up front.
+//-----------------------------------------------------------------------------
+#define MDLCACHE_RESIDENT_MANIFEST_DIR	"mdlcache"
+
+bool CMDLCache::ShouldRetainResident( studiodata_t *pStudioData )
+{
+	if ( !m_bInitialized || mod_resident_budget.GetInt() <= 0 )
+		return false;
+
+	if ( pStudioData->m_nFlags & ( STUDIODATA_ERROR_MODEL | STUDIODATA_FLAGS_COMBINED_PLACEHOLDER | STUDIODATA_FLAGS_COMBINED | STUDIODATA_FLAGS_COMBINED_ASSET ) )
+		return false;
+
+	return ( pStudioData->m_pCombinedStudioData == NULL );
+}
+
+unsigned int CMDLCache::ComputeResidentSize( studiodata_t *pStudioData )
+{
+	unsigned int nBytes = 0;
+
+	studiohdr_t *pStudioHdr = (studiohdr_t *)GetCacheSection( MDLCACHE_STUDIOHDR )->GetNoTouch( pStudioData->m_MDLCache );
+	if ( pStudioHdr )
+	{
+		nBytes += pStudioHdr->length;
+
+		// block 0 is the .mdl itself
+		int nBlocks = MIN( pStudioData->m_vecAnimBlocks.Count(), pStudioHdr->numanimblocks );
+		for ( int i = 1; i < nBlocks; ++i )
+		{
+			if ( pStudioData->m_vecAnimBlocks[i] && GetCacheSection( MDLCACHE_ANIMBLOCK )->IsPresent( pStudioData->m_vecAnimBlocks[i] ) )
+			{
+				const mstudioanimblock_t *pBlock = pStudioHdr->pAnimBlock( i );
+				nBytes += pBlock->dataend - pBlock->datastart;
+			}
+		}
+	}
+
+	int nVCollideSize;
+	if ( GetVCollideSize( pStudioData->m_Handle, &nVCollideSize ) )
+	{
+		nBytes += nVCollideSize;
+	}
+
+	return nBytes;
+}
+
+void CMDLCache::EvictResident( unsigned int nBudgetBytes )
+{
+	if ( !m_ResidentHandles.Count() )
+		return;
+
+	// oldest map first
+	CUtlVector< MDLHandle_t > sorted;
+	sorted.AddVectorToTail( m_ResidentHandles );
+	std::sort( sorted.Base(), sorted.Base() + sorted.Count(), [this]( MDLHandle_t a, MDLHandle_t b )
+	{
+		return m_MDLDict[a]->m_nLastMapSerial < m_MDLDict[b]->m_nLastMapSerial;
+	} );
+
+	CUtlVector< unsigned int > sizes;
+	sizes.SetCount( sorted.Count() );
+	unsigned int nTotalBytes = 0;
+	for ( int i = 0; i < sorted.Count(); ++i )
+	{
+		sizes[i] = ComputeResidentSize( m_MDLDict[sorted[i]] );
+		nTotalBytes += sizes[i];
+	}
+
+	int nEvicted = 0;
+	for ( int i = 0; i < sorted.Count() && nTotalBytes > nBudgetBytes; ++i )
+	{
+		MDLHandle_t handle = sorted[i];
+		MdlCacheMsg( "MDLCache: Evicting resident %s (%u bytes)\n", GetModelName( handle ), sizes[i] );
+
+		m_ResidentHandles.FindAndFastRemove( handle );
+		m_MDLDict[handle]->m_nFlags &= ~STUDIODATA_FLAGS_RESIDENT;
+		ShutdownStudioData( handle, false );
+		m_MDLDict.RemoveAt( handle );
+
+		nTotalBytes -= sizes[i];
+		++nEvicted;
+	}
+
+	DevMsg( 2, "MDLCache: %d resident models (%u KB), evicted %d\n", m_ResidentHandles.Count(), nTotalBytes / 1024, nEvicted );
+}
+
+void CMDLCache::ReleaseManifestModels()
+{
+	// Drop the manifest references; anything the map didn't pick up becomes resident (or goes away)
+	for ( int i = 0; i < m_ManifestHandles.Count(); ++i )
+	{
+		Release( m_ManifestHandles[i] );
+	}
+	m_ManifestHandles.Purge();
+}
+
+void CMDLCache::BeginMapResidency( const char *pszMapName )
+{
+	ReleaseManifestModels();
+
+	V_FileBase( pszMapName, m_szResidentMapName, sizeof( m_szResidentMapName ) );
+
+	if ( !mod_resident_manifest.GetBool() || mod_resident_budget.GetInt() <= 0 || !m_szResidentMapName[0] )
+		return;
+
+	char szManifest[MAX_PATH];
+	V_snprintf( szManifest, sizeof( szManifest ), MDLCACHE_RESIDENT_MANIFEST_DIR "/%s.lst", m_szResidentMapName );
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !g_pFullFileSystem->ReadFile( szManifest, "MOD", buf ) )
+		return;
+
+	int nWarm = 0;
+	char szModelName[MAX_PATH];
+	while ( buf.IsValid() && buf.GetBytesRemaining() )
+	{
+		buf.GetLine( szModelName, sizeof( szModelName ) );
+		V_StripTrailingWhitespace( szModelName );
+		if ( !szModelName[0] )
+			continue;
+
+		MDLHandle_t handle = m_MDLDict.Find( szModelName );
+		if ( handle != m_MDLDict.InvalidIndex() && ( m_MDLDict[handle]->m_nFlags & STUDIODATA_FLAGS_RESIDENT ) )
+		{
+			++nWarm;
+		}
+
+		// Holding a reference keeps resident data out of this load's purges
+		handle = FindMDL( szModelName );
+		GetStudioHdr( handle );
+		m_ManifestHandles.AddToTail( handle );
+	}
+
+	DevMsg( "MDLCache: %s manifest prewarmed %d models, %d already resident\n", m_szResidentMapName, m_ManifestHandles.Count(), nWarm );
+}
+
+void CMDLCache::EndMapResidency()
+{
+	ReleaseManifestModels();
+
+	if ( mod_resident_manifest.GetBool() && mod_resident_budget.GetInt() > 0 && m_szResidentMapName[0] )
+	{
+		CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+		for ( MDLHandle_t i = m_MDLDict.First(); i != m_MDLDict.InvalidIndex(); i = m_MDLDict.Next( i ) )
+		{
+			studiodata_t *pStudioData = m_MDLDict[i];
+			if ( pStudioData->m_nRefCount > 0 && ShouldRetainResident( pStudioData ) )
+			{
+				buf.Printf( "%s\n", m_MDLDict.GetElementName( i ) );
+			}
+		}
+
+		char szManifest[MAX_PATH];
+		V_snprintf( szManifest, sizeof( szManifest ), MDLCACHE_RESIDENT_MANIFEST_DIR "/%s.lst", m_szResidentMapName );
+		g_pFullFileSystem->CreateDirHierarchy( MDLCACHE_RESIDENT_MANIFEST_DIR, "DEFAULT_WRITE_PATH" );
+		g_pFullFileSystem->WriteFile( szManifest, "DEFAULT_WRITE_PATH", buf );
+	}
+	m_szResidentMapName[0] = '\0';
+
+	EvictResident( (unsigned int)MAX( mod_resident_budget.GetInt(), 0 ) * 1024 * 1024 );
+}
+
+void CMDLCache::ResidentReport()
+{
+	unsigned int nTotalBytes = 0;
+	for ( int i = 0; i < m_ResidentHandles.Count(); ++i )
+	{
+		studiodata_t *pStudioData = m_MDLDict[m_ResidentHandles[i]];
+		unsigned int nBytes = ComputeResidentSize( pStudioData );
+		Msg( "%8u KB  map %3d  %s\n", nBytes / 1024, pStudioData->m_nLastMapSerial, m_MDLDict.GetElementName( m_ResidentHandles[i] ) );
+		nTotalBytes += nBytes;
+	}
+	Msg( "%d resident models, %u KB of %d MB budget (current map serial %d)\n", m_ResidentHandles.Count(), nTotalBytes / 1024, mod_resident_budget.GetInt(), m_nMapSerial );
+}
+
+
 //-----------------------------------------------------------------------------
 // Is a particular part of the model data loaded?
 //-----------------------------------------------------------------------------
@@ -4388,7 +4738,26 @@ void CMDLCache::CacheData( DataCacheHandle_t *c, void *pData, int size, const ch
 //-----------------------------------------------------------------------------
 void *CMDLCache::CheckData( DataCacheHandle_t c, MDLCacheDataType_t type )
 {
-	return GetCacheSection( type )->Get( c, true );
+	IDataCacheSection *pSection = GetCacheSection( type );
+
+	MDLFrameLockMemo_t *pMemo = GetFrameLockMemo();
+	if ( pMemo->m_nDepth <= 0 || c == DC_INVALID_HANDLE || !mod_framelock_memo.GetBool() || !pSection->IsFrameLocking() )
+		return pSection->Get( c, true );
+
+	MDLFrameLockMemo_t::Entry_t *pEntry = GetFrameLockMemoEntry( pMemo, c );
+	int nDiscardSerial = g_nFrameLockDiscardSerial;
+	if ( pEntry->m_hData == c && pEntry->m_nGeneration == pMemo->m_nGeneration && pEntry->m_nDiscardSerial == nDiscardSerial )
+		return pEntry->m_pData;
+
+	void *pData = pSection->Get( c, true );
+	if ( pData )
+	{
+		pEntry->m_hData = c;
+		pEntry->m_pData = pData;
+		pEntry->m_nGeneration = pMemo->m_nGeneration;
+		pEntry->m_nDiscardSerial = nDiscardSerial;
+	}
+	return pData;
 }
 
 //-----------------------------------------------------------------------------
@@ -4420,6 +4789,7 @@ void CMDLCache::UncacheData( DataCacheHandle_t c, MDLCacheDataType_t type, bool
 	}
 
 	pSection->BreakLock( c );
+	++g_nFrameLockDiscardSerial;
 
 	const void *pItemData;
 	pSection->Remove( c, &pItemData );
@@ -5784,6 +6154,119 @@ CON_COMMAND( mdlcache_dump_dictionary_state, "Dump the state of the MDLCache Dic
 	g_pMDLCache->DumpDictionaryState();
 }
 
+//-----------------------------------------------------------------------------
+// Contention benchmark: N threads walking the bone setup access pattern
+// (critical section, studiohdr, virtual model, anim blocks) over the same
+// set of loaded models at once.
+//-----------------------------------------------------------------------------
+struct MDLContentionBenchThread_t
+{
+	const CUtlVector< MDLHandle_t >	*m_pHandles;
+	int								m_nIterations;
+	int64							m_nLookups;
+};
+
+static uintp MDLContentionBenchThread( void *pParam )
+{
+	MDLContentionBenchThread_t *pInfo = (MDLContentionBenchThread_t *)pParam;
+	const CUtlVector< MDLHandle_t > &handles = *pInfo->m_pHandles;
+
+	for ( int nIter = 0; nIter < pInfo->m_nIterations; ++nIter )
+	{
+		for ( int i = 0; i < handles.Count(); ++i )
+		{
+			MDLCACHE_CRITICAL_SECTION_( g_pMDLCache );
+
+			studiohdr_t *pStudioHdr = g_pMDLCache->GetStudioHdr( handles[i] );
+			if ( !pStudioHdr )
+				continue;
+
+			// bone setup comes back to the same header, virtual model and anim blocks several times per model
+			for ( int nPass = 0; nPass < 4; ++nPass )
+			{
+				g_pMDLCache->GetStudioHdr( handles[i] );
+				g_pMDLCache->GetVirtualModelFast( pStudioHdr, handles[i] );
+				for ( int nBlock = 1; nBlock < pStudioHdr->numanimblocks; ++nBlock )
+				{
+					g_pMDLCache->GetAnimBlock( handles[i], nBlock, false );
+				}
+				pInfo->m_nLookups += 2 + MAX( pStudioHdr->numanimblocks - 1, 0 );
+			}
+		}
+	}
+	return 0;
+}
+
+void CMDLCache::ContentionBench( int nThreads, int nIterations )
+{
+	nThreads = clamp( nThreads, 1, MAX_THREADS_SUPPORTED - 2 );
+
+	// hold a reference on everything loaded so nothing goes away underneath the threads
+	CUtlVector< MDLHandle_t > handles;
+	for ( MDLHandle_t i = m_MDLDict.First(); i != m_MDLDict.InvalidIndex(); i = m_MDLDict.Next( i ) )
+	{
+		studiodata_t *pStudioData = m_MDLDict[i];
+		if ( pStudioData->m_nRefCount <= 0 || ( pStudioData->m_nFlags & STUDIODATA_ERROR_MODEL ) || !IsDataLoaded( i, MDLCACHE_STUDIOHDR ) )
+			continue;
+		AddRef( i );
+		handles.AddToTail( i );
+	}
+
+	if ( !handles.Count() )
+	{
+		Msg( "mdlcache_contention_bench: no models loaded\n" );
+		return;
+	}
+
+	bool bSavedMemo = mod_framelock_memo.GetBool();
+	for ( int nMemo = 0; nMemo < 2; ++nMemo )
+	{
+		mod_framelock_memo.SetValue( nMemo );
+
+		MDLContentionBenchThread_t info[MAX_THREADS_SUPPORTED];
+		ThreadHandle_t hThreads[MAX_THREADS_SUPPORTED];
+
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			info[i].m_pHandles = &handles;
+			info[i].m_nIterations = nIterations;
+			info[i].m_nLookups = 0;
+			hThreads[i] = CreateSimpleThread( MDLContentionBenchThread, &info[i] );
+		}
+
+		int64 nLookups = 0;
+		for ( int i = 0; i < nThreads; ++i )
+		{
+			ThreadJoin( hThreads[i] );
+			ReleaseThreadHandle( hThreads[i] );
+			nLookups += info[i].m_nLookups;
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		Msg( "mdlcache_contention_bench: memo %s, %d threads x %d iterations over %d models: %.1f ms, %.2f M lookups/sec\n",
+			nMemo ? "on " : "off", nThreads, nIterations, handles.Count(), flElapsed * 1000.0, flElapsed > 0.0 ? ( nLookups / flElapsed ) * 1e-6 : 0.0 );
+	}
+	mod_framelock_memo.SetValue( bSavedMemo );
+
+	for ( int i = 0; i < handles.Count(); ++i )
+	{
+		Release( handles[i] );
+	}
+}
+
+CON_COMMAND( mdlcache_contention_bench, "Times threads doing bone setup style lookups against every loaded model, with and without the frame lock memo. Arguments: [threads] [iterations]" )
+{
+	int nThreads = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 4;
+	int nIterations = ( args.ArgC() > 2 ) ? atoi( args[2] ) : 100;
+	g_MDLCache.ContentionBench( nThreads, nIterations );
+}
+
+CON_COMMAND( mdlcache_resident_report, "Lists unreferenced models kept resident across level transitions." )
+{
+	g_MDLCache.ResidentReport();
+}
+
 //-----------------------------------------------------------------------------
 // Clears the anim cache, freeing its memory
 //
@@ -7,6 +7,7 @@
 #include "client_pch.h"
 #include "baseclientstate.h"
 #include "inetchannel.h"
+#include "net_chan.h"
 #include "netmessages.h"
 #include "proto_oob.h"
 #include "dt_recv_eng.h"
@@ -133,6 +134,107 @@ void CL_NameCvarChanged( IConVar *pConVar, const char *pOldString, float flOldVa
 }
 
 
+//-----------------------------------------------------------------------------
+// Connect-to-spawn timing. net_signontest reconnects a number of times with
+// net_fakelag/net_fakeloss applied (they affect loopback too) and reports the
+// spread, e.g. to compare net_reliablewindow 0 and 1 on a listen server.
+//-----------------------------------------------------------------------------
+extern ConVar net_reliablewindow;
+static ConVar net_showsignontime( "net_showsignontime", "0", 0, "Print how long it took from connect until fully in game" );
+
+static double s_flSignonStartTime = -1.0;
+static int s_nSignonTestRunsLeft = 0;
+static CUtlVector< float > s_SignonTestTimes;
+static float s_flSignonTestSavedLag = 0.0f;
+static float s_flSignonTestSavedLoss = 0.0f;
+
+static void SignonTest_Stop()
+{
+	ConVarRef net_fakelag( "net_fakelag" );
+	ConVarRef net_fakeloss( "net_fakeloss" );
+	net_fakelag.SetValue( s_flSignonTestSavedLag );
+	net_fakeloss.SetValue( s_flSignonTestSavedLoss );
+
+	s_nSignonTestRunsLeft = 0;
+}
+
+static void SignonTimer_Report( INetChannel *pNetChannel )
+{
+	if ( s_flSignonStartTime < 0.0 )
+		return;
+
+	float flTime = Plat_FloatTime() - s_flSignonStartTime;
+	s_flSignonStartTime = -1.0;
+
+	if ( net_showsignontime.GetBool() || s_nSignonTestRunsLeft > 0 )
+	{
+		ConVarRef net_fakelag( "net_fakelag" );
+		ConVarRef net_fakeloss( "net_fakeloss" );
+		ConMsg( "Signon took %.2f s (reliable window %s, net_fakelag %g, net_fakeloss %g)\n", flTime,
+			static_cast< CNetChan * >( pNetChannel )->IsReliableWindowEnabled() ? "on" : "off",
+			net_fakelag.GetFloat(), net_fakeloss.GetFloat() );
+	}
+
+	if ( s_nSignonTestRunsLeft <= 0 )
+		return;
+
+	s_SignonTestTimes.AddToTail( flTime );
+
+	if ( --s_nSignonTestRunsLeft > 0 )
+	{
+		Cbuf_AddText( Cbuf_GetCurrentPlayer(), "retry\n" );
+		return;
+	}
+
+	float flMin = FLT_MAX;
+	float flMax = 0.0f;
+	float flTotal = 0.0f;
+	FOR_EACH_VEC( s_SignonTestTimes, i )
+	{
+		flMin = MIN( flMin, s_SignonTestTimes[i] );
+		flMax = MAX( flMax, s_SignonTestTimes[i] );
+		flTotal += s_SignonTestTimes[i];
+	}
+
+	ConMsg( "net_signontest: %d runs, min %.2f s, avg %.2f s, max %.2f s (net_reliablewindow %d)\n",
+		s_SignonTestTimes.Count(), flMin, flTotal / s_SignonTestTimes.Count(), flMax, net_reliablewindow.GetInt() );
+
+	SignonTest_Stop();
+}
+
+CON_COMMAND( net_signontest, "Reconnect to the current server <runs> times with [fakelag ms] and [fakeloss percent] and report the signon times, 0 runs cancels" )
+{
+	if ( args.ArgC() < 2 )
+	{
+		ConMsg( "Usage: net_signontest <runs> [fakelag ms] [fakeloss %%]\n" );
+		return;
+	}
+
+	if ( s_nSignonTestRunsLeft > 0 )
+	{
+		SignonTest_Stop();
+	}
+
+	int nRuns = atoi( args[1] );
+	if ( nRuns <= 0 )
+		return;
+
+	ConVarRef net_fakelag( "net_fakelag" );
+	ConVarRef net_fakeloss( "net_fakeloss" );
+	s_flSignonTestSavedLag = net_fakelag.GetFloat();
+	s_flSignonTestSavedLoss = net_fakeloss.GetFloat();
+
+	if ( args.ArgC() > 2 )
+		net_fakelag.SetValue( (float)atof( args[2] ) );
+	if ( args.ArgC() > 3 )
+		net_fakeloss.SetValue( (float)atof( args[3] ) );
+
+	s_SignonTestTimes.RemoveAll();
+	s_nSignonTestRunsLeft = nRuns;
+
+	Cbuf_AddText( Cbuf_GetCurrentPlayer(), "retry\n" );
+}
+
 
 #ifndef DEDICATED
 void askconnect_accept_f()
@@ -752,6 +854,12 @@ bool CBaseClientState::SetSignonState ( int state, int count, const CNETMsg_Sign
 	}
 
 	m_nSignonState = state;
+
+	if ( state == SIGNONSTATE_FULL && !m_NetChannel->IsPlayback() )
+	{
+		SignonTimer_Report( m_NetChannel );
+	}
+
 	return true;
 }
 
@@ -1085,6 +1193,8 @@ void CBaseClientState::ConnectInternal( const char *pchPublicAddress, char const
 	//standard connect always connects one players.
 	m_nNumPlayersToConnect = numPlayers;
 
+	s_flSignonStartTime = Plat_FloatTime();
+
 	// For the check for resend timer to fire a connection / getchallenge request.
 	SetSignonState( SIGNONSTATE_CHALLENGE, -1, NULL );
 
@@ -1168,6 +1278,8 @@ void CBaseClientState::FullConnect( const ns_address &adr, int nEncryptionKey )
 	m_NetChannel = NET_CreateNetChannel( m_Socket, &adr, "CLIENT", this, pbEncryptionKey, false );
 
 	Assert( m_NetChannel );
+
+	static_cast< CNetChan * >( m_NetChannel )->SetReliableWindow( m_DeferredConnection.m_bReliableWindow );
 	
 	m_NetChannel->StartStreaming( m_nChallengeNr );	// open TCP stream
 
@@ -1660,6 +1772,19 @@ bool CBaseClientState::ProcessConnectionlessPacket( netpacket_t *packet )
 			bool bConnectionExpectingEncryptionKey = ( m_DeferredConnection.m_nEncryptionKey != 0 ) ||
 				( g_mapServersToCertificates.Find( ns_address_render( packet->from ).String() ) != UTL_INVAL_SYMBOL );
 
+			// first reserved field has the capabilities the server agreed to
+			int nServerCaps = 0;
+			if ( msg.GetNumBytesLeft() >= 5 && msg.ReadByte() == '.' )
+			{
+				char chServerCaps[5] = {};
+				for ( int j = 0; j < 4; ++ j )
+					chServerCaps[j] = msg.ReadByte();
+
+				if ( 1 != sscanf( chServerCaps, "%04X", &nServerCaps ) )
+					nServerCaps = 0;
+			}
+			m_DeferredConnection.m_bReliableWindow = ( nServerCaps & NET_RELIABLE_WINDOW_CAPS ) != 0;
+
 			int nEncryptionKeyIndex = 0;
 			if ( ( 1 == sscanf( chEncryptionKeyIndex, "%08X", &nEncryptionKeyIndex ) ) &&
 				( ( nEncryptionKeyIndex != 0 ) == bConnectionExpectingEncryptionKey ) )
@@ -86,6 +86,7 @@ struct DeferredConnection_t
 		m_bOfficialValveServer = false;
 		m_nEncryptionKey = 0;
 		m_nEncryptedSize = 0;
+		m_bReliableWindow = false;
 		memset( m_chLobbyType, 0, sizeof( m_chLobbyType ) );
 	}
 
@@ -103,6 +104,7 @@ struct DeferredConnection_t
 	ns_address m_adrServerAddress;
 	int		m_nEncryptionKey;
 	int		m_nEncryptedSize;
+	bool	m_bReliableWindow;	// server agreed to the windowed reliable stream
 };
 
 // 0 == public, 1 == private, 2 == double NAT'd private (for  direct connection)
@@ -43,6 +43,7 @@
 #include "dt_send_eng.h"
 #include "dt_recv_eng.h"
 #include "networkstringtable.h"
+#include "net_chan.h"
 #include "sys_dll.h"
 #include "host_cmd.h"
 #include "sv_steamauth.h"
@@ -188,6 +189,7 @@ static void SvGameDataChangeCallback( IConVar *pConVar, const char *pOldValue, f
 extern ConVar	sv_search_key;
 extern ConVar	sv_lan;
 extern ConVar	cl_hideserverip;
+extern ConVar	net_reliablewindow;
 
 ConVar			sv_region( "sv_region","-1", FCVAR_NONE | FCVAR_RELEASE, "The region of the world to report this server in." );
 static ConVar	sv_instancebaselines( "sv_instancebaselines", "1", FCVAR_DEVELOPMENTONLY, "Enable instanced baselines. Saves network overhead." );
@@ -771,6 +773,23 @@ IClient *CBaseServer::ConnectClient ( const ns_address &adr, int protocol, int c
 
 	// setup netchannl settings
 	netchan->SetChallengeNr( challenge );
+
+	// use the windowed reliable stream if the client advertised it and we allow it
+	bool bReliableWindow = false;
+	if ( net_reliablewindow.GetBool() && splitScreenClients.Count() )
+	{
+		for ( int iCvar = 0; iCvar < splitScreenClients[ 0 ]->convars().cvars().size(); ++iCvar )
+		{
+			CMsg_CVars::CVar const &rCvarInfo = splitScreenClients[ 0 ]->convars().cvars( iCvar );
+			if ( !V_strcmp( "net_reliablewindow", NetMsgGetCVarUsingDictionary( rCvarInfo ) ) )
+			{
+				bReliableWindow = ( atoi( rCvarInfo.value().c_str() ) != 0 );
+				break;
+			}
+		}
+	}
+
+	static_cast< CNetChan * >( netchan )->SetReliableWindow( bReliableWindow );
 	
 	COM_TimestampedLog( "CBaseServer::ConnectClient:  client->Connect" );
 
@@ -794,7 +813,8 @@ IClient *CBaseServer::ConnectClient ( const ns_address &adr, int protocol, int c
 	client->m_pLastSnapshot = NULL;
 	
 	// Tell client connection worked, now use netchannels
-	NET_OutOfBandPrintf ( m_Socket, adr, "%c.%08X.0000.0000.0000.0000.", S2C_CONNECTION, nEncryptionKeyIndex );
+	NET_OutOfBandPrintf ( m_Socket, adr, "%c.%08X.%04X.0000.0000.0000.", S2C_CONNECTION, nEncryptionKeyIndex,
+		bReliableWindow ? NET_RELIABLE_WINDOW_CAPS : 0 );
 
 	// Set up client structure.
 	if ( authProtocol == PROTOCOL_HASHEDCDKEY )
@@ -3675,10 +3695,10 @@ void CBaseServer::WriteTempEntities( CBaseClient *client, CFrameSnapshot *pCurre
 
 	// Build list of events sorted by send table classID (makes the delta work better in cases with a lot of the same message type )
 	for ( int nSnapShotIndex = 0; 
-		 nSnapShotIndex < snapshotlist.m_vecSnapshots.Count(); 
+		 nSnapShotIndex < snapshotlist.Count(); 
 		 ++nSnapShotIndex )
 	{
-		CFrameSnapshot *pSnapshot = snapshotlist.m_vecSnapshots[ nSnapShotIndex ];
+		CFrameSnapshot *pSnapshot = snapshotlist[ nSnapShotIndex ];
 
 		for( int i = 0; i < pSnapshot->m_nTempEntities; ++i )
 		{
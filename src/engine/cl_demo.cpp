@@ -2957,7 +2957,10 @@ void CDemoPlayer::ScanForImportantTicks()
 						bf_read data( &msg->string_data()[0], msg->string_data().size() );
 						table->ParseUpdate( data, msg->num_changed_entries() );
 					}
-					delete netmsg;
+					if ( netmsg )
+					{
+						netmsg->Release();
+					}
 				}
 			}
 		}
@@ -56,6 +56,7 @@
 #include "matchmaking/imatchframework.h"
 #include "tier2/tier2.h"
 #include "host_state.h"
+#include "net_chan.h"
 #include "enginethreads.h"
 #include "vgui/ISystem.h"
 #include "pure_server.h"
@@ -2747,9 +2748,11 @@ void CL_Move(float accumulated_extra_samples, bool bFinalTick )
 
 	// don't send packets if update time not reached or chnnel still sending
 	// in loopback mode don't send only if host_limitlocal is enabled
+	// during signon a windowed channel acks reliable data right away, not at 5 packets/second
+	bool bAckReliableNow = !cl.IsActive() && static_cast< CNetChan * >( cl.m_NetChannel )->IsReliableAckPending();
 
 	if ( ( !cl.m_NetChannel->IsLoopback() || host_limitlocal.GetInt() ) &&
-		 ( ( net_time < cl.m_flNextCmdTime ) || !cl.m_NetChannel->CanPacket()  || !bFinalTick ) )
+		 ( ( net_time < cl.m_flNextCmdTime && !bAckReliableNow ) || !cl.m_NetChannel->CanPacket()  || !bFinalTick ) )
 	{
 		bSendPacket = false;
 	}
@@ -289,6 +289,8 @@ void CM_FreeMap(void)
 	// get the current collision bsp -- there is only one!
 	CCollisionBSPData *pBSPData = GetCollisionBSPData();
 
+	CM_FreePointGrid();
+
 	// free the collision bsp data
 	CollisionBSPData_Destroy( pBSPData );
 }
@@ -346,6 +348,8 @@ cmodel_t *CM_LoadMap( const char *pPathName, bool allowReusePrevious, texinfo_t
 		return &pBSPData->map_cmodels[0];		// still have the right version
 	}
 
+	CM_FreePointGrid();
+
 	// only pre-load if the map doesn't already exist
 	CollisionBSPData_PreLoad( pBSPData );
 
@@ -366,6 +370,7 @@ cmodel_t *CM_LoadMap( const char *pPathName, bool allowReusePrevious, texinfo_t
 	CM_InitPortalOpenState( pBSPData );
 	FloodAreaConnections( pBSPData );
 	CM_RegisterPaintMap( pBSPData );
+	CM_BuildPointGrid( pBSPData );
 
 #ifdef COUNT_COLLISIONS
 	// initialize counters
@@ -476,6 +481,11 @@ int CM_PointLeafnum (const Vector& p)
 
 	if (!pBSPData->numplanes)
 		return 0;		// sound may call this without map loaded
+
+	int l = CM_PointGridLeafnum( p );
+	if ( l >= 0 )
+		return l;
+
 	return CM_PointLeafnum_r (pBSPData, p, 0);
 }
 
@@ -718,7 +728,7 @@ CM_PointContents
 
 int CM_PointContents ( const Vector &p, int headnode, int contentsMask )
 {
-	int		l;
+	int		l = -1;
 
 	// get the current collision bsp -- there is only one!
 	CCollisionBSPData *pBSPData = GetCollisionBSPData();
@@ -731,8 +741,27 @@ int CM_PointContents ( const Vector &p, int headnode, int contentsMask )
 		return 0;
 	}
 
-	l = CM_PointLeafnum_r (pBSPData, p, headnode);
+	if ( headnode == 0 )
+	{
+		int nContents;
+		if ( CM_PointGridContents( p, &l, &nContents ) )
+			return nContents;
+	}
 
+	if ( l < 0 )
+	{
+		l = CM_PointLeafnum_r (pBSPData, p, headnode);
+	}
+
+	return CM_LeafPointContents( pBSPData, p, l );
+}
+
+
+//-----------------------------------------------------------------------------
+// Contents of the brushes in leaf l that contain p
+//-----------------------------------------------------------------------------
+int CM_LeafPointContents( CCollisionBSPData *pBSPData, const Vector &p, int l )
+{
 	// iterate the leaf brushes and check for intersection with each one
 	cleaf_t &leaf = pBSPData->map_leafs[l];
 	if ( leaf.cluster < 0 )
@@ -0,0 +1,458 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Uniform grid over the world BSP for point leaf and contents queries.
+//			Each cell remembers the leaf it lies in when no node plane crosses
+//			it, and the contents of every point in it when no brush of that
+//			leaf crosses it either. Those cells answer CM_PointLeafnum and
+//			CM_PointContents with one lookup; the rest walk the tree as before.
+//
+//=============================================================================//
+
+#include <stdlib.h>
+#include "cmodel_engine.h"
+#include "cmodel_private.h"
+#include "bspflags.h"
+#include "convar.h"
+#include "vstdlib/random.h"
+#include "tier0/fasttimer.h"
+#include "tier1/utlvector.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+static ConVar cm_pointgrid_cellsize( "cm_pointgrid_cellsize", "64", 0, "Cell size of the world point contents grid built at map load, 0 to not build one" );
+
+// Maps bigger than this many cells of cm_pointgrid_cellsize get coarser cells instead (4 bytes each)
+#define POINTGRID_MAX_CELLS		( 1 << 20 )
+
+// Cells are classified a little bigger than they are, so points that round
+// into a neighbouring cell, and planes that pass within this of a cell, never
+// get an answer the tree wouldn't give
+#define POINTGRID_EPSILON		0.125f
+
+#define POINTGRID_UNKNOWN		0xFFFF
+
+struct pointgridcell_t
+{
+	unsigned short	leaf;			// POINTGRID_UNKNOWN if a node plane crosses the cell
+	unsigned short	contents;		// index into s_PointGrid.m_Contents, POINTGRID_UNKNOWN if a brush crosses the cell
+};
+
+struct CPointGrid
+{
+	Vector			m_vecOrigin;
+	float			m_flCellSize;
+	float			m_flInvCellSize;
+	int				m_nCells[3];
+	pointgridcell_t	*m_pCells;
+	CUtlVector<int>	m_Contents;		// the distinct contents values cells have
+};
+
+static CPointGrid s_PointGrid;
+
+
+//-----------------------------------------------------------------------------
+// Returns 0 if the whole box is in front of the plane, 1 if it is all behind
+// it, -1 if the plane crosses it. Matches the d < 0 test of CM_PointLeafnum_r.
+//-----------------------------------------------------------------------------
+static int PointGrid_BoxOnPlaneSide( const Vector &mins, const Vector &maxs, const cplane_t *plane )
+{
+	float flMinDist, flMaxDist;
+	if ( plane->type < 3 )
+	{
+		flMinDist = mins[plane->type] - plane->dist;
+		flMaxDist = maxs[plane->type] - plane->dist;
+	}
+	else
+	{
+		Vector vecCenter = ( mins + maxs ) * 0.5f;
+		Vector vecExtents = maxs - vecCenter;
+		float flDist = DotProduct( plane->normal, vecCenter ) - plane->dist;
+		float flRadius = fabsf( plane->normal.x ) * vecExtents.x + fabsf( plane->normal.y ) * vecExtents.y + fabsf( plane->normal.z ) * vecExtents.z;
+		flMinDist = flDist - flRadius;
+		flMaxDist = flDist + flRadius;
+	}
+
+	if ( flMinDist >= 0.0f )
+		return 0;
+	if ( flMaxDist < 0.0f )
+		return 1;
+	return -1;
+}
+
+
+//-----------------------------------------------------------------------------
+// Returns the contents every point of the box has in leaf l the way
+// CM_LeafPointContents computes them, or false if a brush crosses the box
+//-----------------------------------------------------------------------------
+static bool PointGrid_BoxContentsInLeaf( CCollisionBSPData *pBSPData, const Vector &mins, const Vector &maxs, int l, int *pContents )
+{
+	const cleaf_t &leaf = pBSPData->map_leafs[l];
+	if ( leaf.cluster < 0 )
+	{
+		*pContents = leaf.contents;
+		return true;
+	}
+
+	Vector vecCenter = ( mins + maxs ) * 0.5f;
+	Vector vecExtents = maxs - vecCenter;
+
+	int nContents = 0;
+	const unsigned short *pBrushList = &pBSPData->map_leafbrushes[leaf.firstleafbrush];
+	for ( int i = 0; i < leaf.numleafbrushes; i++ )
+	{
+		const cbrush_t *pBrush = &pBSPData->map_brushes[ pBrushList[i] ];
+		if ( !pBrush->contents )
+			continue;
+
+		if ( pBrush->IsBox() )
+		{
+			const cboxbrush_t *pBox = &pBSPData->map_boxbrushes[pBrush->GetBox()];
+			if ( maxs.x < pBox->mins.x || maxs.y < pBox->mins.y || maxs.z < pBox->mins.z ||
+				 mins.x > pBox->maxs.x || mins.y > pBox->maxs.y || mins.z > pBox->maxs.z )
+				continue;
+
+			if ( mins.x >= pBox->mins.x && mins.y >= pBox->mins.y && mins.z >= pBox->mins.z &&
+				 maxs.x <= pBox->maxs.x && maxs.y <= pBox->maxs.y && maxs.z <= pBox->maxs.z )
+			{
+				nContents |= pBrush->contents;
+				continue;
+			}
+
+			return false;
+		}
+
+		// Inside means behind every side, like CM_LeafPointContents; being in
+		// front of any one side puts the whole box outside
+		bool bInside = true;
+		bool bOutside = false;
+		const cbrushside_t *pSide = &pBSPData->map_brushsides[pBrush->firstbrushside];
+		for ( const cbrushside_t * const pSideLimit = pSide + pBrush->numsides; pSide < pSideLimit; pSide++ )
+		{
+			if ( pSide->bBevel )
+				continue;
+
+			const cplane_t *plane = pSide->plane;
+			float flDist = DotProduct( plane->normal, vecCenter ) - plane->dist;
+			float flRadius = fabsf( plane->normal.x ) * vecExtents.x + fabsf( plane->normal.y ) * vecExtents.y + fabsf( plane->normal.z ) * vecExtents.z;
+			if ( flDist - flRadius > 0.0f )
+			{
+				bOutside = true;
+				break;
+			}
+			if ( flDist + flRadius > 0.0f )
+			{
+				bInside = false;
+			}
+		}
+
+		if ( bOutside )
+			continue;
+		if ( !bInside )
+			return false;
+
+		nContents |= pBrush->contents;
+	}
+
+	*pContents = nContents;
+	return true;
+}
+
+
+static void PointGrid_CellBounds( const int lo[3], const int hi[3], Vector &mins, Vector &maxs )
+{
+	for ( int i = 0; i < 3; i++ )
+	{
+		mins[i] = s_PointGrid.m_vecOrigin[i] + lo[i] * s_PointGrid.m_flCellSize - POINTGRID_EPSILON;
+		maxs[i] = s_PointGrid.m_vecOrigin[i] + hi[i] * s_PointGrid.m_flCellSize + POINTGRID_EPSILON;
+	}
+}
+
+
+static unsigned short PointGrid_ContentsIndex( int nContents )
+{
+	int i = s_PointGrid.m_Contents.Find( nContents );
+	if ( i == s_PointGrid.m_Contents.InvalidIndex() )
+	{
+		if ( s_PointGrid.m_Contents.Count() >= POINTGRID_UNKNOWN )
+			return POINTGRID_UNKNOWN;
+		i = s_PointGrid.m_Contents.AddToTail( nContents );
+	}
+	return (unsigned short)i;
+}
+
+
+//-----------------------------------------------------------------------------
+// Classifies the cells [lo, hi) starting at node num. A block that a plane or
+// brush crosses is split in half along its longest side until single cells
+// are left, so the work goes where the geometry is.
+//-----------------------------------------------------------------------------
+static void PointGrid_Build_r( CCollisionBSPData *pBSPData, int num, const int lo[3], const int hi[3] )
+{
+	Vector mins, maxs;
+	PointGrid_CellBounds( lo, hi, mins, maxs );
+
+	while ( num >= 0 )
+	{
+		const cnode_t *node = pBSPData->map_rootnode + num;
+		int nSide = PointGrid_BoxOnPlaneSide( mins, maxs, node->plane );
+		if ( nSide < 0 )
+			break;
+		num = node->children[nSide];
+	}
+
+	int nLeaf = -1;
+	int nContents = 0;
+	bool bKnown = false;
+	if ( num < 0 )
+	{
+		nLeaf = -1 - num;
+		bKnown = PointGrid_BoxContentsInLeaf( pBSPData, mins, maxs, nLeaf, &nContents );
+	}
+
+	int nAxis = 0;
+	for ( int i = 1; i < 3; i++ )
+	{
+		if ( hi[i] - lo[i] > hi[nAxis] - lo[nAxis] )
+		{
+			nAxis = i;
+		}
+	}
+
+	if ( !bKnown && hi[nAxis] - lo[nAxis] > 1 )
+	{
+		int nMid = ( lo[nAxis] + hi[nAxis] ) / 2;
+		int loHalf[3] = { lo[0], lo[1], lo[2] };
+		int hiHalf[3] = { hi[0], hi[1], hi[2] };
+		hiHalf[nAxis] = nMid;
+		PointGrid_Build_r( pBSPData, num, lo, hiHalf );
+		loHalf[nAxis] = nMid;
+		PointGrid_Build_r( pBSPData, num, loHalf, hi );
+		return;
+	}
+
+	pointgridcell_t cell;
+	cell.leaf = ( nLeaf >= 0 ) ? (unsigned short)nLeaf : POINTGRID_UNKNOWN;
+	cell.contents = bKnown ? PointGrid_ContentsIndex( nContents ) : POINTGRID_UNKNOWN;
+
+	int nStrideY = s_PointGrid.m_nCells[0];
+	int nStrideZ = s_PointGrid.m_nCells[0] * s_PointGrid.m_nCells[1];
+	for ( int z = lo[2]; z < hi[2]; z++ )
+	{
+		for ( int y = lo[1]; y < hi[1]; y++ )
+		{
+			pointgridcell_t *pCell = &s_PointGrid.m_pCells[ z * nStrideZ + y * nStrideY ];
+			for ( int x = lo[0]; x < hi[0]; x++ )
+			{
+				pCell[x] = cell;
+			}
+		}
+	}
+}
+
+
+void CM_BuildPointGrid( CCollisionBSPData *pBSPData )
+{
+	CM_FreePointGrid();
+
+	float flCellSize = cm_pointgrid_cellsize.GetFloat();
+	if ( flCellSize <= 0.0f || !pBSPData->numnodes || !pBSPData->numcmodels )
+		return;
+
+	// Leaf numbers have to fit in a cell next to the unknown marker
+	if ( pBSPData->numleafs >= POINTGRID_UNKNOWN )
+		return;
+
+	CFastTimer timer;
+	timer.Start();
+
+	const cmodel_t &world = pBSPData->map_cmodels[0];
+	Vector vecSize = world.maxs - world.mins;
+	int64 nCells;
+	for ( ;; )
+	{
+		nCells = 1;
+		for ( int i = 0; i < 3; i++ )
+		{
+			s_PointGrid.m_nCells[i] = MAX( 1, (int)ceil( vecSize[i] / flCellSize ) );
+			nCells *= s_PointGrid.m_nCells[i];
+		}
+		if ( nCells <= POINTGRID_MAX_CELLS )
+			break;
+		flCellSize *= 2.0f;
+	}
+
+	s_PointGrid.m_vecOrigin = world.mins;
+	s_PointGrid.m_flCellSize = flCellSize;
+	s_PointGrid.m_flInvCellSize = 1.0f / flCellSize;
+	s_PointGrid.m_pCells = new pointgridcell_t[ (int)nCells ];
+
+	int lo[3] = { 0, 0, 0 };
+	PointGrid_Build_r( pBSPData, 0, lo, s_PointGrid.m_nCells );
+
+	timer.End();
+	DevMsg( "Point grid: %d x %d x %d cells of %.0f units, %d KB, built in %.1f ms\n",
+		s_PointGrid.m_nCells[0], s_PointGrid.m_nCells[1], s_PointGrid.m_nCells[2], flCellSize,
+		(int)( nCells * sizeof( pointgridcell_t ) / 1024 ), timer.GetDuration().GetMillisecondsF() );
+}
+
+
+void CM_FreePointGrid()
+{
+	delete[] s_PointGrid.m_pCells;
+	s_PointGrid.m_pCells = NULL;
+	s_PointGrid.m_Contents.Purge();
+}
+
+
+static inline const pointgridcell_t *PointGrid_Cell( const Vector &p )
+{
+	if ( !s_PointGrid.m_pCells )
+		return NULL;
+
+	int nIndex[3];
+	for ( int i = 0; i < 3; i++ )
+	{
+		float f = ( p[i] - s_PointGrid.m_vecOrigin[i] ) * s_PointGrid.m_flInvCellSize;
+
+		// Written so NaNs end up outside too
+		if ( !( f >= 0.0f && f < (float)s_PointGrid.m_nCells[i] ) )
+			return NULL;
+		nIndex[i] = (int)f;
+	}
+
+	return &s_PointGrid.m_pCells[ ( nIndex[2] * s_PointGrid.m_nCells[1] + nIndex[1] ) * s_PointGrid.m_nCells[0] + nIndex[0] ];
+}
+
+
+int CM_PointGridLeafnum( const Vector &p )
+{
+	const pointgridcell_t *pCell = PointGrid_Cell( p );
+	if ( !pCell || pCell->leaf == POINTGRID_UNKNOWN )
+		return -1;
+	return pCell->leaf;
+}
+
+
+bool CM_PointGridContents( const Vector &p, int *pLeaf, int *pContents )
+{
+	const pointgridcell_t *pCell = PointGrid_Cell( p );
+	if ( !pCell || pCell->leaf == POINTGRID_UNKNOWN )
+	{
+		*pLeaf = -1;
+		return false;
+	}
+
+	*pLeaf = pCell->leaf;
+	if ( pCell->contents == POINTGRID_UNKNOWN )
+		return false;
+
+	*pContents = s_PointGrid.m_Contents[pCell->contents];
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Times the grid against the tree on random points in the open parts of the
+// map and checks they agree
+//-----------------------------------------------------------------------------
+CON_COMMAND( cm_pointgrid_report, "Reports the world point grid's memory use and how fast it answers point queries compared to the tree" )
+{
+	CCollisionBSPData *pBSPData = GetCollisionBSPData();
+	if ( !s_PointGrid.m_pCells )
+	{
+		Msg( "No point grid (cm_pointgrid_cellsize %s, map loaded: %s)\n", cm_pointgrid_cellsize.GetString(), pBSPData->numnodes ? "yes" : "no" );
+		return;
+	}
+
+	int nCells = s_PointGrid.m_nCells[0] * s_PointGrid.m_nCells[1] * s_PointGrid.m_nCells[2];
+	int nLeafCells = 0;
+	int nContentsCells = 0;
+	for ( int i = 0; i < nCells; i++ )
+	{
+		if ( s_PointGrid.m_pCells[i].leaf != POINTGRID_UNKNOWN )
+		{
+			nLeafCells++;
+			if ( s_PointGrid.m_pCells[i].contents != POINTGRID_UNKNOWN )
+			{
+				nContentsCells++;
+			}
+		}
+	}
+
+	Msg( "Point grid: %d x %d x %d cells of %.0f units, %d KB\n",
+		s_PointGrid.m_nCells[0], s_PointGrid.m_nCells[1], s_PointGrid.m_nCells[2], s_PointGrid.m_flCellSize,
+		(int)( ( nCells * sizeof( pointgridcell_t ) + s_PointGrid.m_Contents.Count() * sizeof( int ) ) / 1024 ) );
+	Msg( "   %.1f%% of cells in one leaf, %.1f%% with uniform contents, %d distinct contents\n",
+		100.0f * nLeafCells / nCells, 100.0f * nContentsCells / nCells, s_PointGrid.m_Contents.Count() );
+
+	int nQueries = ( args.ArgC() > 1 ) ? atoi( args[1] ) : 1000000;
+	nQueries = clamp( nQueries, 1000, 4000000 );
+
+	// Points in solid leaves are trivial for both, so only time the ones in
+	// leaves with a cluster, which is where game code asks
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	const cmodel_t &world = pBSPData->map_cmodels[0];
+	CUtlVector<Vector> points;
+	points.EnsureCapacity( nQueries );
+	for ( int nTries = 0; points.Count() < nQueries && nTries < nQueries * 100; nTries++ )
+	{
+		Vector p( random.RandomFloat( world.mins.x, world.maxs.x ), random.RandomFloat( world.mins.y, world.maxs.y ), random.RandomFloat( world.mins.z, world.maxs.z ) );
+		if ( pBSPData->map_leafs[ CM_PointLeafnum_r( pBSPData, p, 0 ) ].cluster >= 0 )
+		{
+			points.AddToTail( p );
+		}
+	}
+
+	if ( !points.Count() )
+		return;
+
+	unsigned int nTreeSum = 0;
+	CFastTimer treeTimer;
+	treeTimer.Start();
+	for ( int i = 0; i < points.Count(); i++ )
+	{
+		nTreeSum += CM_LeafPointContents( pBSPData, points[i], CM_PointLeafnum_r( pBSPData, points[i], 0 ) );
+	}
+	treeTimer.End();
+
+	unsigned int nGridSum = 0;
+	CFastTimer gridTimer;
+	gridTimer.Start();
+	for ( int i = 0; i < points.Count(); i++ )
+	{
+		nGridSum += CM_PointContents( points[i], 0, MASK_ALL );
+	}
+	gridTimer.End();
+
+	int nMismatches = 0;
+	int nGridAnswered = 0;
+	for ( int i = 0; i < points.Count(); i++ )
+	{
+		int nLeaf = CM_PointLeafnum_r( pBSPData, points[i], 0 );
+		int nGridLeaf, nGridContents;
+		if ( CM_PointGridContents( points[i], &nGridLeaf, &nGridContents ) )
+		{
+			nGridAnswered++;
+			if ( nGridContents != CM_LeafPointContents( pBSPData, points[i], nLeaf ) )
+			{
+				nMismatches++;
+			}
+		}
+		if ( nGridLeaf >= 0 && nGridLeaf != nLeaf )
+		{
+			nMismatches++;
+		}
+	}
+
+	double flTreeSeconds = treeTimer.GetDuration().GetSeconds();
+	double flGridSeconds = gridTimer.GetDuration().GetSeconds();
+	Msg( "   %d points in open leaves, %.1f%% answered from the grid\n", points.Count(), 100.0f * nGridAnswered / points.Count() );
+	Msg( "   %-12s %.2f M point contents/sec\n", "tree", flTreeSeconds > 0.0 ? points.Count() / flTreeSeconds / 1e6 : 0.0 );
+	Msg( "   %-12s %.2f M point contents/sec\n", "grid", flGridSeconds > 0.0 ? points.Count() / flGridSeconds / 1e6 : 0.0 );
+	if ( nMismatches || nTreeSum != nGridSum )
+	{
+		Warning( "   %d points answered differently by the grid and the tree!\n", nMismatches );
+	}
+}
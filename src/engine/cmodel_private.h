@@ -568,6 +568,17 @@ public:
 	}
 
 	bool IsEmpty() { return m_pEngineTrace == NULL ? true : false; }
+	bool IsStaticWorldOnly( IHandleEntity *pIgnore )
+	{
+		if ( IsEmpty() )
+			return false;
+		for ( int i = 0; i < m_entityList.Count(); i++ )
+		{
+			if ( m_entityList[i].pEntity != pIgnore )
+				return false;
+		}
+		return true;
+	}
 	// For entities...
 	IterationRetval_t EnumElement( IHandleEntity *pHandleEntity );
 	bool CanTraceRay( const Ray_t &ray );
@@ -615,6 +626,25 @@ void FASTCALL CM_TestBoxInBrush( TraceInfo_t *pTraceInfo, const cbrush_t *brush
 void FASTCALL CM_RecursiveHullCheck ( TraceInfo_t *pTraceInfo, int num, const float p1f, const float p2f );
 bool FASTCALL CM_RecursiveOcclusionPass( COcclusionInfo &oi, int num, const float p1f, const float p2f, const Vector& p1, const Vector& p2 );
 void CM_GetTraceDataForBSP( const Vector &mins, const Vector &maxs, CTraceListData &traceData );
+int CM_PointLeafnum_r( CCollisionBSPData *pBSPData, const Vector& p, int num );
+int CM_LeafPointContents( CCollisionBSPData *pBSPData, const Vector &p, int l );
+
+//=============================================================================
+//
+// World point grid (cmodel_pointgrid.cpp): a uniform grid over the world built
+// at map load, answering point leaf and contents queries without walking the
+// tree for cells that lie in a single leaf
+//
+
+void CM_BuildPointGrid( CCollisionBSPData *pBSPData );
+void CM_FreePointGrid();
+
+// Returns the world leaf p is in, or -1 if the grid can't tell
+int CM_PointGridLeafnum( const Vector &p );
+
+// Returns true with the world contents at p if no node or brush crosses its
+// cell. Otherwise *pLeaf is the leaf p is in, or -1 if the grid can't tell.
+bool CM_PointGridContents( const Vector &p, int *pLeaf, int *pContents );
 
 
 //=============================================================================
@@ -9,6 +9,7 @@
 #include "dt.h"
 #include "dt_encode.h"
 #include "coordsize.h"
+#include "vstdlib/random.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -1462,3 +1463,393 @@ PropTypeFns g_PropTypeFns[DPT_NUMSendPropTypes] =
 		Int64_SkipProp,
 	},
 };
+
+
+//-----------------------------------------------------------------------------
+// dt_bitbuf_bench times writing and reading back each of the bit encodings the
+// property encoders above use, and checks the values survive the trip.
+// dt_bitbuf_selfcheck checks bf_write still produces the same bytes as the
+// encoders it replaced.
+//-----------------------------------------------------------------------------
+#define BITBUF_BENCH_VALUES		4096
+#define BITBUF_BENCH_CELL_BITS	10
+
+enum BitBufBenchEncoding_t
+{
+	BITBUF_BENCH_UBITLONG = 0,
+	BITBUF_BENCH_SBITLONG,
+	BITBUF_BENCH_ONEBIT,
+	BITBUF_BENCH_UBITVAR,
+	BITBUF_BENCH_VARINT32,
+	BITBUF_BENCH_SIGNEDVARINT32,
+	BITBUF_BENCH_VARINT64,
+	BITBUF_BENCH_SIGNEDVARINT64,
+	BITBUF_BENCH_BITFLOAT,
+	BITBUF_BENCH_COORD,
+	BITBUF_BENCH_COORDMP,
+	BITBUF_BENCH_COORDMP_LOWPRECISION,
+	BITBUF_BENCH_COORDMP_INTEGRAL,
+	BITBUF_BENCH_CELLCOORD,
+	BITBUF_BENCH_CELLCOORD_LOWPRECISION,
+	BITBUF_BENCH_CELLCOORD_INTEGRAL,
+	BITBUF_BENCH_NORMAL,
+	BITBUF_BENCH_VEC3COORD,
+	BITBUF_BENCH_BITS,
+};
+
+struct BitBufBenchValues_t
+{
+	uint32 m_nUInt[BITBUF_BENCH_VALUES];
+	int32 m_nInt[BITBUF_BENCH_VALUES];
+	uint64 m_nUInt64[BITBUF_BENCH_VALUES];
+	float m_flCoord[BITBUF_BENCH_VALUES];
+	float m_flCellCoord[BITBUF_BENCH_VALUES];
+	float m_flNormal[BITBUF_BENCH_VALUES];
+	Vector m_vecCoord[BITBUF_BENCH_VALUES];
+};
+
+template< int ENCODING >
+static FORCEINLINE void BitBufBench_Write( bf_write &buf, const BitBufBenchValues_t &values, int i )
+{
+	switch ( ENCODING )
+	{
+	case BITBUF_BENCH_UBITLONG:				buf.WriteUBitLong( values.m_nUInt[i] & 0xfffff, 20 ); break;
+	case BITBUF_BENCH_SBITLONG:				buf.WriteSBitLong( values.m_nInt[i] >> 12, 20 ); break;
+	case BITBUF_BENCH_ONEBIT:				buf.WriteOneBit( values.m_nUInt[i] & 1 ); break;
+	case BITBUF_BENCH_UBITVAR:				buf.WriteUBitVar( values.m_nUInt[i] ); break;
+	case BITBUF_BENCH_VARINT32:				buf.WriteVarInt32( values.m_nUInt[i] ); break;
+	case BITBUF_BENCH_SIGNEDVARINT32:		buf.WriteSignedVarInt32( values.m_nInt[i] ); break;
+	case BITBUF_BENCH_VARINT64:				buf.WriteVarInt64( values.m_nUInt64[i] ); break;
+	case BITBUF_BENCH_SIGNEDVARINT64:		buf.WriteSignedVarInt64( (int64)values.m_nUInt64[i] ); break;
+	case BITBUF_BENCH_BITFLOAT:				buf.WriteBitFloat( values.m_flCoord[i] ); break;
+	case BITBUF_BENCH_COORD:				buf.WriteBitCoord( values.m_flCoord[i] ); break;
+	case BITBUF_BENCH_COORDMP:				buf.WriteBitCoordMP( values.m_flCoord[i], kCW_None ); break;
+	case BITBUF_BENCH_COORDMP_LOWPRECISION:	buf.WriteBitCoordMP( values.m_flCoord[i], kCW_LowPrecision ); break;
+	case BITBUF_BENCH_COORDMP_INTEGRAL:		buf.WriteBitCoordMP( values.m_flCoord[i], kCW_Integral ); break;
+	case BITBUF_BENCH_CELLCOORD:			buf.WriteBitCellCoord( values.m_flCellCoord[i], BITBUF_BENCH_CELL_BITS, kCW_None ); break;
+	case BITBUF_BENCH_CELLCOORD_LOWPRECISION:	buf.WriteBitCellCoord( values.m_flCellCoord[i], BITBUF_BENCH_CELL_BITS, kCW_LowPrecision ); break;
+	case BITBUF_BENCH_CELLCOORD_INTEGRAL:	buf.WriteBitCellCoord( values.m_flCellCoord[i], BITBUF_BENCH_CELL_BITS, kCW_Integral ); break;
+	case BITBUF_BENCH_NORMAL:				buf.WriteBitNormal( values.m_flNormal[i] ); break;
+	case BITBUF_BENCH_VEC3COORD:			buf.WriteBitVec3Coord( values.m_vecCoord[i] ); break;
+	case BITBUF_BENCH_BITS:					buf.WriteBits( &values.m_nUInt64[i], 61 ); break;
+	}
+}
+
+// The bit-at-a-time encoders bf_write used before it batched fields into 64-bit
+// words. Every byte the current encoders write has to match these.
+static void BitBufBench_OldVarInt64( bf_write &buf, uint64 data )
+{
+	while ( data > 0x7F )
+	{
+		buf.WriteUBitLong( (uint32)( data & 0x7F ) | 0x80, 8 );
+		data >>= 7;
+	}
+	buf.WriteUBitLong( (uint32)data & 0x7F, 8 );
+}
+
+static void BitBufBench_OldBitCoord( bf_write &buf, const float f )
+{
+	int		signbit = (f <= -COORD_RESOLUTION);
+	int		intval = (int)abs(f);
+	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
+
+	buf.WriteOneBit( intval );
+	buf.WriteOneBit( fractval );
+
+	if ( intval || fractval )
+	{
+		buf.WriteOneBit( signbit );
+		if ( intval )
+		{
+			intval--;
+			buf.WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
+		}
+		if ( fractval )
+		{
+			buf.WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
+		}
+	}
+}
+
+static void BitBufBench_OldBitCoordMP( bf_write &buf, const float f, EBitCoordType coordType )
+{
+	bool bIntegral = ( coordType == kCW_Integral );
+	bool bLowPrecision = ( coordType == kCW_LowPrecision );  
+
+	int		signbit = (f <= -( bLowPrecision ? COORD_RESOLUTION_LOWPRECISION : COORD_RESOLUTION ));
+	int		intval = (int)abs(f);
+	int		fractval = bLowPrecision ? 
+		( abs((int)(f*COORD_DENOMINATOR_LOWPRECISION)) & (COORD_DENOMINATOR_LOWPRECISION-1) ) :
+		( abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1) );
+
+	bool    bInBounds = intval < (1 << COORD_INTEGER_BITS_MP );
+
+	buf.WriteOneBit( bInBounds );
+	buf.WriteOneBit( intval );
+	if ( bIntegral )
+	{
+		if ( intval )
+		{
+			buf.WriteOneBit( signbit );
+			intval--;
+			buf.WriteUBitLong( (unsigned int)intval, bInBounds ? COORD_INTEGER_BITS_MP : COORD_INTEGER_BITS );
+		}
+	}
+	else
+	{
+		buf.WriteOneBit( signbit );
+		if ( intval )
+		{
+			intval--;
+			buf.WriteUBitLong( (unsigned int)intval, bInBounds ? COORD_INTEGER_BITS_MP : COORD_INTEGER_BITS );
+		}
+		buf.WriteUBitLong( (unsigned int)fractval, bLowPrecision ? COORD_FRACTIONAL_BITS_MP_LOWPRECISION : COORD_FRACTIONAL_BITS );
+	}
+}
+
+static void BitBufBench_OldBitNormal( bf_write &buf, float f )
+{
+	int	signbit = (f <= -NORMAL_RESOLUTION);
+	unsigned int fractval = abs( (int)(f*NORMAL_DENOMINATOR) );
+	if (fractval > NORMAL_DENOMINATOR)
+		fractval = NORMAL_DENOMINATOR;
+
+	buf.WriteOneBit( signbit );
+	buf.WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+}
+
+static void BitBufBench_OldBitVec3Coord( bf_write &buf, const Vector& fa )
+{
+	int		xflag, yflag, zflag;
+
+	xflag = (fa[0] >= COORD_RESOLUTION) || (fa[0] <= -COORD_RESOLUTION);
+	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
+	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
+
+	buf.WriteOneBit( xflag );
+	buf.WriteOneBit( yflag );
+	buf.WriteOneBit( zflag );
+
+	if ( xflag )
+		BitBufBench_OldBitCoord( buf, fa[0] );
+	if ( yflag )
+		BitBufBench_OldBitCoord( buf, fa[1] );
+	if ( zflag )
+		BitBufBench_OldBitCoord( buf, fa[2] );
+}
+
+// Encodings that weren't touched go through bf_write on both sides
+template< int ENCODING >
+static FORCEINLINE void BitBufBench_WriteOld( bf_write &buf, const BitBufBenchValues_t &values, int i )
+{
+	switch ( ENCODING )
+	{
+	case BITBUF_BENCH_VARINT32:				BitBufBench_OldVarInt64( buf, values.m_nUInt[i] ); break;
+	case BITBUF_BENCH_SIGNEDVARINT32:		BitBufBench_OldVarInt64( buf, bitbuf::ZigZagEncode32( values.m_nInt[i] ) ); break;
+	case BITBUF_BENCH_VARINT64:				BitBufBench_OldVarInt64( buf, values.m_nUInt64[i] ); break;
+	case BITBUF_BENCH_SIGNEDVARINT64:		BitBufBench_OldVarInt64( buf, bitbuf::ZigZagEncode64( (int64)values.m_nUInt64[i] ) ); break;
+	case BITBUF_BENCH_COORD:				BitBufBench_OldBitCoord( buf, values.m_flCoord[i] ); break;
+	case BITBUF_BENCH_COORDMP:				BitBufBench_OldBitCoordMP( buf, values.m_flCoord[i], kCW_None ); break;
+	case BITBUF_BENCH_COORDMP_LOWPRECISION:	BitBufBench_OldBitCoordMP( buf, values.m_flCoord[i], kCW_LowPrecision ); break;
+	case BITBUF_BENCH_COORDMP_INTEGRAL:		BitBufBench_OldBitCoordMP( buf, values.m_flCoord[i], kCW_Integral ); break;
+	case BITBUF_BENCH_NORMAL:				BitBufBench_OldBitNormal( buf, values.m_flNormal[i] ); break;
+	case BITBUF_BENCH_VEC3COORD:			BitBufBench_OldBitVec3Coord( buf, values.m_vecCoord[i] ); break;
+	default:								BitBufBench_Write< ENCODING >( buf, values, i ); break;
+	}
+}
+
+// Returns false if the value didn't come back, floats are allowed the encoding's resolution
+template< int ENCODING >
+static FORCEINLINE bool BitBufBench_Read( bf_read &buf, const BitBufBenchValues_t &values, int i )
+{
+	switch ( ENCODING )
+	{
+	case BITBUF_BENCH_UBITLONG:				return buf.ReadUBitLong( 20 ) == ( values.m_nUInt[i] & 0xfffff );
+	case BITBUF_BENCH_SBITLONG:				return buf.ReadSBitLong( 20 ) == ( values.m_nInt[i] >> 12 );
+	case BITBUF_BENCH_ONEBIT:				return buf.ReadOneBit() == (int)( values.m_nUInt[i] & 1 );
+	case BITBUF_BENCH_UBITVAR:				return buf.ReadUBitVar() == values.m_nUInt[i];
+	case BITBUF_BENCH_VARINT32:				return buf.ReadVarInt32() == values.m_nUInt[i];
+	case BITBUF_BENCH_SIGNEDVARINT32:		return buf.ReadSignedVarInt32() == values.m_nInt[i];
+	case BITBUF_BENCH_VARINT64:				return buf.ReadVarInt64() == values.m_nUInt64[i];
+	case BITBUF_BENCH_SIGNEDVARINT64:		return buf.ReadSignedVarInt64() == (int64)values.m_nUInt64[i];
+	case BITBUF_BENCH_BITFLOAT:				return buf.ReadBitFloat() == values.m_flCoord[i];
+	case BITBUF_BENCH_COORD:				return fabs( buf.ReadBitCoord() - values.m_flCoord[i] ) <= COORD_RESOLUTION;
+	case BITBUF_BENCH_COORDMP:				return fabs( buf.ReadBitCoordMP( kCW_None ) - values.m_flCoord[i] ) <= COORD_RESOLUTION;
+	case BITBUF_BENCH_COORDMP_LOWPRECISION:	return fabs( buf.ReadBitCoordMP( kCW_LowPrecision ) - values.m_flCoord[i] ) <= COORD_RESOLUTION_LOWPRECISION;
+	case BITBUF_BENCH_COORDMP_INTEGRAL:		return fabs( buf.ReadBitCoordMP( kCW_Integral ) - values.m_flCoord[i] ) <= 1.0f;
+	case BITBUF_BENCH_CELLCOORD:			return fabs( buf.ReadBitCellCoord( BITBUF_BENCH_CELL_BITS, kCW_None ) - values.m_flCellCoord[i] ) <= COORD_RESOLUTION;
+	case BITBUF_BENCH_CELLCOORD_LOWPRECISION:	return fabs( buf.ReadBitCellCoord( BITBUF_BENCH_CELL_BITS, kCW_LowPrecision ) - values.m_flCellCoord[i] ) <= COORD_RESOLUTION_LOWPRECISION;
+	case BITBUF_BENCH_CELLCOORD_INTEGRAL:	return fabs( buf.ReadBitCellCoord( BITBUF_BENCH_CELL_BITS, kCW_Integral ) - values.m_flCellCoord[i] ) <= 1.0f;
+	case BITBUF_BENCH_NORMAL:				return fabs( buf.ReadBitNormal() - values.m_flNormal[i] ) <= NORMAL_RESOLUTION;
+	case BITBUF_BENCH_VEC3COORD:
+		{
+			Vector vecCoord;
+			buf.ReadBitVec3Coord( vecCoord );
+			return fabs( vecCoord.x - values.m_vecCoord[i].x ) <= COORD_RESOLUTION &&
+				fabs( vecCoord.y - values.m_vecCoord[i].y ) <= COORD_RESOLUTION &&
+				fabs( vecCoord.z - values.m_vecCoord[i].z ) <= COORD_RESOLUTION;
+		}
+	case BITBUF_BENCH_BITS:
+		{
+			uint64 nBits = 0;
+			buf.ReadBits( &nBits, 61 );
+			return nBits == ( values.m_nUInt64[i] & ( ( 1ull << 61 ) - 1 ) );
+		}
+	}
+	return false;
+}
+
+template< int ENCODING >
+static void BitBufBench_Run( const char *pName, const BitBufBenchValues_t &values, uint32 *pBuffer, int nBufferBytes, int nIterations )
+{
+	int nBits = 0;
+
+	double flStart = Plat_FloatTime();
+	for ( int nIteration = 0; nIteration < nIterations; ++nIteration )
+	{
+		bf_write buf( "dt_bitbuf_bench", pBuffer, nBufferBytes );
+		for ( int i = 0; i < BITBUF_BENCH_VALUES; ++i )
+		{
+			BitBufBench_Write< ENCODING >( buf, values, i );
+		}
+		nBits = buf.GetNumBitsWritten();
+	}
+	double flWrite = Plat_FloatTime() - flStart;
+
+	int nMismatches = 0;
+	flStart = Plat_FloatTime();
+	for ( int nIteration = 0; nIteration < nIterations; ++nIteration )
+	{
+		bf_read buf( "dt_bitbuf_bench", pBuffer, nBufferBytes, nBits );
+		for ( int i = 0; i < BITBUF_BENCH_VALUES; ++i )
+		{
+			nMismatches += !BitBufBench_Read< ENCODING >( buf, values, i );
+		}
+	}
+	double flRead = Plat_FloatTime() - flStart;
+
+	double flScale = 1e9 / ( (double)nIterations * BITBUF_BENCH_VALUES );
+	Msg( "   %-28s write %6.2f ns  read %6.2f ns  %5.1f bits/value%s\n", pName, flWrite * flScale, flRead * flScale,
+		(float)nBits / BITBUF_BENCH_VALUES, nMismatches ? "  MISMATCHED" : "" );
+}
+
+// Writes every value with the current encoder and with the old one, after each
+// number of leading bits from 0 to 31 and into buffers full of stale bits, and
+// compares the bytes. Returns false if they differ anywhere.
+template< int ENCODING >
+static bool BitBufBench_SelfCheck( const char *pName, const BitBufBenchValues_t &values, uint32 *pBuffer, uint32 *pOldBuffer, int nBufferBytes )
+{
+	for ( int nLeadingBits = 0; nLeadingBits < 32; ++nLeadingBits )
+	{
+		int nStale = ( nLeadingBits & 1 ) ? 0xff : 0x00;
+		V_memset( pBuffer, nStale, nBufferBytes );
+		V_memset( pOldBuffer, nStale, nBufferBytes );
+		bf_write newBuf( "dt_bitbuf_selfcheck", pBuffer, nBufferBytes );
+		bf_write oldBuf( "dt_bitbuf_selfcheck", pOldBuffer, nBufferBytes );
+		newBuf.WriteUBitLong( 0, nLeadingBits );
+		oldBuf.WriteUBitLong( 0, nLeadingBits );
+		for ( int i = 0; i < BITBUF_BENCH_VALUES; ++i )
+		{
+			BitBufBench_Write< ENCODING >( newBuf, values, i );
+			BitBufBench_WriteOld< ENCODING >( oldBuf, values, i );
+		}
+
+		if ( newBuf.IsOverflowed() || oldBuf.IsOverflowed() || newBuf.GetNumBitsWritten() != oldBuf.GetNumBitsWritten() ||
+			V_memcmp( pBuffer, pOldBuffer, newBuf.GetNumBytesWritten() ) != 0 )
+		{
+			Msg( "   %-28s DIFFERS FROM OLD ENCODER after %d leading bits\n", pName, nLeadingBits );
+			return false;
+		}
+	}
+
+	Msg( "   %-28s ok\n", pName );
+	return true;
+}
+
+// Varints get a spread of lengths, the way entity indices, counts and ticks do.
+// Coords run a little past MAX_COORD_INTEGER so the out of range encodings are
+// covered too.
+static void BitBufBench_InitValues( BitBufBenchValues_t *pValues, float flMaxCoord )
+{
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	for ( int i = 0; i < BITBUF_BENCH_VALUES; ++i )
+	{
+		uint32 nRandom = ( (uint32)random.RandomInt( 0, 0xffff ) << 16 ) | (uint32)random.RandomInt( 0, 0xffff );
+		pValues->m_nUInt[i] = nRandom >> random.RandomInt( 0, 31 );
+		pValues->m_nInt[i] = (int32)nRandom >> random.RandomInt( 0, 31 );
+		pValues->m_nUInt64[i] = ( ( (uint64)nRandom << 32 ) | (uint32)random.RandomInt( 0, 0x7fffffff ) ) >> random.RandomInt( 0, 63 );
+		pValues->m_flCoord[i] = random.RandomFloat( -flMaxCoord, flMaxCoord );
+		pValues->m_flCellCoord[i] = random.RandomFloat( 0.0f, (float)( 1 << BITBUF_BENCH_CELL_BITS ) - 1.0f );
+		pValues->m_flNormal[i] = random.RandomFloat( -1.0f, 1.0f );
+		pValues->m_vecCoord[i].Init( random.RandomFloat( -flMaxCoord, flMaxCoord ), random.RandomFloat( -flMaxCoord, flMaxCoord ), random.RandomInt( 0, 3 ) ? random.RandomFloat( -256.0f, 256.0f ) : 0.0f );
+	}
+}
+
+// Enough room for the widest encoding, a 10 byte VarInt64
+static int BitBufBench_BufferBytes()
+{
+	int nBufferBytes = BITBUF_BENCH_VALUES * bitbuf::kMaxVarintBytes + 16;
+	return ( nBufferBytes + 3 ) & ~3;
+}
+
+CON_COMMAND( dt_bitbuf_bench, "Times writing and reading back the bit encodings used by the property encoders. Arguments: [iterations]" )
+{
+	int nIterations = MAX( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 200, 1 );
+
+	BitBufBenchValues_t *pValues = new BitBufBenchValues_t;
+	BitBufBench_InitValues( pValues, 4096.0f );
+	int nBufferBytes = BitBufBench_BufferBytes();
+	uint32 *pBuffer = new uint32[nBufferBytes / 4];
+
+	Msg( "dt_bitbuf_bench: %d values x %d iterations\n", BITBUF_BENCH_VALUES, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_UBITLONG >( "UBitLong( 20 )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_SBITLONG >( "SBitLong( 20 )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_ONEBIT >( "OneBit", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_UBITVAR >( "UBitVar", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_VARINT32 >( "VarInt32", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_SIGNEDVARINT32 >( "SignedVarInt32", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_VARINT64 >( "VarInt64", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_SIGNEDVARINT64 >( "SignedVarInt64", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_BITFLOAT >( "BitFloat", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_COORD >( "BitCoord", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_COORDMP >( "BitCoordMP", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_COORDMP_LOWPRECISION >( "BitCoordMP( LowPrecision )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_COORDMP_INTEGRAL >( "BitCoordMP( Integral )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_CELLCOORD >( "BitCellCoord", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_CELLCOORD_LOWPRECISION >( "BitCellCoord( LowPrecision )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_CELLCOORD_INTEGRAL >( "BitCellCoord( Integral )", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_NORMAL >( "BitNormal", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_VEC3COORD >( "BitVec3Coord", *pValues, pBuffer, nBufferBytes, nIterations );
+	BitBufBench_Run< BITBUF_BENCH_BITS >( "Bits( 61 )", *pValues, pBuffer, nBufferBytes, nIterations );
+
+	delete [] pBuffer;
+	delete pValues;
+}
+
+CON_COMMAND( dt_bitbuf_selfcheck, "Checks that bf_write writes the same bytes as the bit-at-a-time encoders it replaced, for every encoding the property encoders use" )
+{
+	BitBufBenchValues_t *pValues = new BitBufBenchValues_t;
+	BitBufBench_InitValues( pValues, MAX_COORD_INTEGER + 1024.0f );
+	int nBufferBytes = BitBufBench_BufferBytes();
+	uint32 *pBuffer = new uint32[nBufferBytes / 4];
+	uint32 *pOldBuffer = new uint32[nBufferBytes / 4];
+
+	Msg( "dt_bitbuf_selfcheck: %d values at 32 bit offsets\n", BITBUF_BENCH_VALUES );
+	bool bOk = true;
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_VARINT32 >( "VarInt32", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_SIGNEDVARINT32 >( "SignedVarInt32", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_VARINT64 >( "VarInt64", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_SIGNEDVARINT64 >( "SignedVarInt64", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_COORD >( "BitCoord", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_COORDMP >( "BitCoordMP", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_COORDMP_LOWPRECISION >( "BitCoordMP( LowPrecision )", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_COORDMP_INTEGRAL >( "BitCoordMP( Integral )", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_NORMAL >( "BitNormal", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	bOk &= BitBufBench_SelfCheck< BITBUF_BENCH_VEC3COORD >( "BitVec3Coord", *pValues, pBuffer, pOldBuffer, nBufferBytes );
+	Msg( "dt_bitbuf_selfcheck: %s\n", bOk ? "passed" : "FAILED" );
+
+	delete [] pOldBuffer;
+	delete [] pBuffer;
+	delete pValues;
+}
@@ -130,18 +130,28 @@ private:
 class CReferencedSnapshotList
 {
 public:
+	CReferencedSnapshotList() : m_pSnapshots( NULL ), m_nSnapshots( 0 ) {}
 	~CReferencedSnapshotList()
 	{
-		for ( int i = 0; i < m_vecSnapshots.Count(); ++i )
+		for ( int i = 0; i < m_nSnapshots; ++i )
 		{
-			m_vecSnapshots[ i ]->ReleaseReference();
+			m_pSnapshots[ i ]->ReleaseReference();
 		}
-		m_vecSnapshots.RemoveAll();
 	}
 
-	CUtlVector< CFrameSnapshot * > m_vecSnapshots;
+	int				Count() const					{ return m_nSnapshots; }
+	CFrameSnapshot	*operator[]( int i ) const		{ Assert( i >= 0 && i < m_nSnapshots ); return m_pSnapshots[ i ]; }
+
+private:
+	friend class CFrameSnapshotManager;
+
+	// Tick scratch memory, see CFrameSnapshotManager::AllocTickScratch
+	CFrameSnapshot	**m_pSnapshots;
+	int				m_nSnapshots;
 };
 
+struct FrameArena_t;
+
 //-----------------------------------------------------------------------------
 // Purpose: snapshot manager class
 //-----------------------------------------------------------------------------
@@ -206,8 +216,19 @@ public:
 
 	void			BuildSnapshotList( CFrameSnapshot *pCurrentSnapshot, CFrameSnapshot *pLastSnapshot, uint32 nSnapshotSet, CReferencedSnapshotList &list );
 
+	// Scratch memory for the calling thread that stays valid until the end of the next
+	// tick and is then released in bulk. Callers never free it. Each thread bump allocates
+	// out of one of two buffers and switches to the other one on its first allocation in
+	// a new tick. Thread safe.
+	void			*AllocTickScratch( size_t nBytes );
+
+	void			PrintTickScratchStats( bool bReset );
+
 private:
 	void					DeleteFrameSnapshot( CFrameSnapshot* pSnapshot );
+
+	FrameArena_t			*GetThreadFrameArena();
+	void					ReleaseFrameArenas();
 	// Non-threadsafe call, used with BuildSnapshotList which acquires the mutex
 	CFrameSnapshot			*NextSnapshot( CFrameSnapshot *pSnapshot );
 
@@ -228,6 +249,11 @@ private:
 	CThreadFastMutex		m_WriteMutex;
 
 	CUtlVector<int>			m_iExplicitDeleteSlots;
+
+	// Every thread that asked for tick scratch memory since the last ReleaseFrameArenas
+	FrameArena_t * volatile	m_pFrameArenas;
+	int						m_nFrameArenaGeneration;
+	int						m_nTickScratchStatsStart;	// host_tickcount the stats were last reset at
 };
 
 PackedEntity* CFrameSnapshotManager::GetPackedEntity( CFrameSnapshot& Snapshot, int entity )
@@ -50,6 +50,7 @@
 #include "dbginput.h"
 #include "filesystem.h"
 #include "tier0/microprofiler.h"
+#include "tier0/vprof_trace.h"
 
 #include "checksum_sha1.h"
 
@@ -456,6 +457,221 @@ CON_COMMAND( mem_eat, "" )
 	MemAlloc_Alloc( 1024*1024 );
 }
 
+#define MEM_THREADBENCH_MIX_FILE	"mem_threadbench_mix.txt"
+
+struct MemThreadBenchSize_t
+{
+	int m_nSize;
+	int m_nWeight;
+};
+
+// Hand-written guess at a server tick's allocation sizes, only used when no
+// mix recorded by mem_threadbench_record is available
+static const MemThreadBenchSize_t s_MemThreadBenchDefaultSizes[] =
+{
+	{ 16, 20 }, { 24, 12 }, { 32, 16 }, { 48, 10 }, { 64, 10 }, { 96, 6 }, { 128, 6 },
+	{ 192, 4 }, { 256, 4 }, { 384, 3 }, { 512, 3 }, { 768, 2 }, { 1024, 2 }, { 2048, 1 }, { 4096, 1 },
+};
+
+static int s_nMemThreadBenchRecordTicks = 0;
+static char s_szMemThreadBenchRecordFile[MAX_PATH];
+
+CON_COMMAND( mem_threadbench_record, "Records the sizes of the heap allocations made over the next few ticks, for mem_threadbench to replay. Arguments: [ticks] [file]" )
+{
+	if ( s_nMemThreadBenchRecordTicks > 0 )
+	{
+		Msg( "mem_threadbench_record: already recording, %d ticks left\n", s_nMemThreadBenchRecordTicks );
+		return;
+	}
+
+	s_nMemThreadBenchRecordTicks = MAX( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 300, 1 );
+	V_strncpy( s_szMemThreadBenchRecordFile, ( args.ArgC() > 2 ) ? args[2] : MEM_THREADBENCH_MIX_FILE, sizeof( s_szMemThreadBenchRecordFile ) );
+	MemAlloc_StartSizeHistogram();
+	Msg( "mem_threadbench_record: recording %d ticks to %s\n", s_nMemThreadBenchRecordTicks, s_szMemThreadBenchRecordFile );
+}
+
+// Called once per server tick, writes the mix out when the recording runs out of ticks
+static void MemThreadBench_Tick()
+{
+	if ( s_nMemThreadBenchRecordTicks <= 0 || --s_nMemThreadBenchRecordTicks > 0 )
+		return;
+
+	uint32 nCounts[MEMALLOC_SIZE_HISTOGRAM_BUCKETS];
+	uint64 nLargeBytes;
+	MemAlloc_StopSizeHistogram( nCounts, &nLargeBytes );
+
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	buf.Printf( "// Allocation sizes recorded by mem_threadbench_record: <size> <count>\n" );
+	uint64 nTotal = 0;
+	for ( int i = 0; i < MEMALLOC_SIZE_HISTOGRAM_BUCKETS; ++i )
+	{
+		if ( !nCounts[i] )
+			continue;
+
+		// Blocks over 4K share the last bucket, replay them at their average size
+		int nSize = ( i < MEMALLOC_SIZE_HISTOGRAM_BUCKETS - 1 ) ? ( i + 1 ) * MEMALLOC_SIZE_HISTOGRAM_STEP : (int)( nLargeBytes / nCounts[i] );
+		buf.Printf( "%d %u\n", nSize, nCounts[i] );
+		nTotal += nCounts[i];
+	}
+
+	if ( !nTotal )
+	{
+		Msg( "mem_threadbench_record: no allocations were recorded (the debug heap doesn't record them)\n" );
+		return;
+	}
+
+	if ( !g_pFileSystem->WriteFile( s_szMemThreadBenchRecordFile, "MOD", buf ) )
+	{
+		Warning( "mem_threadbench_record: couldn't write %s\n", s_szMemThreadBenchRecordFile );
+		return;
+	}
+	Msg( "mem_threadbench_record: wrote %llu allocations to %s\n", nTotal, s_szMemThreadBenchRecordFile );
+}
+
+// Loads a mix written by mem_threadbench_record, scaling the counts down so the weights fit RandomInt
+static bool LoadMemThreadBenchSizes( const char *pFileName, CUtlVector< MemThreadBenchSize_t > &sizes )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !g_pFileSystem->ReadFile( pFileName, "MOD", buf ) )
+		return false;
+
+	CUtlVector< uint64 > counts;
+	uint64 nTotal = 0;
+	char szLine[256];
+	while ( buf.IsValid() && buf.GetBytesRemaining() > 0 )
+	{
+		buf.GetLine( szLine, sizeof( szLine ) );
+		int nSize;
+		uint64 nCount;
+		if ( szLine[0] == '/' || sscanf( szLine, "%d %llu", &nSize, &nCount ) != 2 || nSize <= 0 || !nCount )
+			continue;
+
+		MemThreadBenchSize_t &size = sizes[ sizes.AddToTail() ];
+		size.m_nSize = nSize;
+		counts.AddToTail( nCount );
+		nTotal += nCount;
+	}
+
+	for ( int i = 0; i < sizes.Count(); ++i )
+	{
+		sizes[i].m_nWeight = MAX( (int)( counts[i] * ( 1 << 20 ) / nTotal ), 1 );
+	}
+	return sizes.Count() > 0;
+}
+
+#define MEM_THREADBENCH_LIVE_BLOCKS	1024
+
+struct MemThreadBenchThread_t
+{
+	int			m_nIterations;
+	int			m_nSeed;
+	double		m_flTime;
+	const MemThreadBenchSize_t *m_pSizes;
+	int			m_nSizes;
+	void		*m_pLive[MEM_THREADBENCH_LIVE_BLOCKS];
+};
+
+static uintp MemThreadBenchThread( void *pParam )
+{
+	MemThreadBenchThread_t *pInfo = (MemThreadBenchThread_t *)pParam;
+	const MemThreadBenchSize_t *pSizes = pInfo->m_pSizes;
+
+	int nTotalWeight = 0;
+	for ( int i = 0; i < pInfo->m_nSizes; ++i )
+	{
+		nTotalWeight += pSizes[i].m_nWeight;
+	}
+
+	CUniformRandomStream random;
+	random.SetSeed( pInfo->m_nSeed );
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < pInfo->m_nIterations; ++i )
+	{
+		// Replace a random block of the live set, so blocks are freed in a different order than they were allocated
+		int iSlot = random.RandomInt( 0, MEM_THREADBENCH_LIVE_BLOCKS - 1 );
+		if ( pInfo->m_pLive[iSlot] )
+		{
+			MemAlloc_Free( pInfo->m_pLive[iSlot] );
+		}
+
+		int nWeight = random.RandomInt( 0, nTotalWeight - 1 );
+		int iSize = 0;
+		while ( nWeight >= pSizes[iSize].m_nWeight )
+		{
+			nWeight -= pSizes[iSize++].m_nWeight;
+		}
+		pInfo->m_pLive[iSlot] = MemAlloc_Alloc( pSizes[iSize].m_nSize );
+	}
+	pInfo->m_flTime = Plat_FloatTime() - flStart;
+	return 0;
+}
+
+// The small block heap's per-thread cache (SBH_THREAD_CACHE) is only built into the
+// Windows tier0 DLL, so on other platforms -nosbhthreadcache changes nothing
+CON_COMMAND( mem_threadbench, "Allocates and frees the block sizes recorded by mem_threadbench_record on several threads. Compare against a run with -nosbhthreadcache (Windows only). Arguments: [threads] [iterations] [mix file]" )
+{
+	int nThreads = clamp( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 4, 1, MAX_THREADS_SUPPORTED - 2 );
+	int nIterations = MAX( ( args.ArgC() > 2 ) ? atoi( args[2] ) : 1000000, 1 );
+	const char *pMixFile = ( args.ArgC() > 3 ) ? args[3] : MEM_THREADBENCH_MIX_FILE;
+
+	CUtlVector< MemThreadBenchSize_t > sizes;
+	if ( LoadMemThreadBenchSizes( pMixFile, sizes ) )
+	{
+		Msg( "mem_threadbench: using the %d sizes recorded in %s\n", sizes.Count(), pMixFile );
+	}
+	else
+	{
+		Msg( "mem_threadbench: no %s, using the built-in guess (run mem_threadbench_record on a live server first)\n", pMixFile );
+		sizes.CopyArray( s_MemThreadBenchDefaultSizes, ARRAYSIZE( s_MemThreadBenchDefaultSizes ) );
+	}
+
+	MemThreadBenchThread_t *pInfo = new MemThreadBenchThread_t[nThreads];
+	ThreadHandle_t hThreads[MAX_THREADS_SUPPORTED];
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		V_memset( &pInfo[i], 0, sizeof( pInfo[i] ) );
+		pInfo[i].m_nIterations = nIterations;
+		pInfo[i].m_nSeed = i + 1;
+		pInfo[i].m_pSizes = sizes.Base();
+		pInfo[i].m_nSizes = sizes.Count();
+		hThreads[i] = CreateSimpleThread( MemThreadBenchThread, &pInfo[i] );
+	}
+
+	double flSlowest = 0.0;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+		flSlowest = MAX( flSlowest, pInfo[i].m_flTime );
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	// What the workers left behind is freed here, the way the main thread frees blocks a job allocated
+	double flFreeStart = Plat_FloatTime();
+	int nLeftover = 0;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		for ( int j = 0; j < MEM_THREADBENCH_LIVE_BLOCKS; ++j )
+		{
+			if ( pInfo[i].m_pLive[j] )
+			{
+				MemAlloc_Free( pInfo[i].m_pLive[j] );
+				nLeftover++;
+			}
+		}
+	}
+	double flFree = Plat_FloatTime() - flFreeStart;
+	delete [] pInfo;
+
+	double flOps = 2.0 * nThreads * nIterations;
+	Msg( "mem_threadbench: %d threads x %d iterations, %.1f ms total\n", nThreads, nIterations, flElapsed * 1000.0 );
+	Msg( "   alloc+free (slowest thread) : %.1f ms, %.2f M ops/sec\n", flSlowest * 1000.0, flSlowest > 0.0 ? ( flOps / flSlowest ) * 1e-6 : 0.0 );
+	Msg( "   cross-thread frees          : %d blocks in %.2f ms\n", nLeftover, flFree * 1000.0 );
+}
+
 ConVar mem_incremental_compact_rate( "mem_incremental_compact_rate", ".5", FCVAR_CHEAT, "Rate at which to attempt internal heap compation" );
 
 static bool MemTest()
@@ -576,6 +792,29 @@ ConVar telemetry_demoend( "telemetry_demoend", "0", 0, "When playing demo, stop
 
 #endif
 
+CON_COMMAND( trace_capture, "Record every TM_ZONE/SNPROF/VPROF zone on all threads for N ticks and write them as a Chrome trace (chrome://tracing, ui.perfetto.dev). Only code built with VPROF_TRACE_ENABLED records zones. Usage: trace_capture <ticks> [file]" )
+{
+	if ( args.ArgC() < 2 )
+	{
+		ConMsg( "Usage: trace_capture <ticks> [file]\n" );
+		return;
+	}
+
+	int nTicks = atoi( args[1] );
+	if ( nTicks <= 0 )
+	{
+		ConMsg( "trace_capture: tick count must be positive\n" );
+		return;
+	}
+
+	char szFileName[MAX_OSPATH];
+	Q_snprintf( szFileName, sizeof( szFileName ), "%s/%s", com_gamedir, ( args.ArgC() > 2 ) ? args[2] : "trace_capture.json" );
+	Q_FixSlashes( szFileName );
+
+	ConMsg( "trace_capture: recording %d ticks to %s\n", nTicks, szFileName );
+	VProfTrace_StartCapture( nTicks, szFileName );
+}
+
 static unsigned g_MainThreadId = ThreadGetCurrentId();
 
 extern bool gfBackground;
@@ -4050,6 +4289,8 @@ void _Host_RunFrame (float time)
 			{ 
 				// Emit an ETW event every simulation frame.
 				ETWSimFrameMark( sv.IsDedicated() );
+				VProfTrace_Tick();
+				MemThreadBench_Tick();
 
 				double now = Plat_FloatTime();
 				float jitter = now - host_idealtime;
@@ -4314,6 +4555,9 @@ void _Host_RunFrame (float time)
 
 			for ( int tick = 0; tick < serverticks; tick++ )
 			{
+				VProfTrace_Tick();
+				MemThreadBench_Tick();
+
 				// NOTE:  Do we want do this at start or end of this loop?
 				++host_tickcount;
 				++host_currentframetick;
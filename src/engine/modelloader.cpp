@@ -4243,6 +4243,9 @@ model_t	*CModelLoader::LoadModel( model_t *mod, REFERENCETYPE *pReferencetype )
 
 			NotifyHunkBeginMapLoad( m_szBaseName );
 
+			// prewarm the models this map used last time it was loaded
+			g_pMDLCache->BeginMapResidency( m_szBaseName );
+
 			bool bQueuedLoader = false;
 			if ( IsGameConsole() )
 			{
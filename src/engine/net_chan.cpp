@@ -18,6 +18,7 @@
 #include "replay.h"
 #include "datacache/imdlcache.h"
 #include "tier0/vprof.h"
+#include "tier1/delegates.h"
 #if defined( _X360 )
 #include "xbox/xbox_console.h"
 #endif
@@ -55,6 +56,10 @@ static ConVar net_compresspackets_minsize( "net_compresspackets_minsize", "1000"
 static ConVar net_maxcleartime( "net_maxcleartime", "4.0", 0, "Max # of seconds we can wait for next packets to be sent based on rate setting (0 == no limit)." );
 static ConVar net_droponsendoverflow( "net_droponsendoverflow", "0", FCVAR_RELEASE, "If enabled, channel will drop client when sending too much data causes buffer overrun" );
 
+// Advertised to the server in the userinfo, the windowed stream is only used if both sides want it
+ConVar net_reliablewindow( "net_reliablewindow", "1", FCVAR_RELEASE | FCVAR_USERINFO, "Send reliable data through a selectively acknowledged window instead of 8 subchannels" );
+static ConVar net_reliablewindow_burst( "net_reliablewindow_burst", "8", 0, "Max packets per tick a windowed channel sends while it has reliable data and bandwidth left", true, 1, true, NET_RELIABLE_WINDOW );
+
 extern ConVar net_maxroutable;
 
 extern int  NET_ConnectSocket( int nSock, const netadr_t &addr );
@@ -411,6 +416,23 @@ void CNetChan::Clear()
 		}
 	}
 
+	for ( i=0; i<NET_RELIABLE_WINDOW; i++ )
+	{
+		if ( m_WindowSlots[i].state == SUBCHANNEL_TOSEND )
+		{
+			m_WindowSlots[i].Free();
+		}
+		else if ( m_WindowSlots[i].state == SUBCHANNEL_WAITING )
+		{
+			m_WindowSlots[i].state = SUBCHANNEL_DIRTY;
+		}
+	}
+
+	for ( i=0; i<MAX_STREAMS; i++ )
+	{
+		m_WindowRecvFragments[i].RemoveAll();
+	}
+
 	m_bStopProcessing = true;
 
 	Reset();
@@ -820,6 +842,8 @@ CNetChan::CNetChan() : m_SplitPlayers( 0, 0, SplitPlayer_t::Less )
 
 	m_bWasLastMessageReliable = false;
 
+	SetReliableWindow( false );
+
 	FlowReset();
 }
 
@@ -895,6 +919,9 @@ void CNetChan::Setup( int sock, const ns_address &adr, const char * name, INetCh
 		m_SubChannels[i].index = i; // set index once
 		m_SubChannels[i].Free();
 	}
+
+	// the windowed stream is negotiated during connect and switched on after Setup
+	SetReliableWindow( false );
 	
 	ResetStreaming();
 
@@ -1337,7 +1364,20 @@ bool CNetChan::Transmit(bool onlyReliable )
 	if ( onlyReliable )
 		m_StreamUnreliable.Reset();
 
-	return (SendDatagram( NULL ) != 0);
+	if ( SendDatagram( NULL ) == 0 )
+		return false;
+
+	// a windowed channel uses the bandwidth left this tick to get more reliable data out
+	if ( m_bReliableWindow )
+	{
+		for ( int i = 1; i < net_reliablewindow_burst.GetInt() && HasWindowDataToSend() && CanSendWindowBurst(); i++ )
+		{
+			if ( SendDatagram( NULL ) == 0 )
+				break;
+		}
+	}
+
+	return true;
 }
 
 bool CNetChan::IsFileInWaitingList( const char *filename )
@@ -1379,6 +1419,9 @@ void CNetChan::RemoveHeadInWaitingList( int nList )
 	m_WaitingList[nList].FindAndRemove( data );	// remove from list
 
 	delete data;	//free structure itself
+
+	// the next head is a new transfer for the windowed stream
+	m_nWindowSendTransfer[nList]++;
 }
 
 
@@ -1907,6 +1950,421 @@ void CNetChan::UpdateSubChannels()
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Windowed reliable stream
+//
+// Instead of 8 subchannels that are acked by flipping a bit each, every packet
+// with reliable data is acked individually: the header carries a mask of which
+// of the last 32 received packets had their reliable data accepted. Up to 32
+// packets of reliable data can be in flight, only the ones that got lost are
+// sent again, and every range carries enough of the transfer header to be
+// stored no matter in which order the ranges arrive.
+//-----------------------------------------------------------------------------
+void CNetChan::SetReliableWindow( bool bEnabled )
+{
+	m_bReliableWindow = bEnabled;
+	m_bReliableAckPending = false;
+	m_nInReliableMask = 0;
+
+	for ( int i = 0; i < NET_RELIABLE_WINDOW; i++ )
+	{
+		m_WindowSlots[i].index = i;
+		m_WindowSlots[i].Free();
+	}
+
+	for ( int i = 0; i < MAX_STREAMS; i++ )
+	{
+		m_nWindowSendTransfer[i] = 0;
+		m_nWindowRecvTransfer[i] = 0;
+		m_WindowRecvFragments[i].Purge();
+	}
+}
+
+bool CNetChan::FillWindowSlot( subChannel_s *slot )
+{
+	int nSendMaxFragments = m_MaxReliablePayloadSize / FRAGMENT_SIZE;
+
+	bool bSendData = false;
+
+	for ( int i = 0; i < MAX_STREAMS; i++ )
+	{
+		slot->startFraggment[i] = 0;
+		slot->numFragments[i] = 0;
+
+		if ( nSendMaxFragments <= 0 || m_WaitingList[i].Count() <= 0 )
+			continue;
+
+		dataFragments_s *data = m_WaitingList[i][0]; // get head
+
+		if ( data->asTCP )
+			continue;
+
+		int nSentFragments = data->ackedFragments + data->pendingFragments;
+
+		Assert( nSentFragments <= data->numFragments );
+
+		if ( nSentFragments == data->numFragments )
+			continue; // all fragments already in flight
+
+		int numFragments = MIN( nSendMaxFragments, data->numFragments - nSentFragments );
+
+		// if we are in file background transmission mode, just send one fragment per packet
+		if ( i == FRAG_FILE_STREAM && m_bFileBackgroundTranmission )
+			numFragments = MIN( 1, numFragments );
+
+		slot->startFraggment[i] = nSentFragments;
+		slot->numFragments[i] = numFragments;
+
+		data->pendingFragments += numFragments;
+
+		bSendData = true;
+
+		nSendMaxFragments -= numFragments;
+	}
+
+	return bSendData;
+}
+
+bool CNetChan::SendWindowData( bf_write &buf )
+{
+	subChannel_s *slot = NULL;
+	int i;
+
+	CompressFragments();
+
+	SendTCPData();
+
+	// lost data goes out again before anything new, oldest first
+	for ( i = 0; i < NET_RELIABLE_WINDOW; i++ )
+	{
+		if ( m_WindowSlots[i].state == SUBCHANNEL_TOSEND &&
+			( !slot || m_WindowSlots[i].sendSeqNr < slot->sendSeqNr ) )
+		{
+			slot = &m_WindowSlots[i];
+		}
+	}
+
+	if ( !slot )
+	{
+		for ( i = 0; i < NET_RELIABLE_WINDOW; i++ )
+		{
+			if ( m_WindowSlots[i].state == SUBCHANNEL_FREE )
+			{
+				slot = &m_WindowSlots[i];
+				break;
+			}
+		}
+
+		if ( !slot )
+			return false; // window is full, wait for acks
+
+		if ( !FillWindowSlot( slot ) )
+			return false; // nothing new to send
+	}
+
+	for ( i = 0; i < MAX_STREAMS; i++ )
+	{
+		if ( slot->numFragments[i] == 0 )
+		{
+			buf.WriteOneBit( 0 ); // no data for this stream
+			continue;
+		}
+
+		dataFragments_t *data = m_WaitingList[i][0];
+
+		buf.WriteOneBit( 1 ); // data follows:
+
+		unsigned int offset = slot->startFraggment[i]*FRAGMENT_SIZE;
+		unsigned int length = slot->numFragments[i]*FRAGMENT_SIZE;
+
+		if ( (slot->startFraggment[i]+slot->numFragments[i]) == data->numFragments )
+		{
+			// we are sending the last fragment, adjust length
+			int rest = FRAGMENT_SIZE - ( data->bytes % FRAGMENT_SIZE );
+			if ( rest < FRAGMENT_SIZE )
+				length -= rest;
+		}
+
+		buf.WriteUBitLong( m_nWindowSendTransfer[i], 8 );
+		buf.WriteUBitLong( slot->startFraggment[i], (MAX_FILE_SIZE_BITS-FRAGMENT_BITS) );
+		buf.WriteUBitLong( slot->numFragments[i], (MAX_FILE_SIZE_BITS-FRAGMENT_BITS) );
+
+		if ( data->file != FILESYSTEM_INVALID_HANDLE )
+		{
+			buf.WriteOneBit( 1 ); // file transmission net message stream
+			buf.WriteUBitLong( data->transferID, 32 );
+		}
+		else
+		{
+			buf.WriteOneBit( 0 ); // normal net message stream
+		}
+
+		if ( data->isCompressed )
+		{
+			buf.WriteOneBit( 1 );
+			buf.WriteUBitLong( data->nUncompressedSize, MAX_FILE_SIZE_BITS );
+		}
+		else
+		{
+			buf.WriteOneBit( 0 );
+		}
+
+		buf.WriteUBitLong( data->bytes, MAX_FILE_SIZE_BITS );
+
+		if ( data->file != FILESYSTEM_INVALID_HANDLE && offset == 0 )
+		{
+			buf.WriteString( data->filename );
+			buf.WriteOneBit( data->isReplayDemo ? 1 : 0 );
+		}
+
+		// write fragments to buffer
+		if ( data->buffer )
+		{
+			Assert( data->file == FILESYSTEM_INVALID_HANDLE );
+			buf.WriteBytes( data->buffer+offset, length );
+		}
+		else
+		{
+			Assert( data->file != FILESYSTEM_INVALID_HANDLE );
+			char *tmpbuf = new char[ MAX( length, 1 ) ];
+			g_pFileSystem->Seek( data->file, offset, FILESYSTEM_SEEK_HEAD );
+			g_pFileSystem->Read( tmpbuf, length, data->file );
+			buf.WriteBytes( tmpbuf, length );
+			delete[] tmpbuf;
+		}
+
+		if ( net_showfragments.GetBool() )
+		{
+			ConMsg("Sending window slot %i: transfer %i, start %i, num %i\n", slot->index, m_nWindowSendTransfer[i], slot->startFraggment[i], slot->numFragments[i] );
+		}
+	}
+
+	slot->sendSeqNr = m_nOutSequenceNr;
+	slot->state = SUBCHANNEL_WAITING;
+
+	return true;
+}
+
+bool CNetChan::ReadWindowData( bf_read &buf, int stream )
+{
+	dataFragments_t * data = &m_ReceiveList[stream]; // get list
+
+	int nTransfer = buf.ReadUBitLong( 8 );
+	int startFragment = buf.ReadUBitLong( MAX_FILE_SIZE_BITS-FRAGMENT_BITS );
+	int numFragments = buf.ReadUBitLong( MAX_FILE_SIZE_BITS-FRAGMENT_BITS );
+
+	bool bFile = buf.ReadOneBit() != 0;
+	unsigned int transferID = bFile ? buf.ReadUBitLong( 32 ) : 0;
+
+	bool bCompressed = buf.ReadOneBit() != 0;
+	unsigned int nUncompressedSize = bCompressed ? buf.ReadUBitLong( MAX_FILE_SIZE_BITS ) : 0;
+
+	unsigned int bytes = buf.ReadUBitLong( MAX_FILE_SIZE_BITS );
+
+	char filename[MAX_OSPATH];
+	filename[0] = 0;
+	bool bReplayDemo = false;
+
+	if ( bFile && startFragment == 0 )
+	{
+		buf.ReadString( filename, sizeof(filename) );
+		bReplayDemo = buf.ReadOneBit() != 0;
+	}
+
+	if ( bytes > MAX_FILE_SIZE || ( bCompressed && nUncompressedSize > MAX_FILE_SIZE ) )
+	{
+		Warning( "Net message exceeds max size (%u / compressed %u / uncompressed %u)\n", MAX_FILE_SIZE, bytes, nUncompressedSize );
+		return false;
+	}
+
+	int nTotalFragments = BYTES2FRAGMENTS( bytes );
+
+	if ( numFragments <= 0 || (startFragment+numFragments) > nTotalFragments )
+	{
+		ConDMsg("Received fragment chunk out of bounds: %i+%i>%i from %s\n", startFragment, numFragments, nTotalFragments, GetAddress() );
+		return false;
+	}
+
+	unsigned int offset = startFragment * FRAGMENT_SIZE;
+	unsigned int length = numFragments * FRAGMENT_SIZE;
+
+	if ( (startFragment+numFragments) == nTotalFragments )
+	{
+		// we are receiving the last fragment, adjust length
+		int rest = FRAGMENT_SIZE - ( bytes % FRAGMENT_SIZE );
+		if ( rest < FRAGMENT_SIZE )
+			length -= rest;
+	}
+
+	signed char nAge = (signed char)( nTransfer - m_nWindowRecvTransfer[stream] );
+
+	if ( nAge < 0 )
+	{
+		// a transfer we already completed, our ack for it got lost
+		buf.SeekRelative( length * 8 );
+		return !buf.IsOverflowed();
+	}
+
+	if ( nAge > 0 )
+	{
+		// the sender dropped what was left of the transfers in between (changelevel)
+		if ( data->buffer )
+		{
+			delete [] data->buffer;
+			data->buffer = NULL;
+			ConDMsg("Fragment transmission aborted at %i/%i from %s.\n", data->ackedFragments, data->numFragments, GetAddress() );
+		}
+
+		m_nWindowRecvTransfer[stream] = nTransfer;
+	}
+
+	if ( !data->buffer )
+	{
+		data->filename[0] = 0;
+		data->isReplayDemo = false;
+		data->transferID = transferID;
+		data->isCompressed = bCompressed;
+		data->nUncompressedSize = nUncompressedSize;
+		data->bytes = bytes;
+		data->bits = bytes * 8;
+		data->asTCP = false;
+		data->numFragments = nTotalFragments;
+		data->ackedFragments = 0;
+		data->file = FILESYSTEM_INVALID_HANDLE;
+		data->buffer = new char[ PAD_NUMBER( data->bytes, 4 ) ];
+
+		m_WindowRecvFragments[stream].SetCount( nTotalFragments );
+		m_WindowRecvFragments[stream].FillWithValue( 0 );
+	}
+	else if ( data->bytes != bytes || data->transferID != transferID || data->isCompressed != bCompressed )
+	{
+		ConDMsg("Received fragments of a different transfer from %s\n", GetAddress() );
+		return false;
+	}
+
+	if ( filename[0] )
+	{
+		V_strncpy( data->filename, filename, sizeof(data->filename) );
+		data->isReplayDemo = bReplayDemo;
+	}
+
+	Assert ( (offset + length) <= data->bytes );
+
+	buf.ReadBytes( data->buffer + offset, length ); // read data
+
+	if ( buf.IsOverflowed() )
+		return false;
+
+	// retransmits of ranges we already have don't count twice
+	byte *pReceived = m_WindowRecvFragments[stream].Base();
+	for ( int i = startFragment; i < startFragment+numFragments; i++ )
+	{
+		if ( !pReceived[i] )
+		{
+			pReceived[i] = 1;
+			data->ackedFragments++;
+		}
+	}
+
+	if ( net_showfragments.GetBool() )
+		ConMsg("Received window fragments: transfer %i, start %i, num %i\n", nTransfer, startFragment, numFragments );
+
+	return true;
+}
+
+void CNetChan::AcknowledgeWindow( int sequence_ack, uint32 ackMask )
+{
+	for ( int i = 0; i < NET_RELIABLE_WINDOW; i++ )
+	{
+		subChannel_s *slot = &m_WindowSlots[i];
+
+		if ( slot->state != SUBCHANNEL_WAITING && slot->state != SUBCHANNEL_DIRTY )
+			continue;
+
+		if ( slot->sendSeqNr > sequence_ack )
+			continue; // remote hasn't seen this packet yet
+
+		if ( slot->state == SUBCHANNEL_DIRTY )
+		{
+			// slot was marked dirty during changelevel, waiting list is already cleared
+			slot->Free();
+			continue;
+		}
+
+		int nAge = sequence_ack - slot->sendSeqNr;
+
+		if ( nAge < NET_RELIABLE_WINDOW && ( ackMask & ( 1u << nAge ) ) )
+		{
+			for ( int j = 0; j < MAX_STREAMS; j++ )
+			{
+				if ( slot->numFragments[j] == 0 )
+					continue;
+
+				Assert( m_WaitingList[j].Count() > 0 );
+
+				dataFragments_t * data = m_WaitingList[j][0];
+
+				// tell waiting list, that we received the acknowledge
+				data->ackedFragments += slot->numFragments[j];
+				data->pendingFragments -= slot->numFragments[j];
+			}
+
+			slot->Free();
+		}
+		else
+		{
+			if ( net_showfragments.GetBool() )
+			{
+				ConMsg("Resending window slot %i: start %i, num %i\n", slot->index, slot->startFraggment[0], slot->numFragments[0] );
+			}
+
+			slot->state = SUBCHANNEL_TOSEND; // schedule for resend
+		}
+	}
+}
+
+bool CNetChan::HasWindowDataToSend()
+{
+	bool bFreeSlot = false;
+
+	for ( int i = 0; i < NET_RELIABLE_WINDOW; i++ )
+	{
+		if ( m_WindowSlots[i].state == SUBCHANNEL_TOSEND )
+			return true;
+
+		if ( m_WindowSlots[i].state == SUBCHANNEL_FREE )
+			bFreeSlot = true;
+	}
+
+	if ( !bFreeSlot )
+		return false;
+
+	for ( int i = 0; i < MAX_STREAMS; i++ )
+	{
+		if ( m_WaitingList[i].Count() <= 0 )
+			continue;
+
+		dataFragments_t *data = m_WaitingList[i][0];
+
+		if ( !data->asTCP && ( data->ackedFragments + data->pendingFragments ) < data->numFragments )
+			return true;
+	}
+
+	return false;
+}
+
+bool CNetChan::CanSendWindowBurst() const
+{
+	if ( !net_chokeloopback.GetInt() && remote_address.IsLoopback() )
+		return true;
+
+	if ( HasQueuedPackets() )
+		return false;
+
+	// stay within the rate, allowing for what it lets us send until the next tick
+	return m_fClearTime < net_time + host_state.interval_per_tick;
+}
+
 #if 1
 
 unsigned short BufferToShortChecksum( const void *pvData, size_t nLength )
@@ -2044,7 +2502,15 @@ int CNetChan::SendDatagram(bf_write *datagram)
 	// Note, this only matters on the PC
 	int nCheckSumStart = send.GetNumBytesWritten();
 
-	send.WriteByte ( m_nInReliableState );
+	if ( m_bReliableWindow )
+	{
+		send.WriteUBitLong( m_nInReliableMask, NET_RELIABLE_WINDOW );
+		m_bReliableAckPending = false;
+	}
+	else
+	{
+		send.WriteByte ( m_nInReliableState );
+	}
 
 	if ( m_nChokedPackets > 0 )
 	{
@@ -2052,7 +2518,7 @@ int CNetChan::SendDatagram(bf_write *datagram)
 		send.WriteByte ( m_nChokedPackets & 0xFF );	// send number of choked packets
 	}
 
-	if ( SendSubChannelData( send ) )
+	if ( m_bReliableWindow ? SendWindowData( send ) : SendSubChannelData( send ) )
 	{
 		flags |= PACKET_FLAG_RELIABLE;
 	}
@@ -2391,6 +2857,7 @@ bool CNetChan::_ProcessMessages( bf_read &buf, bool wasReliable  )
 				if ( (*blockmsgname== '1') || !Q_stricmp(blockmsgname, netmsg->GetName() ) )
 				{
 					Msg("Blocking message %s\n", netmsg->ToString() );
+					netmsg->Release();
 					continue;
 				}
 			}
@@ -2406,7 +2873,7 @@ bool CNetChan::_ProcessMessages( bf_read &buf, bool wasReliable  )
 				// This means we were deleted during the processing of that message.
 				if ( m_bShouldDelete )
 				{
-					delete netmsg;
+					netmsg->Release();
 					delete this;
 					return false;
 				}
@@ -2414,7 +2881,7 @@ bool CNetChan::_ProcessMessages( bf_read &buf, bool wasReliable  )
 				// This means our message buffer was freed or invalidated during the processing of that message.
 				if ( m_bStopProcessing )
 				{
-					delete netmsg;
+					netmsg->Release();
 					return false;
 				}
 
@@ -2422,13 +2889,13 @@ bool CNetChan::_ProcessMessages( bf_read &buf, bool wasReliable  )
 				{
 					ConDMsg( "Netchannel: failed processing message %s.\n", netmsg->GetName() );
 					Assert ( 0 );
-					delete netmsg;
+					netmsg->Release();
 					return false;
 				}
 
 				if ( IsOverflowed() )
 				{
-					delete netmsg;
+					netmsg->Release();
 					return false;
 				}
 
@@ -2436,7 +2903,7 @@ bool CNetChan::_ProcessMessages( bf_read &buf, bool wasReliable  )
 				pMsgBind = ( ( CNetChan * )m_pActiveChannel )->FindMessageBinder( cmd, iMsgHandler++ );
 			} while( pMsgBind );
 
-			delete netmsg;
+			netmsg->Release();
 		}
 		else
 		{
@@ -2579,6 +3046,13 @@ bool CNetChan::CheckReceivingList(int nList)
 
 	// got all fragments
 
+	if ( m_bReliableWindow )
+	{
+		// anything else arriving for this transfer is a retransmit
+		m_nWindowRecvTransfer[nList]++;
+		m_WindowRecvFragments[nList].RemoveAll();
+	}
+
 	if ( net_showfragments.GetBool() )
 		ConMsg("Receiving complete: %i fragments, %i bytes\n", data->numFragments, data->bytes );
 
@@ -2708,7 +3182,14 @@ int CNetChan::ProcessPacketHeader( netpacket_t * packet )
 		}
 	}
 
-	int relState	= packet->message.ReadByte();	// reliable state of 8 subchannels
+	int relState	= 0;	// reliable state of 8 subchannels
+	uint32 nAckMask	= 0;	// or which of the last 32 packets had their reliable data accepted
+
+	if ( m_bReliableWindow )
+		nAckMask = packet->message.ReadUBitLong( NET_RELIABLE_WINDOW );
+	else
+		relState = packet->message.ReadByte();
+
 	int nChoked		= 0;	// read later if choked flag is set
 	int i,j;
 
@@ -2753,7 +3234,12 @@ int CNetChan::ProcessPacketHeader( netpacket_t * packet )
 		}
 	}
 
-	for ( i = 0; i<MAX_SUBCHANNELS; i++ )
+	if ( m_bReliableWindow )
+	{
+		AcknowledgeWindow( sequence_ack, nAckMask );
+	}
+
+	for ( i = 0; !m_bReliableWindow && i<MAX_SUBCHANNELS; i++ )
 	{
 		int bitmask = (1<<i);
 
@@ -2822,6 +3308,13 @@ int CNetChan::ProcessPacketHeader( netpacket_t * packet )
 		}
 	}
 
+	if ( m_bReliableWindow )
+	{
+		// bit 0 of the mask always refers to the latest packet
+		int nShift = sequence - m_nInSequenceNr;
+		m_nInReliableMask = ( nShift < NET_RELIABLE_WINDOW ) ? ( m_nInReliableMask << nShift ) : 0;
+	}
+
 	m_nInSequenceNr = sequence;
 	m_nOutSequenceNrAck = sequence_ack;
 
@@ -2909,19 +3402,39 @@ void CNetChan::ProcessPacket( netpacket_t * packet, bool bHasHeader )
 
 	if ( flags & PACKET_FLAG_RELIABLE )
 	{
-		int i, bit = 1<<msg.ReadUBitLong( 3 );
+		int i;
 
-		for ( i=0; i<MAX_STREAMS; i++ )
+		if ( m_bReliableWindow )
 		{
-			if ( msg.ReadOneBit() != 0 )
+			for ( i=0; i<MAX_STREAMS; i++ )
 			{
-				if ( !ReadSubChannelData( msg, i ) )
-					return; // error while reading fragments, drop whole packet
+				if ( msg.ReadOneBit() != 0 )
+				{
+					if ( !ReadWindowData( msg, i ) )
+						return; // error while reading fragments, drop whole packet
+				}
 			}
+
+			// acknowledge this packet, and do it soon even if we have nothing else to say
+			m_nInReliableMask |= 1;
+			m_bReliableAckPending = true;
 		}
+		else
+		{
+			int bit = 1<<msg.ReadUBitLong( 3 );
+
+			for ( i=0; i<MAX_STREAMS; i++ )
+			{
+				if ( msg.ReadOneBit() != 0 )
+				{
+					if ( !ReadSubChannelData( msg, i ) )
+						return; // error while reading fragments, drop whole packet
+				}
+			}
 
-		// flip subChannel bit to signal successfull receiving
-		FLIPBIT(m_nInReliableState, bit);
+			// flip subChannel bit to signal successfull receiving
+			FLIPBIT(m_nInReliableState, bit);
+		}
 		
 		for ( i=0; i<MAX_STREAMS; i++ )
 		{
@@ -3795,3 +4308,235 @@ bool CNetChan::IsRemoteDisconnected() const
 	// Regular case never signals this way.
 	return false;
 }
+
+
+//-----------------------------------------------------------------------------
+// net_msgparse_bench: times parsing a packet of typical server messages, once
+// allocating a fresh message per parse the way the binders used to and once
+// through the pool they use now, and counts the heap allocations of each.
+//-----------------------------------------------------------------------------
+
+// Sits in front of g_pMemAlloc while a run is timed and counts the allocations
+// made on the thread that installed it
+class CNetMsgParseBenchMemAlloc : public IMemAlloc
+{
+public:
+	virtual void *Alloc( size_t nSize )															{ Count(); return m_pMemAlloc->IndirectAlloc( nSize ); }
+	virtual void *Realloc( void *pMem, size_t nSize )											{ Count(); return m_pMemAlloc->Realloc( pMem, nSize ); }
+	DELEGATE_TO_OBJECT_1V(			Free, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( void *,	Expand_NoLongerSupported, void *, size_t, m_pMemAlloc );
+	virtual void *Alloc( size_t nSize, const char *pFileName, int nLine )						{ Count(); return m_pMemAlloc->IndirectAlloc( nSize, pFileName, nLine ); }
+	virtual void *Realloc( void *pMem, size_t nSize, const char *pFileName, int nLine )			{ Count(); return m_pMemAlloc->Realloc( pMem, nSize, pFileName, nLine ); }
+	DELEGATE_TO_OBJECT_3V(			Free, void *, const char *, int, m_pMemAlloc );
+#ifdef MEMALLOC_SUPPORTS_ALIGNED_ALLOCATIONS
+	virtual void *AllocAlign( size_t nSize, size_t align )										{ Count(); return m_pMemAlloc->AllocAlign( nSize, align ); }
+	virtual void *AllocAlign( size_t nSize, size_t align, const char *pFileName, int nLine )	{ Count(); return m_pMemAlloc->AllocAlign( nSize, align, pFileName, nLine ); }
+	virtual void *ReallocAlign( void *pMem, size_t nSize, size_t align )						{ Count(); return m_pMemAlloc->ReallocAlign( pMem, nSize, align ); }
+#endif
+	DELEGATE_TO_OBJECT_4( void*,	Expand_NoLongerSupported, void *, size_t, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( size_t,	GetSize, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			PushAllocDbgInfo, const char *, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			PopAllocDbgInfo, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int32,	CrtSetBreakAlloc, int32, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( int,		CrtSetReportMode, int, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int,		CrtIsValidHeapPointer, const void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_3( int,		CrtIsValidPointer, const void *, unsigned int, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		CrtCheckMemory, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int,		CrtSetDbgFlag, int, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			CrtMemCheckpoint, _CrtMemState *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			DumpStats, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			DumpStatsFileBase, const char *, IMemAlloc::DumpStatsFormat_t, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( size_t,	ComputeMemoryUsedBy, const char *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2( void*,	CrtSetReportFile, int, void*, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( void*,	CrtSetReportHook, void*, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5( int,		CrtDbgReport, int, const char *, int, const char *, const char *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		heapchk, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( bool,		IsDebugHeap, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			GetActualDbgInfo, const char *&, int &, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5V(			RegisterAllocation, const char *, int, size_t, size_t, unsigned, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_5V(			RegisterDeallocation, const char *, int, size_t, size_t, unsigned, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( int,		GetVersion, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			CompactHeap, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( MemAllocFailHandler_t, SetAllocFailHandler, MemAllocFailHandler_t, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			DumpBlockStats, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			SetStatsExtraInfo, const char *, const char *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( size_t,	MemoryAllocFailed, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0V(			CompactIncremental, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			OutOfMemory, size_t, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_2V(			GlobalMemoryStatus, size_t *, size_t *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( IVirtualMemorySection *, AllocateVirtualMemorySection, size_t, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1( int,		GetGenericMemoryStats, GenericMemoryStat_t **, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_0( uint32,	GetDebugInfoSize, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			SaveDebugInfo, void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_1V(			RestoreDebugInfo, const void *, m_pMemAlloc );
+	DELEGATE_TO_OBJECT_3V(			InitDebugInfo, void *, const char *, int, m_pMemAlloc );
+	virtual void *RegionAlloc( int region, size_t nSize )										{ Count(); return m_pMemAlloc->RegionAlloc( region, nSize ); }
+	virtual void *RegionAlloc( int region, size_t nSize, const char *pFileName, int nLine )	{ Count(); return m_pMemAlloc->RegionAlloc( region, nSize, pFileName, nLine ); }
+
+	CNetMsgParseBenchMemAlloc() : m_pMemAlloc( NULL ), m_nThreadId( 0 ), m_nAllocs( 0 ) {}
+
+	// Main thread only. Stays usable after Stop() for threads that picked it up
+	// just before, it keeps passing everything on.
+	void Start()
+	{
+		Assert( g_pMemAlloc != this );
+		m_pMemAlloc = g_pMemAlloc;
+		m_nThreadId = ThreadGetCurrentId();
+		m_nAllocs = 0;
+		g_pMemAlloc = this;
+	}
+
+	int Stop()
+	{
+		Assert( g_pMemAlloc == this );
+		g_pMemAlloc = m_pMemAlloc;
+		return m_nAllocs;
+	}
+
+private:
+	void Count()
+	{
+		if ( ThreadGetCurrentId() == m_nThreadId )
+		{
+			m_nAllocs++;
+		}
+	}
+
+	IMemAlloc		*m_pMemAlloc;
+	ThreadId_t		m_nThreadId;
+	int				m_nAllocs;
+};
+
+static CNetMsgParseBenchMemAlloc s_NetMsgParseBenchMemAlloc;
+
+template< class T >
+static bool NetMsgParseBench_Parse( bf_read &buf, bool bPooled )
+{
+	T *pMsg = bPooled ? T::CreateParsed() : new T;
+	bool bResult = pMsg->ReadFromBuffer( buf );
+	if ( bPooled )
+	{
+		pMsg->Release();
+	}
+	else
+	{
+		delete pMsg;
+	}
+	return bResult;
+}
+
+static bool NetMsgParseBench_ParsePacket( bf_read &buf, bool bPooled )
+{
+	while ( buf.GetNumBitsLeft() >= 8 )
+	{
+		bool bResult;
+		switch ( buf.ReadVarInt32() )
+		{
+		case net_Tick:				bResult = NetMsgParseBench_Parse< CNETMsg_Tick_t::MyType_t >( buf, bPooled ); break;
+		case svc_PacketEntities:	bResult = NetMsgParseBench_Parse< CSVCMsg_PacketEntities_t >( buf, bPooled ); break;
+		case svc_Sounds:			bResult = NetMsgParseBench_Parse< CSVCMsg_Sounds_t >( buf, bPooled ); break;
+		case svc_GameEvent:			bResult = NetMsgParseBench_Parse< CSVCMsg_GameEvent_t >( buf, bPooled ); break;
+		default:					return false;
+		}
+
+		if ( !bResult )
+			return false;
+	}
+	return true;
+}
+
+CON_COMMAND( net_msgparse_bench, "Times parsing a packet of typical server messages with and without the parsed message pool, and counts their heap allocations. Arguments: [iterations]" )
+{
+	int nIterations = MAX( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 20000, 1 );
+
+	byte packet[4096];
+	bf_write write( "net_msgparse_bench", packet, sizeof( packet ) );
+	int nMessages = 0;
+
+	CNETMsg_Tick_t tick( 51234, 0.004f, 0.0005f, 0.0002f );
+	nMessages += tick.WriteToBuffer( write ) ? 1 : 0;
+
+	CSVCMsg_PacketEntities_t entities;
+	byte entityData[1200];
+	for ( int i = 0; i < (int)sizeof( entityData ); ++i )
+	{
+		entityData[i] = (byte)( i * 131 + ( i >> 3 ) );
+	}
+	entities.set_max_entries( 2048 );
+	entities.set_updated_entries( 37 );
+	entities.set_is_delta( true );
+	entities.set_delta_from( 51230 );
+	entities.set_entity_data( entityData, sizeof( entityData ) );
+	nMessages += entities.WriteToBuffer( write ) ? 1 : 0;
+
+	CSVCMsg_Sounds_t sounds;
+	for ( int i = 0; i < 6; ++i )
+	{
+		CSVCMsg_Sounds::sounddata_t *pSound = sounds.add_sounds();
+		pSound->set_origin_x( 1200 + i * 40 );
+		pSound->set_origin_y( -800 + i * 16 );
+		pSound->set_origin_z( 64 );
+		pSound->set_volume( 255 );
+		pSound->set_entity_index( 12 + i );
+		pSound->set_channel( 1 );
+		pSound->set_pitch( 100 );
+		pSound->set_sound_num( 300 + i );
+		pSound->set_sound_level( 75 );
+	}
+	nMessages += sounds.WriteToBuffer( write ) ? 1 : 0;
+
+	CSVCMsg_GameEvent_t event;
+	event.set_eventid( 23 );
+	for ( int i = 0; i < 6; ++i )
+	{
+		CSVCMsg_GameEvent::key_t *pKey = event.add_keys();
+		pKey->set_type( ( i & 1 ) ? 3 : 1 );
+		if ( i & 1 )
+		{
+			pKey->set_val_long( 1000 + i );
+		}
+		else
+		{
+			pKey->set_val_string( "weapon_ak47_headshot" );
+		}
+	}
+	nMessages += event.WriteToBuffer( write ) ? 1 : 0;
+
+	if ( write.IsOverflowed() || nMessages != 4 )
+	{
+		Warning( "net_msgparse_bench: couldn't write the packet\n" );
+		return;
+	}
+
+	// Fill the pool first so the pooled run measures the steady state
+	{
+		bf_read read( "net_msgparse_bench", packet, write.GetNumBytesWritten() );
+		NetMsgParseBench_ParsePacket( read, true );
+	}
+
+	Msg( "net_msgparse_bench: %d messages, %d bytes per packet, %d packets\n", nMessages, write.GetNumBytesWritten(), nIterations );
+
+	for ( int nPooled = 0; nPooled < 2; ++nPooled )
+	{
+		bool bFailed = false;
+		double flStart = Plat_FloatTime();
+		for ( int i = 0; i < nIterations; ++i )
+		{
+			bf_read read( "net_msgparse_bench", packet, write.GetNumBytesWritten() );
+			bFailed |= !NetMsgParseBench_ParsePacket( read, nPooled != 0 );
+		}
+		double flElapsed = Plat_FloatTime() - flStart;
+
+		// Counted on a separate pass so the proxy doesn't slow down the timed one
+		s_NetMsgParseBenchMemAlloc.Start();
+		for ( int i = 0; i < nIterations; ++i )
+		{
+			bf_read read( "net_msgparse_bench", packet, write.GetNumBytesWritten() );
+			NetMsgParseBench_ParsePacket( read, nPooled != 0 );
+		}
+		int nAllocs = s_NetMsgParseBenchMemAlloc.Stop();
+
+		Msg( "   %-12s %7.3f us/packet  %6.2f allocations/packet%s\n", nPooled ? "pooled" : "new/delete", flElapsed * 1e6 / nIterations,
+			(float)nAllocs / nIterations, bFailed ? "  FAILED" : "" );
+	}
+}
@@ -37,6 +37,9 @@
 #define SUBCHANNEL_WAITING	2   // sbuchannel sent data, waiting for ACK
 #define SUBCHANNEL_DIRTY	3	// subchannel is marked as dirty during changelevel
 
+#define NET_RELIABLE_WINDOW			32	// reliable packets in flight with the windowed stream, one per bit of the ack mask
+#define NET_RELIABLE_WINDOW_CAPS	0x0001	// capability bit in S2C_CONNECTION
+
 class CNETMsg_SplitScreenUser;
 
 class CNetChan : public INetChannel
@@ -226,6 +229,12 @@ public:	// INetChannel interface
 	// For Steam sockets, returns true if the low level socket is gone (remote disconnected, etc.)
 	bool		IsRemoteDisconnected() const;
 
+	// Windowed reliable stream, both ends must agree on it before the first packet
+	void		SetReliableWindow( bool bEnabled );
+	bool		IsReliableWindowEnabled() const { return m_bReliableWindow; }
+	// True if windowed reliable data arrived that we haven't acknowledged yet
+	bool		IsReliableAckPending() const { return m_bReliableAckPending; }
+
 public:
 
 	static bool	IsValidFileForTransfer( const char *pFilename );
@@ -286,6 +295,13 @@ private:
 	subChannel_s *GetFreeSubChannel(); // NULL == all subchannels in use
 	void	UpdateSubChannels( void );
 	void	SendTCPData( void );
+
+	bool	SendWindowData( bf_write &buf );
+	bool	ReadWindowData( bf_read &buf, int stream );
+	void	AcknowledgeWindow( int sequence_ack, uint32 ackMask );
+	bool	FillWindowSlot( subChannel_s *slot );
+	bool	HasWindowDataToSend( void );
+	bool	CanSendWindowBurst( void ) const;
 	
 	
 	char const *GetBufferDebugName( EBufType eBufType );
@@ -367,6 +383,17 @@ public:
 	dataFragments_t					m_ReceiveList[MAX_STREAMS]; // receive buffers for streams
 	subChannel_s					m_SubChannels[MAX_SUBCHANNELS];
 
+	// Windowed reliable stream, used instead of the subchannels when negotiated.
+	// Each packet with reliable data takes a slot until the remote side's ack
+	// mask says it arrived, or shows it didn't and the slot is sent again.
+	bool				m_bReliableWindow;
+	bool				m_bReliableAckPending;
+	uint32				m_nInReliableMask;	// bit n set: reliable data of packet m_nInSequenceNr-n was accepted
+	subChannel_s		m_WindowSlots[NET_RELIABLE_WINDOW];
+	unsigned char		m_nWindowSendTransfer[MAX_STREAMS];	// number of the transfer at the head of each waiting list
+	unsigned char		m_nWindowRecvTransfer[MAX_STREAMS];	// number of the transfer being received
+	CUtlVector< byte >	m_WindowRecvFragments[MAX_STREAMS];	// fragments of that transfer received so far
+
 	unsigned int	m_FileRequestCounter;	// increasing counter with each file request
 	bool			m_bFileBackgroundTranmission; // if true, only send 1 fragment per packet
 	bool			m_bUseCompression;	// if true, larger reliable data will be bzip compressed
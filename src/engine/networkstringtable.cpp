@@ -95,6 +95,10 @@ static ConVar stringtable_usedictionaries( "stringtable_usedictionaries",
 										   0, "Use dictionaries for string table networking\n" );
 static ConVar stringtable_alwaysrebuilddictionaries( "stringtable_alwaysrebuilddictionaries", "0", 0, "Rebuild dictionary file on every level load\n" );
 static ConVar stringtable_showsizes( "stringtable_showsizes", "0", 0, "Show sizes of string tables when building for signon\n" );
+static ConVar stringtable_shareupdates( "stringtable_shareupdates", "1", 0, "Encode a string table update once per acked tick and share it between clients\n" );
+
+// Keep at most this many encoded updates per container before starting over
+#define STRINGTABLE_UPDATE_CACHE_SIZE	64
 
 
 
@@ -679,6 +683,8 @@ CNetworkStringTable::CNetworkStringTable( TABLEID id, const char *tableName, int
 	m_nLastChangedTick = 0;
 	m_bChangeHistoryEnabled = false;
 	m_bLocked = false;
+	m_bChangeLogValid = true;
+	m_nChangeSerial = 0;
 
 	m_nMaxEntries = maxentries;
 	m_nEntryBits = Q_log2( m_nMaxEntries );
@@ -778,6 +784,10 @@ void CNetworkStringTable::DeleteAllStrings( void )
 	delete m_pItems;
 	m_pItems = new CNetworkStringDict( m_nFlags & NSF_DICTIONARY_ENABLED );
 
+	m_ChangeLog.RemoveAll();
+	m_bChangeLogValid = true;
+	++m_nChangeSerial;
+
 	if ( m_pItemsClientSide )
 	{
 		delete m_pItemsClientSide;
@@ -844,6 +854,108 @@ void CNetworkStringTable::SetTick(int tick_count)
 {
 	Assert( tick_count >= m_nTickCount );
 	m_nTickCount = tick_count;
+
+	// Updates are written from several threads, so the log is only ever fixed
+	// up here on the main thread
+	if ( !m_bChangeLogValid )
+	{
+		RebuildChangeLog();
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Records that networked item stringNumber changed at tick
+//-----------------------------------------------------------------------------
+void CNetworkStringTable::NoteItemChanged( int stringNumber, int tick )
+{
+	++m_nChangeSerial;
+
+	if ( !m_bChangeLogValid )
+		return;
+
+	// Ticks going backwards would break the ordering, leave it to SetTick to rebuild
+	if ( m_ChangeLog.Count() && m_ChangeLog.Tail().m_nTick > tick )
+	{
+		InvalidateChangeLog();
+		return;
+	}
+
+	// Items that keep changing leave old entries behind, drop them once they
+	// outnumber the items. The rebuild picks up this change too.
+	if ( m_ChangeLog.Count() >= 2 * (int)m_pItems->Count() + 64 )
+	{
+		RebuildChangeLog();
+		return;
+	}
+
+	ChangeLogEntry_t &entry = m_ChangeLog[ m_ChangeLog.AddToTail() ];
+	entry.m_nTick = tick;
+	entry.m_nIndex = stringNumber;
+}
+
+void CNetworkStringTable::RebuildChangeLog( void )
+{
+	int count = m_pItems->Count();
+
+	m_ChangeLog.SetCount( count );
+	for ( int i = 0; i < count; i++ )
+	{
+		m_ChangeLog[ i ].m_nTick = m_pItems->Element( i ).GetTickChanged();
+		m_ChangeLog[ i ].m_nIndex = i;
+	}
+
+	m_ChangeLog.Sort();
+
+	m_bChangeLogValid = true;
+}
+
+void CNetworkStringTable::InvalidateChangeLog( void )
+{
+	m_bChangeLogValid = false;
+	++m_nChangeSerial;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Collects the indices of the items that may have changed after tick,
+//			in ascending order. Returns -1 if it's no cheaper than checking
+//			every item.
+//-----------------------------------------------------------------------------
+int CNetworkStringTable::GetChangedSince( int tick, CUtlVector< int > &indices ) const
+{
+	int nLogCount = m_ChangeLog.Count();
+	if ( !m_bChangeLogValid || !nLogCount )
+		return -1;
+
+	// First entry changed after tick
+	int nLow = 0;
+	int nHigh = nLogCount;
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) / 2;
+		if ( m_ChangeLog[ nMid ].m_nTick <= tick )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	int nChanged = nLogCount - nLow;
+	if ( nChanged >= (int)m_pItems->Count() )
+		return -1;
+
+	indices.SetCount( nChanged );
+	for ( int i = 0; i < nChanged; i++ )
+	{
+		indices[ i ] = m_ChangeLog[ nLow + i ].m_nIndex;
+	}
+
+	// Entries must go out in index order, duplicates are skipped by the caller
+	indices.Sort();
+
+	return nChanged;
 }
 
 bool CNetworkStringTable::Lock(	bool bLock )
@@ -892,6 +1004,9 @@ void CNetworkStringTable::RestoreTick(int tick)
 		if ( tickChanged > m_nLastChangedTick )
 			m_nLastChangedTick = tickChanged;
 	}
+
+	++m_nChangeSerial;
+	RebuildChangeLog();
 }
 
 //-----------------------------------------------------------------------------
@@ -971,10 +1086,26 @@ int CNetworkStringTable::WriteUpdate( CBaseClient *client, bf_write &buf, int ti
 	int count = m_pItems->Count();
 	int nDictionaryCount = 0;
 
+	// Only visit the entries the change log says changed after tick_ack, unless
+	// that's most of the table anyway
+	CUtlVector< int > changed;
+	int nCandidates = ( tick_ack >= 0 ) ? GetChangedSince( tick_ack, changed ) : -1;
+	bool bUseChangeLog = ( nCandidates >= 0 );
+	if ( !bUseChangeLog )
+	{
+		nCandidates = count;
+	}
+
 	buf.WriteOneBit( bEncodeUsingDictionaries ? 1 : 0 );
 
-	for ( int i = 0; i < count; i++ )
+	for ( int nCandidate = 0; nCandidate < nCandidates; nCandidate++ )
 	{
+		int i = bUseChangeLog ? changed[ nCandidate ] : nCandidate;
+
+		// Listed more than once
+		if ( i == lastEntry )
+			continue;
+
 		CNetworkStringTableItem *p = &m_pItems->Element( i );
 
 		// Client is up to date
@@ -1262,6 +1393,9 @@ void CNetworkStringTable::CopyStringTable(CNetworkStringTable * table)
 
 		AddString( true, table->GetString( i ), item->m_nUserDataLength, item->m_pUserData );
 	}
+
+	// The ticks were replayed out of order
+	RebuildChangeLog();
 }
 
 #endif
@@ -1462,6 +1596,11 @@ int CNetworkStringTable::AddString( bool bIsServer, const char *string, int leng
 			}
 		}
 
+		if ( bHasChanged )
+		{
+			NoteItemChanged( i, item->GetTickChanged() );
+		}
+
 		if ( bHasChanged && !m_bChangeHistoryEnabled )
 		{
 			DataChanged( i, item );
@@ -1525,6 +1664,11 @@ void CNetworkStringTable::SetStringUserData( int stringNumber, int length /*=0*/
 
 	if ( p->SetUserData( m_nTickCount, length, userdata ) )
 	{
+		if ( dict == m_pItems )
+		{
+			NoteItemChanged( stringNumber, p->GetTickChanged() );
+		}
+
 		// Mark changed
 		DataChanged( saveStringNumber, p );
 	}
@@ -1755,6 +1899,9 @@ void CNetworkStringTable::UpdateDictionaryString( int stringNumber )
 		return;
 	}
 	CheckDictionary( stringNumber );
+
+	// The string may be encoded differently now
+	++m_nChangeSerial;
 }
 
 //-----------------------------------------------------------------------------
@@ -2063,21 +2210,69 @@ void CNetworkStringTableContainer::WriteUpdateMessage( CBaseClient *client, int
 			continue;
 
 		CSVCMsg_UpdateStringTable_t msg;
+		msg.set_table_id( table->GetTableId() );
 
-		//setup a writer for the bits that go to our temporary buffer so we can assign it over later
-		bf_write string_data_buf( StringTableBuff, sizeof( StringTableBuff ) );
+		// A tracing client needs its update written out entry by entry
+		bool bShareUpdate = stringtable_shareupdates.GetBool() && !( client && client->IsTracing() );
+		int nChangeSerial = table->GetChangeSerial();
+		bool bCached = false;
 
-		msg.set_table_id( table->GetTableId() );
-		msg.set_num_changed_entries( table->WriteUpdate( client, string_data_buf, tick_ack ) );
+		if ( bShareUpdate )
+		{
+			AUTO_LOCK( m_UpdateCacheMutex );
+			for ( int j = 0; j < m_UpdateCache.Count(); j++ )
+			{
+				const EncodedUpdate_t *pUpdate = m_UpdateCache[ j ];
+				if ( pUpdate->m_nTableId == table->GetTableId() &&
+					 pUpdate->m_nTickAck == tick_ack &&
+					 pUpdate->m_nChangeSerial == nChangeSerial )
+				{
+					msg.set_num_changed_entries( pUpdate->m_nEntries );
+					msg.mutable_string_data()->assign( pUpdate->m_Data.Base(), pUpdate->m_Data.Base() + pUpdate->m_Data.Count() );
+					bCached = true;
+					break;
+				}
+			}
+		}
 
-		//handle the situation where the data may have been truncated
-		if( string_data_buf.IsOverflowed() )
-			return;
+		if ( !bCached )
+		{
+			//setup a writer for the bits that go to our temporary buffer so we can assign it over later
+			bf_write string_data_buf( StringTableBuff, sizeof( StringTableBuff ) );
+
+			msg.set_num_changed_entries( table->WriteUpdate( client, string_data_buf, tick_ack ) );
+
+			//handle the situation where the data may have been truncated
+			if( string_data_buf.IsOverflowed() )
+				return;
 
-		Assert( msg.num_changed_entries() > 0 ); // don't send unnecessary empty updates
+			Assert( msg.num_changed_entries() > 0 ); // don't send unnecessary empty updates
 
-		//copy over the data we wrote into the actual message
-		msg.mutable_string_data()->assign( StringTableBuff, StringTableBuff + Bits2Bytes( string_data_buf.GetNumBitsWritten() ) );
+			int nBytes = Bits2Bytes( string_data_buf.GetNumBitsWritten() );
+
+			//copy over the data we wrote into the actual message
+			msg.mutable_string_data()->assign( StringTableBuff, StringTableBuff + nBytes );
+
+			if ( bShareUpdate )
+			{
+				AUTO_LOCK( m_UpdateCacheMutex );
+
+				// Ticks that stopped advancing (rollback containers) leave stale entries behind
+				if ( m_UpdateCache.Count() >= STRINGTABLE_UPDATE_CACHE_SIZE )
+				{
+					m_UpdateCache.PurgeAndDeleteElements();
+				}
+
+				// Another thread may have just encoded the same update, which is harmless
+				EncodedUpdate_t *pUpdate = new EncodedUpdate_t;
+				pUpdate->m_nTableId = table->GetTableId();
+				pUpdate->m_nTickAck = tick_ack;
+				pUpdate->m_nChangeSerial = nChangeSerial;
+				pUpdate->m_nEntries = msg.num_changed_entries();
+				pUpdate->m_Data.CopyArray( StringTableBuff, nBytes );
+				m_UpdateCache.AddToTail( pUpdate );
+			}
+		}
 
 		if ( !msg.WriteToBuffer( buf ) )
 			return;
@@ -2113,6 +2308,12 @@ void CNetworkStringTableContainer::DirectUpdate( int tick_ack )
 	}
 }
 
+void CNetworkStringTableContainer::PurgeUpdateCache( void )
+{
+	AUTO_LOCK( m_UpdateCacheMutex );
+	m_UpdateCache.PurgeAndDeleteElements();
+}
+
 void CNetworkStringTableContainer::EnableRollback( bool bState )
 {
 	// we can't dis/enable rollback if we already created tabled
@@ -2158,6 +2359,10 @@ void CNetworkStringTableContainer::SetTick( int tick_count)
 
 	m_nTickCount = tick_count;
 
+#ifndef SHARED_NET_STRING_TABLES
+	PurgeUpdateCache();
+#endif
+
 	// Determine if an update is needed
 	for ( int i = 0; i < m_Tables.Count(); i++ )
 	{
@@ -2180,6 +2385,11 @@ void CNetworkStringTableContainer::RemoveAllTables( void )
 		m_Tables.Remove( 0 );
 		delete table;
 	}
+
+#ifndef SHARED_NET_STRING_TABLES
+	// New tables reuse the ids
+	PurgeUpdateCache();
+#endif
 }
 
 //-----------------------------------------------------------------------------
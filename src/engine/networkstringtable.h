@@ -17,6 +17,7 @@
 #include "tier1/utldict.h"
 #include "tier1/utlbuffer.h"
 #include "tier1/bitbuf.h"
+#include "tier0/threadtools.h"
 
 class SVC_CreateStringTable;
 class CBaseClient;
@@ -112,6 +113,9 @@ public:
 
 	bool			WriteBaselines( CSVCMsg_CreateStringTable_t &msg );
 
+	// Bumped by every change that can alter what WriteUpdate encodes
+	int				GetChangeSerial() const { return m_nChangeSerial; }
+
 #endif
 
 	void			TriggerCallbacks( int tick_ack  );
@@ -132,6 +136,12 @@ protected:
 	void			DeleteAllStrings( void );
 	void			CheckDictionary( int stringNumber );
 
+	// Change log upkeep
+	void			NoteItemChanged( int stringNumber, int tick );
+	void			RebuildChangeLog( void );
+	void			InvalidateChangeLog( void );
+	int				GetChangedSince( int tick, CUtlVector< int > &indices ) const;
+
 	CNetworkStringTable( const CNetworkStringTable & ); // not implemented, not allowed
 
 	TABLEID					m_id;
@@ -146,6 +156,7 @@ protected:
 	bool					m_bLocked : 1;
 	bool					m_bAllowClientSideAddString : 1;
 	bool					m_bUserDataFixedSize : 1;
+	bool					m_bChangeLogValid : 1;
 
 	int						m_nFlags; // NSF_*
 
@@ -162,6 +173,24 @@ protected:
 
 	INetworkStringDict		*m_pItems;
 	INetworkStringDict		*m_pItemsClientSide;	 // For m_bAllowClientSideAddString, these items are non-networked and are referenced by a negative string index!!!
+
+	struct ChangeLogEntry_t
+	{
+		int					m_nTick;
+		int					m_nIndex;
+
+		bool operator<( const ChangeLogEntry_t &other ) const
+		{
+			return m_nTick < other.m_nTick || ( m_nTick == other.m_nTick && m_nIndex < other.m_nIndex );
+		}
+	};
+
+	// Networked items in the order their ticks changed, so an update only visits
+	// the entries the client hasn't acked. An item may be listed more than once,
+	// but always at or after its current tick changed. Rebuilt from the items
+	// whenever ticks go backwards (rollback, CopyStringTable).
+	CUtlVector< ChangeLogEntry_t > m_ChangeLog;
+	int						m_nChangeSerial;
 };
 
 //-----------------------------------------------------------------------------
@@ -231,6 +260,25 @@ private:
 	bool		m_bEnableRollback;	// enables rollback feature
 
 	CUtlVector < CNetworkStringTable* > m_Tables;	// the string tables
+
+#ifndef SHARED_NET_STRING_TABLES
+	// Most clients ack the same few ticks, so the encoded update for a table and
+	// tick_ack is built once and shared. Entries are dropped every tick and never
+	// used once their table changed. Clients are sent from several threads.
+	struct EncodedUpdate_t
+	{
+		TABLEID				m_nTableId;
+		int					m_nTickAck;
+		int					m_nChangeSerial;
+		int					m_nEntries;
+		CUtlVector< uint8 >	m_Data;
+	};
+
+	void		PurgeUpdateCache( void );
+
+	CUtlVector< EncodedUpdate_t* > m_UpdateCache;
+	CThreadFastMutex	m_UpdateCacheMutex;
+#endif
 };
 
 #endif // NETWORKSTRINGTABLE_H
@@ -754,7 +754,9 @@ static inline int SV_WriteDeletions( CEntityWriteInfo &u )
 	CFrameSnapshot *pFromSnapShot = u.m_pFromSnapshot;
 	CFrameSnapshot *pToSnapShot = u.m_pToSnapshot;
 
-	CUtlVector< int > deletions;
+	// Only allocated once there's something to delete, most packets have nothing
+	int *pDeletions = NULL;
+	int nDeletions = 0;
 
 	int nLast = MAX( pFromSnapShot->m_nNumEntities, pToSnapShot->m_nNumEntities );
 	for ( int i = 0; i < nLast; i++ )
@@ -794,20 +796,24 @@ static inline int SV_WriteDeletions( CEntityWriteInfo &u )
 		{
 			TRACE_PACKET( ( "  SV Explicit Destroy (%d)\n", i ) );
 			Assert( !u.m_pTo->transmit_entity.Get(i) );
-			deletions.AddToTail( i );
+			if ( !pDeletions )
+			{
+				pDeletions = (int *)framesnapshotmanager->AllocTickScratch( nLast * sizeof( int ) );
+			}
+			pDeletions[ nDeletions++ ] = i;
 		}
 	}
 
-	u.m_pBuf->WriteUBitVar( deletions.Count() );
+	u.m_pBuf->WriteUBitVar( nDeletions );
 	int nBase = -1;
-	FOR_EACH_VEC( deletions, i )
+	for ( int i = 0; i < nDeletions; ++i )
 	{
-		int nSlot = deletions[ i ];
+		int nSlot = pDeletions[ i ];
 		int nDelta = nSlot - nBase;
 		u.m_pBuf->WriteUBitVar( nDelta );
 		nBase = nSlot;
 	}
-	return deletions.Count();
+	return nDeletions;
 }
 
 
@@ -13,6 +13,11 @@
 #endif
 #include "framesnapshot.h"
 #include "sys_dll.h"
+#include "tier1/memstack.h"
+
+#ifdef POSIX
+#include <sys/resource.h>
+#endif
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -21,8 +26,35 @@ DEFINE_FIXEDSIZE_ALLOCATOR( CFrameSnapshot, 64, 64 );
 
 
 static ConVar sv_creationtickcheck( "sv_creationtickcheck", "1", FCVAR_CHEAT | FCVAR_DEVELOPMENTONLY, "Do extended check for encoding of timestamps against tickcount" );
+static ConVar sv_framearena( "sv_framearena", "1", FCVAR_RELEASE, "Serve per-tick snapshot scratch memory from per-thread arenas instead of the heap" );
 extern	CGlobalVars g_ServerGlobalVariables;
 
+// Each thread reserves two of these, memory is committed as it's used
+#define FRAME_ARENA_MAX_SIZE		( 1024 * 1024 )
+#define FRAME_ARENA_COMMIT_SIZE		( 64 * 1024 )
+#define FRAME_ARENA_ALIGNMENT		16
+
+struct FrameArena_t
+{
+	FrameArena_t			*m_pNext;
+
+	int						m_nTick;		// host_tickcount the current buffer was switched to
+	int						m_iCurrent;
+	bool					m_bReserved;	// false if the address space couldn't be reserved, everything then comes from the heap
+	CMemoryStack			m_Buffers[2];
+	CUtlVector< void * >	m_HeapBlocks[2];	// allocations that didn't fit or came while sv_framearena was off
+
+	// Stats since the last reset, only written by the owning thread
+	int						m_nAllocs;
+	int						m_nHeapAllocs;
+	int64					m_nBytes;
+	int						m_nHighestUsed;
+};
+
+// s_pThreadFrameArena is stale, and already freed, unless its generation matches m_nFrameArenaGeneration
+static CTHREADLOCALPTR( FrameArena_t ) s_pThreadFrameArena;
+static CTHREADLOCALINT s_nThreadFrameArenaGeneration;
+
 // Expose interface
 static CFrameSnapshotManager g_FrameSnapshotManager;
 CFrameSnapshotManager *framesnapshotmanager = &g_FrameSnapshotManager;
@@ -35,6 +67,9 @@ CFrameSnapshotManager::CFrameSnapshotManager( void ) : m_PackedEntitiesPool( MAX
 	COMPILE_TIME_ASSERT( INVALID_PACKED_ENTITY_HANDLE == 0 );
 	Assert( INVALID_PACKED_ENTITY_HANDLE == m_PackedEntities.InvalidIndex() );
 	Q_memset( m_pLastPackedData, 0x00, MAX_EDICTS * sizeof(PackedEntityHandle_t) );
+	m_pFrameArenas = NULL;
+	m_nFrameArenaGeneration = 1;
+	m_nTickScratchStatsStart = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -54,6 +89,8 @@ CFrameSnapshotManager::~CFrameSnapshotManager( void )
 		Assert( m_PackedEntities.Count() == 0 );
 	}
 #endif
+
+	ReleaseFrameArenas();
 }
 
 //-----------------------------------------------------------------------------
@@ -71,6 +108,168 @@ void CFrameSnapshotManager::LevelChanged()
 	m_PackedEntityCache.RemoveAll();
 	COMPILE_TIME_ASSERT( INVALID_PACKED_ENTITY_HANDLE == 0 );
 	Q_memset( m_pLastPackedData, 0x00, MAX_EDICTS * sizeof(PackedEntityHandle_t) );
+
+	ReleaseFrameArenas();
+}
+
+//-----------------------------------------------------------------------------
+// Tick scratch memory
+//-----------------------------------------------------------------------------
+static void ReleaseFrameArenaBuffer( FrameArena_t *pArena, int iBuffer, bool bDecommit )
+{
+	if ( pArena->m_bReserved )
+	{
+		pArena->m_Buffers[iBuffer].FreeAll( bDecommit );
+	}
+
+	FOR_EACH_VEC( pArena->m_HeapBlocks[iBuffer], i )
+	{
+		free( pArena->m_HeapBlocks[iBuffer][i] );
+	}
+	pArena->m_HeapBlocks[iBuffer].RemoveAll();
+}
+
+FrameArena_t *CFrameSnapshotManager::GetThreadFrameArena()
+{
+	if ( s_nThreadFrameArenaGeneration == m_nFrameArenaGeneration )
+		return s_pThreadFrameArena;
+
+	FrameArena_t *pArena = new FrameArena_t;
+	pArena->m_nTick = host_tickcount;
+	pArena->m_iCurrent = 0;
+	pArena->m_nAllocs = 0;
+	pArena->m_nHeapAllocs = 0;
+	pArena->m_nBytes = 0;
+	pArena->m_nHighestUsed = 0;
+	pArena->m_bReserved = true;
+	for ( int i = 0; i < ARRAYSIZE( pArena->m_Buffers ); ++i )
+	{
+		pArena->m_bReserved = pArena->m_Buffers[i].Init( "CFrameSnapshotManager::TickScratch", FRAME_ARENA_MAX_SIZE, FRAME_ARENA_COMMIT_SIZE, 0, FRAME_ARENA_ALIGNMENT ) && pArena->m_bReserved;
+	}
+	s_pThreadFrameArena = pArena;
+	s_nThreadFrameArenaGeneration = m_nFrameArenaGeneration;
+
+	FrameArena_t *pHead;
+	do
+	{
+		pHead = m_pFrameArenas;
+		pArena->m_pNext = pHead;
+	}
+	while ( ThreadInterlockedCompareExchangePointer( (void * volatile *)&m_pFrameArenas, pArena, pHead ) != pHead );
+
+	return pArena;
+}
+
+void *CFrameSnapshotManager::AllocTickScratch( size_t nBytes )
+{
+	FrameArena_t *pArena = GetThreadFrameArena();
+
+	// First allocation on this thread since the tick changed. Nothing handed out
+	// from the other buffer can still be in use, it is at least a tick old.
+	if ( pArena->m_nTick != host_tickcount )
+	{
+		pArena->m_nTick = host_tickcount;
+		pArena->m_iCurrent ^= 1;
+		ReleaseFrameArenaBuffer( pArena, pArena->m_iCurrent, false );
+	}
+
+	pArena->m_nAllocs++;
+	pArena->m_nBytes += nBytes;
+
+	// CMemoryStack treats running past its reservation as out of memory, so
+	// anything that might not fit, padding included, goes to the heap instead
+	CMemoryStack &buffer = pArena->m_Buffers[pArena->m_iCurrent];
+	if ( sv_framearena.GetBool() && pArena->m_bReserved && nBytes + FRAME_ARENA_ALIGNMENT <= (size_t)( buffer.GetMaxSize() - buffer.GetUsed() ) )
+	{
+		void *pResult = buffer.Alloc( (unsigned)nBytes );
+		if ( pResult )
+		{
+			pArena->m_nHighestUsed = MAX( pArena->m_nHighestUsed, buffer.GetUsed() );
+			return pResult;
+		}
+	}
+
+	void *pResult = malloc( nBytes ? nBytes : 1 );
+	pArena->m_HeapBlocks[pArena->m_iCurrent].AddToTail( pResult );
+	pArena->m_nHeapAllocs++;
+	return pResult;
+}
+
+// Called between levels and at shutdown when no thread is using its scratch memory.
+// Threads that ask for scratch memory again get a new arena.
+void CFrameSnapshotManager::ReleaseFrameArenas()
+{
+	FrameArena_t *pArena = m_pFrameArenas;
+	m_pFrameArenas = NULL;
+	m_nFrameArenaGeneration++;
+	m_nTickScratchStatsStart = host_tickcount;
+
+	while ( pArena )
+	{
+		FrameArena_t *pNext = pArena->m_pNext;
+		for ( int i = 0; i < ARRAYSIZE( pArena->m_Buffers ); ++i )
+		{
+			ReleaseFrameArenaBuffer( pArena, i, true );
+		}
+		delete pArena;
+		pArena = pNext;
+	}
+}
+
+void CFrameSnapshotManager::PrintTickScratchStats( bool bReset )
+{
+	int nTicks = MAX( host_tickcount - m_nTickScratchStatsStart, 1 );
+	int nThreads = 0;
+	int64 nAllocs = 0, nHeapAllocs = 0, nBytes = 0;
+	int nCommitted = 0, nHighestUsed = 0;
+
+	// Read without the owners' cooperation, which is good enough for statistics
+	for ( FrameArena_t *pArena = m_pFrameArenas; pArena; pArena = pArena->m_pNext )
+	{
+		nThreads++;
+		nAllocs += pArena->m_nAllocs;
+		nHeapAllocs += pArena->m_nHeapAllocs;
+		nBytes += pArena->m_nBytes;
+		nCommitted += pArena->m_Buffers[0].GetSize() + pArena->m_Buffers[1].GetSize();
+		nHighestUsed = MAX( nHighestUsed, pArena->m_nHighestUsed );
+
+		if ( bReset )
+		{
+			pArena->m_nAllocs = 0;
+			pArena->m_nHeapAllocs = 0;
+			pArena->m_nBytes = 0;
+			pArena->m_nHighestUsed = 0;
+		}
+	}
+
+	Msg( "tick scratch (sv_framearena %d): %d ticks, %d threads\n", sv_framearena.GetInt(), nTicks, nThreads );
+	Msg( "   scratch allocations    : %.1f / tick, %.1f KB / tick\n", (float)nAllocs / nTicks, (float)nBytes / nTicks / 1024.0f );
+	Msg( "   from the arenas        : %.1f / tick\n", (float)( nAllocs - nHeapAllocs ) / nTicks );
+	Msg( "   heap allocs + frees    : %.1f / tick\n", 2.0f * nHeapAllocs / nTicks );
+	Msg( "   arena committed        : %d KB, fullest buffer %d KB\n", nCommitted / 1024, nHighestUsed / 1024 );
+	Msg( "   heap in use            : %.2f MB\n", g_pMemAlloc->GetSize( 0 ) / ( 1024.0f * 1024.0f ) );
+#ifdef POSIX
+	struct rusage usage;
+	if ( getrusage( RUSAGE_SELF, &usage ) == 0 )
+	{
+#ifdef OSX
+		Msg( "   peak resident set      : %.2f MB\n", usage.ru_maxrss / ( 1024.0f * 1024.0f ) );
+#else
+		Msg( "   peak resident set      : %.2f MB\n", usage.ru_maxrss / 1024.0f );
+#endif
+	}
+#endif
+
+	if ( bReset )
+	{
+		m_nTickScratchStatsStart = host_tickcount;
+	}
+}
+
+CON_COMMAND( sv_framearena_stats, "Print per-tick snapshot scratch allocations since the last reset or level change, and peak memory use. Arguments: [reset]" )
+{
+	bool bReset = ( args.ArgC() > 1 ) && !V_stricmp( args[1], "reset" );
+	framesnapshotmanager->PrintTickScratchStats( bReset );
 }
 
 CFrameSnapshot *CFrameSnapshotManager::NextSnapshot( CFrameSnapshot *pSnapshot )
@@ -457,6 +656,12 @@ void CFrameSnapshotManager::BuildSnapshotList( CFrameSnapshot *pCurrentSnapshot,
 	// Keep list building thread-safe
 	AUTO_LOCK_FM( m_FrameSnapshotsWriteMutex );
 
+	// Can't hold more than every snapshot there is
+	int nMaxSnapshots = m_FrameSnapshots.Count();
+	Assert( !list.m_pSnapshots );
+	list.m_pSnapshots = (CFrameSnapshot **)AllocTickScratch( nMaxSnapshots * sizeof( CFrameSnapshot * ) );
+	list.m_nSnapshots = 0;
+
 	int nInsanity = 0;
 	CFrameSnapshot *pSnapshot;
 	if ( pLastSnapshot )
@@ -471,10 +676,10 @@ void CFrameSnapshotManager::BuildSnapshotList( CFrameSnapshot *pCurrentSnapshot,
 	while ( pSnapshot )
 	{
 		//only add snapshots that match the desired set to the list
-		if( pSnapshot->m_nSnapshotSet == nSnapshotSet )
+		if( pSnapshot->m_nSnapshotSet == nSnapshotSet && list.m_nSnapshots < nMaxSnapshots )
 		{
 			pSnapshot->AddReference();
-			list.m_vecSnapshots.AddToTail( pSnapshot );
+			list.m_pSnapshots[ list.m_nSnapshots++ ] = pSnapshot;
 		}
 
 		++nInsanity;
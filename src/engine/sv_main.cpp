@@ -2670,6 +2670,7 @@ bool SV_ActivateServer()
         // purge unused models and their data hierarchy (materials, shaders, etc)
         modelloader->PurgeUnusedModels();
 		g_pMDLCache->UnloadQueuedHardwareData(); // need to do this to properly remove the data associated with purged models (on the client this is called by materialsystem, but not on the dedicated server)
+		g_pMDLCache->EndMapResidency(); // the client does this from EndMapLoad
     }
 
 	// Steam is required for proper hltv server startup if the server is broadcasting in http
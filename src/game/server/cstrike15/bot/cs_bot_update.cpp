@@ -874,7 +874,7 @@ void CCSBot::Update( void )
 	}
 	else
 	{
-        TM_ZONE_FILTERED(TELEMETRY_LEVEL1, 50, TMZF_NONE, "%s", tmDynamicString(TELEMETRY_LEVEL0, m_state->GetName())); 
+        TM_ZONE_FILTERED(TELEMETRY_LEVEL1, 50, TMZF_NONE, "%s", m_state->GetName()); 
 		//SNPROF(m_state->GetName());
 
 		m_state->OnUpdate( this );
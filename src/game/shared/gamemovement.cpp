@@ -24,6 +24,8 @@
 #if (PREDICTION_ERROR_CHECK_LEVEL > 0) && (PREDICTION_ERROR_CHECK_STACKS_FOR_MISSING > 0)
 #include "tier0/stacktools.h"
 #endif
+#include "igamesystem.h"
+#include "tier1/generichash.h"
 
 // memdbgon must be the last include file in a .cpp file!!!
 #include "tier0/memdbgon.h"
@@ -63,6 +65,26 @@ ConVar player_limit_jump_speed( "player_limit_jump_speed", "1", FCVAR_REPLICATED
 // [MD] I'll remove this eventually. For now, I want the ability to A/B the optimizations.
 bool g_bMovementOptimizations = true;
 
+// Bumped every level so remembered traces of the static world die with the map
+static int s_nTraceMemoLevel = 0;
+
+class CTraceMemoLevelSystem : public CAutoGameSystem
+{
+public:
+	CTraceMemoLevelSystem() : CAutoGameSystem( "CTraceMemoLevelSystem" ) {}
+	virtual void LevelInitPreEntity() { ++s_nTraceMemoLevel; }
+};
+static CTraceMemoLevelSystem s_TraceMemoLevelSystem;
+
+#if !defined( CLIENT_DLL )
+// Totals for sv_movement_trace_memo_report
+static int s_nTraceMemoCommands;
+static int s_nTraceMemoTraces;
+static int s_nTraceMemoHits;
+static int s_nTraceMemoStaticHits;
+static double s_flTraceMemoStartTime;
+#endif
+
 // Roughly how often we want to update the info about the ground surface we're on.
 // We don't need to do this very often.
 #define CATEGORIZE_GROUND_SURFACE_INTERVAL			0.3f
@@ -755,6 +777,25 @@ CGameMovement::CGameMovement( void )
 
 	memset( m_flStuckCheckTime, 0, sizeof(m_flStuckCheckTime) );
 	m_pTraceListData = NULL;
+
+	for ( int i = 0; i < MAX_PLAYERS; ++i )
+	{
+		for ( int slot = 0; slot < MAX_TRACE_MEMO_SLOTS; ++slot )
+		{
+			TraceMemo_t &memo = m_TraceMemo[ i ][ slot ];
+			memo.m_vecStart.Init();
+			memo.m_vecEnd.Init();
+			memo.m_vecMins.Init();
+			memo.m_vecMaxs.Init();
+			memo.m_fMask = 0;
+			memo.m_nCollisionGroup = 0;
+			memo.m_nSerial = -1;
+			memo.m_bStaticWorld = false;
+		}
+	}
+	m_nTraceMemoCommand = 0;
+	m_bTraceListStaticWorld = false;
+	m_nTraceMemoHits = 0;
 }
 
 //-----------------------------------------------------------------------------
@@ -1293,6 +1334,7 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 	{
 		m_pTraceListData = enginetrace->AllocTraceListData();
 	}
+	m_bTraceListStaticWorld = false;
 	if ( !move->m_nPlayerHandle.IsValid() )
 	{
 		return;
@@ -1316,6 +1358,9 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 	AddPointToBounds( start + boxMins - bloat, moveMins, moveMaxs );
 	// now build an optimized trace within these bounds
 	enginetrace->SetupLeafAndEntityListBox( moveMins, moveMaxs, m_pTraceListData );
+
+	// With nothing but the player nearby its traces can't hit anything that moves
+	m_bTraceListStaticWorld = m_pTraceListData->IsStaticWorldOnly( move->m_nPlayerHandle.Get() );
 }
 
 //-----------------------------------------------------------------------------
@@ -1325,6 +1370,8 @@ void CGameMovement::SetupMovementBounds( CMoveData *move )
 void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 {
 	m_nTraceCount = 0;
+	m_nTraceMemoHits = 0;
+	++m_nTraceMemoCommand;
 
 	Assert( pMove && pPlayer );
 
@@ -1368,11 +1415,19 @@ void CGameMovement::ProcessMovement( CBasePlayer *pPlayer, CMoveData *pMove )
 
 	m_bProcessingMovement = false;
 
+	// The trace list is only known to be this player's until the next SetupMovementBounds
+	m_bTraceListStaticWorld = false;
+
 #if !defined( CLIENT_DLL )
 	if ( !player->IsBot() )
 	{
 		VPROF_INCREMENT_COUNTER( "PlayerMovementTraces", m_nTraceCount );
+		VPROF_INCREMENT_COUNTER( "PlayerMovementTracesAvoided", m_nTraceMemoHits );
 	}
+
+	++s_nTraceMemoCommands;
+	s_nTraceMemoTraces += m_nTraceCount;
+	s_nTraceMemoHits += m_nTraceMemoHits;
 #endif
 }
 
@@ -3881,6 +3936,106 @@ void CGameMovement::ResetGetWaterContentsForPointCache()
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: Looks for the same hull trace made earlier by this player. Returns
+//			true with its result in pm if nothing it could have hit can have
+//			moved since; otherwise *ppSlot is where the new trace should be
+//			remembered, or NULL if it shouldn't be.
+//-----------------------------------------------------------------------------
+bool CGameMovement::FindTraceMemo( const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, bool bInTraceList, trace_t &pm, TraceMemo_t **ppSlot )
+{
+	*ppSlot = NULL;
+	if ( !g_bMovementOptimizations || !m_bProcessingMovement )
+		return false;
+
+	Assert( player );
+	int idx = player->entindex() - 1;
+	if ( idx < 0 || idx >= MAX_PLAYERS )
+		return false;
+
+	unsigned int nHash = Hash12( &start ) ^ ( Hash12( &end ) * 31 ) ^ fMask;
+	TraceMemo_t *pMemo = &m_TraceMemo[ idx ][ nHash & ( MAX_TRACE_MEMO_SLOTS - 1 ) ];
+
+	// Only the static world was near it then; that's still all that is near it
+	// if this command's list encloses it and holds no entities. Otherwise it has
+	// to be from this command, nothing moves while a command is being run.
+	// Check this first, a slot that was never stored or was thrown away by a
+	// trace that didn't finish holds no key worth comparing.
+	bool bUsable;
+	if ( pMemo->m_bStaticWorld )
+	{
+		bUsable = pMemo->m_nSerial == s_nTraceMemoLevel && bInTraceList && m_bTraceListStaticWorld;
+	}
+	else
+	{
+		bUsable = pMemo->m_nSerial == m_nTraceMemoCommand;
+	}
+
+	if ( bUsable && pMemo->m_vecStart == start && pMemo->m_vecEnd == end && pMemo->m_vecMins == mins && pMemo->m_vecMaxs == maxs &&
+		 pMemo->m_fMask == fMask && pMemo->m_nCollisionGroup == collisionGroup )
+	{
+		pm = pMemo->m_Trace;
+		++m_nTraceMemoHits;
+#if !defined( CLIENT_DLL )
+		if ( pMemo->m_bStaticWorld )
+		{
+			++s_nTraceMemoStaticHits;
+		}
+#endif
+		return true;
+	}
+
+	// Take the key now, the trace may overwrite what start and end refer to
+	pMemo->m_vecStart = start;
+	pMemo->m_vecEnd = end;
+	pMemo->m_vecMins = mins;
+	pMemo->m_vecMaxs = maxs;
+	pMemo->m_fMask = fMask;
+	pMemo->m_nCollisionGroup = collisionGroup;
+	pMemo->m_nSerial = -1;
+	pMemo->m_bStaticWorld = false;
+
+	*ppSlot = pMemo;
+	return false;
+}
+
+
+void CGameMovement::StoreTraceMemo( TraceMemo_t *pSlot, bool bInTraceList, const trace_t &pm )
+{
+	pSlot->m_bStaticWorld = bInTraceList && m_bTraceListStaticWorld;
+	pSlot->m_nSerial = pSlot->m_bStaticWorld ? s_nTraceMemoLevel : m_nTraceMemoCommand;
+	pSlot->m_Trace = pm;
+}
+
+
+#if !defined( CLIENT_DLL )
+CON_COMMAND( sv_movement_trace_memo_report, "Reports the player hull traces the movement trace memo saved since the last report" )
+{
+	if ( !UTIL_IsCommandIssuedByServerAdmin() )
+		return;
+
+	double flNow = Plat_FloatTime();
+	double flTicks = s_flTraceMemoStartTime ? ( flNow - s_flTraceMemoStartTime ) / gpGlobals->interval_per_tick : 0.0;
+	if ( flTicks >= 1.0 )
+	{
+		Msg( "movement trace memo: %d commands over %.0f ticks, %.1f traces per tick, %.1f avoided per tick (%.1f from earlier commands)\n",
+			s_nTraceMemoCommands, flTicks, s_nTraceMemoTraces / flTicks, s_nTraceMemoHits / flTicks, s_nTraceMemoStaticHits / flTicks );
+	}
+	else
+	{
+		Msg( "movement trace memo: %d commands, %d traces, %d avoided (%d from earlier commands)\n",
+			s_nTraceMemoCommands, s_nTraceMemoTraces, s_nTraceMemoHits, s_nTraceMemoStaticHits );
+	}
+
+	s_nTraceMemoCommands = 0;
+	s_nTraceMemoTraces = 0;
+	s_nTraceMemoHits = 0;
+	s_nTraceMemoStaticHits = 0;
+	s_flTraceMemoStartTime = flNow;
+}
+#endif
+
+
 int CGameMovement::GetWaterContentsForPointCached( const Vector &point, int slot )
 {
 	if ( g_bMovementOptimizations ) 
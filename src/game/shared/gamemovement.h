@@ -282,6 +282,35 @@ protected:
 	int m_CachedGetPointContents[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];
 	Vector m_CachedGetPointContentsPoint[ MAX_PLAYERS ][ MAX_PC_CACHE_SLOTS ];	
 
+	enum
+	{
+		// Hull traces remembered per player, picked by a hash of the trace (power of two)
+		MAX_TRACE_MEMO_SLOTS = 8,
+	};
+
+	struct TraceMemo_t
+	{
+		Vector			m_vecStart;
+		Vector			m_vecEnd;
+		Vector			m_vecMins;
+		Vector			m_vecMaxs;
+		unsigned int	m_fMask;
+		int				m_nCollisionGroup;
+		int				m_nSerial;			// command it was traced in, or the level if m_bStaticWorld
+		bool			m_bStaticWorld;		// only the world and static props were near, good for later commands too
+		trace_t			m_Trace;
+	};
+
+	// Memo of the player's hull traces, used to skip tracing the same ray again
+	// in a command, or in a later command while still only the static world is near
+	bool			FindTraceMemo( const Vector &start, const Vector &end, const Vector &mins, const Vector &maxs, unsigned int fMask, int collisionGroup, bool bInTraceList, trace_t &pm, TraceMemo_t **ppSlot );
+	void			StoreTraceMemo( TraceMemo_t *pSlot, bool bInTraceList, const trace_t &pm );
+
+	TraceMemo_t		m_TraceMemo[ MAX_PLAYERS ][ MAX_TRACE_MEMO_SLOTS ];
+	int				m_nTraceMemoCommand;
+	bool			m_bTraceListStaticWorld;	// m_pTraceListData holds nothing but the player
+	int				m_nTraceMemoHits;
+
 //private:
 	int				m_iSpeedCropped;
 
@@ -307,13 +336,21 @@ public:
 //-----------------------------------------------------------------------------
 inline void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& end, unsigned int fMask, int collisionGroup, trace_t& pm )
 {
-	++m_nTraceCount;
 	VPROF( "CGameMovement::TracePlayerBBox" );
 
+	const Vector &mins = GetPlayerMins();
+	const Vector &maxs = GetPlayerMaxs();
 	Ray_t ray;
-	ray.Init( start, end, GetPlayerMins(), GetPlayerMaxs() );
+	ray.Init( start, end, mins, maxs );
+	bool bInTraceList = m_pTraceListData && m_pTraceListData->CanTraceRay(ray);
+
+	TraceMemo_t *pMemo;
+	if ( FindTraceMemo( start, end, mins, maxs, fMask, collisionGroup, bInTraceList, pm, &pMemo ) )
+		return;
+
+	++m_nTraceCount;
 	ITraceFilter *pFilter = LockTraceFilter( collisionGroup );
-	if ( m_pTraceListData && m_pTraceListData->CanTraceRay(ray) )
+	if ( bInTraceList )
 	{
 		enginetrace->TraceRayAgainstLeafAndEntityList( ray, m_pTraceListData, fMask, pFilter, &pm );
 	}
@@ -322,6 +359,11 @@ inline void CGameMovement::TracePlayerBBox( const Vector& start, const Vector& e
 		enginetrace->TraceRay( ray, fMask, pFilter, &pm );
 	}
 	UnlockTraceFilter( pFilter );
+
+	if ( pMemo )
+	{
+		StoreTraceMemo( pMemo, bInTraceList, pm );
+	}
 }
 
 inline void CGameMovement::GameMovementTraceHull( const Vector& start, const Vector& end, const Vector &mins, const Vector &maxs, unsigned int fMask, ITraceFilter *pFilter, trace_t *pTrace )
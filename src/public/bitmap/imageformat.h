@@ -17,6 +17,7 @@
 
 #include "bitmap/imageformat_declarations.h"
 
+class IThreadPool;
 
 //-----------------------------------------------------------------------------
 // Color structures
@@ -471,6 +472,30 @@ namespace ImageLoader
 	void ByteSwapImageData( unsigned char *pImageData, int nImageSize, ImageFormat imageFormat, int width = 0, int stride = 0 );
 	bool IsFormatValidForConversion( ImageFormat fmt );
 
+	//-----------------------------------------------------------------------------
+	// Block compression
+	//-----------------------------------------------------------------------------
+	enum DXTEncodeQuality_t
+	{
+		DXT_ENCODE_FAST = 0,		// endpoints from the bounding box of each block, refitted once
+		DXT_ENCODE_NORMAL,			// endpoints from the principal axis, refitted twice
+		DXT_ENCODE_HIGH,			// refitted until the error stops dropping, DXT1 3 color blocks tried too
+	};
+
+	// DXT1/3/5 go through nvtc where it's available unless the built-in encoder is
+	// forced. ATI1N, ATI2N and DXT5 GA always use the built-in encoder.
+	void SetDXTEncoder( bool bForceBuiltIn, DXTEncodeQuality_t nQuality );
+
+	// Compresses RGBA8888, BGRA8888, BGRX8888, RGB888 or ARGB8888 to DXT1, DXT1_ONEBITALPHA,
+	// DXT3, DXT5, ATI1N or ATI2N with the built-in encoder, whatever SetDXTEncoder says
+	bool CompressDXT( const unsigned char *pSrc, ImageFormat srcFormat, unsigned char *pDst, ImageFormat dstFormat,
+					  int nWidth, int nHeight, DXTEncodeQuality_t nQuality, bool bDXT5GA = false );
+
+	// Resampling, mipmap generation and block compression are split across this pool.
+	// NULL (the default) runs them on the calling thread.
+	void SetThreadPool( IThreadPool *pPool );
+	IThreadPool *GetThreadPool();
+
 	//-----------------------------------------------------------------------------
 	// convert back and forth from D3D format to ImageFormat, regardless of
 	// whether it's supported or not
@@ -406,6 +406,17 @@ public:
 
 	// Dump out resident combiner info
 	virtual void		DebugCombinerInfo( ) = 0;
+
+	// ========================
+	// cross-map residency
+
+	// Called once the name of the map being loaded is known. Prewarms the models recorded
+	// in that map's manifest from its previous run.
+	virtual void		BeginMapResidency( const char *pszMapName ) = 0;
+
+	// Called once the map is fully loaded and unused models have been purged. Writes the
+	// map's manifest and trims unreferenced resident models to the residency budget.
+	virtual void		EndMapResidency( ) = 0;
 };
 
 DECLARE_TIER3_INTERFACE( IMDLCache, g_pMDLCache );
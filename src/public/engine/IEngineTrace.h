@@ -189,8 +189,8 @@ protected:
 //-----------------------------------------------------------------------------
 // Interface the engine exposes to the game DLL
 //-----------------------------------------------------------------------------
-#define INTERFACEVERSION_ENGINETRACE_SERVER	"EngineTraceServer004"
-#define INTERFACEVERSION_ENGINETRACE_CLIENT	"EngineTraceClient004"
+#define INTERFACEVERSION_ENGINETRACE_SERVER	"EngineTraceServer005"
+#define INTERFACEVERSION_ENGINETRACE_CLIENT	"EngineTraceClient005"
 abstract_class IEngineTrace
 {
 public:
@@ -106,6 +106,9 @@ public:
 	// NOTE: The leaflist trace will NOT check this.  Traces are intersected
 	// against the culled volume exclusively.
 	virtual bool CanTraceRay( const Ray_t &ray ) = 0;
+	// True if the volume holds no entities besides pIgnore, so traces in it
+	// can only hit the world and static props
+	virtual bool IsStaticWorldOnly( IHandleEntity *pIgnore ) = 0;
 };
 #endif // GAMETRACE_H
 
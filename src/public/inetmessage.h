@@ -40,6 +40,8 @@ public:
 
 	virtual const char		*ToString( void ) const = 0; // returns a human readable string about message content
 	virtual size_t			GetSize() const = 0;
+
+	virtual void			Release( void ) { delete this; } // frees a message returned by INetMessageBinder::CreateFromBuffer
 };
 
 class INetMessageBinder
@@ -49,7 +51,7 @@ public:
 
 	virtual int	GetType( void ) const = 0; // returns module specific header tag eg svc_serverinfo
 	virtual void SetNetChannel(INetChannel * netchan) = 0; // netchannel this message is from/for
-	virtual INetMessage *CreateFromBuffer( bf_read &buffer ) = 0;
+	virtual INetMessage *CreateFromBuffer( bf_read &buffer ) = 0; // caller must Release() the result
 	virtual bool Process( const INetMessage &src ) = 0;
 };
 
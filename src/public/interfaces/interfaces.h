@@ -254,7 +254,7 @@ DECLARE_TIER3_INTERFACE( vgui::ISystem, g_pVGuiSystem );
 #define DATACACHE_INTERFACE_VERSION				"VDataCache003"
 DECLARE_TIER3_INTERFACE( IDataCache, g_pDataCache );	// FIXME: Should IDataCache be in tier2?
 
-#define MDLCACHE_INTERFACE_VERSION				"MDLCache004"
+#define MDLCACHE_INTERFACE_VERSION				"MDLCache005"
 DECLARE_TIER3_INTERFACE( IMDLCache, g_pMDLCache );
 DECLARE_TIER3_INTERFACE( IMDLCache, mdlcache );
 
@@ -84,8 +84,8 @@ struct TriGeometryData_t
 	float m_VertexCoordData[9];								// can't use a vector in a union
 
 	uint8 m_nFlags;											// triangle flags
-	signed char m_nTmpData0;								// used by kd-tree builder
-	signed char m_nTmpData1;								// used by kd-tree builder
+	signed char m_nTmpData0;								// no longer used
+	signed char m_nTmpData1;								// no longer used
 
 
 	// accessors to get around union annoyance
@@ -136,6 +136,15 @@ struct CacheOptimizedTriangle
 #define KDNODE_STATE_ZSPLIT 2								// this node is a zsplit
 #define KDNODE_STATE_LEAF 3									// this node is a leaf
 
+#define MAILBOX_HASH_SIZE 256
+#define MAX_TREE_DEPTH 21
+#define MAX_NODE_STACK_LEN (40*MAX_TREE_DEPTH)
+
+// x86 PC builds include an 8-wide AVX2 packet tracer (trace8_avx2.cpp), used when the CPU has AVX2
+#if !defined( _X360 ) && !defined( _PS3 )
+#define RAYTRACE_AVX2 1
+#endif
+
 struct CacheOptimizedKDNode
 {
 	// this is the cache intensive data structure. "Tricks" are used to fit it into 8 bytes:
@@ -235,9 +244,10 @@ class RayStream
 {
 	friend class RayTracingEnvironment;
 
-	RayTracingSingleResult *PendingStreamOutputs[8][4];
+	// up to 8 rays per direction octant, traced as one 8-ray packet
+	RayTracingSingleResult *PendingStreamOutputs[8][8];
 	int n_in_stream[8];
-	FourRays PendingRays[8];
+	FourRays PendingRays[8][2];
 
 public:
 	RayStream(void)
@@ -334,6 +344,18 @@ public:
 					RayTracingResult *rslt_out,
 					int32 skip_id=-1, ITransparentTriangleCallback *pCallback = NULL, RTECullMode_t cullMode = RTE_CULL_NONE );
 
+	// traces two bundles of 4 rays which share a direction sign mask. With AVX2 both go through
+	// the tree together as one 8-wide packet, otherwise this is two Trace4Rays calls. There is no
+	// transparency callback here; use Trace4Rays for that.
+	void Trace8Rays(const FourRays rays[2], const fltx4 TMin[2], const fltx4 TMax[2], int DirectionSignMask,
+					RayTracingResult rslt_out[2],
+					int32 skip_id=-1, RTECullMode_t cullMode = RTE_CULL_NONE );
+
+	// the 8-wide packet path is used when the CPU supports it. This allows turning it off, e.g.
+	// for comparisons. Returns whether it is in use.
+	static bool SetUseWidePackets( bool bUse );
+	static bool IsUsingWidePackets( void );
+
 	// compute virtual light sources to model inter-reflection
 	void ComputeVirtualLightSources(void);
 
@@ -370,13 +392,17 @@ public:
 	int MakeLeafNode(int first_tri, int last_tri);
 
 
+	// classifications (PLANECHECK_xxx) of the triangles in tri_list are written to pClassifications
 	float CalculateCostsOfSplit(
 		int split_plane,int32 const *tri_list,int ntris,
 		Vector MinBound,Vector MaxBound, float &split_value,
-		int &nleft, int &nright, int &nboth);
-		
-	void RefineNode(int node_number,int32 const *tri_list,int ntris,
-						 Vector MinBound,Vector MaxBound, int depth);
+		int &nleft, int &nright, int &nboth, int8 *pClassifications);
+
+	// builds the subtree under node_number into Nodes / TriIndices. Large subtrees are handed
+	// to other threads and spliced back in, giving the same tree as a serial build.
+	void RefineNode(CUtlVector<CacheOptimizedKDNode> &Nodes, CUtlVector<int32> &TriIndices,
+					int node_number,int32 const *tri_list,int ntris,
+					Vector MinBound,Vector MaxBound, int depth);
 	
 	void CalculateTriangleListBounds(int32 const *tris,int ntris,
 									 Vector &minout, Vector &maxout);
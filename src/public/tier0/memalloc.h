@@ -103,6 +103,15 @@ PLATFORM_INTERFACE void RemoveMemoryInfoCallback( IMemoryInfo* pMemoryInfo );
 // Display the memory statistics from the callbacks controlled by the above functions.
 PLATFORM_INTERFACE void DumpMemoryInfoStats();
 
+// Histogram of the sizes of the heap allocations made between Start and Stop, in
+// MEMALLOC_SIZE_HISTOGRAM_STEP byte steps. The last bucket counts everything over
+// 4K, and its total size is returned separately. Only the standard heap records;
+// the debug heap leaves the histogram empty.
+#define MEMALLOC_SIZE_HISTOGRAM_STEP		16
+#define MEMALLOC_SIZE_HISTOGRAM_BUCKETS		( 4096 / MEMALLOC_SIZE_HISTOGRAM_STEP + 1 )
+PLATFORM_INTERFACE void MemAlloc_StartSizeHistogram();
+PLATFORM_INTERFACE void MemAlloc_StopSizeHistogram( uint32 *pCounts, uint64 *pLargeBytes );
+
 //-----------------------------------------------------------------------------
 // NOTE! This should never be called directly from leaf code
 // Just use new,delete,malloc,free etc. They will call into this eventually
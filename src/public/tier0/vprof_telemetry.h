@@ -66,6 +66,9 @@ inline void TelemetrySetLevel( unsigned int Level ) {}
 // need some of the types even if we aren't using Telemetry
 #include "../../thirdparty/telemetry/include/tmtypes.h"
 
+// Zones can still go to the built-in trace recorder, see VPROF_TRACE_ENABLED
+#include "tier0/vprof_trace.h"
+
 #else
 
 //
@@ -175,7 +178,11 @@ PLATFORM_INTERFACE TelemetryData g_Telemetry;
 //	kThreshold [in] microseconds that the zone must span before being sent to server.
 //	kFlags [in] flags for the zone (same as those passed to tmEnter.
 //	kpFormat [in] name of the zone (same as those passed to tmEnter. This may contain printf-style format specifiers.
+#if defined( RAD_TELEMETRY_ENABLED ) || !defined( VPROF_TRACE_ENABLED )
 #define TM_ZONE_FILTERED( context, kThreshold, kFlags, kpFormat, ... ) TELEMETRY_REQUIRED( tmZoneFiltered( context, kThreshold, kFlags, kpFormat, ##__VA_ARGS__ ) )
+#else
+#define TM_ZONE_FILTERED( context, kThreshold, kFlags, kpFormat, ... ) VPROF_TRACE_ZONE( kpFormat, ##__VA_ARGS__ )
+#endif
 
 
 //void tmZone( HTELEMETRY cx,TmU32 const kFlags,char const * kpFormat,...  );
@@ -187,7 +194,11 @@ PLATFORM_INTERFACE TelemetryData g_Telemetry;
 //	cx [in] handle to a valid Telemetry context
 //	kFlags [in] flags for the zone (same as those passed to tmEnter
 //	kpFormat [in] name of the zone (same as those passed to tmEnter. This may contain printf-style format specifiers.
+#if defined( RAD_TELEMETRY_ENABLED ) || !defined( VPROF_TRACE_ENABLED )
 #define TM_ZONE( context, kFlags, kpFormat, ... ) TELEMETRY_REQUIRED( tmZone( context, kFlags, kpFormat, ##__VA_ARGS__ ) )
+#else
+#define TM_ZONE( context, kFlags, kpFormat, ... ) VPROF_TRACE_ZONE( kpFormat, ##__VA_ARGS__ )
+#endif
 
 //Standardized zones
 #define TM_ZONE_DEFAULT( context ) TM_ZONE( context, TMZF_NONE, __FUNCTION__ )
@@ -0,0 +1,89 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+//
+// Cross-thread timeline recorder behind TM_ZONE, SNPROF and VPROF_BUDGET when
+// RAD Telemetry isn't compiled in. Each thread writes its zones into its own
+// ring buffer without taking locks; VProfTrace_StartCapture arms the recorder
+// for a number of ticks and the capture is written out in Chrome trace-event
+// format (chrome://tracing, ui.perfetto.dev) when the last tick ends. The rings
+// only exist while a capture is running.
+//
+// tier0 always carries the recorder outside of _CERT and PS3 builds, but the
+// zone macros only feed it in code built with VPROF_TRACE_ENABLED (debug builds,
+// or anything that defines it); everywhere else they stay empty as before.
+// While no capture is running a zone costs one load and one branch.
+//
+//===============================================================================
+
+#ifndef VPROF_TRACE_H
+#define VPROF_TRACE_H
+#if defined( COMPILER_MSVC )
+#pragma once
+#endif
+
+#include "tier0/platform.h"
+
+#if !defined( _CERT ) && !defined( _PS3 )
+#define VPROF_TRACE_RECORDER
+#endif
+
+#if defined( _DEBUG ) && !defined( VPROF_TRACE_ENABLED )
+#define VPROF_TRACE_ENABLED
+#endif
+
+#if defined( VPROF_TRACE_ENABLED ) && !defined( VPROF_TRACE_RECORDER )
+#undef VPROF_TRACE_ENABLED
+#endif
+
+#ifdef VPROF_TRACE_RECORDER
+
+// True while a capture is running
+PLATFORM_INTERFACE bool g_bVProfTraceCapture;
+
+// Starts a zone on the calling thread and returns a handle for ending it there, 0 if
+// nothing was recorded. The name is copied, so it may be built on the fly; "%s" and
+// "(%s)%s" (category, name) are recorded without formatting.
+PLATFORM_INTERFACE uint32 VProfTrace_BeginZone( PRINTF_FORMAT_STRING const char *pFormat, ... );
+PLATFORM_INTERFACE void VProfTrace_EndZone( uint32 nZone );
+
+// Records every zone for the next nTicks ticks and writes them to pFileName
+PLATFORM_INTERFACE void VProfTrace_StartCapture( int nTicks, const char *pFileName );
+
+// Call once per tick from the main thread
+PLATFORM_INTERFACE void VProfTrace_Tick();
+
+class CVProfTraceScope
+{
+public:
+	CVProfTraceScope( uint32 nZone ) : m_nZone( nZone ) {}
+	~CVProfTraceScope()
+	{
+		if ( m_nZone )
+		{
+			VProfTrace_EndZone( m_nZone );
+		}
+	}
+
+private:
+	uint32 m_nZone;
+};
+
+#else
+
+inline void VProfTrace_StartCapture( int nTicks, const char *pFileName ) {}
+inline void VProfTrace_Tick() {}
+
+#endif // VPROF_TRACE_RECORDER
+
+#ifdef VPROF_TRACE_ENABLED
+
+#define VPROF_TRACE_SCOPE_VARIABLE_NAME( prefix, line ) prefix##line
+#define VPROF_TRACE_SCOPE_VARIABLE_DECL( line, kpFormat, ... ) CVProfTraceScope VPROF_TRACE_SCOPE_VARIABLE_NAME( VProfTrace_, line )( g_bVProfTraceCapture ? VProfTrace_BeginZone( kpFormat, ##__VA_ARGS__ ) : 0 )
+#define VPROF_TRACE_ZONE( kpFormat, ... ) VPROF_TRACE_SCOPE_VARIABLE_DECL( __LINE__, kpFormat, ##__VA_ARGS__ )
+
+#else
+
+#define VPROF_TRACE_ZONE( kpFormat, ... ) ((void)0)
+
+#endif // VPROF_TRACE_ENABLED
+
+#endif // VPROF_TRACE_H
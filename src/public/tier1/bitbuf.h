@@ -136,6 +136,38 @@ namespace bitbuf
 
 	const int kMaxVarintBytes = 10;
 	const int kMaxVarint32Bytes = 5;
+
+	// Number of bytes the varint encoding of n takes, worked out with compares
+	// instead of a loop
+	inline int VarIntByteCount( uint64 n )
+	{
+		return 1 + ( n >= ( 1ull << 7 ) ) + ( n >= ( 1ull << 14 ) ) + ( n >= ( 1ull << 21 ) ) + ( n >= ( 1ull << 28 ) ) +
+			( n >= ( 1ull << 35 ) ) + ( n >= ( 1ull << 42 ) ) + ( n >= ( 1ull << 49 ) ) + ( n >= ( 1ull << 56 ) ) + ( n >= ( 1ull << 63 ) );
+	}
+
+	// Moves the low 56 bits of n into the low 7 bits of eight bytes, ready for
+	// the continuation bits to be ORed in
+	inline uint64 SpreadVarIntBytes( uint64 n )
+	{
+		return ( n & 0x7full ) | ( ( n << 1 ) & 0x7f00ull ) | ( ( n << 2 ) & 0x7f0000ull ) | ( ( n << 3 ) & 0x7f000000ull ) |
+			( ( n << 4 ) & 0x7f00000000ull ) | ( ( n << 5 ) & 0x7f0000000000ull ) | ( ( n << 6 ) & 0x7f000000000000ull ) | ( ( n << 7 ) & 0x7f00000000000000ull );
+	}
+
+	// The inverse: packs the 7-bit groups of eight encoded bytes back together,
+	// dropping the continuation bits
+	inline uint64 CompactVarIntBytes( uint64 n )
+	{
+		return ( n & 0x7full ) | ( ( n >> 1 ) & 0x3f80ull ) | ( ( n >> 2 ) & 0x1fc000ull ) | ( ( n >> 3 ) & 0xfe00000ull ) |
+			( ( n >> 4 ) & 0x7f0000000ull ) | ( ( n >> 5 ) & 0x3f800000000ull ) | ( ( n >> 6 ) & 0x1fc0000000000ull ) | ( ( n >> 7 ) & 0xfe000000000000ull );
+	}
+
+	// Length of the varint at the bottom of eight encoded bytes, 9 if none of them ends it
+	inline int VarIntLengthInQWord( uint64 n )
+	{
+		uint64 nStop = ~n & 0x8080808080808080ull;
+		uint64 nContinued = ( ( nStop & ( 0 - nStop ) ) - 1 ) & 0x8080808080808080ull;
+		return (int)( ( ( nContinued >> 7 ) * 0x0101010101010101ull ) >> 56 ) + 1;
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -188,6 +220,11 @@ public:
 	// Write signed or unsigned. Range is only checked in debug.
 	void			WriteUBitLong( unsigned int data, int numbits, bool bCheckRange=true );
 	void			WriteSBitLong( int data, int numbits );
+
+	// Bulk writes: callers that know how much they're about to write check for room
+	// once with CheckForOverflow( nTotalBits ) and then skip the per-call bounds test.
+	// As with WriteUBitLong, data must fit in numbits.
+	void			WriteUBitLongNoCheck( unsigned int data, int numbits );
 	
 	// Tell it whether or not the data is unsigned. If it's signed,
 	// cast to unsigned before passing in (it will cast back inside).
@@ -386,8 +423,6 @@ inline void bf_write::WriteUBitLong( unsigned int curData, int numbits, bool bCh
 	Assert( numbits >= 0 && numbits <= 32 );
 #endif
 
-	extern uint32 g_BitWriteMasks[32][33];
-
 	// Bounds checking..
 	if ((m_iCurBit+numbits) > m_nDataBits)
 	{
@@ -397,6 +432,16 @@ inline void bf_write::WriteUBitLong( unsigned int curData, int numbits, bool bCh
 		return;
 	}
 
+	WriteUBitLongNoCheck( curData, numbits );
+}
+
+inline void bf_write::WriteUBitLongNoCheck( unsigned int curData, int numbits )
+{
+	Assert( numbits >= 0 && numbits <= 32 );
+	Assert( m_iCurBit + numbits <= m_nDataBits );
+
+	extern uint32 g_BitWriteMasks[32][33];
+
 	int nBitsLeft = numbits;
 	int iCurBit = m_iCurBit;
 
@@ -1130,6 +1175,11 @@ public:
 	FORCEINLINE int ReadSBitLong( int numbits );
 	FORCEINLINE unsigned int ReadUBitVar( void );
 	FORCEINLINE unsigned int PeekUBitLong( int numbits );
+
+	// The next 64 bits of the stream in one word, without consuming them, so a
+	// whole encoding can be decoded before deciding how many bits it used.
+	// Returns false within two dwords of the end of the buffer.
+	FORCEINLINE bool PeekBits64( uint64 *pBits ) const;
 	FORCEINLINE float ReadBitFloat( void );
 	float ReadBitCoord();
 	float ReadBitCoordMP( EBitCoordType coordType );
@@ -1280,6 +1330,17 @@ FORCEINLINE unsigned int CBitRead::PeekUBitLong( int numbits )
 	return nRet;
 }
 
+FORCEINLINE bool CBitRead::PeekBits64( uint64 *pBits ) const
+{
+	// The bytes left after m_pDataIn are always a whole number of dwords
+	if ( m_pDataIn + 2 > m_pBufferEnd )
+		return false;
+
+	uint64 nNext = LittleDWord( m_pDataIn[0] ) | ( (uint64)LittleDWord( m_pDataIn[1] ) << 32 );
+	*pBits = m_nInBufWord | ( nNext << m_nBitsAvail );
+	return true;
+}
+
 FORCEINLINE int CBitRead::ReadSBitLong( int numbits )
 {
 	int nRet = ReadUBitLong( numbits );
@@ -33,6 +33,16 @@ public:
 	void					TouchResource( memhandle_t handle );
 	void					MarkAsStale( memhandle_t handle );		// move to head of LRU
 
+	// Lock free variants. A deferred touch sets a referenced bit and queues the
+	// handle; the item is moved to the LRU tail when CommitDeferredTouches() drains
+	// the queue, or given a second chance when it reaches the head during eviction.
+	void					TouchResourceDeferred( memhandle_t handle );
+	void					CommitDeferredTouches();
+
+	// True if the handle hasn't been freed since it was resolved with
+	// GetResource_LockFree(). Check it after reading through the returned store.
+	bool					IsHandleValid_LockFree( memhandle_t handle );
+
 	int						LockCount( memhandle_t handle );
 	int						BreakLock( memhandle_t handle );
 	int						BreakAllLocks();
@@ -78,6 +88,7 @@ protected:
 	memhandle_t				StoreResourceInHandle( unsigned short memoryIndex, void *pStore, unsigned int realSize );
 	void					*GetResource_NoLock( memhandle_t handle );
 	void					*GetResource_NoLockNoLRUTouch( memhandle_t handle );
+	void					*GetResource_LockFree( memhandle_t handle, bool bTouch );
 	void					*LockResource( memhandle_t handle );
 	void					*LockResourceReturnCount( int *pCount, memhandle_t handle );
 
@@ -102,6 +113,35 @@ protected:
 	void					TouchByIndex( unsigned short memoryIndex );
 	void *					GetForFreeByIndex( unsigned short memoryIndex );
 
+	// Mirror of the serial/store of each element, kept in pages that never move so
+	// handles can be resolved without the mutex. Only written with the mutex held.
+	struct resource_lookup_t
+	{
+		void * volatile			pStore;
+		volatile unsigned short	serial;
+		volatile unsigned char	bReferenced;
+		unsigned char			unused;
+	};
+
+	enum
+	{
+		LOOKUP_PAGE_BITS = 8,
+		LOOKUP_PAGE_SIZE = ( 1 << LOOKUP_PAGE_BITS ),
+		LOOKUP_PAGE_COUNT = ( 65536 / LOOKUP_PAGE_SIZE ),
+	};
+
+	resource_lookup_t *		GetLookup( unsigned short memoryIndex );
+	void					UpdateLookup( unsigned short memoryIndex );
+	bool					ClearReferenced( unsigned short memoryIndex );
+	void					QueueDeferredTouch( memhandle_t handle );
+
+	// Handles touched through the lock free path since the last commit. Touches
+	// past the end are dropped; those items still have their referenced bit.
+	enum
+	{
+		DEFERRED_TOUCH_QUEUE_SIZE = 1024,
+	};
+
 	// One of these is stored per active allocation
 	struct resource_lru_element_t
 	{
@@ -129,6 +169,10 @@ protected:
 	unsigned short m_freeOnDestruct : 1;
 	unsigned short m_unused : 14;
 
+	resource_lookup_t * volatile m_pLookupPages[LOOKUP_PAGE_COUNT];
+
+	unsigned int volatile	m_DeferredTouches[DEFERRED_TOUCH_QUEUE_SIZE];
+	int32 volatile			m_nDeferredTouches;
 };
 
 template< class STORAGE_TYPE, class CREATE_PARAMS, class LOCK_TYPE = STORAGE_TYPE *, class MUTEX_TYPE = CThreadNullMutex>
@@ -195,6 +239,18 @@ public:
 		return NULL;
 	}
 
+	// Use GetData() to translate pointer to LOCK_TYPE
+	// Doesn't take the mutex; a touch is deferred (see TouchResourceDeferred)
+	LOCK_TYPE GetResource_LockFree( memhandle_t hMem, bool bTouch )
+	{
+		void *pLock = BaseClass::GetResource_LockFree( hMem, bTouch );
+		if ( pLock )
+		{
+			return StoragePointer(pLock)->GetData();
+		}
+		return NULL;
+	}
+
 	// Wrapper to match implementation of allocation with typed storage & alloc params.
 	memhandle_t CreateResource( const CREATE_PARAMS &createParams, bool bCreateLocked = false )
 	{
@@ -279,6 +335,12 @@ inline unsigned short CDataManagerBase::FromHandle( memhandle_t handle )
 	return m_memoryLists.InvalidIndex();
 }
 
+inline CDataManagerBase::resource_lookup_t *CDataManagerBase::GetLookup( unsigned short memoryIndex )
+{
+	resource_lookup_t *pPage = m_pLookupPages[memoryIndex >> LOOKUP_PAGE_BITS];
+	return ( pPage ) ? &pPage[memoryIndex & ( LOOKUP_PAGE_SIZE - 1 )] : NULL;
+}
+
 inline int CDataManagerBase::LockCount( memhandle_t handle )
 {
 	Lock();
@@ -0,0 +1,150 @@
+//========= Copyright Valve Corporation, All rights reserved. =================//
+//
+// Read-only KeyValues tree parsed in place, with a position independent
+// binary form that can be walked without parsing
+//
+//=============================================================================//
+
+#ifndef KEYVALUESDOCUMENT_H
+#define KEYVALUESDOCUMENT_H
+
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/keyvalues.h"
+#include "tier1/utlvector.h"
+
+class CUtlBuffer;
+class IBaseFileSystem;
+
+//-----------------------------------------------------------------------------
+// Purpose: A read-only alternative to KeyValues for large data files (item
+//			schema, manifests). The source text is copied once and tokenized in
+//			place, so key names and string values are views into that copy and
+//			the nodes live in a single array: loading is two allocations and
+//			Purge() frees it all at once.
+//
+//			The binary form (SaveBinary) is a header, the node array and a string
+//			blob, all addressed by offset. LoadBinary() can use it where it lies,
+//			e.g. a memory mapped file, without building anything.
+//
+//			Follows the KeyValues text syntax including [$CONDITIONAL] tags.
+//			#include and #base aren't supported. Node 0 is an unnamed root whose
+//			children are the top level keys. Use ToKeyValues() for code that
+//			needs a mutable tree.
+//-----------------------------------------------------------------------------
+class KeyValuesDocument
+{
+public:
+	typedef int KeyHandle_t;
+	enum { INVALID_KEY = -1 };
+
+	KeyValuesDocument();
+	~KeyValuesDocument();
+
+	// Text. pBuffer need not be null terminated if nSize is given
+	bool LoadFromBuffer( const char *pszResourceName, const char *pBuffer, int nSize = -1, GetSymbolProc_t pfnEvaluateSymbolProc = NULL, bool bUsesEscapeSequences = false );
+	bool LoadFromFile( IBaseFileSystem *pFileSystem, const char *pszResourceName, const char *pPathID = NULL, GetSymbolProc_t pfnEvaluateSymbolProc = NULL );
+
+	// Binary. With bCopy false, pData must outlive the document (and stay at the same address)
+	bool SaveBinary( CUtlBuffer &buf ) const;
+	bool LoadBinary( const void *pData, int nSize, bool bCopy = true );
+
+	void Purge();
+	bool IsValid() const						{ return m_nNodes > 0; }
+	int GetKeyCount() const						{ return m_nNodes; }
+	int GetMemoryUsage() const;
+
+	// Navigation; the top level keys are peers starting at GetFirstKey()
+	KeyHandle_t GetFirstKey() const				{ return m_nNodes ? m_pNodes[0].m_nFirstChild : INVALID_KEY; }
+	KeyHandle_t GetFirstSubKey( KeyHandle_t hKey ) const;
+	KeyHandle_t GetNextKey( KeyHandle_t hKey ) const;
+	KeyHandle_t FindKey( KeyHandle_t hParent, const char *pszKeyName ) const;	// supports "a/b/c"
+
+	const char *GetName( KeyHandle_t hKey ) const;
+	bool IsSection( KeyHandle_t hKey ) const;
+	const char *GetString( KeyHandle_t hKey, const char *pszDefault = "" ) const;
+	int GetInt( KeyHandle_t hKey, int nDefault = 0 ) const;
+	uint64 GetUint64( KeyHandle_t hKey, uint64 nDefault = 0 ) const;
+	float GetFloat( KeyHandle_t hKey, float flDefault = 0.0f ) const;
+	bool GetBool( KeyHandle_t hKey, bool bDefault = false ) const	{ return GetInt( hKey, bDefault ? 1 : 0 ) != 0; }
+
+	const char *GetString( KeyHandle_t hParent, const char *pszKeyName, const char *pszDefault ) const	{ return GetString( FindKey( hParent, pszKeyName ), pszDefault ); }
+	int GetInt( KeyHandle_t hParent, const char *pszKeyName, int nDefault ) const						{ return GetInt( FindKey( hParent, pszKeyName ), nDefault ); }
+	float GetFloat( KeyHandle_t hParent, const char *pszKeyName, float flDefault ) const				{ return GetFloat( FindKey( hParent, pszKeyName ), flDefault ); }
+
+	// Deep copy of a key (and its subkeys) into a regular KeyValues tree. Values are stored as strings.
+	KeyValues *ToKeyValues( KeyHandle_t hKey ) const;
+
+private:
+	// Binary layout, all 32 bit little endian
+	struct Node_t
+	{
+		uint32	m_nNameHash;		// HashStringCaselessConventional of the name
+		uint32	m_nName;			// offset into the string blob
+		uint32	m_nValue;			// offset into the string blob, SECTION_VALUE for sections
+		int32	m_nFirstChild;
+		int32	m_nNextPeer;
+	};
+
+	struct BinaryHeader_t
+	{
+		uint32	m_nMagic;
+		uint32	m_nVersion;
+		uint32	m_nNodes;
+		uint32	m_nStringBytes;
+	};
+
+	enum
+	{
+		SECTION_VALUE = 0xFFFFFFFF,
+		BINARY_MAGIC = 0x3144564B,	// 'KVD1'
+		BINARY_VERSION = 1,
+		MAX_DEPTH = 100,
+	};
+
+	// text parser
+	enum Token_t
+	{
+		TOKEN_EOF,
+		TOKEN_OPEN,
+		TOKEN_CLOSE,
+		TOKEN_EQUALS,
+		TOKEN_STRING,
+		TOKEN_CONDITIONAL,
+	};
+	Token_t ReadToken( char *&pToken );
+	void UnreadToken( Token_t token, char *pToken );
+	bool ParseKeys( KeyHandle_t hParent, int nDepth );
+	bool EvaluateConditional( const char *pszExpression );
+	void ReportError( const char *pszMessage );
+
+	KeyHandle_t AddNode( const char *pszName );
+	void LinkNode( KeyHandle_t hParent, KeyHandle_t &hLastChild, KeyHandle_t hNode );
+	const Node_t &Node( KeyHandle_t hKey ) const	{ return m_pNodes[hKey]; }
+	KeyHandle_t FindChild( KeyHandle_t hParent, const char *pszName, int nNameLen ) const;
+	void RecursiveToKeyValues( KeyValues *pParent, KeyHandle_t hFirst ) const;
+
+	const Node_t		*m_pNodes;
+	int					m_nNodes;
+	const char			*m_pStrings;
+	int					m_nStringBytes;
+
+	// owned storage: text parses fill both, binary copies use only m_Storage
+	CUtlVector< Node_t > m_Nodes;
+	CUtlVector< char >	m_Storage;
+
+	// parse state
+	char				*m_pCur;
+	char				m_chPending;
+	Token_t				m_nUnreadToken;
+	char				*m_pUnreadToken;
+	bool				m_bHasUnreadToken;
+	bool				m_bUsesEscapeSequences;
+	bool				m_bError;
+	GetSymbolProc_t		m_pfnEvaluateSymbolProc;
+	const char			*m_pszResourceName;
+};
+
+#endif // KEYVALUESDOCUMENT_H
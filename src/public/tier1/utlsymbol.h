@@ -196,59 +196,79 @@ private:
 
 };
 
-class CUtlSymbolTableMT :  public CUtlSymbolTable
+//-----------------------------------------------------------------------------
+// CUtlSymbolTableMT:
+// description:
+//    Thread safe symbol table with the same interface and symbol values as
+//    CUtlSymbolTable. It is insert-only, so Find and String never lock:
+//    lookups walk a fixed array of bucket chains that inserts only ever push
+//    new nodes onto with a compare-and-swap, and strings are read out of a
+//    fixed table of id segments. A node is fully written before it is
+//    published and gets the next id right after, so ids stay dense.
+//-----------------------------------------------------------------------------
+
+class CUtlSymbolTableMT
 {
 public:
-	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false )
-		: CUtlSymbolTable( growSize, initSize, caseInsensitive )
-	{
-	}
+	// growSize and initSize are unused, the table doesn't grow by reallocating
+	CUtlSymbolTableMT( int growSize = 0, int initSize = 32, bool caseInsensitive = false );
+	~CUtlSymbolTableMT();
 
-	CUtlSymbol AddString( const char* pString )
-	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::AddString( pString );
-		m_lock.UnlockWrite();
-		return result;
-	}
+	// Finds and/or creates a symbol based on the string
+	CUtlSymbol AddString( const char* pString );
 
-	CUtlSymbol Find( const char* pString ) const
-	{
-		m_lock.LockForWrite();
-		CUtlSymbol result = CUtlSymbolTable::Find( pString );
-		m_lock.UnlockWrite();
-		return result;
-	}
+	// Finds the symbol for pString
+	CUtlSymbol Find( const char* pString ) const;
 
-	const char* String( CUtlSymbol id ) const
-	{
-		m_lock.LockForRead();
-		const char *pszResult = CUtlSymbolTable::String( id );
-		m_lock.UnlockRead();
-		return pszResult;
-	}
+	// Look up the string associated with a particular symbol
+	const char* String( CUtlSymbol id ) const;
 
 	const char * StringNoLock( CUtlSymbol id ) const
 	{
-		return CUtlSymbolTable::String( id );
+		return String( id );
 	}
 
-	void LockForRead()
+	inline bool HasElement(const char* pStr) const
 	{
-		m_lock.LockForRead();
+		return Find(pStr) != UTL_INVAL_SYMBOL;
 	}
 
-	void UnlockForRead()
+	int GetNumStrings( void ) const
 	{
-		m_lock.UnlockRead();
+		return MIN( (int)m_nSymbols, (int)UTL_INVAL_SYMBOL );
 	}
 
+	// Remove all symbols in the table. Not safe while other threads use it.
+	void RemoveAll();
+
+	// Reads don't take a lock any more; these stay for code that brackets StringNoLock
+	void LockForRead() {}
+	void UnlockForRead() {}
+
 private:
-#ifdef WIN32
-	mutable CThreadSpinRWLock m_lock;
-#else
-	mutable CThreadRWLock m_lock;
-#endif
+	enum
+	{
+		BUCKET_COUNT = 4096,		// power of two
+		SEGMENT_SIZE = 256,			// strings per segment of m_pSegments
+		SEGMENT_COUNT = ( UTL_INVAL_SYMBOL + 1 ) / SEGMENT_SIZE,
+	};
+
+	struct Node_t
+	{
+		Node_t * volatile	m_pNext;
+		unsigned int		m_nHash;
+		volatile int		m_nId;		// -1 until the inserting thread has given it an id
+		char				m_String[1];
+	};
+
+	unsigned int ComputeHash( const char *pString ) const;
+	Node_t *FindNode( Node_t *pHead, const char *pString, unsigned int nHash ) const;
+	static UtlSymId_t WaitForId( const Node_t *pNode );
+
+	Node_t * volatile		m_pBuckets[BUCKET_COUNT];
+	const char ** volatile	m_pSegments[SEGMENT_COUNT];
+	CInterlockedInt			m_nSymbols;
+	bool					m_bInsensitive;
 };
 
 
@@ -51,6 +51,34 @@ public:
 
 VSTDLIB_INTERFACE IKeyValuesSystem *KeyValuesSystem();
 
+//-----------------------------------------------------------------------------
+// Purpose: Interns a key name the first time it's used and keeps the symbol, so
+//			hot code can look keys up by symbol without rehashing the string.
+//			e.g.: static CKeyValuesSymbol s_keyHealth( "health" );
+//				  pKV->GetInt( s_keyHealth );
+//-----------------------------------------------------------------------------
+class CKeyValuesSymbol
+{
+public:
+	explicit CKeyValuesSymbol( const char *pszName ) : m_pszName( pszName ), m_hSymbol( INVALID_KEY_SYMBOL ) {}
+
+	// symbols are never freed, so racing threads just store the same value
+	HKeySymbol Get() const
+	{
+		if ( m_hSymbol == INVALID_KEY_SYMBOL )
+		{
+			m_hSymbol = KeyValuesSystem()->GetSymbolForString( m_pszName );
+		}
+		return m_hSymbol;
+	}
+	operator HKeySymbol() const { return Get(); }
+	const char *GetName() const { return m_pszName; }
+
+private:
+	const char *m_pszName;
+	mutable HKeySymbol m_hSymbol;
+};
+
 // #define KEYVALUESSYSTEM_INTERFACE_VERSION "KeyValuesSystem002"
 
 #endif // VSTDLIB_IKEYVALUESSYSTEM_H
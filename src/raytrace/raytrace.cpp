@@ -4,6 +4,7 @@
 #include <filesystem_tools.h>
 #include <cmdlib.h>
 #include <stdio.h>
+#include "tier0/threadtools.h"
 
 // NOTE: This has to be the last file included!
 #include "tier0/memdbgon.h"
@@ -300,10 +301,6 @@ void CacheOptimizedTriangle::ExtractVerticesFromIntersectionFormat( Vector &v0,
 }
 
 
-#define MAILBOX_HASH_SIZE 256
-#define MAX_TREE_DEPTH 21
-#define MAX_NODE_STACK_LEN (40*MAX_TREE_DEPTH)
-
 struct NodeToVisit {
 	CacheOptimizedKDNode const *node;
 	fltx4 TMin;
@@ -383,6 +380,48 @@ void RayTracingEnvironment::Trace4Rays( const FourRays &rays, fltx4 TMin, fltx4
 	}
 }
 
+#ifdef RAYTRACE_AVX2
+// trace8_avx2.cpp
+void Trace8RaysAVX2( RayTracingEnvironment *pEnv, const FourRays rays[2], const fltx4 TMin[2], const fltx4 TMax[2],
+					 int DirectionSignMask, RayTracingResult rslt_out[2], int32 skip_id, RTECullMode_t cullMode );
+#endif
+
+static int s_nUseWidePackets = -1;							// -1 = not decided yet
+
+bool RayTracingEnvironment::SetUseWidePackets( bool bUse )
+{
+#ifdef RAYTRACE_AVX2
+	s_nUseWidePackets = ( bUse && GetCPUInformation().m_bAVX2 ) ? 1 : 0;
+#else
+	s_nUseWidePackets = 0;
+#endif
+	return s_nUseWidePackets != 0;
+}
+
+bool RayTracingEnvironment::IsUsingWidePackets( void )
+{
+	if ( s_nUseWidePackets < 0 )
+		SetUseWidePackets( true );
+	return s_nUseWidePackets != 0;
+}
+
+void RayTracingEnvironment::Trace8Rays( const FourRays rays[2], const fltx4 TMin[2], const fltx4 TMax[2],
+										int DirectionSignMask, RayTracingResult rslt_out[2],
+										int32 skip_id, RTECullMode_t cullMode )
+{
+#ifdef RAYTRACE_AVX2
+	if ( IsUsingWidePackets() )
+	{
+		rays[0].Check();
+		rays[1].Check();
+		Trace8RaysAVX2( this, rays, TMin, TMax, DirectionSignMask, rslt_out, skip_id, cullMode );
+		return;
+	}
+#endif
+	Trace4Rays( rays[0], TMin[0], TMax[0], DirectionSignMask, &rslt_out[0], skip_id, NULL, cullMode );
+	Trace4Rays( rays[1], TMin[1], TMax[1], DirectionSignMask, &rslt_out[1], skip_id, NULL, cullMode );
+}
+
 template< RTECullMode_t cullMode >
 bi32x4 DidHit( fltx4 DDotN, bi32x4 epsilon_hit )
 {
@@ -736,15 +775,15 @@ void RayTracingEnvironment::CalculateTriangleListBounds(int32 const *tris,int nt
 float RayTracingEnvironment::CalculateCostsOfSplit(
 	int split_plane,int32 const *tri_list,int ntris,
 	Vector MinBound,Vector MaxBound, float &split_value,
-	int &nleft, int &nright, int &nboth)
+	int &nleft, int &nright, int &nboth, int8 *pClassifications)
 {
 	// determine the costs of splitting on a given axis, and label triangles with respect to
-	// that axis by storing the value in coordselect0. It will also return the number of
+	// that axis by storing the value in pClassifications. It will also return the number of
 	// tris in the left, right, and nboth groups, in order to facilitate memory
 	nleft = nboth = nright = 0;
 
-	// now, label each triangle. Since we have not converted the triangles into
-	// intersection fromat yet, we can use the CoordSelect0 field of each as a temp.
+	// now, label each triangle. The labels are kept per call rather than in the triangles
+	// since subtrees are built in parallel and straddling triangles are in both.
 	nleft = 0;
 	nright = 0;
 	nboth = 0;
@@ -753,6 +792,7 @@ float RayTracingEnvironment::CalculateCostsOfSplit(
 	for( int t = 0; t < ntris; t++ )
 	{
 		CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
+		int8 &classification = pClassifications[t];
 		// determine max and min coordinate values for later optimization
 		for( int v = 0; v < 3; v++ )
 		{
@@ -763,17 +803,17 @@ float RayTracingEnvironment::CalculateCostsOfSplit(
 		{
 			case PLANECHECK_NEGATIVE:
 				nleft++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_NEGATIVE;
+				classification = PLANECHECK_NEGATIVE;
 				break;
 
 			case PLANECHECK_POSITIVE:
 				nright++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_POSITIVE;
+				classification = PLANECHECK_POSITIVE;
 				break;
 
 			case PLANECHECK_STRADDLING:
 				nboth++;
-				tri.m_Data.m_GeometryData.m_nTmpData0 = PLANECHECK_STRADDLING;
+				classification = PLANECHECK_STRADDLING;
 				break;
 		}
 	}
@@ -801,22 +841,79 @@ float RayTracingEnvironment::CalculateCostsOfSplit(
 
 #define NEVER_SPLIT 0
 
-void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list, int ntris,
+// subtrees with at least this many triangles are built on another thread, while one is free
+#define KDTREE_PARALLEL_MIN_TRIS 4096
+
+static CInterlockedInt s_nKDBuildThreads;					// build threads running
+
+struct KDSubtreeBuild_t
+{
+	RayTracingEnvironment *m_pEnv;
+	CUtlVector<CacheOptimizedKDNode> m_Nodes;				// [0] is the subtree root
+	CUtlVector<int32> m_TriIndices;
+	int32 const *m_pTriList;
+	int m_nTris;
+	Vector m_MinBound;
+	Vector m_MaxBound;
+	int m_nDepth;
+};
+
+static uintp KDSubtreeBuildThread( void *pParam )
+{
+	KDSubtreeBuild_t *pBuild = (KDSubtreeBuild_t *)pParam;
+	pBuild->m_pEnv->RefineNode( pBuild->m_Nodes, pBuild->m_TriIndices, 0, pBuild->m_pTriList, pBuild->m_nTris,
+								pBuild->m_MinBound, pBuild->m_MaxBound, pBuild->m_nDepth );
+	--s_nKDBuildThreads;
+	return 0;
+}
+
+static bool ReserveKDBuildThread( void )
+{
+	int nMaxThreads = GetCPUInformation().m_nLogicalProcessors - 1;
+	if ( ++s_nKDBuildThreads <= nMaxThreads )
+		return true;
+	--s_nKDBuildThreads;
+	return false;
+}
+
+// appends a subtree built on its own to Nodes / TriIndices, with its root going into
+// Nodes[nRootNode]. This lays it out exactly as building it in place would have.
+static void SpliceKDSubtree( CUtlVector<CacheOptimizedKDNode> &Nodes, CUtlVector<int32> &TriIndices,
+							 int nRootNode, const KDSubtreeBuild_t &build )
+{
+	int nNodeBase = Nodes.Count() - 1;						// subtree node i>0 lands at nNodeBase + i
+	int nTriBase = TriIndices.Count();
+	for( int i = 0; i < build.m_Nodes.Count(); i++ )
+	{
+		CacheOptimizedKDNode node = build.m_Nodes[i];
+		if ( node.NodeType() == KDNODE_STATE_LEAF )
+			node.Children += nTriBase << 2;
+		else
+			node.Children += nNodeBase << 2;
+		if ( i == 0 )
+			Nodes[nRootNode] = node;
+		else
+			Nodes.AddToTail( node );
+	}
+	TriIndices.AddMultipleToTail( build.m_TriIndices.Count(), build.m_TriIndices.Base() );
+}
+
+void RayTracingEnvironment::RefineNode( CUtlVector<CacheOptimizedKDNode> &Nodes, CUtlVector<int32> &TriIndices,
+										int node_number, int32 const * tri_list, int ntris,
 										Vector MinBound, Vector MaxBound, int depth )
 {
 	if ( ntris < 3 )											// never split empty lists
 	{
 		// no point in continuing
-		OptimizedKDTree[node_number].Children = KDNODE_STATE_LEAF + ( TriangleIndexList.Count() << 2 );
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode( ntris );
+		Nodes[node_number].Children = KDNODE_STATE_LEAF + ( TriIndices.Count() << 2 );
+		Nodes[node_number].SetNumberOfTrianglesInLeafNode( ntris );
 
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+		Nodes[node_number].vecMins = MinBound;
+		Nodes[node_number].vecMaxs = MaxBound;
 #endif
 
-		for( int t = 0; t < ntris; t++ )
-			TriangleIndexList.AddToTail( tri_list[t] );
+		TriIndices.AddMultipleToTail( ntris, tri_list );
 		return;
 	}
 
@@ -825,6 +922,10 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 	float best_splitvalue = 0;
 	int split_plane = 0;
 
+	// side of the trial split and of the best split so far, for each triangle
+	int8 *trial_classifications = new int8[2 * ntris];
+	int8 *best_classifications = trial_classifications + ntris;
+
 	int tri_skip = 1 + ( ntris / 10 );								// don't try all trinagles as split
 	// points when there are a lot of them
 	for( int axis = 0; axis < 3; axis++ )
@@ -849,7 +950,7 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 //				printf("ts=%d tv=%d tp=%f\n",ts,tv,trial_splitvalue);
 				float trial_cost =
 					CalculateCostsOfSplit( axis, tri_list, ntris, MinBound, MaxBound, trial_splitvalue,
-										   trial_nleft, trial_nright, trial_nboth );
+										   trial_nleft, trial_nright, trial_nboth, trial_classifications );
 // 				printf("try %d cost=%f nl=%d nr=%d nb=%d sp=%f\n",axis,trial_cost,trial_nleft,trial_nright, trial_nboth,
 // 					   trial_splitvalue);
 				if ( trial_cost < best_cost )
@@ -861,11 +962,7 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 					best_nboth = trial_nboth;
 					best_splitvalue = trial_splitvalue;
 					// save away the axis classification of each triangle
-					for( int t = 0 ; t < ntris; t++ )
-					{
-						CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
-						tri.m_Data.m_GeometryData.m_nTmpData1 = tri.m_Data.m_GeometryData.m_nTmpData0;
-					}
+					memcpy( best_classifications, trial_classifications, ntris );
 				}
 				if ( ts ==- 1 )
 					break;
@@ -877,14 +974,13 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 	if ( ( cost_of_no_split <= best_cost ) || NEVER_SPLIT || ( depth > MAX_TREE_DEPTH ))
 	{
 		// no benefit to splitting. just make this a leaf node
-		OptimizedKDTree[node_number].Children = KDNODE_STATE_LEAF + ( TriangleIndexList.Count() << 2 );
-		OptimizedKDTree[node_number].SetNumberOfTrianglesInLeafNode( ntris );
+		Nodes[node_number].Children = KDNODE_STATE_LEAF + ( TriIndices.Count() << 2 );
+		Nodes[node_number].SetNumberOfTrianglesInLeafNode( ntris );
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+		Nodes[node_number].vecMins = MinBound;
+		Nodes[node_number].vecMaxs = MaxBound;
 #endif
-		for( int t = 0; t < ntris; t++ )
-			TriangleIndexList.AddToTail( tri_list[t] );
+		TriIndices.AddMultipleToTail( ntris, tri_list );
 	}
 	else
 	{
@@ -908,8 +1004,7 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 		int n_right_output = 0;
 		for( int t = 0; t < ntris; t++ )
 		{
-			CacheOptimizedTriangle &tri = OptimizedTriangleList[tri_list[t]];
-			switch( tri.m_Data.m_GeometryData.m_nTmpData1 )
+			switch( best_classifications[t] )
 			{
 				case PLANECHECK_NEGATIVE:
 //					printf("%d goes left\n",t);
@@ -929,28 +1024,58 @@ void RayTracingEnvironment::RefineNode( int node_number, int32 const * tri_list,
 
 			}
 		}
-		int left_child = OptimizedKDTree.Count();
+		delete[] trial_classifications;
+		trial_classifications = NULL;
+
+		int left_child = Nodes.Count();
 		int right_child = left_child + 1;
 // 		printf("node %d split on axis %d at %f, nl=%d nr=%d nb=%d lc=%d rc=%d\n",node_number,
 // 			   split_plane,best_splitvalue,best_nleft,best_nright,best_nboth,
 // 			   left_child,right_child);
-		OptimizedKDTree[node_number].Children = split_plane + ( left_child << 2 );
-		OptimizedKDTree[node_number].SplittingPlaneValue = best_splitvalue;
+		Nodes[node_number].Children = split_plane + ( left_child << 2 );
+		Nodes[node_number].SplittingPlaneValue = best_splitvalue;
 #ifdef DEBUG_RAYTRACE
-		OptimizedKDTree[node_number].vecMins = MinBound;
-		OptimizedKDTree[node_number].vecMaxs = MaxBound;
+		Nodes[node_number].vecMins = MinBound;
+		Nodes[node_number].vecMaxs = MaxBound;
 #endif
 		CacheOptimizedKDNode newnode;
-		OptimizedKDTree.AddToTail( newnode );
-		OptimizedKDTree.AddToTail( newnode );
+		Nodes.AddToTail( newnode );
+		Nodes.AddToTail( newnode );
 		// now, recurse!
 		if ( ( ntris < 20 ) && ( (best_nleft == 0 ) || ( best_nright == 0 )) )
 			depth += 100;
-		RefineNode( left_child, new_triangle_list, best_nleft + best_nboth, LeftMins, LeftMaxes, depth + 1 );
-		RefineNode( right_child, new_triangle_list + best_nleft, best_nright + best_nboth,
-					RightMins, RightMaxes, depth + 1 );
+
+		int n_right_tris = best_nright + best_nboth;
+		if ( ( n_right_tris >= KDTREE_PARALLEL_MIN_TRIS ) && ReserveKDBuildThread() )
+		{
+			// build the right side on another thread while we do the left, then splice it in
+			// after the left side, which is where a serial build would have put it
+			KDSubtreeBuild_t *pBuild = new KDSubtreeBuild_t;
+			pBuild->m_pEnv = this;
+			pBuild->m_Nodes.AddToTail( newnode );
+			pBuild->m_pTriList = new_triangle_list + best_nleft;
+			pBuild->m_nTris = n_right_tris;
+			pBuild->m_MinBound = RightMins;
+			pBuild->m_MaxBound = RightMaxes;
+			pBuild->m_nDepth = depth + 1;
+			ThreadHandle_t hThread = CreateSimpleThread( KDSubtreeBuildThread, pBuild );
+
+			RefineNode( Nodes, TriIndices, left_child, new_triangle_list, best_nleft + best_nboth, LeftMins, LeftMaxes, depth + 1 );
+
+			ThreadJoin( hThread );
+			ReleaseThreadHandle( hThread );
+			SpliceKDSubtree( Nodes, TriIndices, right_child, *pBuild );
+			delete pBuild;
+		}
+		else
+		{
+			RefineNode( Nodes, TriIndices, left_child, new_triangle_list, best_nleft + best_nboth, LeftMins, LeftMaxes, depth + 1 );
+			RefineNode( Nodes, TriIndices, right_child, new_triangle_list + best_nleft, n_right_tris,
+						RightMins, RightMaxes, depth + 1 );
+		}
 		delete[] new_triangle_list;
 	}
+	delete[] trial_classifications;
 }
 
 
@@ -963,7 +1088,7 @@ void RayTracingEnvironment::SetupAccelerationStructure( void )
 		root_triangle_list[t] = t;
 	CalculateTriangleListBounds( root_triangle_list, OptimizedTriangleList.Count(), m_MinBound,
 								 m_MaxBound );
-	RefineNode( 0, root_triangle_list, OptimizedTriangleList.Count(), m_MinBound, m_MaxBound, 0 );
+	RefineNode( OptimizedKDTree, TriangleIndexList, 0, root_triangle_list, OptimizedTriangleList.Count(), m_MinBound, m_MaxBound, 0 );
 	delete[] root_triangle_list;
 
 	// now, convert all triangles to "intersection format"
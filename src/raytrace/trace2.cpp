@@ -311,21 +311,34 @@ inline void RayTracingEnvironment::FlushStreamEntry(RayStream &s,int msk, RTECul
 {
 	assert(msk>=0);
 	assert(msk<8);
-	fltx4 tmax=s.PendingRays[msk].direction.length();
-	fltx4 scl=ReciprocalSaturateSIMD(tmax);
-	s.PendingRays[msk].direction*=scl;					// normalize
-	RayTracingResult tmpresult;
-	Trace4Rays(s.PendingRays[msk],Four_Zeros,tmax,msk,&tmpresult,-1,NULL,cullMode);
+	// a full entry goes out as one 8-ray packet, a partial one (from FinishRayStream) may only
+	// need the first bundle of 4
+	int nbundles=(s.n_in_stream[msk]>4)?2:1;
+	fltx4 tmin[2]={Four_Zeros,Four_Zeros};
+	fltx4 tmax[2];
+	for(int b=0;b<nbundles;b++)
+	{
+		tmax[b]=s.PendingRays[msk][b].direction.length();
+		fltx4 scl=ReciprocalSaturateSIMD(tmax[b]);
+		s.PendingRays[msk][b].direction*=scl;				// normalize
+	}
+	RayTracingResult tmpresult[2];
+	if (nbundles==2)
+		Trace8Rays(s.PendingRays[msk],tmin,tmax,msk,tmpresult,-1,cullMode);
+	else
+		Trace4Rays(s.PendingRays[msk][0],Four_Zeros,tmax[0],msk,&tmpresult[0],-1,NULL,cullMode);
 	// now, write out results
-	for(int r=0;r<4;r++)
+	for(int r=0;r<4*nbundles;r++)
 	{
 		RayTracingSingleResult *out=s.PendingStreamOutputs[msk][r];
-		out->ray_length=SubFloat( tmax, r );
-		out->surface_normal.x=tmpresult.surface_normal.X(r);
-		out->surface_normal.y=tmpresult.surface_normal.Y(r);
-		out->surface_normal.z=tmpresult.surface_normal.Z(r);
-		out->HitID=tmpresult.HitIds[r];
-		out->HitDistance=SubFloat( tmpresult.HitDistance, r );
+		RayTracingResult const &rslt=tmpresult[r>>2];
+		int lane=r&3;
+		out->ray_length=SubFloat( tmax[r>>2], lane );
+		out->surface_normal.x=rslt.surface_normal.X(lane);
+		out->surface_normal.y=rslt.surface_normal.Y(lane);
+		out->surface_normal.z=rslt.surface_normal.Z(lane);
+		out->HitID=rslt.HitIds[lane];
+		out->HitDistance=SubFloat( rslt.HitDistance, lane );
 	}
 	s.n_in_stream[msk]=0;
 }
@@ -341,20 +354,21 @@ void RayTracingEnvironment::AddToRayStream(RayStream &s,
 	assert(msk>=0);
 	assert(msk<8);
 	int pos=s.n_in_stream[msk];
-	assert(pos<4);
-	s.PendingRays[msk].origin.X(pos)=start.x;
-	s.PendingRays[msk].origin.Y(pos)=start.y;
-	s.PendingRays[msk].origin.Z(pos)=start.z;
-	s.PendingRays[msk].direction.X(pos)=delta.x;
-	s.PendingRays[msk].direction.Y(pos)=delta.y;
-	s.PendingRays[msk].direction.Z(pos)=delta.z;
+	assert(pos<8);
+	FourRays &rays=s.PendingRays[msk][pos>>2];
+	int lane=pos&3;
+	rays.origin.X(lane)=start.x;
+	rays.origin.Y(lane)=start.y;
+	rays.origin.Z(lane)=start.z;
+	rays.direction.X(lane)=delta.x;
+	rays.direction.Y(lane)=delta.y;
+	rays.direction.Z(lane)=delta.z;
 	s.PendingStreamOutputs[msk][pos]=rslt_out;
-	if (pos==3)
+	s.n_in_stream[msk]++;
+	if (pos==7)
 	{
 		FlushStreamEntry(s,msk,cullMode);
 	}
-	else
-		s.n_in_stream[msk]++;
 }
 
 void RayTracingEnvironment::FinishRayStream(RayStream &s, RTECullMode_t cullMode )
@@ -364,15 +378,19 @@ void RayTracingEnvironment::FinishRayStream(RayStream &s, RTECullMode_t cullMode
 		int cnt=s.n_in_stream[msk];
 		if (cnt)
 		{
-			// fill in unfilled entries with dups of first
-			for(int c=cnt;c<4;c++)
+			// fill in unfilled entries of the last bundle with dups of first
+			int nfill=(cnt>4)?8:4;
+			FourRays const &first=s.PendingRays[msk][0];
+			for(int c=cnt;c<nfill;c++)
 			{
-				s.PendingRays[msk].origin.X(c) = s.PendingRays[msk].origin.X(0);
-				s.PendingRays[msk].origin.Y(c) = s.PendingRays[msk].origin.Y(0);
-				s.PendingRays[msk].origin.Z(c) = s.PendingRays[msk].origin.Z(0);
-				s.PendingRays[msk].direction.X(c) = s.PendingRays[msk].direction.X(0);
-				s.PendingRays[msk].direction.Y(c) = s.PendingRays[msk].direction.Y(0);
-				s.PendingRays[msk].direction.Z(c) = s.PendingRays[msk].direction.Z(0);
+				FourRays &rays=s.PendingRays[msk][c>>2];
+				int lane=c&3;
+				rays.origin.X(lane) = first.origin.X(0);
+				rays.origin.Y(lane) = first.origin.Y(0);
+				rays.origin.Z(lane) = first.origin.Z(0);
+				rays.direction.X(lane) = first.direction.X(0);
+				rays.direction.Y(lane) = first.direction.Y(0);
+				rays.direction.Z(lane) = first.direction.Z(0);
 				s.PendingStreamOutputs[msk][c]=s.PendingStreamOutputs[msk][0];
 			}
 			FlushStreamEntry(s,msk,cullMode);
@@ -0,0 +1,286 @@
+// $Id$
+
+// 8-wide version of RayTracingEnvironment::Trace4Rays, using AVX2. Only called through
+// Trace8Rays when the CPU reports AVX2 support, so the functions here are compiled for AVX2
+// individually and the rest of the library keeps its instruction set.
+//
+// This follows Trace4Rays operation for operation (including the reciprocal estimate plus
+// newton step), so a ray gets the same result whichever path traces it.
+
+#include "raytrace.h"
+
+#ifdef RAYTRACE_AVX2
+
+#include <immintrin.h>
+
+// NOTE: This has to be the last file included!
+#include "tier0/memdbgon.h"
+
+
+#if defined( GNUC )
+#define AVX2_FUNC __attribute__(( target( "avx2" ) ))
+#else
+#define AVX2_FUNC
+#endif
+
+struct NodeToVisit8
+{
+	CacheOptimizedKDNode const *node;
+	__m256 TMin;
+	__m256 TMax;
+};
+
+
+AVX2_FUNC static FORCEINLINE __m256 Combine8( const fltx4 &lo, const fltx4 &hi )
+{
+	return _mm256_insertf128_ps( _mm256_castps128_ps256( lo ), hi, 1 );
+}
+
+AVX2_FUNC static FORCEINLINE void Split8( __m256 v, fltx4 &lo, fltx4 &hi )
+{
+	lo = _mm256_castps256_ps128( v );
+	hi = _mm256_extractf128_ps( v, 1 );
+}
+
+AVX2_FUNC static FORCEINLINE bool IsAnyTrue8( __m256 mask )
+{
+	return _mm256_movemask_ps( mask ) != 0;
+}
+
+AVX2_FUNC static FORCEINLINE __m256 Select8( __m256 old, __m256 value, __m256 mask )
+{
+	return _mm256_blendv_ps( old, value, mask );
+}
+
+// ReciprocalSaturateSIMD: 1/0 gives a big but finite result
+AVX2_FUNC static FORCEINLINE __m256 ReciprocalSaturate8( __m256 a )
+{
+	__m256 zero_mask = _mm256_cmp_ps( a, _mm256_setzero_ps(), _CMP_EQ_OQ );
+	a = _mm256_or_ps( a, _mm256_and_ps( _mm256_set1_ps( SubFloat( Four_Epsilons, 0 ) ), zero_mask ) );
+	__m256 ret = _mm256_rcp_ps( a );
+	return _mm256_sub_ps( _mm256_add_ps( ret, ret ), _mm256_mul_ps( a, _mm256_mul_ps( ret, ret ) ) );
+}
+
+
+template <RTECullMode_t cullMode>
+AVX2_FUNC static void Trace8RaysAVX2( RayTracingEnvironment *pEnv, const FourRays rays[2],
+									  const fltx4 TMin4[2], const fltx4 TMax4[2], int DirectionSignMask,
+									  RayTracingResult rslt_out[2], int32 skip_id )
+{
+	const __m256 Eps = _mm256_set1_ps( 1.0e-10f );		// FourEpsilons and FourZeros in raytrace.cpp
+	const __m256 NegEps = _mm256_set1_ps( -1.0e-10f );
+	const __m256 Zero = _mm256_setzero_ps();
+	const __m256 One = _mm256_set1_ps( 1.0f );
+
+	__m256 origin[3], direction[3], OneOverRayDir[3];
+	for( int c = 0; c < 3; c++ )
+	{
+		origin[c] = Combine8( rays[0].origin[c], rays[1].origin[c] );
+		direction[c] = Combine8( rays[0].direction[c], rays[1].direction[c] );
+		OneOverRayDir[c] = ReciprocalSaturate8( direction[c] );
+	}
+
+	__m256 HitIds = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+	__m256 HitDistance = _mm256_set1_ps( 1.0e23f );
+	__m256 NormalX = Zero, NormalY = Zero, NormalZ = Zero;
+
+	__m256 TMin = Combine8( TMin4[0], TMin4[1] );
+	__m256 TMax = Combine8( TMax4[0], TMax4[1] );
+
+	// now, clip rays against bounding box
+	for( int c = 0; c < 3; c++ )
+	{
+		__m256 isect_min_t =
+			_mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( pEnv->m_MinBound[c] ), origin[c] ), OneOverRayDir[c] );
+		__m256 isect_max_t =
+			_mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( pEnv->m_MaxBound[c] ), origin[c] ), OneOverRayDir[c] );
+		TMin = _mm256_max_ps( TMin, _mm256_min_ps( isect_min_t, isect_max_t ) );
+		TMax = _mm256_min_ps( TMax, _mm256_max_ps( isect_min_t, isect_max_t ) );
+	}
+
+	if ( IsAnyTrue8( _mm256_cmp_ps( TMin, TMax, _CMP_LE_OS ) ) )
+	{
+		int32 mailboxids[MAILBOX_HASH_SIZE];				// used to avoid redundant triangle tests
+		memset( mailboxids, 0xff, sizeof( mailboxids ) );
+
+		// based on ray direction, whether to visit left or right node first
+		int front_idx[3], back_idx[3];
+		for( int c = 0; c < 3; c++ )
+		{
+			back_idx[c] = ( DirectionSignMask & ( 1 << c ) ) ? 0 : 1;
+			front_idx[c] = 1 - back_idx[c];
+		}
+
+		NodeToVisit8 NodeQueue[MAX_NODE_STACK_LEN];
+		CacheOptimizedKDNode const *CurNode = &( pEnv->OptimizedKDTree[0] );
+		NodeToVisit8 *stack_ptr = &NodeQueue[MAX_NODE_STACK_LEN];
+		while( 1 )
+		{
+			while ( CurNode->NodeType() != KDNODE_STATE_LEAF )	// traverse until next leaf
+			{
+				int split_plane_number = CurNode->NodeType();
+				CacheOptimizedKDNode const *FrontChild = &( pEnv->OptimizedKDTree[CurNode->LeftChild()] );
+
+				__m256 dist_to_sep_plane =					// dist=(split-org)/dir
+					_mm256_mul_ps( _mm256_sub_ps( _mm256_set1_ps( CurNode->SplittingPlaneValue ),
+												  origin[split_plane_number] ), OneOverRayDir[split_plane_number] );
+
+				__m256 active = _mm256_cmp_ps( TMin, TMax, _CMP_LE_OS );
+
+				// now, decide how to traverse children. can either do front,back, or do front and push
+				// back.
+				__m256 hits_front = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMin, _CMP_GE_OS ) );
+				if ( ! IsAnyTrue8( hits_front ) )
+				{
+					// missed the front. only traverse back
+					CurNode = FrontChild + back_idx[split_plane_number];
+					TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+				}
+				else
+				{
+					__m256 hits_back = _mm256_and_ps( active, _mm256_cmp_ps( dist_to_sep_plane, TMax, _CMP_LE_OS ) );
+					if ( ! IsAnyTrue8( hits_back ) )
+					{
+						// missed the back - only need to traverse front node
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+					else
+					{
+						// at least some rays hit both nodes.
+						// must push far, traverse near
+						Assert( stack_ptr > NodeQueue );
+						-- stack_ptr;
+						stack_ptr->node = FrontChild + back_idx[split_plane_number];
+						stack_ptr->TMin = _mm256_max_ps( TMin, dist_to_sep_plane );
+						stack_ptr->TMax = TMax;
+						CurNode = FrontChild + front_idx[split_plane_number];
+						TMax = _mm256_min_ps( TMax, dist_to_sep_plane );
+					}
+				}
+			}
+			// hit a leaf! must do intersection check
+			int ntris = CurNode->NumberOfTrianglesInLeaf();
+			if ( ntris )
+			{
+				int32 const * tlist = &( pEnv->TriangleIndexList[CurNode->TriangleIndexStart()] );
+				do
+				{
+					int tnum = *( tlist++ );
+					// check mailbox
+					int mbox_slot = tnum & ( MAILBOX_HASH_SIZE - 1 );
+					TriIntersectData_t const * tri = &( pEnv->OptimizedTriangleList[tnum].m_Data.m_IntersectData );
+					if ( ( mailboxids[mbox_slot] == tnum ) || ( tri->m_nTriangleID == skip_id ) )
+						continue;
+					mailboxids[mbox_slot] = tnum;
+
+					// compute plane intersection
+					__m256 Nx = _mm256_set1_ps( tri->m_flNx );
+					__m256 Ny = _mm256_set1_ps( tri->m_flNy );
+					__m256 Nz = _mm256_set1_ps( tri->m_flNz );
+
+					__m256 DDotN = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( direction[0], Nx ),
+																 _mm256_mul_ps( direction[1], Ny ) ),
+												  _mm256_mul_ps( direction[2], Nz ) );
+
+					__m256 did_hit = _mm256_or_ps( _mm256_cmp_ps( DDotN, Eps, _CMP_GT_OS ),
+												   _mm256_cmp_ps( DDotN, NegEps, _CMP_LT_OS ) );
+					if ( cullMode == RTE_CULL_FRONT )
+						did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( DDotN, Zero, _CMP_GT_OS ) );
+					else if ( cullMode == RTE_CULL_BACK )
+						did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( DDotN, Zero, _CMP_LT_OS ) );
+
+					__m256 ODotN = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( origin[0], Nx ),
+																 _mm256_mul_ps( origin[1], Ny ) ),
+												  _mm256_mul_ps( origin[2], Nz ) );
+					__m256 numerator = _mm256_sub_ps( _mm256_set1_ps( tri->m_flD ), ODotN );
+
+					__m256 isect_t = _mm256_div_ps( numerator, DDotN );
+					// now, we have the distance to the plane. lets update our mask
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, Eps, _CMP_GT_OS ) );
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( isect_t, HitDistance, _CMP_LT_OS ) );
+
+					if ( ! IsAnyTrue8( did_hit ) )
+						continue;
+
+					// now, check 3 edges
+					__m256 hitc1 = _mm256_add_ps( origin[tri->m_nCoordSelect0],
+												  _mm256_mul_ps( isect_t, direction[tri->m_nCoordSelect0] ) );
+					__m256 hitc2 = _mm256_add_ps( origin[tri->m_nCoordSelect1],
+												  _mm256_mul_ps( isect_t, direction[tri->m_nCoordSelect1] ) );
+
+					// do barycentric coordinate check
+					__m256 B0 = _mm256_mul_ps( _mm256_set1_ps( tri->m_ProjectedEdgeEquations[0] ), hitc1 );
+					B0 = _mm256_add_ps( B0, _mm256_mul_ps( _mm256_set1_ps( tri->m_ProjectedEdgeEquations[1] ), hitc2 ) );
+					B0 = _mm256_add_ps( B0, _mm256_set1_ps( tri->m_ProjectedEdgeEquations[2] ) );
+
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B0, Eps, _CMP_GE_OS ) );
+
+					__m256 B1 = _mm256_mul_ps( _mm256_set1_ps( tri->m_ProjectedEdgeEquations[3] ), hitc1 );
+					B1 = _mm256_add_ps( B1, _mm256_mul_ps( _mm256_set1_ps( tri->m_ProjectedEdgeEquations[4] ), hitc2 ) );
+					B1 = _mm256_add_ps( B1, _mm256_set1_ps( tri->m_ProjectedEdgeEquations[5] ) );
+
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B1, Eps, _CMP_GE_OS ) );
+
+					__m256 B2 = _mm256_add_ps( B1, B0 );
+					did_hit = _mm256_and_ps( did_hit, _mm256_cmp_ps( B2, One, _CMP_LE_OS ) );
+
+					if ( ! IsAnyTrue8( did_hit ) )
+						continue;
+
+					// now, set the hit_id and closest_hit fields for any enabled rays
+					HitIds = Select8( HitIds, _mm256_castsi256_ps( _mm256_set1_epi32( tnum ) ), did_hit );
+					HitDistance = Select8( HitDistance, isect_t, did_hit );
+					NormalX = Select8( NormalX, Nx, did_hit );
+					NormalY = Select8( NormalY, Ny, did_hit );
+					NormalZ = Select8( NormalZ, Nz, did_hit );
+				} while ( --ntris );
+
+				// now, check if all rays have terminated
+				if ( ! IsAnyTrue8( _mm256_cmp_ps( TMax, HitDistance, _CMP_LE_OS ) ) )
+					break;
+			}
+
+			if ( stack_ptr == &NodeQueue[MAX_NODE_STACK_LEN] )
+				break;
+
+			// pop stack!
+			CurNode = stack_ptr->node;
+			TMin = stack_ptr->TMin;
+			TMax = stack_ptr->TMax;
+			stack_ptr++;
+		}
+	}
+
+	fltx4 lo, hi;
+	Split8( HitIds, lo, hi );
+	StoreAlignedSIMD( (float *)rslt_out[0].HitIds, lo );
+	StoreAlignedSIMD( (float *)rslt_out[1].HitIds, hi );
+	Split8( HitDistance, rslt_out[0].HitDistance, rslt_out[1].HitDistance );
+	Split8( NormalX, rslt_out[0].surface_normal.x, rslt_out[1].surface_normal.x );
+	Split8( NormalY, rslt_out[0].surface_normal.y, rslt_out[1].surface_normal.y );
+	Split8( NormalZ, rslt_out[0].surface_normal.z, rslt_out[1].surface_normal.z );
+}
+
+
+AVX2_FUNC void Trace8RaysAVX2( RayTracingEnvironment *pEnv, const FourRays rays[2], const fltx4 TMin[2], const fltx4 TMax[2],
+							   int DirectionSignMask, RayTracingResult rslt_out[2], int32 skip_id, RTECullMode_t cullMode )
+{
+	switch ( cullMode )
+	{
+	case RTE_CULL_FRONT:
+		Trace8RaysAVX2<RTE_CULL_FRONT>( pEnv, rays, TMin, TMax, DirectionSignMask, rslt_out, skip_id );
+		break;
+	case RTE_CULL_BACK:
+		Trace8RaysAVX2<RTE_CULL_BACK>( pEnv, rays, TMin, TMax, DirectionSignMask, rslt_out, skip_id );
+		break;
+	default:
+		Trace8RaysAVX2<RTE_CULL_NONE>( pEnv, rays, TMin, TMax, DirectionSignMask, rslt_out, skip_id );
+		break;
+	}
+
+	// the rest of the library may be plain SSE code; avoid the AVX to SSE transition penalty
+	_mm256_zeroupper();
+}
+
+#endif // RAYTRACE_AVX2
@@ -21,6 +21,7 @@ char *GetCommandLine();
 #include "tier0/valve_on.h"
 #include "tier0/threadtools.h"
 #include "tier0/icommandline.h"
+#include "mem_helpers.h"
 
 #if defined( LINUX ) || defined( OSX )
 #include <dlfcn.h>
@@ -103,6 +104,12 @@ BOOL WINAPI DllMain(
 )
 {
 	g_hTier0Instance = hinstDLL;
+
+	// The allocator hands an exiting thread's caches on to the next thread
+	if ( fdwReason == DLL_THREAD_DETACH && g_pfnMemAllocThreadExit )
+	{
+		g_pfnMemAllocThreadExit();
+	}
 	return true;
 }
 #endif
@@ -361,6 +361,35 @@ static bool Check3DNowTechnology(void)
 #endif
 }
 
+// AVX2 and FMA3 are only usable if the OS saves the YMM registers on context switches too
+static bool CheckAVX2Technology( void )
+{
+#if defined( _X360 ) || defined( _PS3 )
+	return false;
+#else
+	if ( cpuid( 0 ).eax < 7 )
+		return false;
+
+	CpuIdResult_t cpuid1 = cpuid( 1 );
+	const unsigned long nRequired1 = ( 1 << 12 ) | ( 1 << 27 ) | ( 1 << 28 );	// FMA, OSXSAVE, AVX
+	if ( ( cpuid1.ecx & nRequired1 ) != nRequired1 )
+		return false;
+	if ( !( cpuidex( 7, 0 ).ebx & ( 1 << 5 ) ) )						// AVX2
+		return false;
+
+	// XCR0 bits 1 and 2: XMM and YMM state enabled by the OS
+#if defined( GNUC )
+	uint32 nXCR0Lo, nXCR0Hi;
+	asm volatile( "xgetbv" : "=a" ( nXCR0Lo ), "=d" ( nXCR0Hi ) : "c" ( 0 ) );
+	return ( nXCR0Lo & 6 ) == 6;
+#elif defined( PLATFORM_WINDOWS_PC )
+	return ( _xgetbv( 0 ) & 6 ) == 6;
+#else
+	return false;
+#endif
+#endif
+}
+
 static bool CheckCMOVTechnology()
 {
 #if defined( _X360 ) || defined( _PS3 )
@@ -829,6 +858,7 @@ const CPUInformation& GetCPUInformation()
 		pi.m_bSSE42 = ( cpuid1.ecx >> 20 ) & 1;
 		pi.m_b3DNow = Check3DNowTechnology();
 		pi.m_bAVX	= ( cpuid1.ecx >> 28 ) & 1;
+		pi.m_bAVX2	= CheckAVX2Technology();
 		pi.m_szProcessorID = ( tchar* )GetProcessorVendorId();
 		pi.m_szProcessorBrand = ( tchar* )GetProcessorBrand();
 		pi.m_bHT = ( pi.m_nPhysicalProcessors < pi.m_nLogicalProcessors ); //HTSupported();
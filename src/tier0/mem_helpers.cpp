@@ -17,6 +17,7 @@
 // Needed for debugging
 const char *g_pszModule = "tier0";
 bool g_bInitMemory = true;
+void (*g_pfnMemAllocThreadExit)() = NULL;
 
 #if defined(PLATFORM_POSIX) || defined( PLATFORM_PS3)
 void DoApplyMemoryInitializations( void *pMem, size_t nSize )
@@ -42,4 +42,7 @@ inline bool CheckWindowsAllocSettings( const char* upperCommandLine ) { return f
 
 size_t CalcHeapUsed();
 
+// Set by the allocator if it wants to hear about threads exiting, see DllMain
+extern void (*g_pfnMemAllocThreadExit)();
+
 #endif // MEM_HELPERS_H
@@ -14,6 +14,7 @@
 //#include <malloc.h>
 
 #include <algorithm>
+#include <new>
 
 #include "tier0/dbg.h"
 #include "tier0/memalloc.h"
@@ -97,6 +98,48 @@ void RemoveMemoryInfoCallback( IMemoryInfo* pMemoryInfo )
 	Assert( !"Tried removing a callback that wasn't there!" );
 }
 
+// Allocation size histogram, see MemAlloc_StartSizeHistogram. Costs one branch
+// per allocation while it isn't recording.
+static bool volatile s_bRecordSizeHistogram = false;
+static int32 volatile s_nSizeHistogram[MEMALLOC_SIZE_HISTOGRAM_BUCKETS];
+static int64 volatile s_nSizeHistogramLargeBytes;
+
+static FORCEINLINE void NoteAllocSize( size_t nSize )
+{
+	if ( !s_bRecordSizeHistogram )
+		return;
+
+	size_t iBucket = ( nSize > 0 ) ? ( nSize - 1 ) / MEMALLOC_SIZE_HISTOGRAM_STEP : 0;
+	if ( iBucket >= MEMALLOC_SIZE_HISTOGRAM_BUCKETS - 1 )
+	{
+		iBucket = MEMALLOC_SIZE_HISTOGRAM_BUCKETS - 1;
+		ThreadInterlockedExchangeAdd64( &s_nSizeHistogramLargeBytes, (int64)nSize );
+	}
+	ThreadInterlockedIncrement( &s_nSizeHistogram[iBucket] );
+}
+
+void MemAlloc_StartSizeHistogram()
+{
+	for ( int i = 0; i < MEMALLOC_SIZE_HISTOGRAM_BUCKETS; ++i )
+	{
+		s_nSizeHistogram[i] = 0;
+	}
+	s_nSizeHistogramLargeBytes = 0;
+	ThreadMemoryBarrier();
+	s_bRecordSizeHistogram = true;
+}
+
+void MemAlloc_StopSizeHistogram( uint32 *pCounts, uint64 *pLargeBytes )
+{
+	s_bRecordSizeHistogram = false;
+	ThreadMemoryBarrier();
+	for ( int i = 0; i < MEMALLOC_SIZE_HISTOGRAM_BUCKETS; ++i )
+	{
+		pCounts[i] = (uint32)s_nSizeHistogram[i];
+	}
+	*pLargeBytes = (uint64)s_nSizeHistogramLargeBytes;
+}
+
 // Dump a summary of all of the non-heap memory blocks that have been
 // registered with AddMemoryInfoCallback.
 void DumpMemoryInfoStats()
@@ -392,6 +435,15 @@ void SetAllocatorObject( IMemAlloc* pAllocator )
 
 #endif // _PS3
 
+#if MEM_SBH_ENABLED && defined( SBH_THREAD_CACHE )
+// tier0's DllMain calls this on DLL_THREAD_DETACH, so the small block heaps
+// can hand the exiting thread's caches on
+static void SBHThreadExit()
+{
+	s_StdMemAlloc.ReleaseThreadCaches();
+}
+#endif
+
 CStdMemAlloc::CStdMemAlloc()
 :	m_pfnFailHandler( DefaultFailHandler ),
 	m_sMemoryAllocFailed( (size_t)0 ),
@@ -427,6 +479,10 @@ CStdMemAlloc::CStdMemAlloc()
 #endif
 	}
 #endif
+
+#if MEM_SBH_ENABLED && defined( SBH_THREAD_CACHE )
+	g_pfnMemAllocThreadExit = SBHThreadExit;
+#endif
 }
 
 #if MEM_SBH_ENABLED
@@ -538,6 +594,13 @@ void CSmallBlockPool<CAllocator>::Init( unsigned nBlockSize )
 	m_nIsCompact = 1;
 }
 
+#ifdef SBH_THREAD_CACHE
+template <typename CAllocator>
+DECL_THREAD_LOCAL typename CSmallBlockPool<CAllocator>::ThreadCache_t *CSmallBlockPool<CAllocator>::gm_pThreadCache = NULL;
+template <typename CAllocator>
+DECL_THREAD_LOCAL bool CSmallBlockPool<CAllocator>::gm_bThreadExited = false;
+#endif
+
 template <typename CAllocator>
 size_t CSmallBlockPool<CAllocator>::GetBlockSize()
 {
@@ -583,6 +646,17 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 		sharedLock.LockForRead();
 	}
 
+	byte *pResult = AllocLocked( pSharedData );
+
+	sharedLock.UnlockRead();
+
+	return pResult;
+}
+
+// Takes a block off the shared free list or the pool's current page, the caller holds the shared lock for read
+template <typename CAllocator>
+byte *CSmallBlockPool<CAllocator>::AllocLocked( SharedData_t *pSharedData )
+{
 	byte *pResult;
 	intp iPage = -1;
 	int iThreadPriority = INT_MAX;
@@ -660,7 +734,6 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 						{
 							m_pNextAlloc = NULL;
 							m_CommitMutex.Unlock();
-							sharedLock.UnlockRead();
 							return NULL;
 						}
 					}
@@ -697,8 +770,6 @@ void *CSmallBlockPool<CAllocator>::Alloc()
 #endif
 	++pSharedData->m_PageStatus[iPage].m_nAllocated;
 
-	sharedLock.UnlockRead();
-
 	return pResult;
 }
 
@@ -706,13 +777,26 @@ template <typename CAllocator>
 void CSmallBlockPool<CAllocator>::Free( void *p )
 {
 	SharedData_t *pSharedData = GetSharedData();
-	size_t iPage = (size_t)((byte *)p - pSharedData->m_pBase) / BYTES_PAGE;
 
 	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
 	if ( !sharedLock.TryLockForRead() )
 	{
 		sharedLock.LockForRead();
 	}
+
+	FreeLocked( pSharedData, p );
+
+	sharedLock.UnlockRead();
+
+	ValidateFreelist( pSharedData );
+}
+
+// Puts a block back on the shared free list, the caller holds the shared lock for read
+template <typename CAllocator>
+void CSmallBlockPool<CAllocator>::FreeLocked( SharedData_t *pSharedData, void *p )
+{
+	size_t iPage = (size_t)((byte *)p - pSharedData->m_pBase) / BYTES_PAGE;
+
 	--pSharedData->m_PageStatus[iPage].m_nAllocated;
 
 	// Once the last allocation is removed from any page in a pool, the pool will no longer be considered compact
@@ -729,17 +813,88 @@ void CSmallBlockPool<CAllocator>::Free( void *p )
 	++m_nFreeBlocks;
 #endif
 	m_FreeList.Push( p );
-	pSharedData->m_Lock.UnlockRead();
+}
+
+// Fills a thread's magazine with up to nBlocks blocks, taking the shared lock once for all of them
+template <typename CAllocator>
+int CSmallBlockPool<CAllocator>::AllocBatch( Magazine_t &magazine, int nBlocks )
+{
+	SharedData_t *pSharedData = GetSharedData();
+
+	ValidateFreelist( pSharedData );
+
+	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
+	if ( !sharedLock.TryLockForRead() )
+	{
+		sharedLock.LockForRead();
+	}
+
+	int nAllocated = 0;
+	while ( nAllocated < nBlocks )
+	{
+		TSLNodeBase_t *pBlock = (TSLNodeBase_t *)AllocLocked( pSharedData );
+		if ( !pBlock )
+		{
+			break;
+		}
+
+		pBlock->Next = magazine.m_pHead;
+		magazine.m_pHead = pBlock;
+		nAllocated++;
+	}
+	magazine.m_nCount += nAllocated;
+
+	sharedLock.UnlockRead();
+
+	return nAllocated;
+}
+
+// Returns up to nBlocks blocks from a thread's magazine to the shared free list
+template <typename CAllocator>
+void CSmallBlockPool<CAllocator>::FreeBatch( Magazine_t &magazine, int nBlocks )
+{
+	SharedData_t *pSharedData = GetSharedData();
+
+	CThreadSpinRWLock &sharedLock = pSharedData->m_Lock;
+	if ( !sharedLock.TryLockForRead() )
+	{
+		sharedLock.LockForRead();
+	}
+
+	while ( nBlocks-- > 0 && magazine.m_pHead )
+	{
+		TSLNodeBase_t *pBlock = magazine.m_pHead;
+		magazine.m_pHead = pBlock->Next;
+		magazine.m_nCount--;
+		FreeLocked( pSharedData, pBlock );
+	}
+
+	sharedLock.UnlockRead();
 
 	ValidateFreelist( pSharedData );
 }
 
+// Blocks sitting in the threads' magazines, read while their owners work on them which is good enough for statistics
+template <typename CAllocator>
+int CSmallBlockPool<CAllocator>::CountCachedBlocks()
+{
+	if ( m_iMagazine < 0 )
+		return 0;
+
+	int nCached = 0;
+	for ( ThreadCache_t *pCache = GetSharedData()->m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		nCached += pCache->m_Magazines[m_iMagazine].m_nCount;
+	}
+	return nCached;
+}
+
 // Count the free blocks.  
 template <typename CAllocator>
 int CSmallBlockPool<CAllocator>::CountFreeBlocks()
 {
 #ifdef TRACK_SBH_COUNTS
-	return m_nFreeBlocks;
+	return m_nFreeBlocks + CountCachedBlocks();
 #else
 	return 0;
 #endif
@@ -1313,6 +1468,73 @@ CSmallBlockHeap<CAllocator>::CSmallBlockHeap()
 		Error( "SBH configuration error: %d/%d pools initialized\n", iCurPool, NUM_POOLS );
 	}
 #endif
+
+	InitThreadCache();
+}
+
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::InitThreadCache()
+{
+#ifdef SBH_THREAD_CACHE
+	const char *pszPlatCommandLine = Plat_GetCommandLineA();
+	if ( pszPlatCommandLine && strstr( pszPlatCommandLine, "-nosbhthreadcache" ) )
+		return;
+
+	for ( int i = 0; i < NUM_POOLS; i++ )
+	{
+		unsigned nBlockSize = (unsigned)m_Pools[i].GetBlockSize();
+		if ( nBlockSize > SBH_MAGAZINE_MAX_BLOCK )
+			continue;
+
+		m_Pools[i].m_iMagazine = i;
+		m_Pools[i].m_nMagazineSize = MIN( SBH_MAGAZINE_BYTES / nBlockSize, SBH_MAGAZINE_MAX_BLOCKS );
+	}
+#endif
+}
+
+template <typename CAllocator>
+typename CSmallBlockHeap<CAllocator>::ThreadCache_t *CSmallBlockHeap<CAllocator>::GetThreadCache()
+{
+#ifdef SBH_THREAD_CACHE
+	ThreadCache_t *pCache = CPool::gm_pThreadCache;
+	if ( pCache )
+		return pCache;
+
+	// Whatever a thread frees on its way out goes straight to the shared lists
+	if ( CPool::gm_bThreadExited )
+		return NULL;
+
+	// Caches are only ever pushed on the front, so walking the list is safe
+	for ( pCache = m_pSharedData->m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		if ( ThreadInterlockedAssignIf( &pCache->m_nState, CPool::THREAD_CACHE_OWNED, CPool::THREAD_CACHE_ORPHANED ) )
+			break;
+	}
+
+	if ( !pCache )
+	{
+		// Straight from the shared list, so this never comes back here
+		pCache = (ThreadCache_t *)FindPool( sizeof( ThreadCache_t ) )->Alloc();
+		if ( !pCache )
+			return NULL;
+
+		memset( pCache, 0, sizeof( *pCache ) );
+		pCache->m_nState = CPool::THREAD_CACHE_OWNED;
+
+		ThreadCache_t *pHead;
+		do
+		{
+			pHead = m_pSharedData->m_pThreadCaches;
+			pCache->m_pNext = pHead;
+		}
+		while ( ThreadInterlockedCompareExchangePointer( (void * volatile *)&m_pSharedData->m_pThreadCaches, pCache, pHead ) != pHead );
+	}
+
+	CPool::gm_pThreadCache = pCache;
+	return pCache;
+#else
+	return NULL;
+#endif
 }
 
 template <typename CAllocator>
@@ -1341,6 +1563,26 @@ void *CSmallBlockHeap<CAllocator>::Alloc( size_t nBytes )
 	}
 	Assert( ShouldUse( nBytes ) );
 	CPool *pPool = FindPool( nBytes );
+
+#ifdef SBH_THREAD_CACHE
+	if ( pPool->m_nMagazineSize )
+	{
+		ThreadCache_t *pCache = GetThreadCache();
+		if ( pCache )
+		{
+			Magazine_t &magazine = pCache->m_Magazines[pPool->m_iMagazine];
+			TSLNodeBase_t *pBlock = NULL;
+			if ( magazine.m_nCount || pPool->AllocBatch( magazine, pPool->m_nMagazineSize / 2 ) )
+			{
+				pBlock = magazine.m_pHead;
+				magazine.m_pHead = pBlock->Next;
+				magazine.m_nCount--;
+			}
+			return pBlock;
+		}
+	}
+#endif
+
 	void *p = pPool->Alloc();
 	return p;
 }
@@ -1383,7 +1625,7 @@ void *CSmallBlockHeap<CAllocator>::Realloc( void *p, size_t nBytes )
 		return p;
 	}
 
-	pOldPool->Free( p );
+	FreeToPool( pOldPool, p );
 
 	return pNewBlock;
 }
@@ -1394,7 +1636,7 @@ void CSmallBlockHeap<CAllocator>::Free( void *p )
 	CPool *pPool = FindPool( p );
 	if ( pPool )
 	{
-		pPool->Free( p );
+		FreeToPool( pPool, p );
 	}
 	else
 	{
@@ -1403,6 +1645,82 @@ void CSmallBlockHeap<CAllocator>::Free( void *p )
 	}
 }
 
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::FreeToPool( CPool *pPool, void *p )
+{
+#ifdef SBH_THREAD_CACHE
+	if ( pPool->m_nMagazineSize )
+	{
+		ThreadCache_t *pCache = GetThreadCache();
+		if ( pCache )
+		{
+			Magazine_t &magazine = pCache->m_Magazines[pPool->m_iMagazine];
+			TSLNodeBase_t *pBlock = (TSLNodeBase_t *)p;
+			pBlock->Next = magazine.m_pHead;
+			magazine.m_pHead = pBlock;
+
+			if ( ++magazine.m_nCount > pPool->m_nMagazineSize )
+			{
+				pPool->FreeBatch( magazine, pPool->m_nMagazineSize / 2 );
+			}
+			return;
+		}
+	}
+#endif
+
+	pPool->Free( p );
+}
+
+// Orphans the current thread's cache, blocks and all, for the next new thread
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::ReleaseThreadCache()
+{
+#ifdef SBH_THREAD_CACHE
+	CPool::gm_bThreadExited = true;
+
+	ThreadCache_t *pCache = CPool::gm_pThreadCache;
+	if ( pCache )
+	{
+		CPool::gm_pThreadCache = NULL;
+		ThreadInterlockedExchange( &pCache->m_nState, CPool::THREAD_CACHE_ORPHANED );
+	}
+#endif
+}
+
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::FlushThreadCache( ThreadCache_t *pCache )
+{
+	for ( int i = 0; i < NUM_POOLS; i++ )
+	{
+		Magazine_t &magazine = pCache->m_Magazines[i];
+		if ( magazine.m_nCount )
+		{
+			m_Pools[i].FreeBatch( magazine, magazine.m_nCount );
+		}
+	}
+}
+
+// Returns the blocks in this thread's magazines and in orphaned caches to the
+// shared free lists. Other live threads keep theirs, nobody else may touch them.
+template <typename CAllocator>
+void CSmallBlockHeap<CAllocator>::FlushThreadCaches()
+{
+#ifdef SBH_THREAD_CACHE
+	for ( ThreadCache_t *pCache = m_pSharedData->m_pThreadCaches; pCache; pCache = pCache->m_pNext )
+	{
+		if ( pCache == CPool::gm_pThreadCache )
+		{
+			FlushThreadCache( pCache );
+		}
+		else if ( ThreadInterlockedAssignIf( &pCache->m_nState, CPool::THREAD_CACHE_FLUSHING, CPool::THREAD_CACHE_ORPHANED ) )
+		{
+			FlushThreadCache( pCache );
+			ThreadInterlockedExchange( &pCache->m_nState, CPool::THREAD_CACHE_ORPHANED );
+		}
+	}
+#endif
+}
+
 template <typename CAllocator>
 size_t CSmallBlockHeap<CAllocator>::GetSize( void *p )
 {
@@ -1618,6 +1936,9 @@ size_t CSmallBlockHeap<CAllocator>::Compact( bool bIncremental )
 	}
 	else
 	{
+		// Pages with blocks in a magazine count as in use, give back what we can first
+		FlushThreadCaches();
+
 		for ( int i = 0; i < NUM_POOLS; i++ )
 		{
 			nRecovered += m_Pools[i].Compact( bIncremental );
@@ -2007,6 +2328,7 @@ INTERNAL_INLINE void *CStdMemAlloc::InternalAllocFromPools( size_t nSize )
 INTERNAL_INLINE void *CStdMemAlloc::InternalAlloc( int region, size_t nSize )
 {
 	PROFILE_ALLOC(Malloc);
+	NoteAllocSize( nSize );
 	
 	void *pMem;
 
@@ -2819,6 +3141,19 @@ size_t CStdMemAlloc::InternalCompact( bool bSmallBlockOnly )
 	return nTotalBytesRecovered;
 }
 
+void CStdMemAlloc::ReleaseThreadCaches()
+{
+#if MEM_SBH_ENABLED
+#ifndef MEMALLOC_NO_FALLBACK
+	m_FallbackSBH.ReleaseThreadCache();
+#endif
+	m_PrimarySBH.ReleaseThreadCache();
+#ifdef MEMALLOC_USE_SECONDARY_SBH
+	m_SecondarySBH.ReleaseThreadCache();
+#endif
+#endif // MEM_SBH_ENABLED
+}
+
 void CStdMemAlloc::CompactIncremental()
 {
 #if MEM_SBH_ENABLED
@@ -70,6 +70,17 @@
 #define TRACK_SBH_COUNTS
 #endif
 
+// Every thread keeps a magazine of free blocks for each of the smaller pools, so
+// most allocations and frees never touch the pool's shared free list. Magazines
+// are refilled from and flushed to the shared list half a magazine at a time.
+// Needs tier0's DllMain to hear about threads exiting, so their caches can be reused.
+#if defined( DECL_THREAD_LOCAL ) && defined( PLATFORM_WINDOWS_PC ) && !defined( STATIC_TIER0 )
+#define SBH_THREAD_CACHE 1
+#endif
+#define SBH_MAGAZINE_MAX_BLOCK		1024		// larger blocks always go through the shared free list
+#define SBH_MAGAZINE_BYTES			( 8 * 1024 )	// what a thread may keep per pool
+#define SBH_MAGAZINE_MAX_BLOCKS		64
+
 #if defined(_X360)
 
 // 360 uses a 48MB primary (physical) SBH and 10MB secondary (virtual) SBH, with no fallback
@@ -126,6 +137,8 @@ public:
 		m_nBlockSize = 0;
 		m_nCommittedPages = 0;
 		m_pFirstPage = NULL;
+		m_iMagazine = -1;
+		m_nMagazineSize = 0;
 	}
 
 	void Init( unsigned nBlockSize );
@@ -164,9 +177,34 @@ private:
 		CTSListBase						m_SortList;
 	};
 
+	struct Magazine_t
+	{
+		TSLNodeBase_t *		m_pHead;
+		int					m_nCount;
+	};
+
+	enum ThreadCacheState_t
+	{
+		THREAD_CACHE_OWNED,
+		THREAD_CACHE_ORPHANED,		// its thread exited, the next new thread adopts it
+		THREAD_CACHE_FLUSHING,		// compaction is taking its blocks back
+	};
+
+	// One per live thread that used the heap. Caches are never freed: an exiting
+	// thread orphans its cache, blocks and all, and the next thread to need one
+	// adopts it, so the list is as long as the most threads ever alive at once.
+	// Only the owner touches the magazines, so they need no lock.
+	struct ThreadCache_t
+	{
+		ThreadCache_t *		m_pNext;
+		int32 volatile		m_nState;
+		Magazine_t			m_Magazines[NUM_POOLS];
+	};
+
 	struct SharedData_t
 	{
 		CAllocator			m_Allocator;
+		ThreadCache_t * volatile m_pThreadCaches;
 		CTSListBase			m_FreePages;
 		CThreadSpinRWLock	m_Lock;
 		size_t				m_numPages;
@@ -181,6 +219,14 @@ private:
 
 	void ValidateFreelist( SharedData_t *pSharedData );
 
+	byte *AllocLocked( SharedData_t *pSharedData );
+	void FreeLocked( SharedData_t *pSharedData, void *p );
+
+	// Moves blocks between the shared free list and a thread's magazine
+	int AllocBatch( Magazine_t &magazine, int nBlocks );
+	void FreeBatch( Magazine_t &magazine, int nBlocks );
+	int CountCachedBlocks();
+
 	CFreeList				m_FreeList;
 
 	CInterlockedPtr<byte>	m_pNextAlloc;
@@ -194,15 +240,22 @@ private:
 	CInterlockedInt			m_nIsCompact;
 
 #ifdef TRACK_SBH_COUNTS
-	CInterlockedInt			m_nFreeBlocks;
+	CInterlockedInt			m_nFreeBlocks;	// in the shared free list, blocks in magazines count as allocated here
 #endif
 
+	int						m_iMagazine;	// index into ThreadCache_t::m_Magazines, -1 if not cached
+	int						m_nMagazineSize;
+
 	static SharedData_t *GetSharedData()
 	{
 		return &gm_SharedData;
 	}
 
 	static SharedData_t gm_SharedData;
+#ifdef SBH_THREAD_CACHE
+	static DECL_THREAD_LOCAL ThreadCache_t *gm_pThreadCache;
+	static DECL_THREAD_LOCAL bool gm_bThreadExited;
+#endif
 };
 
 //-----------------------------------------------------------------------------
@@ -225,6 +278,7 @@ public:
 	size_t Compact( bool bIncremental );
 	bool Validate();
 	void InitPools( const uint *pSizes );
+	void ReleaseThreadCache();
 
 	enum
 	{
@@ -234,10 +288,18 @@ public:
 private:
 	typedef CSmallBlockPool<CAllocator> CPool;
 	typedef struct CSmallBlockPool<CAllocator>::SharedData_t SharedData_t;
+	typedef struct CSmallBlockPool<CAllocator>::ThreadCache_t ThreadCache_t;
+	typedef struct CSmallBlockPool<CAllocator>::Magazine_t Magazine_t;
 
 	CPool *FindPool( size_t nBytes );
 	CPool *FindPool( void *p );
 
+	void InitThreadCache();
+	ThreadCache_t *GetThreadCache();
+	void FreeToPool( CPool *pPool, void *p );
+	void FlushThreadCache( ThreadCache_t *pCache );
+	void FlushThreadCaches();
+
 	// Map size to a pool address to a pool
 	CPool *m_PoolLookup[ MAX_SBH_BLOCK >> SBH_BLOCK_LOOKUP_GRANULARITY ];
 	CPool m_Pools[NUM_POOLS];
@@ -268,6 +330,9 @@ public:
 	size_t InternalCompact( bool bSmallBlockOnly );
 	void CompactOnFail();
 
+	// Called on a thread as it exits
+	void ReleaseThreadCaches();
+
 	// Release versions
 	virtual void *Alloc( size_t nSize );
 	virtual void *Realloc( void *pMem, size_t nSize );
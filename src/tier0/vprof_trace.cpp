@@ -0,0 +1,402 @@
+//============ Copyright (c) Valve Corporation, All rights reserved. ============
+//
+// Cross-thread timeline recorder, see vprof_trace.h
+//
+//===============================================================================
+
+#include "pch_tier0.h"
+#include "tier0/vprof_trace.h"
+#include "tier0/threadtools.h"
+#include "tier0/fasttimer.h"
+#include "tier0/dbg.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "tier0/memdbgon.h"
+
+#ifdef VPROF_TRACE_RECORDER
+
+// Must be a power of two. A thread that records more zones than this during a
+// capture keeps only the most recent ones.
+#define VPROF_TRACE_EVENTS_PER_THREAD	( 32 * 1024 )
+
+// Number of zones timed when estimating the cost of recording
+#define VPROF_TRACE_CALIBRATION_ZONES	1024
+
+struct VProfTraceEvent_t
+{
+	uint64 m_nStart;
+	uint64 m_nEnd;					// 0 while the zone is open
+	const char *m_pCategory;		// VPROF budget group, never freed
+	char m_Name[40];
+};
+
+struct VProfTraceThread_t
+{
+	VProfTraceThread_t *m_pNext;
+	uint64 m_nThreadId;
+	bool m_bMainThread;
+
+	// Set while the owning thread is in BeginZone or EndZone, so the end of a
+	// capture can wait for it to get out before reading and freeing the ring
+	volatile int32 m_nBusy;
+
+	// Only the owning thread writes these while a capture runs. The ring is
+	// allocated by the first zone of a capture and freed when the capture ends.
+	VProfTraceEvent_t *m_pEvents;
+	uint32 m_nCaptureFirst;			// m_nReserved when the ring was allocated
+	volatile uint32 m_nReserved;
+};
+
+bool g_bVProfTraceCapture = false;
+
+// Every thread that ever recorded a zone, pushed without locking. The entries
+// stay until the process exits because threads don't tell us when they go
+// away, but they only hold a ring during a capture.
+static VProfTraceThread_t * volatile s_pTraceThreads = NULL;
+static CTHREADLOCALPTR( VProfTraceThread_t ) s_pThreadTrace;
+
+static int s_nTraceTicksLeft;
+static uint64 s_nTraceCaptureStart;
+static char s_TraceFileName[MAX_PATH];
+static uint32 s_nTraceTickZone;
+static int s_nTraceTick;
+static double s_flTraceZoneCost;
+static int32 volatile s_nTraceFence;
+
+
+static VProfTraceThread_t *GetThreadTrace()
+{
+	VProfTraceThread_t *pThread = s_pThreadTrace;
+	if ( pThread )
+		return pThread;
+
+	pThread = new VProfTraceThread_t;
+	pThread->m_nThreadId = (uint64)ThreadGetCurrentId();
+	pThread->m_bMainThread = ThreadInMainThread();
+	pThread->m_nBusy = 0;
+	pThread->m_pEvents = NULL;
+	pThread->m_nCaptureFirst = 0;
+	pThread->m_nReserved = 0;
+	s_pThreadTrace = pThread;
+
+	VProfTraceThread_t *pHead;
+	do
+	{
+		pHead = s_pTraceThreads;
+		pThread->m_pNext = pHead;
+	}
+	while ( ThreadInterlockedCompareExchangePointer( (void * volatile *)&s_pTraceThreads, pThread, pHead ) != pHead );
+
+	return pThread;
+}
+
+
+static void CopyZoneName( char *pDest, const char *pSrc )
+{
+	if ( !pSrc )
+		pSrc = "(null)";
+
+	int i = 0;
+	for ( ; i < (int)sizeof( ((VProfTraceEvent_t *)0)->m_Name ) - 1 && pSrc[i]; ++i )
+	{
+		pDest[i] = pSrc[i];
+	}
+	pDest[i] = 0;
+}
+
+
+// Zone handles are the ring slot plus one, so 0 can mean "not recorded"
+uint32 VProfTrace_BeginZone( const char *pFormat, ... )
+{
+	VProfTraceThread_t *pThread = GetThreadTrace();
+
+	// The exchange is a full barrier: either the end of the capture sees us
+	// busy and waits, or we see that the capture has already ended
+	ThreadInterlockedExchange( &pThread->m_nBusy, 1 );
+	if ( !g_bVProfTraceCapture )
+	{
+		pThread->m_nBusy = 0;
+		return 0;
+	}
+
+	if ( !pThread->m_pEvents )
+	{
+		pThread->m_pEvents = new VProfTraceEvent_t[VPROF_TRACE_EVENTS_PER_THREAD];
+		pThread->m_nCaptureFirst = pThread->m_nReserved;
+	}
+
+	uint32 nSlot = pThread->m_nReserved;
+	VProfTraceEvent_t *pEvent = &pThread->m_pEvents[nSlot & ( VPROF_TRACE_EVENTS_PER_THREAD - 1 )];
+	pEvent->m_nEnd = 0;
+	pEvent->m_pCategory = NULL;
+
+	// The formats the instrumentation macros use are recorded without going
+	// through vsnprintf, which would cost more than the rest of the zone
+	va_list args;
+	va_start( args, pFormat );
+	if ( !strchr( pFormat, '%' ) )
+	{
+		CopyZoneName( pEvent->m_Name, pFormat );
+	}
+	else if ( !strcmp( pFormat, "%s" ) )
+	{
+		CopyZoneName( pEvent->m_Name, va_arg( args, const char * ) );
+	}
+	else if ( !strcmp( pFormat, "(%s)%s" ) )
+	{
+		pEvent->m_pCategory = va_arg( args, const char * );
+		CopyZoneName( pEvent->m_Name, va_arg( args, const char * ) );
+	}
+	else
+	{
+		vsnprintf( pEvent->m_Name, sizeof( pEvent->m_Name ), pFormat, args );
+		pEvent->m_Name[sizeof( pEvent->m_Name ) - 1] = 0;
+	}
+	va_end( args );
+
+	pEvent->m_nStart = Plat_Rdtsc();
+
+	ThreadMemoryBarrier();
+	pThread->m_nReserved = nSlot + 1;
+	ThreadMemoryBarrier();
+	pThread->m_nBusy = 0;
+	return nSlot + 1;
+}
+
+
+void VProfTrace_EndZone( uint32 nZone )
+{
+	VProfTraceThread_t *pThread = s_pThreadTrace;
+	if ( !pThread )
+		return;
+
+	ThreadInterlockedExchange( &pThread->m_nBusy, 1 );
+
+	// Zones still open when the capture ended stay open. So do zones from an
+	// earlier capture's ring, and zones whose slot the ring has wrapped onto.
+	uint32 nSlot = nZone - 1;
+	if ( g_bVProfTraceCapture && pThread->m_pEvents &&
+		nSlot - pThread->m_nCaptureFirst < pThread->m_nReserved - pThread->m_nCaptureFirst &&
+		pThread->m_nReserved - nSlot <= VPROF_TRACE_EVENTS_PER_THREAD )
+	{
+		pThread->m_pEvents[nSlot & ( VPROF_TRACE_EVENTS_PER_THREAD - 1 )].m_nEnd = Plat_Rdtsc();
+	}
+
+	ThreadMemoryBarrier();
+	pThread->m_nBusy = 0;
+}
+
+
+void VProfTrace_StartCapture( int nTicks, const char *pFileName )
+{
+	if ( g_bVProfTraceCapture )
+	{
+		Warning( "trace capture already running, %d ticks left\n", s_nTraceTicksLeft );
+		return;
+	}
+
+	if ( nTicks <= 0 )
+		return;
+
+	strncpy( s_TraceFileName, pFileName, sizeof( s_TraceFileName ) - 1 );
+	s_TraceFileName[sizeof( s_TraceFileName ) - 1] = 0;
+
+	s_nTraceTicksLeft = nTicks;
+	s_nTraceTick = 0;
+	s_nTraceTickZone = 0;
+	g_bVProfTraceCapture = true;
+
+	// Time the recorder itself so the capture can say what it cost, then drop
+	// the calibration zones from this thread's ring
+	uint64 nCalibrationStart = Plat_Rdtsc();
+	for ( int i = 0; i < VPROF_TRACE_CALIBRATION_ZONES; ++i )
+	{
+		VProfTrace_EndZone( VProfTrace_BeginZone( "(%s)%s", "Trace", "Calibration" ) );
+	}
+	s_flTraceZoneCost = (double)( Plat_Rdtsc() - nCalibrationStart ) / VPROF_TRACE_CALIBRATION_ZONES;
+
+	VProfTraceThread_t *pThread = GetThreadTrace();
+	pThread->m_nCaptureFirst = pThread->m_nReserved;
+	s_nTraceCaptureStart = Plat_Rdtsc();
+}
+
+
+//-----------------------------------------------------------------------------
+// Stops recording and waits for every thread to leave BeginZone/EndZone, so
+// the rings can be read and freed
+//-----------------------------------------------------------------------------
+static void StopTraceCapture()
+{
+	g_bVProfTraceCapture = false;
+
+	// Full barrier, pairs with the exchange in BeginZone and EndZone
+	ThreadInterlockedExchange( &s_nTraceFence, 0 );
+
+	for ( VProfTraceThread_t *pThread = s_pTraceThreads; pThread; pThread = pThread->m_pNext )
+	{
+		while ( pThread->m_nBusy )
+		{
+			ThreadPause();
+		}
+	}
+}
+
+static void FreeTraceRings()
+{
+	for ( VProfTraceThread_t *pThread = s_pTraceThreads; pThread; pThread = pThread->m_pNext )
+	{
+		delete[] pThread->m_pEvents;
+		pThread->m_pEvents = NULL;
+	}
+}
+
+
+static void WriteJSONString( FILE *fp, const char *pString )
+{
+	fputc( '"', fp );
+	for ( const char *p = pString; *p; ++p )
+	{
+		unsigned char c = (unsigned char)*p;
+		if ( c == '"' || c == '\\' )
+		{
+			fputc( '\\', fp );
+			fputc( c, fp );
+		}
+		else if ( c < 0x20 )
+		{
+			fprintf( fp, "\\u%04x", c );
+		}
+		else
+		{
+			fputc( c, fp );
+		}
+	}
+	fputc( '"', fp );
+}
+
+
+//-----------------------------------------------------------------------------
+// Writes the zones that started after the capture began as complete ("X")
+// events, one track per thread
+//-----------------------------------------------------------------------------
+static void WriteTraceCapture( uint64 nCaptureEnd )
+{
+	FILE *fp = fopen( s_TraceFileName, "w" );
+	if ( !fp )
+	{
+		Warning( "trace capture: couldn't open %s for writing\n", s_TraceFileName );
+		return;
+	}
+
+	fprintf( fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	fprintf( fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"tier0\"}}" );
+
+	int nThreads = 0;
+	int nEvents = 0;
+	int nMainThreadEvents = 0;
+	int nWrapped = 0;
+
+	for ( VProfTraceThread_t *pThread = s_pTraceThreads; pThread; pThread = pThread->m_pNext )
+	{
+		if ( !pThread->m_pEvents )
+			continue;
+
+		// Older zones were overwritten if the thread recorded more than the ring holds
+		uint32 nReserved = pThread->m_nReserved;
+		uint32 nFirst = pThread->m_nCaptureFirst;
+		if ( nReserved - nFirst > VPROF_TRACE_EVENTS_PER_THREAD )
+		{
+			nFirst = nReserved - VPROF_TRACE_EVENTS_PER_THREAD;
+			++nWrapped;
+		}
+
+		int nThreadEvents = 0;
+		for ( uint32 i = nFirst; i != nReserved; ++i )
+		{
+			const VProfTraceEvent_t &event = pThread->m_pEvents[i & ( VPROF_TRACE_EVENTS_PER_THREAD - 1 )];
+			if ( event.m_nStart < s_nTraceCaptureStart || event.m_nStart > nCaptureEnd )
+				continue;
+
+			// Still open when the capture ended
+			if ( event.m_nEnd < event.m_nStart )
+				continue;
+
+			if ( !nThreadEvents )
+			{
+				fprintf( fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%llu,\"args\":{\"name\":\"%s %llu\"}}",
+					(unsigned long long)pThread->m_nThreadId, pThread->m_bMainThread ? "main" : "thread", (unsigned long long)pThread->m_nThreadId );
+			}
+
+			double flStart = (double)( event.m_nStart - s_nTraceCaptureStart ) * g_ClockSpeedMicrosecondsMultiplier;
+			double flDuration = (double)( event.m_nEnd - event.m_nStart ) * g_ClockSpeedMicrosecondsMultiplier;
+
+			fprintf( fp, ",\n{\"name\":" );
+			WriteJSONString( fp, event.m_Name );
+			if ( event.m_pCategory )
+			{
+				fprintf( fp, ",\"cat\":" );
+				WriteJSONString( fp, event.m_pCategory );
+			}
+			fprintf( fp, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%llu}",
+				flStart, flDuration, (unsigned long long)pThread->m_nThreadId );
+
+			++nThreadEvents;
+		}
+
+		if ( nThreadEvents )
+		{
+			++nThreads;
+			nEvents += nThreadEvents;
+			if ( pThread->m_bMainThread )
+			{
+				nMainThreadEvents += nThreadEvents;
+			}
+		}
+	}
+
+	fprintf( fp, "\n]}\n" );
+	fclose( fp );
+
+	double flZoneCost = s_flTraceZoneCost;
+	double flCaptureLength = (double)( nCaptureEnd - s_nTraceCaptureStart );
+	double flMainThreadOverhead = flCaptureLength > 0.0 ? 100.0 * nMainThreadEvents * flZoneCost / flCaptureLength : 0.0;
+
+	Msg( "trace capture: wrote %d zones from %d threads over %.1f ms to %s\n",
+		nEvents, nThreads, flCaptureLength * g_ClockSpeedMillisecondsMultiplier, s_TraceFileName );
+	Msg( "trace capture: %.0f ns per zone, %.2f%% of the main thread\n",
+		flZoneCost * g_ClockSpeedMicrosecondsMultiplier * 1000.0, flMainThreadOverhead );
+	if ( nWrapped )
+	{
+		Warning( "trace capture: %d threads recorded more than %d zones and lost the oldest, capture fewer ticks\n", nWrapped, VPROF_TRACE_EVENTS_PER_THREAD );
+	}
+}
+
+
+void VProfTrace_Tick()
+{
+	if ( !g_bVProfTraceCapture )
+		return;
+
+	// Each tick gets a zone of its own on the main thread
+	if ( s_nTraceTickZone )
+	{
+		VProfTrace_EndZone( s_nTraceTickZone );
+		s_nTraceTickZone = 0;
+	}
+
+	if ( s_nTraceTicksLeft-- > 0 )
+	{
+		s_nTraceTickZone = VProfTrace_BeginZone( "Tick %d", s_nTraceTick++ );
+		return;
+	}
+
+	uint64 nCaptureEnd = Plat_Rdtsc();
+	StopTraceCapture();
+	WriteTraceCapture( nCaptureEnd );
+	FreeTraceRings();
+}
+
+#endif // VPROF_TRACE_RECORDER
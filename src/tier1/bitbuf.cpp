@@ -121,6 +121,55 @@ public:
 CBitWriteMasksInit g_BitWriteMasksInit;
 
 
+//-----------------------------------------------------------------------------
+// Gathers the fields of an encoding LSB first in a 64-bit word so they go into
+// the buffer with one bounds check and one or two stores, instead of one of
+// each per field. A field a value doesn't send is added as 0 with a width of
+// zero, which keeps the encoders free of branches on the value.
+//-----------------------------------------------------------------------------
+class CBitWriteAccumulator
+{
+public:
+	CBitWriteAccumulator() : m_nWord( 0 ), m_nBits( 0 ) {}
+
+	// nData must fit in nBits, the fields aren't masked one by one
+	FORCEINLINE void Add( uint32 nData, int nBits )
+	{
+		Assert( nBits >= 0 && nBits <= 32 && m_nBits + nBits <= 64 );
+		Assert( nBits == 32 || nData < ( 1u << nBits ) );
+		m_nWord |= (uint64)nData << m_nBits;
+		m_nBits += nBits;
+	}
+
+	FORCEINLINE void WriteTo( bf_write *pBuf )
+	{
+		Assert( m_nBits > 0 );
+		if ( pBuf->CheckForOverflow( m_nBits ) )
+			return;
+
+		// The one mask for the whole encoding. WriteUBitLongNoCheck doesn't mask,
+		// so this keeps a bad field from reaching the bits after the encoding.
+		uint64 nWord = m_nWord & ( ~(uint64)0 >> ( 64 - m_nBits ) );
+		if ( m_nBits > 32 )
+		{
+			pBuf->WriteUBitLongNoCheck( (uint32)nWord, 32 );
+			pBuf->WriteUBitLongNoCheck( (uint32)( nWord >> 32 ), m_nBits - 32 );
+		}
+		else
+		{
+			pBuf->WriteUBitLongNoCheck( (uint32)nWord, m_nBits );
+		}
+
+		m_nWord = 0;
+		m_nBits = 0;
+	}
+
+private:
+	uint64 m_nWord;
+	int m_nBits;
+};
+
+
 // ---------------------------------------------------------------------------------------- //
 // bf_write
 // ---------------------------------------------------------------------------------------- //
@@ -330,12 +379,18 @@ void bf_write::WriteVarInt32( uint32 data )
 	}
 	else // Slow path
 	{
-		while ( data > 0x7F ) 
+		// Build the whole encoding in registers and write it a dword at a time
+		int size = bitbuf::VarIntByteCount( data );
+		uint64 encoded = bitbuf::SpreadVarIntBytes( data ) | ( 0x80808080ull & ( ( 1ull << ( ( size - 1 ) * 8 ) ) - 1 ) );
+		if ( size > 4 )
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
-			data >>= 7;
+			WriteUBitLong( (uint32)encoded, 32, false );
+			WriteUBitLong( (uint32)( encoded >> 32 ), ( size - 4 ) * 8, false );
+		}
+		else
+		{
+			WriteUBitLong( (uint32)encoded, size * 8, false );
 		}
-		WriteUBitLong( data & 0x7F, 8 );
 	}
 }
 
@@ -444,12 +499,27 @@ void bf_write::WriteVarInt64( uint64 data )
 	}
 	else // slow path
 	{
-		while ( data > 0x7F ) 
+		// Build the whole encoding in registers and write it a dword at a time. The
+		// first eight bytes carry 56 bits, values of 2^56 and up need one or two more.
+		int size = bitbuf::VarIntByteCount( data );
+		int lowsize = MIN( size, 8 );
+		uint64 encoded = bitbuf::SpreadVarIntBytes( data ) | ( 0x8080808080808080ull & ( ( 1ull << ( ( lowsize - 1 ) * 8 ) ) - 1 ) );
+		if ( size > 8 )
+		{
+			encoded |= 0x8000000000000000ull;
+		}
+
+		WriteUBitLong( (uint32)encoded, MIN( lowsize, 4 ) * 8, false );
+		if ( lowsize > 4 )
 		{
-			WriteUBitLong( (data & 0x7F) | 0x80, 8 );
-			data >>= 7;
+			WriteUBitLong( (uint32)( encoded >> 32 ), ( lowsize - 4 ) * 8, false );
+		}
+		if ( size > 8 )
+		{
+			uint32 high = (uint32)( data >> 56 );
+			high = ( high & 0x7f ) | ( ( high << 1 ) & 0x100 ) | ( size > 9 ? 0x80 : 0 );
+			WriteUBitLong( high, ( size - 8 ) * 8, false );
 		}
-		WriteUBitLong( data & 0x7F, 8 );
 	}
 }
 
@@ -641,51 +711,29 @@ void bf_write::WriteBitCoordMP( const float f, EBitCoordType coordType )
 
 
 	bool    bInBounds = intval < (1 << COORD_INTEGER_BITS_MP );
+	int		bHasInt = ( intval != 0 );
+	// The integer is only sent when there is one, adjusted from [1..MAX_COORD_VALUE]
+	// to [0..MAX_COORD_VALUE-1] and masked to its width as in AddBitCoord
+	int		nIntBits = bHasInt ? ( bInBounds ? COORD_INTEGER_BITS_MP : COORD_INTEGER_BITS ) : 0;
 
-	WriteOneBit( bInBounds );
+	CBitWriteAccumulator bits;
+	bits.Add( bInBounds, 1 );
+	bits.Add( bHasInt, 1 );
 
 	if ( bIntegral )
 	{
-		// Send the sign bit
-		WriteOneBit( intval );
-		if ( intval )
-		{
-			WriteOneBit( signbit );
-			// Send the integer if we have one.
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			if ( bInBounds )
-			{
-				WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS_MP );
-			}
-			else
-			{
-				WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-			}
-		}
+		// The sign bit is only sent with an integer
+		bits.Add( signbit & bHasInt, bHasInt );
+		bits.Add( (unsigned int)( intval - 1 ) & ( ( 1 << nIntBits ) - 1 ), nIntBits );
 	}
 	else
 	{
-		// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-		WriteOneBit( intval );
-		// Send the sign bit
-		WriteOneBit( signbit );
-
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			if ( bInBounds )
-			{
-				WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS_MP );
-			}
-			else
-			{
-				WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-			}
-		}
-		WriteUBitLong( (unsigned int)fractval, bLowPrecision ? COORD_FRACTIONAL_BITS_MP_LOWPRECISION : COORD_FRACTIONAL_BITS );
+		bits.Add( signbit, 1 );
+		bits.Add( (unsigned int)( intval - 1 ) & ( ( 1 << nIntBits ) - 1 ), nIntBits );
+		bits.Add( (unsigned int)fractval, bLowPrecision ? COORD_FRACTIONAL_BITS_MP_LOWPRECISION : COORD_FRACTIONAL_BITS );
 	}
+
+	bits.WriteTo( this );
 }
 
 void bf_write::WriteBitCellCoord( const float f, int bits, EBitCoordType coordType )
@@ -716,39 +764,36 @@ void bf_write::WriteBitCellCoord( const float f, int bits, EBitCoordType coordTy
 }
 
 
-void bf_write::WriteBitCoord(const float f)
+// Queues the fields of a WriteBitCoord: the integer and fraction flags, then the
+// sign and whichever parts are nonzero. At most 22 bits.
+static FORCEINLINE void AddBitCoord( CBitWriteAccumulator &bits, const float f )
 {
-#if defined( BB_PROFILING )
-	VPROF( "bf_write::WriteBitCoord" );
-#endif
 	int		signbit = (f <= -COORD_RESOLUTION);
 	int		intval = (int)abs(f);
 	int		fractval = abs((int)(f*COORD_DENOMINATOR)) & (COORD_DENOMINATOR-1);
 
+	int bHasInt = ( intval != 0 );
+	int bHasFract = ( fractval != 0 );
 
-	// Send the bit flags that indicate whether we have an integer part and/or a fraction part.
-	WriteOneBit( intval );
-	WriteOneBit( fractval );
+	bits.Add( bHasInt | ( bHasFract << 1 ), 2 );
+	bits.Add( signbit & ( bHasInt | bHasFract ), bHasInt | bHasFract );
 
-	if ( intval || fractval )
-	{
-		// Send the sign bit
-		WriteOneBit( signbit );
+	// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]. The
+	// mask also drops the -1 of a coord with no integer part, and the high bits of
+	// one past MAX_COORD_VALUE, which the old bit-at-a-time writes overwrote.
+	int nIntBits = bHasInt ? COORD_INTEGER_BITS : 0;
+	bits.Add( (unsigned int)( intval - 1 ) & ( ( 1 << nIntBits ) - 1 ), nIntBits );
+	bits.Add( (unsigned int)fractval, bHasFract ? COORD_FRACTIONAL_BITS : 0 );
+}
 
-		// Send the integer if we have one.
-		if ( intval )
-		{
-			// Adjust the integers from [1..MAX_COORD_VALUE] to [0..MAX_COORD_VALUE-1]
-			intval--;
-			WriteUBitLong( (unsigned int)intval, COORD_INTEGER_BITS );
-		}
-		
-		// Send the fraction if we have one
-		if ( fractval )
-		{
-			WriteUBitLong( (unsigned int)fractval, COORD_FRACTIONAL_BITS );
-		}
-	}
+void bf_write::WriteBitCoord(const float f)
+{
+#if defined( BB_PROFILING )
+	VPROF( "bf_write::WriteBitCoord" );
+#endif
+	CBitWriteAccumulator bits;
+	AddBitCoord( bits, f );
+	bits.WriteTo( this );
 }
 
 void bf_write::WriteBitFloat(float val)
@@ -770,16 +815,21 @@ void bf_write::WriteBitVec3Coord( const Vector& fa )
 	yflag = (fa[1] >= COORD_RESOLUTION) || (fa[1] <= -COORD_RESOLUTION);
 	zflag = (fa[2] >= COORD_RESOLUTION) || (fa[2] <= -COORD_RESOLUTION);
 
-	WriteOneBit( xflag );
-	WriteOneBit( yflag );
-	WriteOneBit( zflag );
-
+	// The flags and three coords can need 69 bits, so the first two coords go
+	// out with the flags and the third on its own
+	CBitWriteAccumulator bits;
+	bits.Add( xflag | ( yflag << 1 ) | ( zflag << 2 ), 3 );
 	if ( xflag )
-		WriteBitCoord( fa[0] );
+		AddBitCoord( bits, fa[0] );
 	if ( yflag )
-		WriteBitCoord( fa[1] );
+		AddBitCoord( bits, fa[1] );
+	bits.WriteTo( this );
+
 	if ( zflag )
-		WriteBitCoord( fa[2] );
+	{
+		AddBitCoord( bits, fa[2] );
+		bits.WriteTo( this );
+	}
 }
 
 void bf_write::WriteBitNormal( float f )
@@ -793,11 +843,8 @@ void bf_write::WriteBitNormal( float f )
 	if (fractval > NORMAL_DENOMINATOR)
 		fractval = NORMAL_DENOMINATOR;
 
-	// Send the sign bit
-	WriteOneBit( signbit );
-
-	// Send the fractional component
-	WriteUBitLong( fractval, NORMAL_FRACTIONAL_BITS );
+	// Send the sign bit and the fractional component together
+	WriteUBitLong( signbit | ( fractval << 1 ), 1 + NORMAL_FRACTIONAL_BITS );
 }
 
 void bf_write::WriteBitVec3Normal( const Vector& fa )
@@ -26,11 +26,19 @@ CDataManagerBase::CDataManagerBase( unsigned int maxSize )
 	m_freeList = m_memoryLists.CreateList();
 	m_listsAreFreed = 0;
 	m_freeOnDestruct = 1;
+	memset( (void *)m_pLookupPages, 0, sizeof( m_pLookupPages ) );
+	memset( (void *)m_DeferredTouches, 0, sizeof( m_DeferredTouches ) );
+	m_nDeferredTouches = 0;
 }
 
 CDataManagerBase::~CDataManagerBase() 
 {
 	Assert( !m_freeOnDestruct || m_listsAreFreed );
+	for ( int i = 0; i < LOOKUP_PAGE_COUNT; i++ )
+	{
+		delete [] m_pLookupPages[i];
+		m_pLookupPages[i] = NULL;
+	}
 }
 
 void CDataManagerBase::NotifySizeChanged( memhandle_t handle, unsigned int oldSize, unsigned int newSize )
@@ -240,12 +248,95 @@ void *CDataManagerBase::GetResource_NoLock( memhandle_t handle )
 	return NULL;
 }
 
+//-----------------------------------------------------------------------------
+// Resolves a handle without taking the mutex. The store pointer is only returned
+// if the handle's serial is unchanged after it was read, so a concurrent free is
+// detected; as with the locked variants, the caller must otherwise guarantee the
+// resource stays alive while it is used.
+//-----------------------------------------------------------------------------
+void *CDataManagerBase::GetResource_LockFree( memhandle_t handle, bool bTouch )
+{
+	unsigned int fullWord = (unsigned int)reinterpret_cast<uintp>( handle );
+	unsigned short serial = fullWord>>16;
+	unsigned short index = fullWord & 0xFFFF;
+	index--;
+
+	resource_lookup_t *pLookup = GetLookup( index );
+	if ( !pLookup || pLookup->serial != serial )
+		return NULL;
+
+	void *pStore = pLookup->pStore;
+	if ( bTouch && !pLookup->bReferenced )
+	{
+		pLookup->bReferenced = 1;
+		QueueDeferredTouch( handle );
+	}
+
+	ThreadMemoryBarrier();
+	if ( pLookup->serial != serial )
+		return NULL;
+
+	return pStore;
+}
+
+bool CDataManagerBase::IsHandleValid_LockFree( memhandle_t handle )
+{
+	// Whatever was read through the store has to be read before the serial is
+	ThreadMemoryBarrier();
+
+	unsigned int fullWord = (unsigned int)reinterpret_cast<uintp>( handle );
+	unsigned short serial = fullWord>>16;
+	unsigned short index = fullWord & 0xFFFF;
+	index--;
+
+	resource_lookup_t *pLookup = GetLookup( index );
+	return ( pLookup && pLookup->serial == serial );
+}
+
+// Called without the mutex, from any thread. A slot that is written after the
+// queue was drained, or not yet written when it is, only loses its touch; the
+// handle's serial is checked when the queue is drained.
+void CDataManagerBase::QueueDeferredTouch( memhandle_t handle )
+{
+	if ( m_nDeferredTouches >= DEFERRED_TOUCH_QUEUE_SIZE )
+		return;
+
+	int nSlot = ThreadInterlockedIncrement( &m_nDeferredTouches ) - 1;
+	if ( nSlot < DEFERRED_TOUCH_QUEUE_SIZE )
+	{
+		m_DeferredTouches[nSlot] = (unsigned int)reinterpret_cast<uintp>( handle );
+	}
+}
+
 void CDataManagerBase::TouchResource( memhandle_t handle )
 {
 	AUTO_LOCK_DM();
 	TouchByIndex( FromHandle(handle) );
 }
 
+void CDataManagerBase::TouchResourceDeferred( memhandle_t handle )
+{
+	GetResource_LockFree( handle, true );
+}
+
+// Move everything queued by a deferred touch since the last commit to the tail of
+// the LRU, in the order it was touched, so callers that walk the LRU directly see
+// a reasonable age order
+void CDataManagerBase::CommitDeferredTouches()
+{
+	AUTO_LOCK_DM();
+	int nTouches = MIN( (int)ThreadInterlockedExchange( &m_nDeferredTouches, 0 ), (int)DEFERRED_TOUCH_QUEUE_SIZE );
+	for ( int i = 0; i < nTouches; i++ )
+	{
+		memhandle_t handle = (memhandle_t)(uintp)m_DeferredTouches[i];
+		unsigned short memoryIndex = FromHandle( handle );
+		if ( memoryIndex != m_memoryLists.InvalidIndex() && ClearReferenced( memoryIndex ) )
+		{
+			TouchByIndex( memoryIndex );
+		}
+	}
+}
+
 void CDataManagerBase::MarkAsStale( memhandle_t handle )
 {
 	AUTO_LOCK_DM();
@@ -254,6 +345,7 @@ void CDataManagerBase::MarkAsStale( memhandle_t handle )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
+			ClearReferenced( memoryIndex );
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
 			m_memoryLists.LinkToHead( m_lruList, memoryIndex );
 		}
@@ -327,6 +419,7 @@ memhandle_t CDataManagerBase::StoreResourceInHandle( unsigned short memoryIndex,
 	resource_lru_element_t &mem = m_memoryLists[memoryIndex];
 	mem.pStore = pStore;
 	m_memUsed += realSize;
+	UpdateLookup( memoryIndex );
 	return ToHandle(memoryIndex);
 }
 
@@ -336,12 +429,60 @@ void CDataManagerBase::TouchByIndex( unsigned short memoryIndex )
 	{
 		if ( m_memoryLists[memoryIndex].lockCount == 0 )
 		{
+			ClearReferenced( memoryIndex );
 			m_memoryLists.Unlink( m_lruList, memoryIndex );
 			m_memoryLists.LinkToTail( m_lruList, memoryIndex );
 		}
 	}
 }
 
+// Must be called with the mutex held whenever the serial or store of an element changes
+void CDataManagerBase::UpdateLookup( unsigned short memoryIndex )
+{
+	resource_lookup_t *pPage = m_pLookupPages[memoryIndex >> LOOKUP_PAGE_BITS];
+	if ( !pPage )
+	{
+		pPage = new resource_lookup_t[LOOKUP_PAGE_SIZE];
+		for ( int i = 0; i < LOOKUP_PAGE_SIZE; i++ )
+		{
+			pPage[i].pStore = NULL;
+			pPage[i].serial = 0;
+			pPage[i].bReferenced = 0;
+			pPage[i].unused = 0;
+		}
+		ThreadMemoryBarrier();
+		m_pLookupPages[memoryIndex >> LOOKUP_PAGE_BITS] = pPage;
+	}
+
+	resource_lookup_t &lookup = pPage[memoryIndex & ( LOOKUP_PAGE_SIZE - 1 )];
+	const resource_lru_element_t &mem = m_memoryLists[memoryIndex];
+	if ( mem.pStore )
+	{
+		lookup.bReferenced = 0;
+		lookup.pStore = mem.pStore;
+		ThreadMemoryBarrier();
+		lookup.serial = mem.serial;
+	}
+	else
+	{
+		// Invalidate the serial first so lock free readers notice the free
+		lookup.serial = mem.serial;
+		ThreadMemoryBarrier();
+		lookup.pStore = NULL;
+	}
+}
+
+bool CDataManagerBase::ClearReferenced( unsigned short memoryIndex )
+{
+	resource_lookup_t *pLookup = GetLookup( memoryIndex );
+	if ( pLookup && pLookup->bReferenced )
+	{
+		pLookup->bReferenced = 0;
+		return true;
+	}
+	return false;
+}
+
 memhandle_t CDataManagerBase::ToHandle( unsigned short index )
 {
 	unsigned int hiword = m_memoryLists.Element(index).serial;
@@ -370,6 +511,7 @@ unsigned int CDataManagerBase::UsedSize()
 unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 {
 	unsigned nBytesInitial = MemUsed_Inline();
+	int nSecondChances = -1;
 	while ( MemUsed_Inline() > MemTotal_Inline() || MemAvailable_Inline() < size )
 	{
 		Lock();
@@ -379,6 +521,22 @@ unsigned int CDataManagerBase::EnsureCapacity( unsigned int size )
 			Unlock();
 			break;
 		}
+
+		// Items touched with a deferred touch get one more trip through the LRU.
+		// Bounded so items being retouched concurrently can't stall eviction.
+		if ( nSecondChances < 0 )
+		{
+			nSecondChances = m_memoryLists.Count( m_lruList );
+		}
+		if ( nSecondChances > 0 && ClearReferenced( lruIndex ) )
+		{
+			nSecondChances--;
+			m_memoryLists.Unlink( m_lruList, lruIndex );
+			m_memoryLists.LinkToTail( m_lruList, lruIndex );
+			Unlock();
+			continue;
+		}
+
 		m_memoryLists.Unlink( m_lruList, lruIndex );
 		void *p = GetForFreeByIndex( lruIndex );
 		Unlock();
@@ -406,6 +564,7 @@ void *CDataManagerBase::GetForFreeByIndex( unsigned short memoryIndex )
 		p = mem.pStore;
 		mem.pStore = NULL;
 		mem.serial++;
+		UpdateLookup( memoryIndex );
 		m_memoryLists.LinkToTail( m_freeList, memoryIndex );
 	}
 	return p;
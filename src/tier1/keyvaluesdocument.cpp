@@ -0,0 +1,704 @@
+//========= Copyright Valve Corporation, All rights reserved. =================//
+//
+// Read-only KeyValues tree parsed in place, with a position independent
+// binary form that can be walked without parsing
+//
+//=============================================================================//
+
+#include "tier1/keyvaluesdocument.h"
+#include "tier1/utlbuffer.h"
+#include "tier1/utldict.h"
+#include "tier1/strtools.h"
+#include "tier1/generichash.h"
+#include "tier1/exprevaluator.h"
+#include "filesystem.h"
+
+// memdbgon must be the last include file in a .cpp file!!!
+#include "tier0/memdbgon.h"
+
+KeyValuesDocument::KeyValuesDocument()
+{
+	m_pNodes = NULL;
+	m_nNodes = 0;
+	m_pStrings = NULL;
+	m_nStringBytes = 0;
+	m_pCur = NULL;
+	m_chPending = 0;
+	m_nUnreadToken = TOKEN_EOF;
+	m_pUnreadToken = NULL;
+	m_bHasUnreadToken = false;
+	m_bUsesEscapeSequences = false;
+	m_bError = false;
+	m_pfnEvaluateSymbolProc = NULL;
+	m_pszResourceName = "";
+}
+
+KeyValuesDocument::~KeyValuesDocument()
+{
+	Purge();
+}
+
+void KeyValuesDocument::Purge()
+{
+	m_Nodes.Purge();
+	m_Storage.Purge();
+	m_pNodes = NULL;
+	m_nNodes = 0;
+	m_pStrings = NULL;
+	m_nStringBytes = 0;
+}
+
+int KeyValuesDocument::GetMemoryUsage() const
+{
+	return m_Nodes.NumAllocated() * sizeof( Node_t ) + m_Storage.NumAllocated();
+}
+
+
+//-----------------------------------------------------------------------------
+// Text parsing
+//-----------------------------------------------------------------------------
+bool KeyValuesDocument::LoadFromFile( IBaseFileSystem *pFileSystem, const char *pszResourceName, const char *pPathID, GetSymbolProc_t pfnEvaluateSymbolProc )
+{
+	CUtlBuffer buf( 0, 0, CUtlBuffer::TEXT_BUFFER );
+	if ( !pFileSystem->ReadFile( pszResourceName, pPathID, buf ) )
+		return false;
+
+	return LoadFromBuffer( pszResourceName, (const char *)buf.Base(), buf.TellPut(), pfnEvaluateSymbolProc );
+}
+
+bool KeyValuesDocument::LoadFromBuffer( const char *pszResourceName, const char *pBuffer, int nSize, GetSymbolProc_t pfnEvaluateSymbolProc, bool bUsesEscapeSequences )
+{
+	Purge();
+
+	if ( !pBuffer )
+		return false;
+
+	if ( nSize < 0 )
+	{
+		nSize = V_strlen( pBuffer );
+	}
+
+	// offset 0 is the empty string (the root's name); the text follows, null terminated
+	m_Storage.SetCount( nSize + 2 );
+	m_Storage[0] = 0;
+	V_memcpy( m_Storage.Base() + 1, pBuffer, nSize );
+	m_Storage[nSize + 1] = 0;
+	m_pStrings = m_Storage.Base();
+	m_nStringBytes = m_Storage.Count();
+
+	// roughly one key per 32 bytes of text in typical data files
+	m_Nodes.EnsureCapacity( nSize / 32 + 1 );
+
+	m_pCur = m_Storage.Base() + 1;
+	m_chPending = 0;
+	m_bHasUnreadToken = false;
+	m_bUsesEscapeSequences = bUsesEscapeSequences;
+	m_bError = false;
+	m_pfnEvaluateSymbolProc = pfnEvaluateSymbolProc;
+	m_pszResourceName = pszResourceName ? pszResourceName : "";
+
+	KeyHandle_t hRoot = AddNode( "" );
+	KeyHandle_t hLastKey = INVALID_KEY;
+	while ( !m_bError )
+	{
+		char *pszName;
+		Token_t token = ReadToken( pszName );
+		if ( token == TOKEN_EOF )
+			break;
+
+		if ( token != TOKEN_STRING || !*pszName )
+		{
+			ReportError( "expected a keyname" );
+			break;
+		}
+
+		if ( !V_stricmp( pszName, "#include" ) || !V_stricmp( pszName, "#base" ) )
+		{
+			char *pszFile;
+			ReadToken( pszFile );
+			Warning( "KeyValuesDocument: %s in %s isn't supported, skipped\n", pszName, m_pszResourceName );
+			continue;
+		}
+
+		KeyHandle_t hKey = AddNode( pszName );
+
+		bool bAccepted = true;
+		char *pszValue;
+		token = ReadToken( pszValue );
+		if ( token == TOKEN_CONDITIONAL )
+		{
+			bAccepted = EvaluateConditional( pszValue );
+			token = ReadToken( pszValue );
+		}
+
+		if ( token != TOKEN_OPEN )
+		{
+			ReportError( "expected {" );
+			break;
+		}
+
+		if ( !ParseKeys( hKey, 1 ) )
+			break;
+
+		if ( bAccepted )
+		{
+			LinkNode( hRoot, hLastKey, hKey );
+		}
+	}
+
+	m_pCur = NULL;
+
+	if ( m_bError )
+	{
+		Purge();
+		return false;
+	}
+
+	m_pNodes = m_Nodes.Base();
+	m_nNodes = m_Nodes.Count();
+	return true;
+}
+
+bool KeyValuesDocument::ParseKeys( KeyHandle_t hParent, int nDepth )
+{
+	if ( nDepth > MAX_DEPTH )
+	{
+		ReportError( "recursion overflow" );
+		return false;
+	}
+
+	KeyHandle_t hLastChild = INVALID_KEY;
+	while ( 1 )
+	{
+		char *pszName;
+		Token_t token = ReadToken( pszName );
+		if ( token == TOKEN_CLOSE )
+			return true;
+
+		if ( token != TOKEN_STRING || !*pszName )
+		{
+			ReportError( ( token == TOKEN_EOF ) ? "got EOF instead of keyname" : "expected a keyname" );
+			return false;
+		}
+
+		KeyHandle_t hKey = AddNode( pszName );
+
+		bool bAccepted = true;
+		char *pszValue;
+		token = ReadToken( pszValue );
+		if ( token == TOKEN_CONDITIONAL )
+		{
+			bAccepted = EvaluateConditional( pszValue );
+			token = ReadToken( pszValue );
+		}
+
+		// support the '=' as an assignment, like KeyValues
+		if ( token == TOKEN_EQUALS )
+		{
+			token = ReadToken( pszValue );
+			if ( token == TOKEN_CONDITIONAL )
+			{
+				bAccepted = EvaluateConditional( pszValue );
+				token = ReadToken( pszValue );
+			}
+		}
+
+		if ( token == TOKEN_OPEN )
+		{
+			if ( !ParseKeys( hKey, nDepth + 1 ) )
+				return false;
+		}
+		else if ( token == TOKEN_STRING )
+		{
+			m_Nodes[hKey].m_nValue = pszValue - m_pStrings;
+
+			// Look ahead one token for a conditional tag
+			char *pszPeek;
+			token = ReadToken( pszPeek );
+			if ( token == TOKEN_CONDITIONAL )
+			{
+				bAccepted = EvaluateConditional( pszPeek );
+			}
+			else
+			{
+				UnreadToken( token, pszPeek );
+			}
+		}
+		else
+		{
+			ReportError( ( token == TOKEN_CLOSE ) ? "got } in key" : "got EOF instead of value" );
+			return false;
+		}
+
+		if ( bAccepted )
+		{
+			LinkNode( hParent, hLastChild, hKey );
+		}
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Tokens are null terminated where they lie. A terminator that is itself a
+// token ({, }, = or ") is remembered in m_chPending before it's overwritten.
+//-----------------------------------------------------------------------------
+KeyValuesDocument::Token_t KeyValuesDocument::ReadToken( char *&pToken )
+{
+	if ( m_bHasUnreadToken )
+	{
+		m_bHasUnreadToken = false;
+		pToken = m_pUnreadToken;
+		return m_nUnreadToken;
+	}
+
+	pToken = NULL;
+
+	char c;
+	if ( m_chPending )
+	{
+		c = m_chPending;
+		m_chPending = 0;
+	}
+	else
+	{
+		// eat white space and remarks
+		while ( 1 )
+		{
+			while ( *m_pCur && V_isspace( *m_pCur ) )
+			{
+				++m_pCur;
+			}
+
+			if ( m_pCur[0] != '/' || m_pCur[1] != '/' )
+				break;
+
+			while ( *m_pCur && *m_pCur != '\n' )
+			{
+				++m_pCur;
+			}
+		}
+
+		c = *m_pCur;
+		if ( !c )
+			return TOKEN_EOF;
+		++m_pCur;
+	}
+
+	switch ( c )
+	{
+	case '{':
+		return TOKEN_OPEN;
+	case '}':
+		return TOKEN_CLOSE;
+	case '=':
+		return TOKEN_EQUALS;
+	case '\"':
+		{
+			pToken = m_pCur;
+			char *pWrite = m_pCur;
+			while ( *m_pCur && *m_pCur != '\"' )
+			{
+				if ( m_bUsesEscapeSequences && *m_pCur == '\\' && m_pCur[1] )
+				{
+					++m_pCur;
+					switch ( *m_pCur )
+					{
+					case 'n':	*pWrite = '\n'; break;
+					case 't':	*pWrite = '\t'; break;
+					case 'v':	*pWrite = '\v'; break;
+					case 'b':	*pWrite = '\b'; break;
+					case 'r':	*pWrite = '\r'; break;
+					case 'f':	*pWrite = '\f'; break;
+					case 'a':	*pWrite = '\a'; break;
+					default:	*pWrite = *m_pCur; break;	// \\ \" \' \?
+					}
+					++pWrite;
+					++m_pCur;
+					continue;
+				}
+				*pWrite++ = *m_pCur++;
+			}
+			if ( *m_pCur )
+			{
+				++m_pCur;
+			}
+			*pWrite = 0;
+			return TOKEN_STRING;
+		}
+	}
+
+	// read in the token until we hit a whitespace or a control character
+	pToken = m_pCur - 1;
+	m_pCur = pToken;
+	bool bConditionalStart = false;
+	bool bConditional = false;
+	while ( *m_pCur )
+	{
+		c = *m_pCur;
+		if ( c == '\"' || c == '{' || c == '}' || c == '=' )
+			break;
+
+		if ( c == '[' )
+			bConditionalStart = true;
+
+		if ( c == ']' && bConditionalStart )
+		{
+			bConditional = true;
+			bConditionalStart = false;
+		}
+
+		if ( V_isspace( c ) && !bConditionalStart )
+			break;
+
+		++m_pCur;
+	}
+
+	if ( *m_pCur )
+	{
+		if ( !V_isspace( *m_pCur ) )
+		{
+			m_chPending = *m_pCur;
+		}
+		*m_pCur++ = 0;
+	}
+
+	return bConditional ? TOKEN_CONDITIONAL : TOKEN_STRING;
+}
+
+void KeyValuesDocument::UnreadToken( Token_t token, char *pToken )
+{
+	Assert( !m_bHasUnreadToken );
+	m_bHasUnreadToken = true;
+	m_nUnreadToken = token;
+	m_pUnreadToken = pToken;
+}
+
+bool KeyValuesDocument::EvaluateConditional( const char *pszExpression )
+{
+	// the shared evaluator in keyvalues.cpp is guarded by its parse lock, use our own
+	CExpressionEvaluator evaluator;
+	bool bResult = false;
+	if ( !evaluator.Evaluate( bResult, pszExpression, m_pfnEvaluateSymbolProc ) )
+	{
+		Warning( "KeyValuesDocument: %s: bad conditional %s\n", m_pszResourceName, pszExpression );
+	}
+	return bResult;
+}
+
+void KeyValuesDocument::ReportError( const char *pszMessage )
+{
+	// approximate, terminators written over newlines aren't counted
+	int nLine = 1;
+	for ( const char *p = m_Storage.Base() + 1; p < m_pCur; ++p )
+	{
+		if ( *p == '\n' )
+		{
+			++nLine;
+		}
+	}
+	Warning( "KeyValuesDocument: %s, near line %d: %s\n", m_pszResourceName, nLine, pszMessage );
+	m_bError = true;
+}
+
+KeyValuesDocument::KeyHandle_t KeyValuesDocument::AddNode( const char *pszName )
+{
+	Node_t node;
+	node.m_nNameHash = HashStringCaselessConventional( pszName );
+	node.m_nName = ( *pszName ) ? pszName - m_pStrings : 0;
+	node.m_nValue = SECTION_VALUE;
+	node.m_nFirstChild = INVALID_KEY;
+	node.m_nNextPeer = INVALID_KEY;
+	return m_Nodes.AddToTail( node );
+}
+
+void KeyValuesDocument::LinkNode( KeyHandle_t hParent, KeyHandle_t &hLastChild, KeyHandle_t hNode )
+{
+	if ( hLastChild == INVALID_KEY )
+	{
+		m_Nodes[hParent].m_nFirstChild = hNode;
+	}
+	else
+	{
+		m_Nodes[hLastChild].m_nNextPeer = hNode;
+	}
+	hLastChild = hNode;
+}
+
+
+//-----------------------------------------------------------------------------
+// Binary form
+//-----------------------------------------------------------------------------
+bool KeyValuesDocument::SaveBinary( CUtlBuffer &buf ) const
+{
+	if ( !m_nNodes || buf.IsText() )
+		return false;
+
+	// Text parses reference the whole source; write only the strings in use, once each
+	CUtlDict< uint32, int > stringOffsets( k_eDictCompareTypeCaseSensitive );
+	CUtlBuffer strings;
+	strings.PutChar( 0 );
+	stringOffsets.Insert( "", 0 );
+
+	CUtlVector< Node_t > nodes;
+	nodes.CopyArray( m_pNodes, m_nNodes );
+	for ( int i = 0; i < nodes.Count(); ++i )
+	{
+		uint32 *pOffsets[2] = { &nodes[i].m_nName, &nodes[i].m_nValue };
+		for ( int j = 0; j < 2; ++j )
+		{
+			if ( *pOffsets[j] == SECTION_VALUE )
+				continue;
+
+			const char *pszString = m_pStrings + *pOffsets[j];
+			int nIndex = stringOffsets.Find( pszString );
+			if ( nIndex == stringOffsets.InvalidIndex() )
+			{
+				nIndex = stringOffsets.Insert( pszString, strings.TellPut() );
+				strings.PutString( pszString );
+				strings.PutChar( 0 );
+			}
+			*pOffsets[j] = stringOffsets[nIndex];
+		}
+	}
+
+	BinaryHeader_t header;
+	header.m_nMagic = BINARY_MAGIC;
+	header.m_nVersion = BINARY_VERSION;
+	header.m_nNodes = nodes.Count();
+	header.m_nStringBytes = strings.TellPut();
+
+	buf.Put( &header, sizeof( header ) );
+	buf.Put( nodes.Base(), nodes.Count() * sizeof( Node_t ) );
+	buf.Put( strings.Base(), strings.TellPut() );
+	return buf.IsValid();
+}
+
+bool KeyValuesDocument::LoadBinary( const void *pData, int nSize, bool bCopy )
+{
+	Purge();
+
+	if ( !pData || nSize < (int)sizeof( BinaryHeader_t ) )
+		return false;
+
+	const BinaryHeader_t *pHeader = (const BinaryHeader_t *)pData;
+	if ( pHeader->m_nMagic != BINARY_MAGIC || pHeader->m_nVersion != BINARY_VERSION )
+		return false;
+
+	int64 nExpectedSize = sizeof( BinaryHeader_t ) + (int64)pHeader->m_nNodes * sizeof( Node_t ) + pHeader->m_nStringBytes;
+	if ( !pHeader->m_nNodes || !pHeader->m_nStringBytes || nExpectedSize > nSize )
+		return false;
+
+	if ( bCopy )
+	{
+		m_Storage.SetCount( (int)nExpectedSize );
+		V_memcpy( m_Storage.Base(), pData, (int)nExpectedSize );
+		pHeader = (const BinaryHeader_t *)m_Storage.Base();
+	}
+
+	const Node_t *pNodes = (const Node_t *)( pHeader + 1 );
+	const char *pStrings = (const char *)( pNodes + pHeader->m_nNodes );
+	int nNodes = pHeader->m_nNodes;
+	int nStringBytes = pHeader->m_nStringBytes;
+
+	// validate once here so the accessors don't have to
+	if ( pStrings[nStringBytes - 1] != 0 )
+	{
+		Purge();
+		return false;
+	}
+
+	// The parser always links a node to ones added after it, and every node but
+	// the root is linked exactly once. Holding images to that keeps them a tree,
+	// so a corrupt one can't send GetNextKey or ToKeyValues round a cycle.
+	CUtlVector< uint8 > linked;
+	linked.SetCount( nNodes );
+	V_memset( linked.Base(), 0, nNodes );
+	for ( int i = 0; i < nNodes; ++i )
+	{
+		const Node_t &node = pNodes[i];
+		if ( node.m_nName >= (uint32)nStringBytes ||
+			( node.m_nValue != SECTION_VALUE && node.m_nValue >= (uint32)nStringBytes ) ||
+			( node.m_nFirstChild != INVALID_KEY && ( node.m_nFirstChild <= i || node.m_nFirstChild >= nNodes || linked[node.m_nFirstChild]++ ) ) ||
+			( node.m_nNextPeer != INVALID_KEY && ( node.m_nNextPeer <= i || node.m_nNextPeer >= nNodes || linked[node.m_nNextPeer]++ ) ) )
+		{
+			Purge();
+			return false;
+		}
+	}
+
+	m_pNodes = pNodes;
+	m_nNodes = nNodes;
+	m_pStrings = pStrings;
+	m_nStringBytes = nStringBytes;
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Accessors
+//-----------------------------------------------------------------------------
+KeyValuesDocument::KeyHandle_t KeyValuesDocument::GetFirstSubKey( KeyHandle_t hKey ) const
+{
+	return ( hKey != INVALID_KEY ) ? Node( hKey ).m_nFirstChild : INVALID_KEY;
+}
+
+KeyValuesDocument::KeyHandle_t KeyValuesDocument::GetNextKey( KeyHandle_t hKey ) const
+{
+	return ( hKey != INVALID_KEY ) ? Node( hKey ).m_nNextPeer : INVALID_KEY;
+}
+
+KeyValuesDocument::KeyHandle_t KeyValuesDocument::FindChild( KeyHandle_t hParent, const char *pszName, int nNameLen ) const
+{
+	// the hash only helps when we have the whole name as a C string
+	bool bUseHash = ( pszName[nNameLen] == 0 );
+	uint32 nHash = bUseHash ? HashStringCaselessConventional( pszName ) : 0;
+
+	for ( KeyHandle_t hKey = Node( hParent ).m_nFirstChild; hKey != INVALID_KEY; hKey = Node( hKey ).m_nNextPeer )
+	{
+		const Node_t &node = Node( hKey );
+		if ( bUseHash && node.m_nNameHash != nHash )
+			continue;
+
+		const char *pszKeyName = m_pStrings + node.m_nName;
+		if ( !V_strnicmp( pszKeyName, pszName, nNameLen ) && pszKeyName[nNameLen] == 0 )
+			return hKey;
+	}
+	return INVALID_KEY;
+}
+
+KeyValuesDocument::KeyHandle_t KeyValuesDocument::FindKey( KeyHandle_t hParent, const char *pszKeyName ) const
+{
+	if ( hParent == INVALID_KEY || !pszKeyName )
+		return INVALID_KEY;
+
+	if ( !*pszKeyName )
+		return hParent;
+
+	KeyHandle_t hKey = hParent;
+	while ( hKey != INVALID_KEY )
+	{
+		const char *pszSubStr = strchr( pszKeyName, '/' );
+		int nLen = pszSubStr ? pszSubStr - pszKeyName : V_strlen( pszKeyName );
+		hKey = FindChild( hKey, pszKeyName, nLen );
+		if ( !pszSubStr )
+			break;
+		pszKeyName = pszSubStr + 1;
+	}
+	return hKey;
+}
+
+const char *KeyValuesDocument::GetName( KeyHandle_t hKey ) const
+{
+	return ( hKey != INVALID_KEY ) ? m_pStrings + Node( hKey ).m_nName : "";
+}
+
+bool KeyValuesDocument::IsSection( KeyHandle_t hKey ) const
+{
+	return ( hKey != INVALID_KEY ) && Node( hKey ).m_nValue == SECTION_VALUE;
+}
+
+const char *KeyValuesDocument::GetString( KeyHandle_t hKey, const char *pszDefault ) const
+{
+	if ( hKey == INVALID_KEY || Node( hKey ).m_nValue == SECTION_VALUE )
+		return pszDefault;
+
+	return m_pStrings + Node( hKey ).m_nValue;
+}
+
+// "0x" followed by 16 hex digits is a uint64 in KeyValues text
+static bool ParseKeyValuesUint64( const char *pszValue, uint64 &nValue )
+{
+	if ( pszValue[0] != '0' || pszValue[1] != 'x' || V_strlen( pszValue ) != 18 )
+		return false;
+
+	nValue = 0;
+	for ( int i = 2; i < 18; i++ )
+	{
+		char digit = pszValue[i];
+		if ( digit >= 'a' )
+			digit -= 'a' - ( '9' + 1 );
+		else if ( digit >= 'A' )
+			digit -= 'A' - ( '9' + 1 );
+		nValue = ( nValue * 16 ) + ( digit - '0' );
+	}
+	return true;
+}
+
+int KeyValuesDocument::GetInt( KeyHandle_t hKey, int nDefault ) const
+{
+	const char *pszValue = GetString( hKey, NULL );
+	if ( !pszValue )
+		return nDefault;
+
+	uint64 nValue;
+	if ( ParseKeyValuesUint64( pszValue, nValue ) )
+		return (int)nValue;
+
+	return V_atoi( pszValue );
+}
+
+uint64 KeyValuesDocument::GetUint64( KeyHandle_t hKey, uint64 nDefault ) const
+{
+	const char *pszValue = GetString( hKey, NULL );
+	if ( !pszValue )
+		return nDefault;
+
+	uint64 nValue;
+	if ( ParseKeyValuesUint64( pszValue, nValue ) )
+		return nValue;
+
+	return V_atoui64( pszValue );
+}
+
+float KeyValuesDocument::GetFloat( KeyHandle_t hKey, float flDefault ) const
+{
+	const char *pszValue = GetString( hKey, NULL );
+	if ( !pszValue )
+		return flDefault;
+
+	return V_atof( pszValue );
+}
+
+KeyValues *KeyValuesDocument::ToKeyValues( KeyHandle_t hKey ) const
+{
+	if ( hKey == INVALID_KEY )
+		return NULL;
+
+	KeyValues *pKV = new KeyValues( GetName( hKey ) );
+	if ( IsSection( hKey ) )
+	{
+		RecursiveToKeyValues( pKV, Node( hKey ).m_nFirstChild );
+	}
+	else
+	{
+		pKV->SetString( NULL, GetString( hKey ) );
+	}
+	return pKV;
+}
+
+void KeyValuesDocument::RecursiveToKeyValues( KeyValues *pParent, KeyHandle_t hFirst ) const
+{
+	// append in order without AddSubKey's walk to the last child
+	KeyValues *pLastChild = NULL;
+	for ( KeyHandle_t hKey = hFirst; hKey != INVALID_KEY; hKey = Node( hKey ).m_nNextPeer )
+	{
+		KeyValues *pChild = new KeyValues( GetName( hKey ) );
+		if ( IsSection( hKey ) )
+		{
+			RecursiveToKeyValues( pChild, Node( hKey ).m_nFirstChild );
+		}
+		else
+		{
+			pChild->SetString( NULL, GetString( hKey ) );
+		}
+
+		if ( pLastChild )
+		{
+			pLastChild->SetNextKey( pChild );
+		}
+		else
+		{
+			pParent->AddSubKey( pChild );
+		}
+		pLastChild = pChild;
+	}
+}
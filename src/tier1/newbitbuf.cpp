@@ -563,6 +563,27 @@ int64 CBitRead::ReadLongLong( void )
 // 40-bits: 268435456-0xFFFFFFFF
 uint32 CBitRead::ReadVarInt32()
 {
+	// Most varints are a single byte
+	if ( m_nBitsAvail >= 8 && !( m_nInBufWord & 0x80 ) )
+	{
+		return ReadUBitLong( 8 );
+	}
+
+	// Otherwise find the end of it in the next eight bytes and consume them all at once
+	uint64 nBits;
+	if ( PeekBits64( &nBits ) )
+	{
+		int nBytes = MIN( bitbuf::VarIntLengthInQWord( nBits ), bitbuf::kMaxVarint32Bytes );
+		uint32 nResult = (uint32)bitbuf::CompactVarIntBytes( nBits & ( ( 1ull << ( nBytes * 8 ) ) - 1 ) );
+		if ( nBytes > 4 )
+		{
+			ReadUBitLong( 32 );
+			nBytes -= 4;
+		}
+		ReadUBitLong( nBytes * 8 );
+		return nResult;
+	}
+
 	uint32 result = 0;
 	int count = 0;
 	uint32 b;
@@ -587,6 +608,24 @@ uint64 CBitRead::ReadVarInt64()
 	int count = 0;
 	uint64 b;
 
+	// Decode up to eight bytes at once, only values of 2^56 and above are longer
+	uint64 nBits;
+	if ( PeekBits64( &nBits ) )
+	{
+		int nBytes = MIN( bitbuf::VarIntLengthInQWord( nBits ), 8 );
+		uint64 nMask = ( nBytes < 8 ) ? ( ( 1ull << ( nBytes * 8 ) ) - 1 ) : ~0ull;
+		result = bitbuf::CompactVarIntBytes( nBits & nMask );
+		count = nBytes;
+		if ( nBytes > 4 )
+		{
+			ReadUBitLong( 32 );
+			nBytes -= 4;
+		}
+		ReadUBitLong( nBytes * 8 );
+		if ( !( ( nBits >> ( count * 8 - 1 ) ) & 1 ) )
+			return result;
+	}
+
 	do 
 	{
 		if ( count == bitbuf::kMaxVarintBytes ) 
@@ -665,6 +704,32 @@ float CBitRead::ReadBitCoord (void)
 	int		intval=0,fractval=0,signbit=0;
 	float	value = 0.0;
 
+	// Decode the flags and fields from one word and consume them with a single read
+	uint64 nBits;
+	if ( PeekBits64( &nBits ) )
+	{
+		int bHasInt = (int)( nBits & 1 );
+		int bHasFract = (int)( ( nBits >> 1 ) & 1 );
+		if ( !( bHasInt | bHasFract ) )
+		{
+			ReadUBitLong( 2 );
+			return value;
+		}
+
+		// A zero width field masks to zero, so the fields need no branches
+		int nIntBits = bHasInt ? COORD_INTEGER_BITS : 0;
+		int nFractBits = bHasFract ? COORD_FRACTIONAL_BITS : 0;
+		signbit = (int)( ( nBits >> 2 ) & 1 );
+		intval = (int)( ( nBits >> 3 ) & s_nMaskTable[nIntBits] ) + bHasInt;
+		fractval = (int)( ( nBits >> ( 3 + nIntBits ) ) & s_nMaskTable[nFractBits] );
+		ReadUBitLong( 3 + nIntBits + nFractBits );
+
+		value = intval + ((float)fractval * COORD_RESOLUTION);
+		if ( signbit )
+			value = -value;
+		return value;
+	}
+
 
 	// Read the required integer and fraction flags
 	intval = ReadOneBit();
@@ -369,6 +369,178 @@ void CUtlSymbolTable::RemoveAll()
 }
 
 
+//-----------------------------------------------------------------------------
+// Thread safe symbol table
+//-----------------------------------------------------------------------------
+CUtlSymbolTableMT::CUtlSymbolTableMT( int growSize, int initSize, bool caseInsensitive ) :
+	m_bInsensitive( caseInsensitive )
+{
+	memset( (void *)m_pBuckets, 0, sizeof( m_pBuckets ) );
+	memset( (void *)m_pSegments, 0, sizeof( m_pSegments ) );
+	m_nSymbols = 0;
+}
+
+CUtlSymbolTableMT::~CUtlSymbolTableMT()
+{
+	RemoveAll();
+}
+
+inline unsigned int CUtlSymbolTableMT::ComputeHash( const char *pString ) const
+{
+	return m_bInsensitive ? HashStringCaseless( pString ) : HashString( pString );
+}
+
+CUtlSymbolTableMT::Node_t *CUtlSymbolTableMT::FindNode( Node_t *pHead, const char *pString, unsigned int nHash ) const
+{
+	for ( Node_t *pNode = pHead; pNode; pNode = pNode->m_pNext )
+	{
+		if ( pNode->m_nHash != nHash )
+			continue;
+
+		if ( !m_bInsensitive ? !strcmp( pNode->m_String, pString ) : !V_stricmp( pNode->m_String, pString ) )
+			return pNode;
+	}
+	return NULL;
+}
+
+// Another thread has published the node and is about to give it an id
+UtlSymId_t CUtlSymbolTableMT::WaitForId( const Node_t *pNode )
+{
+	int nId;
+	while ( ( nId = pNode->m_nId ) < 0 )
+	{
+		ThreadPause();
+	}
+	return (UtlSymId_t)nId;
+}
+
+CUtlSymbol CUtlSymbolTableMT::Find( const char* pString ) const
+{
+	VPROF( "CUtlSymbol::Find" );
+	if (!pString)
+		return CUtlSymbol();
+
+	unsigned int nHash = ComputeHash( pString );
+	Node_t *pNode = FindNode( m_pBuckets[nHash & ( BUCKET_COUNT - 1 )], pString, nHash );
+	if ( !pNode )
+		return CUtlSymbol();
+
+	return CUtlSymbol( WaitForId( pNode ) );
+}
+
+CUtlSymbol CUtlSymbolTableMT::AddString( const char* pString )
+{
+	VPROF("CUtlSymbol::AddString");
+	if (!pString) 
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+
+	unsigned int nHash = ComputeHash( pString );
+	Node_t * volatile *pBucket = &m_pBuckets[nHash & ( BUCKET_COUNT - 1 )];
+
+	Node_t *pNewNode = NULL;
+	for ( ;; )
+	{
+		Node_t *pHead = *pBucket;
+		Node_t *pNode = FindNode( pHead, pString, nHash );
+		if ( pNode )
+		{
+			// Somebody else added it, maybe while we were trying to
+			free( pNewNode );
+			return CUtlSymbol( WaitForId( pNode ) );
+		}
+
+		if ( !pNewNode )
+		{
+			int lenString = strlen( pString ) + 1;
+			MEM_ALLOC_CREDIT();
+			pNewNode = (Node_t *)malloc( offsetof( Node_t, m_String ) + lenString );
+			pNewNode->m_nHash = nHash;
+			pNewNode->m_nId = -1;
+			memcpy( pNewNode->m_String, pString, lenString );
+		}
+
+		// Publish the node only once it's fully written; if the bucket changed
+		// under us, look again for the string in what was added
+		pNewNode->m_pNext = pHead;
+		ThreadMemoryBarrier();
+		if ( ThreadInterlockedCompareExchangePointer( (void * volatile *)pBucket, pNewNode, pHead ) == pHead )
+			break;
+	}
+
+	int nId = ++m_nSymbols - 1;
+	if ( nId >= UTL_INVAL_SYMBOL )
+	{
+		AssertMsg( 0, "CUtlSymbolTableMT is full" );
+		pNewNode->m_nId = UTL_INVAL_SYMBOL;
+		return CUtlSymbol( UTL_INVAL_SYMBOL );
+	}
+
+	const char **pSegment = m_pSegments[nId / SEGMENT_SIZE];
+	if ( !pSegment )
+	{
+		const char **pNewSegment = (const char **)calloc( SEGMENT_SIZE, sizeof( const char * ) );
+		pSegment = (const char **)ThreadInterlockedCompareExchangePointer( (void * volatile *)&m_pSegments[nId / SEGMENT_SIZE], pNewSegment, NULL );
+		if ( pSegment )
+		{
+			free( pNewSegment );
+		}
+		else
+		{
+			pSegment = pNewSegment;
+		}
+	}
+
+	// The string has to be reachable by id before anyone can see the id
+	pSegment[nId % SEGMENT_SIZE] = pNewNode->m_String;
+	ThreadMemoryBarrier();
+	pNewNode->m_nId = nId;
+
+	return CUtlSymbol( (UtlSymId_t)nId );
+}
+
+const char* CUtlSymbolTableMT::String( CUtlSymbol id ) const
+{
+	if (!id.IsValid()) 
+		return "";
+
+	// A stale or foreign id mustn't read past the table in release builds either
+	UtlSymId_t nId = (UtlSymId_t)id;
+	if ( (int)nId >= m_nSymbols )
+	{
+		AssertMsg( 0, "CUtlSymbolTableMT::String: symbol out of range" );
+		return "";
+	}
+
+	const char **pSegment = m_pSegments[nId / SEGMENT_SIZE];
+	const char *pString = pSegment ? pSegment[nId % SEGMENT_SIZE] : NULL;
+	Assert( pString );
+	return pString ? pString : "";
+}
+
+void CUtlSymbolTableMT::RemoveAll()
+{
+	for ( int i = 0; i < BUCKET_COUNT; i++ )
+	{
+		Node_t *pNode = m_pBuckets[i];
+		while ( pNode )
+		{
+			Node_t *pNext = pNode->m_pNext;
+			free( pNode );
+			pNode = pNext;
+		}
+		m_pBuckets[i] = NULL;
+	}
+
+	for ( int i = 0; i < SEGMENT_COUNT; i++ )
+	{
+		free( (void *)m_pSegments[i] );
+		m_pSegments[i] = NULL;
+	}
+
+	m_nSymbols = 0;
+}
+
+
 //-----------------------------------------------------------------------------
 // Purpose: 
 // Input  : *pFileName - 
@@ -18,8 +18,10 @@
 #define NO_THREAD_NAMES
 #include "threads.h"
 #include "pacifier.h"
+#include "tier0/threadtools.h"
+#include "tier1/utlvector.h"
 
-#define	MAX_THREADS	16
+#define	MAX_THREADS	MAX_TOOL_THREADS
 
 
 class CRunThreadsData
@@ -33,7 +35,6 @@ public:
 CRunThreadsData g_RunThreadsData[MAX_THREADS];
 
 
-int		dispatch;
 int		workcount;
 qboolean		pacifier;
 
@@ -42,33 +43,296 @@ bool g_bLowPriorityThreads = false;
 
 HANDLE g_ThreadHandles[MAX_THREADS];
 
+// Index of the RunThreads thread we're on (0 outside of them).
+static CTHREADLOCALINT g_iWorkThread;
+
+
+/*
+===================================================================
+
+Work dispatch
+
+Work items go out in chunks claimed from a shared cursor, one interlocked
+compare-exchange per chunk. Chunks start at 1/(4*numthreads) of what's left
+and shrink with it, so the tail of a phase is handed out an item at a time.
+Once the cursor runs out, an idle thread steals the back half of the largest
+chunk another thread is still holding, so one unlucky chunk can't leave the
+rest of the machine waiting on it.
+
+Items are dispatched in index order (vvis relies on that, it sorts portals
+so the cheap ones finish first and speed up the rest). SetThreadWorkCosts()
+reorders the next run most expensive first and sizes chunks by cost.
+
+===================================================================
+*/
+
+#define MAX_WORK_CHUNK			1024
+#define WORK_CHUNKS_PER_THREAD	4
+
+struct ThreadWorkRange_t
+{
+	CThreadFastMutex	m_Mutex;
+	volatile int		m_iNext;	// the owner runs from the front..
+	volatile int		m_iEnd;		// ..and thieves take from the back
+	int					m_nChunks;
+	int					m_nSteals;
+	char				m_Pad[64];	// keep neighbouring threads off this cache line
+};
+
+static ThreadWorkRange_t g_WorkRanges[MAX_THREADS];
+static int32 volatile g_iWorkCursor;
+
+// Set by SetThreadWorkCosts() and turned into an order by RunThreadsOn().
+static const float *g_pflNextWorkCosts;
+static CUtlVector<int> g_WorkOrder;				// dispatch position -> work item
+static CUtlVector<double> g_WorkCostSums;		// total cost of positions [0, i)
+
+static CThreadFastMutex g_PacifierMutex;
+
+struct ThreadPhaseTime_t
+{
+	char	m_szName[64];
+	int		m_nRuns;
+	int		m_nWorkItems;
+	double	m_flSeconds;
+	int		m_nChunks;
+	int		m_nSteals;
+};
+
+static CUtlVector<ThreadPhaseTime_t> g_ThreadPhaseTimes;
+static const char *g_pszThreadPhaseName;
+
+
+void SetThreadWorkCosts( const float *pflCosts )
+{
+	g_pflNextWorkCosts = pflCosts;
+}
+
+void SetThreadPhaseName( const char *pszName )
+{
+	g_pszThreadPhaseName = pszName;
+}
+
+
+static int WorkOrderCompare( const void *pA, const void *pB )
+{
+	int a = *(const int *)pA;
+	int b = *(const int *)pB;
+	if ( g_pflNextWorkCosts[a] != g_pflNextWorkCosts[b] )
+		return ( g_pflNextWorkCosts[a] > g_pflNextWorkCosts[b] ) ? -1 : 1;
+	return a - b;
+}
+
+static void InitWorkDispatch( int workcnt )
+{
+	g_iWorkCursor = 0;
+	workcount = workcnt;
+
+	for ( int i=0; i < MAX_THREADS; i++ )
+	{
+		g_WorkRanges[i].m_iNext = 0;
+		g_WorkRanges[i].m_iEnd = 0;
+		g_WorkRanges[i].m_nChunks = 0;
+		g_WorkRanges[i].m_nSteals = 0;
+	}
+
+	g_WorkOrder.RemoveAll();
+	g_WorkCostSums.RemoveAll();
+	if ( !g_pflNextWorkCosts )
+		return;
+
+	g_WorkOrder.SetCount( workcnt );
+	for ( int i=0; i < workcnt; i++ )
+		g_WorkOrder[i] = i;
+	qsort( g_WorkOrder.Base(), workcnt, sizeof( int ), WorkOrderCompare );
+
+	g_WorkCostSums.SetCount( workcnt + 1 );
+	g_WorkCostSums[0] = 0;
+	for ( int i=0; i < workcnt; i++ )
+		g_WorkCostSums[i+1] = g_WorkCostSums[i] + Max( g_pflNextWorkCosts[g_WorkOrder[i]], 0.0f );
+
+	g_pflNextWorkCosts = NULL;
+}
+
+// Where a chunk that starts at dispatch position iStart should end.
+static int WorkChunkEnd( int iStart )
+{
+	int nDivisor = WORK_CHUNKS_PER_THREAD * numthreads;
+	int iLast = Min( workcount, iStart + MAX_WORK_CHUNK );
+
+	if ( !g_WorkCostSums.Count() )
+		return clamp( iStart + ( workcount - iStart ) / nDivisor, iStart + 1, iLast );
+
+	// first position at which the chunk has covered its share of the remaining cost
+	double flTarget = g_WorkCostSums[iStart] + ( g_WorkCostSums[workcount] - g_WorkCostSums[iStart] ) / nDivisor;
+	int iLow = iStart + 1, iHigh = iLast;
+	while ( iLow < iHigh )
+	{
+		int iMid = ( iLow + iHigh ) / 2;
+		if ( g_WorkCostSums[iMid] >= flTarget )
+			iHigh = iMid;
+		else
+			iLow = iMid + 1;
+	}
+	return iLow;
+}
+
+static void UpdateWorkPacifier( int iDispatched )
+{
+	if ( !pacifier || !g_PacifierMutex.TryLock() )
+		return;
+
+	if ( g_WorkCostSums.Count() && g_WorkCostSums[workcount] > 0 )
+		UpdatePacifier( (float)( g_WorkCostSums[iDispatched] / g_WorkCostSums[workcount] ) );
+	else
+		UpdatePacifier( (float)iDispatched / workcount );
+
+	g_PacifierMutex.Unlock();
+}
+
+static bool ClaimWorkChunk( int &iBegin, int &iEnd )
+{
+	for ( ;; )
+	{
+		int iStart = g_iWorkCursor;
+		if ( iStart >= workcount )
+			return false;
+
+		int iChunkEnd = WorkChunkEnd( iStart );
+		if ( ThreadInterlockedAssignIf( &g_iWorkCursor, iChunkEnd, iStart ) )
+		{
+			UpdateWorkPacifier( iStart );
+			iBegin = iStart;
+			iEnd = iChunkEnd;
+			return true;
+		}
+	}
+}
+
+static bool StealWorkChunk( int iThread, int &iBegin, int &iEnd )
+{
+	for ( ;; )
+	{
+		// Unlocked peek for the thread with the most left; it's rechecked under its lock.
+		int iVictim = -1;
+		int nMost = 0;
+		for ( int i=0; i < numthreads; i++ )
+		{
+			int nLeft = g_WorkRanges[i].m_iEnd - g_WorkRanges[i].m_iNext;
+			if ( i != iThread && nLeft > nMost )
+			{
+				iVictim = i;
+				nMost = nLeft;
+			}
+		}
+
+		if ( iVictim == -1 )
+			return false;
+
+		ThreadWorkRange_t &victim = g_WorkRanges[iVictim];
+		victim.m_Mutex.Lock();
+		int nLeft = victim.m_iEnd - victim.m_iNext;
+		if ( nLeft > 0 )
+		{
+			iEnd = victim.m_iEnd;
+			iBegin = iEnd - ( nLeft + 1 ) / 2;
+			victim.m_iEnd = iBegin;
+			victim.m_Mutex.Unlock();
+			return true;
+		}
+		victim.m_Mutex.Unlock();
+	}
+}
 
 
 /*
 =============
 GetThreadWork
 
+Returns the next work item for the calling thread, or -1 when there's
+nothing left to run.
 =============
 */
 int	GetThreadWork (void)
 {
-	int	r;
+	int iThread = g_iWorkThread;
+	ThreadWorkRange_t &range = g_WorkRanges[iThread];
 
-	ThreadLock ();
+	for ( ;; )
+	{
+		range.m_Mutex.Lock();
+		if ( range.m_iNext < range.m_iEnd )
+		{
+			int iPos = range.m_iNext++;
+			range.m_Mutex.Unlock();
+			return g_WorkOrder.Count() ? g_WorkOrder[iPos] : iPos;
+		}
+		range.m_Mutex.Unlock();
 
-	if (dispatch == workcount)
+		int iBegin, iEnd;
+		if ( ClaimWorkChunk( iBegin, iEnd ) )
+		{
+			range.m_nChunks++;
+		}
+		else if ( StealWorkChunk( iThread, iBegin, iEnd ) )
+		{
+			range.m_nSteals++;
+		}
+		else
+		{
+			return -1;
+		}
+
+		range.m_Mutex.Lock();
+		range.m_iNext = iBegin;
+		range.m_iEnd = iEnd;
+		range.m_Mutex.Unlock();
+	}
+}
+
+
+static void RecordThreadPhaseTime( double flSeconds )
+{
+	const char *pszName = g_pszThreadPhaseName ? g_pszThreadPhaseName : "(unnamed)";
+	g_pszThreadPhaseName = NULL;
+
+	int iPhase;
+	for ( iPhase=0; iPhase < g_ThreadPhaseTimes.Count(); iPhase++ )
+	{
+		if ( !Q_stricmp( g_ThreadPhaseTimes[iPhase].m_szName, pszName ) )
+			break;
+	}
+
+	if ( iPhase == g_ThreadPhaseTimes.Count() )
 	{
-		ThreadUnlock ();
-		return -1;
+		iPhase = g_ThreadPhaseTimes.AddToTail();
+		memset( &g_ThreadPhaseTimes[iPhase], 0, sizeof( ThreadPhaseTime_t ) );
+		Q_strncpy( g_ThreadPhaseTimes[iPhase].m_szName, pszName, sizeof( g_ThreadPhaseTimes[iPhase].m_szName ) );
 	}
 
-	UpdatePacifier( (float)dispatch / workcount );
+	ThreadPhaseTime_t &phase = g_ThreadPhaseTimes[iPhase];
+	phase.m_nRuns++;
+	phase.m_nWorkItems += workcount;
+	phase.m_flSeconds += flSeconds;
+	for ( int i=0; i < MAX_THREADS; i++ )
+	{
+		phase.m_nChunks += g_WorkRanges[i].m_nChunks;
+		phase.m_nSteals += g_WorkRanges[i].m_nSteals;
+	}
+}
 
-	r = dispatch;
-	dispatch++;
-	ThreadUnlock ();
+void PrintThreadPhaseTimes()
+{
+	if ( !g_ThreadPhaseTimes.Count() )
+		return;
 
-	return r;
+	Msg( "\n%-28s %5s %10s %10s %9s %8s\n", "Threaded phase", "runs", "items", "chunks", "steals", "seconds" );
+	for ( int i=0; i < g_ThreadPhaseTimes.Count(); i++ )
+	{
+		const ThreadPhaseTime_t &phase = g_ThreadPhaseTimes[i];
+		Msg( "%-28s %5d %10d %10d %9d %8.2f\n", phase.m_szName, phase.m_nRuns, phase.m_nWorkItems, phase.m_nChunks, phase.m_nSteals, phase.m_flSeconds );
+	}
+	Msg( "\n" );
 }
 
 
@@ -136,8 +400,10 @@ void ThreadSetDefault (void)
 	{
 		GetSystemInfo (&info);
 		numthreads = info.dwNumberOfProcessors;
-		if (numthreads < 1 || numthreads > 32)
+		if (numthreads < 1)
 			numthreads = 1;
+		else if (numthreads > MAX_TOOL_THREADS)
+			numthreads = MAX_TOOL_THREADS;
 	}
 
 	Msg ("%i threads\n", numthreads);
@@ -169,6 +435,7 @@ void ThreadUnlock (void)
 DWORD WINAPI InternalRunThreadsFn( LPVOID pParameter )
 {
 	CRunThreadsData *pData = (CRunThreadsData*)pParameter;
+	g_iWorkThread = pData->m_iThread;
 	pData->m_Fn( pData->m_iThread, pData->m_pUserData );
 	return 0;
 }
@@ -227,11 +494,10 @@ RunThreadsOn
 */
 void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pUserData )
 {
-	int		start, end;
+	double	start, end;
 
 	start = Plat_FloatTime();
-	dispatch = 0;
-	workcount = workcnt;
+	InitWorkDispatch( workcnt );
 	StartPacifier("");
 	pacifier = showpacifier;
 
@@ -247,11 +513,10 @@ void RunThreadsOn( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pU
 
 
 	end = Plat_FloatTime();
+	RecordThreadPhaseTime( end - start );
 	if (pacifier)
 	{
 		EndPacifier(false);
-		printf (" (%i)\n", end-start);
+		printf (" (%i)\n", (int)(end-start));
 	}
 }
-
-
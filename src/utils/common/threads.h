@@ -17,8 +17,11 @@
 
 
 // Arrays that are indexed by thread should always be MAX_TOOL_THREADS+1
-// large so THREADINDEX_MAIN can be used from the main thread.
-#define MAX_TOOL_THREADS	16
+// large so THREADINDEX_MAIN can be used from the main thread. They take that
+// much space whatever numthreads is, so keep their elements to a pointer or a
+// small struct and allocate anything bigger the first time a thread uses it
+// (like DispTested_t::m_pTested in vrad).
+#define MAX_TOOL_THREADS	64
 #define THREADINDEX_MAIN	(MAX_TOOL_THREADS)
 
 
@@ -45,6 +48,17 @@ void SetLowPriority();
 void ThreadSetDefault (void);
 int	GetThreadWork (void);
 
+// Optional relative cost of each work item for the next RunThreadsOn / RunThreadsOnIndividual
+// call. Items are then handed out most expensive first. pflCosts must stay valid until that
+// call starts; by default items go out in index order.
+void SetThreadWorkCosts( const float *pflCosts );
+
+// Names the next RunThreadsOn call in the per-phase timings (the macros below do this).
+void SetThreadPhaseName( const char *pszName );
+
+// Prints the accumulated wall time, item, chunk and steal counts of each threaded phase.
+void PrintThreadPhaseTimes();
+
 void RunThreadsOnIndividual ( int workcnt, qboolean showpacifier, ThreadWorkerFn fn );
 
 void RunThreadsOn ( int workcnt, qboolean showpacifier, RunThreadsFn fn, void *pUserData=NULL );
@@ -58,8 +72,8 @@ void ThreadUnlock (void);
 
 
 #ifndef NO_THREAD_NAMES
-#define RunThreadsOn(n,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOn(n,p,f); }
-#define RunThreadsOnIndividual(n,p,f) { if (p) printf("%-20s ", #f ":"); RunThreadsOnIndividual(n,p,f); }
+#define RunThreadsOn(n,p,f) { SetThreadPhaseName(#f); if (p) printf("%-20s ", #f ":"); RunThreadsOn(n,p,f); }
+#define RunThreadsOnIndividual(n,p,f) { SetThreadPhaseName(#f); if (p) printf("%-20s ", #f ":"); RunThreadsOnIndividual(n,p,f); }
 #endif
 
 #endif // THREADS_H
@@ -0,0 +1,1097 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Distributes work units from a master tool process to worker
+//			processes over TCP. See workerpool.h.
+//
+//			Every process runs the whole tool up to a WorkerPool_DistributeWork
+//			call, so the inputs are identical everywhere. Workers ask for
+//			chunks of units and send back one result per unit; the master
+//			applies them on its main thread. A worker that disconnects has its
+//			unfinished units handed out again.
+//
+//			The master only listens on loopback unless it's given an interface,
+//			and a worker has to present the pool's token before it's handed any
+//			work. Everything a worker sends is checked against the phase before
+//			the master uses it.
+//
+//=============================================================================//
+
+#if defined( _WIN32 )
+#define _CRT_RAND_S		// rand_s, for the token local workers are given
+#include <stdlib.h>
+#include <winsock.h>
+#include <windows.h>
+typedef int socklen_t;
+#elif defined( POSIX )
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+typedef int SOCKET;
+#define INVALID_SOCKET		-1
+#define SOCKET_ERROR		-1
+#define closesocket			close
+#endif
+
+#include "cmdlib.h"
+#include "threads.h"
+#include "pacifier.h"
+#include "workerpool.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "tier1/utlvector.h"
+
+
+#define WORKERPOOL_VERSION				2
+#define WORKERPOOL_MAX_TOKEN			128
+#define WORKERPOOL_CONNECT_TIMEOUT		60.0	// seconds to wait for spawned workers / for the master to come up
+#define WORKERPOOL_MAX_CHUNK			1024
+#define WORKERPOOL_MAX_MESSAGE			( 512 * 1024 * 1024 )
+
+bool g_bWorkerPool = false;
+bool g_bWorkerPoolMaster = false;
+
+enum WorkerPoolMsgType_t
+{
+	WPMSG_HELLO = 1,	// worker -> master: version, token
+	WPMSG_REQUEST,		// worker -> master: phase, unit count, thread count. Asks for (more) work
+	WPMSG_WORK,			// master -> worker: first unit, unit count
+	WPMSG_RESULT,		// worker -> master: unit, result data
+	WPMSG_PHASE_DONE,	// master -> worker: every unit of the phase is done
+	WPMSG_FETCH,		// worker -> master: broadcast index
+	WPMSG_BLOB,			// master -> worker: broadcast data
+	WPMSG_QUIT,			// master -> worker
+};
+
+struct WorkerPoolMsgHeader_t
+{
+	uint32	m_nType;
+	uint32	m_nSize;	// payload bytes following the header
+};
+
+struct WorkerPoolRequest_t
+{
+	uint32	m_iPhase;
+	uint32	m_nThreads;
+	uint64	m_nWorkUnits;
+};
+
+struct WorkerPoolWork_t
+{
+	uint64	m_iFirstUnit;
+	uint64	m_nUnits;
+};
+
+struct PoolWorker_t
+{
+	SOCKET		m_Socket;
+	int			m_iWorker;
+	bool		m_bWaitingForWork;	// has a REQUEST we haven't answered
+	WorkerPoolRequest_t m_Request;	// the last one
+	int			m_iWaitingForBlob;	// broadcast it asked for before we published it, or -1
+	int			m_nBlobsFetched;	// broadcasts are fetched in order
+	uint64		m_nUnitsDone;
+	CUtlVector< WorkerPoolWork_t > m_Assigned;	// this phase
+};
+
+// Shared
+static int g_iPoolPhase = 0;
+static int g_nPoolBroadcasts = 0;
+static char g_szPoolToken[WORKERPOOL_MAX_TOKEN];
+
+// Master
+static SOCKET g_ListenSocket = INVALID_SOCKET;
+static CUtlVector< PoolWorker_t * > g_PoolWorkers;
+static int g_iNextWorkerID = 0;
+static CUtlVector< CUtlBuffer * > g_PoolBroadcasts;	// NULL once every worker has fetched it
+#if defined( _WIN32 )
+static CUtlVector< HANDLE > g_SpawnedWorkers;
+#elif defined( POSIX )
+static CUtlVector< pid_t > g_SpawnedWorkers;
+#endif
+
+// Master, current phase
+static uint64 g_nPhaseUnits;
+static uint64 g_iPhaseNextUnit;
+static uint64 g_nPhaseReceived;
+static CUtlVector< byte > g_PhaseReceived;
+static CUtlVector< uint64 > g_PhaseRequeued;
+static WorkerPoolReceiveFn g_pfnPhaseReceive;
+static float g_flPacifierStart = 0.0f;
+static float g_flPacifierEnd = 1.0f;
+
+// Worker
+static SOCKET g_MasterSocket = INVALID_SOCKET;
+static CThreadFastMutex g_MasterSendMutex;
+
+// Both, while running a chunk on our own threads
+static WorkerPoolProcessFn g_pfnChunkProcess;
+static uint64 g_iChunkFirstUnit;
+static CUtlBuffer g_ChunkResults[MAX_TOOL_THREADS+1];
+
+
+//-----------------------------------------------------------------------------
+// Sockets
+//-----------------------------------------------------------------------------
+static bool SendAll( SOCKET s, const void *pData, int nBytes )
+{
+	const char *p = (const char *)pData;
+	while ( nBytes > 0 )
+	{
+		int n = send( s, p, nBytes, 0 );
+		if ( n <= 0 )
+		{
+#ifdef POSIX
+			if ( n < 0 && errno == EINTR )
+				continue;
+#endif
+			return false;
+		}
+		p += n;
+		nBytes -= n;
+	}
+	return true;
+}
+
+static bool RecvAll( SOCKET s, void *pData, int nBytes )
+{
+	char *p = (char *)pData;
+	while ( nBytes > 0 )
+	{
+		int n = recv( s, p, nBytes, 0 );
+		if ( n <= 0 )
+		{
+#ifdef POSIX
+			if ( n < 0 && errno == EINTR )
+				continue;
+#endif
+			return false;
+		}
+		p += n;
+		nBytes -= n;
+	}
+	return true;
+}
+
+static bool SendMsg( SOCKET s, uint32 nType, const void *pData1 = NULL, int nSize1 = 0, const void *pData2 = NULL, int nSize2 = 0 )
+{
+	WorkerPoolMsgHeader_t hdr;
+	hdr.m_nType = nType;
+	hdr.m_nSize = nSize1 + nSize2;
+	return SendAll( s, &hdr, sizeof( hdr ) ) && SendAll( s, pData1, nSize1 ) && SendAll( s, pData2, nSize2 );
+}
+
+static bool RecvMsg( SOCKET s, WorkerPoolMsgHeader_t &hdr, CUtlBuffer &payload )
+{
+	if ( !RecvAll( s, &hdr, sizeof( hdr ) ) || hdr.m_nSize > WORKERPOOL_MAX_MESSAGE )
+		return false;
+
+	payload.Clear();
+	payload.EnsureCapacity( hdr.m_nSize );
+	if ( !RecvAll( s, payload.Base(), hdr.m_nSize ) )
+		return false;
+	payload.SeekPut( CUtlBuffer::SEEK_HEAD, hdr.m_nSize );
+	return true;
+}
+
+static void SetNoDelay( SOCKET s )
+{
+	int bNoDelay = 1;
+	setsockopt( s, IPPROTO_TCP, TCP_NODELAY, (const char *)&bNoDelay, sizeof( bNoDelay ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Runs units [iFirst, iFirst+nUnits) on our threads. Workers send each result
+// as soon as it's done; the master (pBuf NULL) leaves them in place.
+//-----------------------------------------------------------------------------
+static void WorkerPool_ProcessWorkUnit( int iThread, int iItem )
+{
+	uint64 iUnit = g_iChunkFirstUnit + iItem;
+	if ( g_bWorkerPoolMaster )
+	{
+		g_pfnChunkProcess( iThread, iUnit, NULL );
+		return;
+	}
+
+	CUtlBuffer &buf = g_ChunkResults[iThread];
+	buf.Clear();
+	g_pfnChunkProcess( iThread, iUnit, &buf );
+
+	AUTO_LOCK( g_MasterSendMutex );
+	if ( !SendMsg( g_MasterSocket, WPMSG_RESULT, &iUnit, sizeof( iUnit ), buf.Base(), buf.TellPut() ) )
+		Error( "Worker pool: lost the connection to the master.\n" );
+}
+
+static void ProcessChunk( WorkerPoolProcessFn pfnProcess, uint64 iFirstUnit, uint64 nUnits )
+{
+	g_pfnChunkProcess = pfnProcess;
+	g_iChunkFirstUnit = iFirstUnit;
+	RunThreadsOnIndividual( (int)nUnits, false, WorkerPool_ProcessWorkUnit );
+}
+
+
+//-----------------------------------------------------------------------------
+// Master
+//-----------------------------------------------------------------------------
+static void MasterServeBlob( PoolWorker_t *pWorker, int iBlob );
+static void MasterReleaseBroadcasts();
+static void MasterDropWorker( PoolWorker_t *pWorker );
+
+static uint64 GetChunkSize( int nThreads )
+{
+	uint64 nRemaining = g_nPhaseUnits - g_iPhaseNextUnit;
+	uint64 nChunk = nRemaining / ( 3 * Max( g_PoolWorkers.Count(), 1 ) );
+	nChunk = Max( nChunk, (uint64)Max( nThreads, 1 ) );
+	nChunk = Min( nChunk, (uint64)WORKERPOOL_MAX_CHUNK );
+	return Min( nChunk, nRemaining );
+}
+
+// Answers the worker's REQUEST if there is anything left to hand out
+static bool MasterAssignWork( PoolWorker_t *pWorker )
+{
+	WorkerPoolWork_t work;
+	if ( g_PhaseRequeued.Count() )
+	{
+		work.m_iFirstUnit = g_PhaseRequeued.Tail();
+		work.m_nUnits = 1;
+		g_PhaseRequeued.RemoveMultipleFromTail( 1 );
+	}
+	else if ( g_iPhaseNextUnit < g_nPhaseUnits )
+	{
+		work.m_iFirstUnit = g_iPhaseNextUnit;
+		work.m_nUnits = GetChunkSize( pWorker->m_Request.m_nThreads );
+		g_iPhaseNextUnit += work.m_nUnits;
+	}
+	else
+	{
+		// Nothing left right now; answered when the phase ends or a worker drops out
+		return false;
+	}
+
+	pWorker->m_Assigned.AddToTail( work );
+	pWorker->m_bWaitingForWork = false;
+	if ( !SendMsg( pWorker->m_Socket, WPMSG_WORK, &work, sizeof( work ) ) )
+	{
+		MasterDropWorker( pWorker );
+	}
+	return true;
+}
+
+static void MasterServeRequest( PoolWorker_t *pWorker )
+{
+	const WorkerPoolRequest_t &request = pWorker->m_Request;
+	if ( (int)request.m_iPhase > g_iPoolPhase )
+		return;		// we haven't got there yet
+
+	if ( (int)request.m_iPhase < g_iPoolPhase || !g_pfnPhaseReceive )
+	{
+		// The phase is over; late joiners skip straight past it
+		pWorker->m_bWaitingForWork = false;
+		if ( !SendMsg( pWorker->m_Socket, WPMSG_PHASE_DONE ) )
+			MasterDropWorker( pWorker );
+	}
+	else if ( request.m_nWorkUnits != g_nPhaseUnits )
+	{
+		Warning( "Worker pool: worker %d is running a different job (%d units instead of %d).\n", pWorker->m_iWorker, (int)request.m_nWorkUnits, (int)g_nPhaseUnits );
+		MasterDropWorker( pWorker );
+	}
+	else
+	{
+		MasterAssignWork( pWorker );
+	}
+}
+
+// Handling a worker can drop workers, so these go through a copy of the list
+static void MasterServeWaitingWorkers()
+{
+	CUtlVector< PoolWorker_t * > workers;
+	workers.CopyArray( g_PoolWorkers.Base(), g_PoolWorkers.Count() );
+	for ( int i = 0; i < workers.Count(); i++ )
+	{
+		if ( g_PoolWorkers.Find( workers[i] ) != g_PoolWorkers.InvalidIndex() && workers[i]->m_bWaitingForWork )
+		{
+			MasterServeRequest( workers[i] );
+		}
+	}
+}
+
+static void MasterDropWorker( PoolWorker_t *pWorker )
+{
+	Warning( "Worker pool: lost worker %d.\n", pWorker->m_iWorker );
+
+	// Whatever it didn't finish goes out again
+	for ( int i = 0; g_pfnPhaseReceive && i < pWorker->m_Assigned.Count(); i++ )
+	{
+		const WorkerPoolWork_t &work = pWorker->m_Assigned[i];
+		for ( uint64 iUnit = work.m_iFirstUnit; iUnit < work.m_iFirstUnit + work.m_nUnits; iUnit++ )
+		{
+			if ( iUnit < g_nPhaseUnits && !g_PhaseReceived[iUnit] )
+				g_PhaseRequeued.AddToTail( iUnit );
+		}
+	}
+
+	closesocket( pWorker->m_Socket );
+	g_PoolWorkers.FindAndRemove( pWorker );
+	delete pWorker;
+
+	// It may have been the last one holding on to a broadcast
+	MasterReleaseBroadcasts();
+
+	if ( g_pfnPhaseReceive && g_PhaseRequeued.Count() )
+	{
+		MasterServeWaitingWorkers();
+	}
+}
+
+static bool MasterAcceptWorker()
+{
+	sockaddr_in addr;
+	socklen_t addrLen = sizeof( addr );
+	SOCKET s = accept( g_ListenSocket, (sockaddr *)&addr, &addrLen );
+	if ( s == INVALID_SOCKET )
+		return false;
+
+	WorkerPoolMsgHeader_t hdr;
+	CUtlBuffer payload;
+	char szToken[WORKERPOOL_MAX_TOKEN];
+	bool bHello = RecvMsg( s, hdr, payload ) && hdr.m_nType == WPMSG_HELLO && payload.GetUnsignedInt() == WORKERPOOL_VERSION;
+	if ( bHello )
+	{
+		payload.GetString( szToken, sizeof( szToken ) );
+		bHello = payload.IsValid() && payload.GetBytesRemaining() == 0 && !V_strcmp( szToken, g_szPoolToken );
+	}
+
+	if ( !bHello )
+	{
+		Warning( "Worker pool: rejected a connection from %s.\n", inet_ntoa( addr.sin_addr ) );
+		closesocket( s );
+		return false;
+	}
+	SetNoDelay( s );
+
+	PoolWorker_t *pWorker = new PoolWorker_t;
+	pWorker->m_Socket = s;
+	pWorker->m_iWorker = g_iNextWorkerID++;
+	pWorker->m_bWaitingForWork = false;
+	pWorker->m_iWaitingForBlob = -1;
+	pWorker->m_nBlobsFetched = 0;
+	pWorker->m_nUnitsDone = 0;
+	g_PoolWorkers.AddToTail( pWorker );
+
+	qprintf( "Worker pool: worker %d connected from %s.\n", pWorker->m_iWorker, inet_ntoa( addr.sin_addr ) );
+	return true;
+}
+
+// Only results for units the worker was handed this phase are taken
+static bool MasterIsAssigned( PoolWorker_t *pWorker, uint64 iUnit )
+{
+	if ( iUnit >= g_nPhaseUnits )
+		return false;
+
+	for ( int i = 0; i < pWorker->m_Assigned.Count(); i++ )
+	{
+		const WorkerPoolWork_t &work = pWorker->m_Assigned[i];
+		if ( iUnit >= work.m_iFirstUnit && iUnit - work.m_iFirstUnit < work.m_nUnits )
+			return true;
+	}
+	return false;
+}
+
+static void MasterHandleMessage( PoolWorker_t *pWorker )
+{
+	WorkerPoolMsgHeader_t hdr;
+	CUtlBuffer payload;
+	if ( !RecvMsg( pWorker->m_Socket, hdr, payload ) )
+	{
+		MasterDropWorker( pWorker );
+		return;
+	}
+
+	switch ( hdr.m_nType )
+	{
+	case WPMSG_REQUEST:
+		{
+			if ( payload.TellPut() != sizeof( pWorker->m_Request ) )
+			{
+				Warning( "Worker pool: bad request from worker %d.\n", pWorker->m_iWorker );
+				MasterDropWorker( pWorker );
+				return;
+			}
+			payload.Get( &pWorker->m_Request, sizeof( pWorker->m_Request ) );
+			pWorker->m_bWaitingForWork = true;
+			MasterServeRequest( pWorker );
+		}
+		break;
+
+	case WPMSG_RESULT:
+		{
+			uint64 iUnit = 0;
+			payload.Get( &iUnit, sizeof( iUnit ) );
+			if ( !payload.IsValid() || !g_pfnPhaseReceive || !MasterIsAssigned( pWorker, iUnit ) )
+			{
+				Warning( "Worker pool: worker %d sent a result for a unit it wasn't given.\n", pWorker->m_iWorker );
+				MasterDropWorker( pWorker );
+				return;
+			}
+
+			if ( !g_PhaseReceived[iUnit] )
+			{
+				g_PhaseReceived[iUnit] = 1;
+				g_nPhaseReceived++;
+				pWorker->m_nUnitsDone++;
+				g_pfnPhaseReceive( iUnit, payload, pWorker->m_iWorker );
+			}
+		}
+		break;
+
+	case WPMSG_FETCH:
+		{
+			// Broadcasts are fetched one after another
+			int iBlob = payload.GetInt();
+			if ( !payload.IsValid() || iBlob != pWorker->m_nBlobsFetched )
+			{
+				Warning( "Worker pool: worker %d asked for broadcast %d out of order.\n", pWorker->m_iWorker, iBlob );
+				MasterDropWorker( pWorker );
+				return;
+			}
+			MasterServeBlob( pWorker, iBlob );
+		}
+		break;
+
+	default:
+		Warning( "Worker pool: bad message %d from worker %d.\n", hdr.m_nType, pWorker->m_iWorker );
+		MasterDropWorker( pWorker );
+		break;
+	}
+}
+
+// Waits up to flTimeout for connections and messages, and handles them
+static void MasterPoll( float flTimeout )
+{
+	fd_set readSet;
+	FD_ZERO( &readSet );
+	FD_SET( g_ListenSocket, &readSet );
+	SOCKET maxSocket = g_ListenSocket;
+	for ( int i = 0; i < g_PoolWorkers.Count(); i++ )
+	{
+		FD_SET( g_PoolWorkers[i]->m_Socket, &readSet );
+		maxSocket = Max( maxSocket, g_PoolWorkers[i]->m_Socket );
+	}
+
+	timeval tv;
+	tv.tv_sec = (long)flTimeout;
+	tv.tv_usec = (long)( ( flTimeout - tv.tv_sec ) * 1000000.0f );
+	if ( select( (int)maxSocket + 1, &readSet, NULL, NULL, &tv ) <= 0 )
+		return;
+
+	if ( FD_ISSET( g_ListenSocket, &readSet ) )
+	{
+		MasterAcceptWorker();
+	}
+
+	CUtlVector< PoolWorker_t * > workers;
+	workers.CopyArray( g_PoolWorkers.Base(), g_PoolWorkers.Count() );
+	for ( int i = 0; i < workers.Count(); i++ )
+	{
+		if ( g_PoolWorkers.Find( workers[i] ) != g_PoolWorkers.InvalidIndex() && FD_ISSET( workers[i]->m_Socket, &readSet ) )
+		{
+			MasterHandleMessage( workers[i] );
+		}
+	}
+}
+
+// With nobody to hand work to, the master does a chunk itself so the tool never stalls
+static void MasterProcessLocalChunk( WorkerPoolProcessFn pfnProcess )
+{
+	uint64 iFirst, nUnits;
+	if ( g_PhaseRequeued.Count() )
+	{
+		iFirst = g_PhaseRequeued.Tail();
+		nUnits = 1;
+		g_PhaseRequeued.RemoveMultipleFromTail( 1 );
+	}
+	else
+	{
+		iFirst = g_iPhaseNextUnit;
+		nUnits = Min( (uint64)numthreads * 4, g_nPhaseUnits - g_iPhaseNextUnit );
+		g_iPhaseNextUnit += nUnits;
+	}
+
+	ProcessChunk( pfnProcess, iFirst, nUnits );
+
+	for ( uint64 iUnit = iFirst; iUnit < iFirst + nUnits; iUnit++ )
+	{
+		g_PhaseReceived[iUnit] = 1;
+	}
+	g_nPhaseReceived += nUnits;
+}
+
+static double MasterDistributeWork( uint64 nWorkUnits, WorkerPoolProcessFn pfnProcess, WorkerPoolReceiveFn pfnReceive )
+{
+	double flStart = Plat_FloatTime();
+
+	g_nPhaseUnits = nWorkUnits;
+	g_iPhaseNextUnit = 0;
+	g_nPhaseReceived = 0;
+	g_PhaseReceived.SetCount( (int)nWorkUnits );
+	if ( nWorkUnits )
+	{
+		memset( g_PhaseReceived.Base(), 0, nWorkUnits );
+	}
+	g_PhaseRequeued.RemoveAll();
+	g_pfnPhaseReceive = pfnReceive;
+	for ( int i = 0; i < g_PoolWorkers.Count(); i++ )
+	{
+		g_PoolWorkers[i]->m_Assigned.RemoveAll();
+		g_PoolWorkers[i]->m_nUnitsDone = 0;
+	}
+
+	// Workers that got here first are already waiting
+	MasterServeWaitingWorkers();
+
+	while ( g_nPhaseReceived < g_nPhaseUnits )
+	{
+		bool bCanProcessLocally = !g_PoolWorkers.Count() && ( g_PhaseRequeued.Count() || g_iPhaseNextUnit < g_nPhaseUnits );
+		MasterPoll( bCanProcessLocally ? 0.0f : 0.1f );
+
+		if ( !g_PoolWorkers.Count() && ( g_PhaseRequeued.Count() || g_iPhaseNextUnit < g_nPhaseUnits ) )
+		{
+			MasterProcessLocalChunk( pfnProcess );
+		}
+
+		UpdatePacifier( g_flPacifierStart + ( g_flPacifierEnd - g_flPacifierStart ) * (float)g_nPhaseReceived / (float)g_nPhaseUnits );
+	}
+	g_flPacifierStart = 0.0f;
+	g_flPacifierEnd = 1.0f;
+
+	for ( int i = 0; i < g_PoolWorkers.Count(); i++ )
+	{
+		qprintf( "Worker pool: worker %d did %d units.\n", g_PoolWorkers[i]->m_iWorker, (int)g_PoolWorkers[i]->m_nUnitsDone );
+		g_PoolWorkers[i]->m_Assigned.RemoveAll();
+	}
+
+	// Release everyone waiting on this phase
+	g_pfnPhaseReceive = NULL;
+	g_PhaseReceived.Purge();
+	MasterServeWaitingWorkers();
+	return Plat_FloatTime() - flStart;
+}
+
+static void MasterServeBlob( PoolWorker_t *pWorker, int iBlob )
+{
+	if ( iBlob < 0 || iBlob >= g_PoolBroadcasts.Count() )
+	{
+		// Not published yet; WorkerPool_Broadcast sends it
+		pWorker->m_iWaitingForBlob = iBlob;
+		return;
+	}
+
+	pWorker->m_iWaitingForBlob = -1;
+	CUtlBuffer *pBuf = g_PoolBroadcasts[iBlob];
+	if ( !pBuf )
+	{
+		// It joined after everyone else was done with this one, so it can't catch up
+		Warning( "Worker pool: worker %d joined too late for broadcast %d, sending it home.\n", pWorker->m_iWorker, iBlob );
+		SendMsg( pWorker->m_Socket, WPMSG_QUIT );
+		MasterDropWorker( pWorker );
+		return;
+	}
+
+	if ( !SendMsg( pWorker->m_Socket, WPMSG_BLOB, pBuf->Base(), pBuf->TellPut() ) )
+	{
+		MasterDropWorker( pWorker );
+		return;
+	}
+
+	pWorker->m_nBlobsFetched = iBlob + 1;
+	MasterReleaseBroadcasts();
+}
+
+// Frees the broadcasts every connected worker has fetched
+static void MasterReleaseBroadcasts()
+{
+	int nFetchedByAll = g_PoolBroadcasts.Count();
+	for ( int i = 0; i < g_PoolWorkers.Count(); i++ )
+	{
+		nFetchedByAll = Min( nFetchedByAll, g_PoolWorkers[i]->m_nBlobsFetched );
+	}
+
+	for ( int i = 0; i < nFetchedByAll; i++ )
+	{
+		if ( g_PoolBroadcasts[i] )
+		{
+			delete g_PoolBroadcasts[i];
+			g_PoolBroadcasts[i] = NULL;
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Worker
+//-----------------------------------------------------------------------------
+static void WorkerRecvMsg( WorkerPoolMsgHeader_t &hdr, CUtlBuffer &payload )
+{
+	if ( !RecvMsg( g_MasterSocket, hdr, payload ) )
+		Error( "Worker pool: lost the connection to the master.\n" );
+
+	if ( hdr.m_nType == WPMSG_QUIT )
+	{
+		closesocket( g_MasterSocket );
+		Plat_ExitProcess( 0 );
+	}
+}
+
+static void WorkerSendRequest( uint64 nWorkUnits )
+{
+	WorkerPoolRequest_t request;
+	request.m_iPhase = g_iPoolPhase;
+	request.m_nThreads = numthreads;
+	request.m_nWorkUnits = nWorkUnits;
+
+	AUTO_LOCK( g_MasterSendMutex );
+	if ( !SendMsg( g_MasterSocket, WPMSG_REQUEST, &request, sizeof( request ) ) )
+		Error( "Worker pool: lost the connection to the master.\n" );
+}
+
+static double WorkerDistributeWork( uint64 nWorkUnits, WorkerPoolProcessFn pfnProcess )
+{
+	double flStart = Plat_FloatTime();
+
+	WorkerSendRequest( nWorkUnits );
+	while ( 1 )
+	{
+		WorkerPoolMsgHeader_t hdr;
+		CUtlBuffer payload;
+		WorkerRecvMsg( hdr, payload );
+
+		if ( hdr.m_nType == WPMSG_PHASE_DONE )
+			break;
+
+		if ( hdr.m_nType != WPMSG_WORK )
+			Error( "Worker pool: unexpected message %d from the master.\n", hdr.m_nType );
+
+		WorkerPoolWork_t work;
+		payload.Get( &work, sizeof( work ) );
+
+		// Ask for the next chunk now so it's here when we finish this one
+		WorkerSendRequest( nWorkUnits );
+		ProcessChunk( pfnProcess, work.m_iFirstUnit, work.m_nUnits );
+	}
+
+	return Plat_FloatTime() - flStart;
+}
+
+static bool ParseHostPort( const char *pszAddress, sockaddr_in &addr )
+{
+	char szHost[256];
+	V_strncpy( szHost, pszAddress, sizeof( szHost ) );
+	char *pColon = strrchr( szHost, ':' );
+	if ( !pColon )
+		return false;
+	*pColon = 0;
+
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( (unsigned short)atoi( pColon + 1 ) );
+	addr.sin_addr.s_addr = inet_addr( szHost );
+	if ( addr.sin_addr.s_addr == INADDR_NONE )
+	{
+		hostent *pHost = gethostbyname( szHost );
+		if ( !pHost || !pHost->h_addr_list[0] )
+			return false;
+		memcpy( &addr.sin_addr, pHost->h_addr_list[0], sizeof( addr.sin_addr ) );
+	}
+	return addr.sin_port != 0;
+}
+
+static void WorkerConnect( const char *pszMaster )
+{
+	sockaddr_in addr;
+	if ( !ParseHostPort( pszMaster, addr ) )
+		Error( "Worker pool: bad master address '%s', expected <host>:<port>.\n", pszMaster );
+
+	// Let workers start before the master does
+	double flGiveUp = Plat_FloatTime() + WORKERPOOL_CONNECT_TIMEOUT;
+	while ( 1 )
+	{
+		g_MasterSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+		if ( g_MasterSocket == INVALID_SOCKET )
+			Error( "Worker pool: can't create a socket.\n" );
+
+		if ( connect( g_MasterSocket, (sockaddr *)&addr, sizeof( addr ) ) != SOCKET_ERROR )
+			break;
+
+		closesocket( g_MasterSocket );
+		if ( Plat_FloatTime() > flGiveUp )
+			Error( "Worker pool: can't connect to the master at %s.\n", pszMaster );
+		ThreadSleep( 500 );
+	}
+	SetNoDelay( g_MasterSocket );
+
+	CUtlBuffer hello;
+	hello.PutUnsignedInt( WORKERPOOL_VERSION );
+	hello.PutString( g_szPoolToken );
+	if ( !SendMsg( g_MasterSocket, WPMSG_HELLO, hello.Base(), hello.TellPut() ) )
+		Error( "Worker pool: lost the connection to the master.\n" );
+}
+
+
+//-----------------------------------------------------------------------------
+// Spawning local workers
+//-----------------------------------------------------------------------------
+static void SpawnLocalWorker( CUtlVector< const char * > &args )
+{
+#if defined( _WIN32 )
+	char szExe[MAX_PATH];
+	GetModuleFileName( NULL, szExe, sizeof( szExe ) );
+
+	CUtlVector< char > cmdLine;
+	for ( int i = 0; i < args.Count(); i++ )
+	{
+		const char *pArg = ( i == 0 ) ? szExe : args[i];
+		cmdLine.AddToTail( '\"' );
+		cmdLine.AddMultipleToTail( V_strlen( pArg ), pArg );
+		cmdLine.AddToTail( '\"' );
+		cmdLine.AddToTail( ' ' );
+	}
+	cmdLine.AddToTail( 0 );
+
+	STARTUPINFO si;
+	memset( &si, 0, sizeof( si ) );
+	si.cb = sizeof( si );
+	PROCESS_INFORMATION pi;
+	if ( !CreateProcess( szExe, cmdLine.Base(), NULL, NULL, FALSE, BELOW_NORMAL_PRIORITY_CLASS, NULL, NULL, &si, &pi ) )
+		Error( "Worker pool: can't start a worker (%s).\n", szExe );
+
+	CloseHandle( pi.hThread );
+	g_SpawnedWorkers.AddToTail( pi.hProcess );
+#elif defined( POSIX )
+	args.AddToTail( NULL );
+	pid_t pid = fork();
+	if ( pid == 0 )
+	{
+		execvp( args[0], (char * const *)args.Base() );
+		_exit( 1 );
+	}
+	args.RemoveMultipleFromTail( 1 );
+
+	if ( pid < 0 )
+		Error( "Worker pool: can't start a worker (%s).\n", args[0] );
+	g_SpawnedWorkers.AddToTail( pid );
+#endif
+}
+
+// A token for the local workers, when the user didn't give one
+static void GenerateToken()
+{
+	uint32 nRandom[4];
+#if defined( _WIN32 )
+	for ( int i = 0; i < ARRAYSIZE( nRandom ); i++ )
+	{
+		unsigned int n;
+		if ( rand_s( &n ) != 0 )
+			Error( "Worker pool: can't generate a token, use -workertoken.\n" );
+		nRandom[i] = n;
+	}
+#elif defined( POSIX )
+	int fd = open( "/dev/urandom", O_RDONLY );
+	if ( fd < 0 || read( fd, nRandom, sizeof( nRandom ) ) != sizeof( nRandom ) )
+		Error( "Worker pool: can't generate a token, use -workertoken.\n" );
+	close( fd );
+#endif
+	V_snprintf( g_szPoolToken, sizeof( g_szPoolToken ), "%08x%08x%08x%08x", nRandom[0], nRandom[1], nRandom[2], nRandom[3] );
+}
+
+static void MasterListen( const char *pszInterface, int nPort )
+{
+	g_ListenSocket = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( g_ListenSocket == INVALID_SOCKET )
+		Error( "Worker pool: can't create a socket.\n" );
+
+	int bReuse = 1;
+	setsockopt( g_ListenSocket, SOL_SOCKET, SO_REUSEADDR, (const char *)&bReuse, sizeof( bReuse ) );
+
+	// Only local workers can join unless we're told which interface to listen on
+	sockaddr_in addr;
+	memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( (unsigned short)nPort );
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	if ( pszInterface )
+	{
+		addr.sin_addr.s_addr = inet_addr( pszInterface );
+		if ( addr.sin_addr.s_addr == INADDR_NONE )
+			Error( "Worker pool: bad interface address '%s'.\n", pszInterface );
+	}
+
+	if ( bind( g_ListenSocket, (sockaddr *)&addr, sizeof( addr ) ) == SOCKET_ERROR || listen( g_ListenSocket, 64 ) == SOCKET_ERROR )
+		Error( "Worker pool: can't listen on %s:%d.\n", inet_ntoa( addr.sin_addr ), nPort );
+
+	socklen_t addrLen = sizeof( addr );
+	getsockname( g_ListenSocket, (sockaddr *)&addr, &addrLen );
+	Msg( "Worker pool: listening on %s:%d.\n", inet_ntoa( addr.sin_addr ), ntohs( addr.sin_port ) );
+}
+
+
+//-----------------------------------------------------------------------------
+// Interface
+//-----------------------------------------------------------------------------
+void WorkerPool_Init( int &argc, char **&argv )
+{
+	int nLocalWorkers = -1, nPort = 0;
+	const char *pszMaster = NULL;
+	const char *pszInterface = NULL;
+	const char *pszToken = NULL;
+
+	// Pull our arguments out of the command line
+	int nOut = 1;
+	for ( int i = 1; i < argc; i++ )
+	{
+		if ( !V_stricmp( argv[i], "-workers" ) && i + 1 < argc )
+		{
+			nLocalWorkers = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-workerport" ) && i + 1 < argc )
+		{
+			nPort = atoi( argv[++i] );
+		}
+		else if ( !V_stricmp( argv[i], "-workerinterface" ) && i + 1 < argc )
+		{
+			pszInterface = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-workertoken" ) && i + 1 < argc )
+		{
+			pszToken = argv[++i];
+		}
+		else if ( !V_stricmp( argv[i], "-worker" ) && i + 1 < argc )
+		{
+			pszMaster = argv[++i];
+		}
+		else
+		{
+			argv[nOut++] = argv[i];
+		}
+	}
+	argc = nOut;
+
+	if ( nLocalWorkers < 0 && !nPort && !pszInterface && !pszMaster )
+		return;
+
+#if defined( _WIN32 )
+	WSADATA wsaData;
+	WSAStartup( MAKEWORD( 1, 1 ), &wsaData );
+#elif defined( POSIX )
+	signal( SIGPIPE, SIG_IGN );
+#endif
+
+	g_bWorkerPool = true;
+	CmdLib_AtCleanup( WorkerPool_Term );
+
+	if ( pszToken )
+	{
+		if ( !*pszToken || V_strlen( pszToken ) >= WORKERPOOL_MAX_TOKEN )
+			Error( "Worker pool: -workertoken has to be 1 to %d characters.\n", WORKERPOOL_MAX_TOKEN - 1 );
+		V_strncpy( g_szPoolToken, pszToken, sizeof( g_szPoolToken ) );
+	}
+
+	if ( pszMaster )
+	{
+		if ( !pszToken )
+			Error( "Worker pool: -worker needs the master's -workertoken.\n" );
+
+		g_bWorkerPoolMaster = false;
+		g_bSuppressPrintfOutput = true;
+		WorkerConnect( pszMaster );
+		return;
+	}
+
+	// Anyone who can reach the port could otherwise write into the build
+	if ( pszInterface && !pszToken )
+		Error( "Worker pool: -workerinterface needs a -workertoken for the remote workers to give.\n" );
+	if ( !pszToken )
+	{
+		GenerateToken();
+	}
+
+	g_bWorkerPoolMaster = true;
+	MasterListen( pszInterface, nPort );
+
+	nLocalWorkers = Max( nLocalWorkers, 0 );
+	if ( !nLocalWorkers )
+		return;
+
+	// Split the machine between the local workers. The map name stays last.
+	sockaddr_in addr;
+	socklen_t addrLen = sizeof( addr );
+	getsockname( g_ListenSocket, (sockaddr *)&addr, &addrLen );
+	if ( addr.sin_addr.s_addr == htonl( INADDR_ANY ) )
+	{
+		addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	}
+	char szMaster[64], szThreads[16];
+	V_snprintf( szMaster, sizeof( szMaster ), "%s:%d", inet_ntoa( addr.sin_addr ), ntohs( addr.sin_port ) );
+	V_snprintf( szThreads, sizeof( szThreads ), "%d", Max( GetCPUInformation().m_nLogicalProcessors / nLocalWorkers, 1 ) );
+
+	CUtlVector< const char * > args;
+	args.AddToTail( argv[0] );
+	args.AddToTail( "-worker" );
+	args.AddToTail( szMaster );
+	args.AddToTail( "-workertoken" );
+	args.AddToTail( g_szPoolToken );
+	for ( int i = 1; i < argc - 1; i++ )
+	{
+		args.AddToTail( argv[i] );
+	}
+	args.AddToTail( "-threads" );
+	args.AddToTail( szThreads );
+	if ( argc > 1 )
+	{
+		args.AddToTail( argv[argc - 1] );
+	}
+
+	for ( int i = 0; i < nLocalWorkers; i++ )
+	{
+		SpawnLocalWorker( args );
+	}
+
+	double flGiveUp = Plat_FloatTime() + WORKERPOOL_CONNECT_TIMEOUT;
+	while ( g_PoolWorkers.Count() < nLocalWorkers && Plat_FloatTime() < flGiveUp )
+	{
+		MasterPoll( 0.1f );
+	}
+	Msg( "Worker pool: %d of %d local workers connected (%s threads each).\n", g_PoolWorkers.Count(), nLocalWorkers, szThreads );
+}
+
+void WorkerPool_Term()
+{
+	if ( !g_bWorkerPool )
+		return;
+
+	if ( !g_bWorkerPoolMaster )
+	{
+		if ( g_MasterSocket != INVALID_SOCKET )
+		{
+			closesocket( g_MasterSocket );
+			g_MasterSocket = INVALID_SOCKET;
+		}
+		return;
+	}
+
+	for ( int i = 0; i < g_PoolWorkers.Count(); i++ )
+	{
+		SendMsg( g_PoolWorkers[i]->m_Socket, WPMSG_QUIT );
+		closesocket( g_PoolWorkers[i]->m_Socket );
+	}
+	g_PoolWorkers.PurgeAndDeleteElements();
+	g_PoolBroadcasts.PurgeAndDeleteElements();
+
+	if ( g_ListenSocket != INVALID_SOCKET )
+	{
+		closesocket( g_ListenSocket );
+		g_ListenSocket = INVALID_SOCKET;
+	}
+
+	// Anything still running (say, a worker that's still loading) has nothing left to do
+	for ( int i = 0; i < g_SpawnedWorkers.Count(); i++ )
+	{
+#if defined( _WIN32 )
+		if ( WaitForSingleObject( g_SpawnedWorkers[i], 1000 ) != WAIT_OBJECT_0 )
+			TerminateProcess( g_SpawnedWorkers[i], 0 );
+		CloseHandle( g_SpawnedWorkers[i] );
+#elif defined( POSIX )
+		if ( waitpid( g_SpawnedWorkers[i], NULL, WNOHANG ) == 0 )
+		{
+			kill( g_SpawnedWorkers[i], SIGTERM );
+			waitpid( g_SpawnedWorkers[i], NULL, 0 );
+		}
+#endif
+	}
+	g_SpawnedWorkers.Purge();
+}
+
+void WorkerPool_PrintUsage()
+{
+	Warning(
+		"Worker pool options:\n"
+		"  -workers <n>    : Spread the work over <n> worker processes on this machine.\n"
+		"                    Output doesn't depend on the number of workers.\n"
+		"  -workerport <p> : Listen for workers on TCP port <p> (any free port by default).\n"
+		"  -workerinterface <address> : Listen on this interface instead of loopback, so\n"
+		"                    workers on other machines can join. Needs -workertoken.\n"
+		"  -workertoken <token> : Shared secret every worker has to present; use the same\n"
+		"                    one on the master and the workers. Anyone holding it can\n"
+		"                    send results, so keep it private.\n"
+		"  -worker <host>:<port> : Run as a worker for the master at <host>. Use the\n"
+		"                    same arguments as the master, plus its -workertoken; the\n"
+		"                    map and game files have to be present on this machine too.\n"
+		"\n"
+		);
+}
+
+void WorkerPool_SetPacifierRange( float flStart, float flEnd )
+{
+	g_flPacifierStart = flStart;
+	g_flPacifierEnd = flEnd;
+}
+
+double WorkerPool_DistributeWork( uint64 nWorkUnits, WorkerPoolProcessFn pfnProcess, WorkerPoolReceiveFn pfnReceive )
+{
+	++g_iPoolPhase;
+	if ( g_bWorkerPoolMaster )
+		return MasterDistributeWork( nWorkUnits, pfnProcess, pfnReceive );
+	else
+		return WorkerDistributeWork( nWorkUnits, pfnProcess );
+}
+
+void WorkerPool_Broadcast( CUtlBuffer &buf )
+{
+	int iBlob = g_nPoolBroadcasts++;
+
+	if ( g_bWorkerPoolMaster )
+	{
+		if ( buf.TellPut() > WORKERPOOL_MAX_MESSAGE )
+			Error( "Worker pool: broadcast %d is %d bytes, split it into pieces of at most %d.\n", iBlob, buf.TellPut(), WORKERPOOL_MAX_MESSAGE );
+
+		CUtlBuffer *pCopy = new CUtlBuffer;
+		pCopy->Put( buf.Base(), buf.TellPut() );
+		g_PoolBroadcasts.AddToTail( pCopy );
+
+		// Serving a worker can drop it, so go through a copy of the list
+		CUtlVector< PoolWorker_t * > workers;
+		workers.CopyArray( g_PoolWorkers.Base(), g_PoolWorkers.Count() );
+		for ( int i = 0; i < workers.Count(); i++ )
+		{
+			if ( g_PoolWorkers.Find( workers[i] ) != g_PoolWorkers.InvalidIndex() && workers[i]->m_iWaitingForBlob == iBlob )
+				MasterServeBlob( workers[i], iBlob );
+		}
+
+		// With no workers there's nobody to keep it for
+		MasterReleaseBroadcasts();
+		return;
+	}
+
+	{
+		AUTO_LOCK( g_MasterSendMutex );
+		if ( !SendMsg( g_MasterSocket, WPMSG_FETCH, &iBlob, sizeof( iBlob ) ) )
+			Error( "Worker pool: lost the connection to the master.\n" );
+	}
+
+	WorkerPoolMsgHeader_t hdr;
+	CUtlBuffer payload;
+	WorkerRecvMsg( hdr, payload );
+	if ( hdr.m_nType != WPMSG_BLOB )
+		Error( "Worker pool: unexpected message %d from the master.\n", hdr.m_nType );
+
+	buf.Clear();
+	buf.Put( payload.Base(), payload.TellPut() );
+}
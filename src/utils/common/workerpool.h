@@ -0,0 +1,52 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Distributes work units from a master tool process to worker
+//			processes over TCP, without VMPI or any other service. Workers are
+//			either spawned on the local machine (-workers <n>) or started by
+//			hand on other machines (-worker <host>:<port>).
+//
+//=============================================================================//
+
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlbuffer.h"
+
+
+extern bool g_bWorkerPool;			// -workers or -worker was given
+extern bool g_bWorkerPoolMaster;	// false in the worker processes
+
+// Call this before the rest of the command line is parsed. It strips the pool arguments
+// from argv; the master then spawns its local workers with the remaining arguments,
+// and a worker connects to its master.
+void WorkerPool_Init( int &argc, char **&argv );
+void WorkerPool_Term();
+
+void WorkerPool_PrintUsage();
+
+// pBuf is NULL when the master processes a unit itself (when it has no workers), so
+// the results should be left in place; pfnReceive is only called for remote results.
+typedef void (*WorkerPoolProcessFn)( int iThread, uint64 iWorkUnit, CUtlBuffer *pBuf );
+typedef void (*WorkerPoolReceiveFn)( uint64 iWorkUnit, CUtlBuffer &buf, int iWorker );
+
+// The master and all the workers call this at the same point in the tool. The workers
+// process the units they're handed with their threads; the master calls pfnReceive
+// once per unit, on the main thread, in no particular order. Workers that connect late
+// skip the phases that are already done. Returns the elapsed time.
+double WorkerPool_DistributeWork( uint64 nWorkUnits, WorkerPoolProcessFn pfnProcess, WorkerPoolReceiveFn pfnReceive );
+
+// The master draws the progress of the next WorkerPool_DistributeWork into this part of
+// the pacifier (all of it by default).
+void WorkerPool_SetPacifierRange( float flStart, float flEnd );
+
+// The master publishes buf; each worker blocks until it has received a copy into buf.
+// Every process has to make the same sequence of calls. A broadcast is one message, so
+// large data has to be sent as several. The master keeps each one until every connected
+// worker has fetched it; a worker that connects after that can't catch up and is sent home.
+void WorkerPool_Broadcast( CUtlBuffer &buf );
+
+
+#endif // WORKERPOOL_H
@@ -92,7 +92,9 @@ void SetMinStripSize(const unsigned int _minStripSize)
 // Be sure to call delete[] on the returned primGroups to avoid leaking mem
 //
 void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numIndices,
-					PrimitiveGroup** primGroups, unsigned short* numGroups)
+					PrimitiveGroup** primGroups, unsigned short* numGroups,
+					const unsigned int _cacheSize, const bool _bStitchStrips,
+					const unsigned int _minStripSize, const bool _bListsOnly)
 {
 	//put data in format that the stripifier likes
 	WordVec tempIndices;
@@ -110,13 +112,13 @@ void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numI
 	NvStripifier stripifier;
 	
 	//do actual stripification
-	stripifier.Stripify(tempIndices, cacheSize, minStripSize, maxIndex, tempStrips, tempFaces);
+	stripifier.Stripify(tempIndices, _cacheSize, _minStripSize, maxIndex, tempStrips, tempFaces);
 
 	//stitch strips together
 	IntVec stripIndices;
 	unsigned int numSeparateStrips = 0;
 
-	if(bListsOnly)
+	if(_bListsOnly)
 	{
 		//if we're outputting only lists, we're done
 		*numGroups = 1;
@@ -168,10 +170,10 @@ void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numI
 	}
 	else
 	{
-		stripifier.CreateStrips(tempStrips, stripIndices, bStitchStrips, numSeparateStrips);
+		stripifier.CreateStrips(tempStrips, stripIndices, _bStitchStrips, numSeparateStrips);
 
 		//if we're stitching strips together, we better get back only one strip from CreateStrips()
-		assert( (bStitchStrips && (numSeparateStrips == 1)) || !bStitchStrips);
+		assert( (_bStitchStrips && (numSeparateStrips == 1)) || !_bStitchStrips);
 		
 		//convert to output format
 		*numGroups = AsUShort( numSeparateStrips ); //for the strips
@@ -187,7 +189,7 @@ void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numI
 		{
 			int stripLength = 0;
 
-			if(!bStitchStrips)
+			if(!_bStitchStrips)
 			{
 				//if we've got multiple strips, we need to figure out the correct length
 				int i = startingLoc;
@@ -257,6 +259,18 @@ void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numI
 }
 
 
+////////////////////////////////////////////////////////////////////////////////////////
+// GenerateStrips()
+//
+// Uses the settings from the Set*() functions above
+//
+void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numIndices,
+					PrimitiveGroup** primGroups, unsigned short* numGroups)
+{
+	GenerateStrips(in_indices, in_numIndices, primGroups, numGroups, cacheSize, bStitchStrips, minStripSize, bListsOnly);
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////////////
 // RemapIndices()
 //
@@ -101,6 +101,13 @@ void SetListsOnly(const bool bListsOnly);
 void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numIndices,
 					PrimitiveGroup** primGroups, unsigned short* numGroups);
 
+// Same as above, but with the settings passed in rather than taken from the Set*()
+// functions, so several threads can generate strips with different settings at once.
+void GenerateStrips(const unsigned short* in_indices, const unsigned int in_numIndices,
+					PrimitiveGroup** primGroups, unsigned short* numGroups,
+					const unsigned int cacheSize, const bool bStitchStrips,
+					const unsigned int minStripSize, const bool bListsOnly);
+
 
 ////////////////////////////////////////////////////////////////////////////////////////
 // RemapIndices()
@@ -111,4 +111,14 @@ void CResponseFiles::ReadListingFile( void )
 	}
 }
 
+// ------ implementation of CResponseBuffer --------------
+
+CResponseBuffer::CResponseBuffer( void const *pvResult, size_t lenResult, char const *szListing )
+{
+	m_bufResult.Put( pvResult, ( int ) lenResult );
+
+	if ( szListing && *szListing )
+		m_bufListing.Put( szListing, ( int ) strlen( szListing ) + 1 );
+}
+
 }; // namespace CmdSink
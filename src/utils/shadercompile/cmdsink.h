@@ -111,6 +111,32 @@ public:
 };
 
 
+/*
+
+Response implementation when the result and the listing are already
+in memory, e.g. read back from the combo cache.
+
+*/
+class CResponseBuffer : public IResponse
+{
+public:
+	explicit CResponseBuffer( void const *pvResult, size_t lenResult, char const *szListing );
+	~CResponseBuffer( void ) {}
+
+public:
+	virtual bool Succeeded( void ) { return true; }
+
+	virtual size_t GetResultBufferLen( void ) { return m_bufResult.TellPut(); }
+	virtual const void * GetResultBuffer( void ) { return m_bufResult.Base(); }
+
+	virtual const char * GetListing( void ) { return m_bufListing.TellPut() ? ( const char * ) m_bufListing.Base() : NULL; }
+
+protected:
+	CUtlBuffer m_bufResult;				//!< Buffer holding the result data
+	CUtlBuffer m_bufListing;			//!< Buffer holding the zero-terminated listing (empty if nothing was reported)
+};
+
+
 }; // namespace CmdSink
 
 
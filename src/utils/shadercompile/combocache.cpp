@@ -0,0 +1,338 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Content-addressed cache of compiled shader combos
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include <io.h>
+#include "cmdlib.h"
+#include "tier0/threadtools.h"
+#include "tier0/dbg.h"
+#include "tier1/strtools.h"
+#include "tier1/utlbuffer.h"
+#include "UtlStringMap.h"
+#include "combocache.h"
+
+
+// Bump this whenever the compiler or the way commands are formatted changes
+#define COMBOCACHE_VERSION		1
+#define COMBOCACHE_ID			(('C'<<24)+('C'<<16)+('H'<<8)+'S')
+
+struct combocacheheader_t
+{
+	int id;
+	int version;
+	int resultSize;
+	int listingSize;
+	MD5Value_t key;
+};
+
+bool g_bComboCache = false;
+
+static char s_CacheDir[MAX_PATH];
+static CInterlockedInt s_nHits;
+static CInterlockedInt s_nMisses;
+static CInterlockedInt s_nStores;
+
+// Every combo of a shader shares the hash of its source closure, so it is
+// only computed once per file
+static CUtlStringMap< MD5Value_t > s_SourceHashes;
+static CThreadFastMutex s_SourceHashMutex;
+
+
+void ComboCache_Init( const char *pDir )
+{
+	// Workers change into their temp directory before compiling
+	V_MakeAbsolutePath( s_CacheDir, sizeof( s_CacheDir ), pDir );
+	V_AppendSlash( s_CacheDir, sizeof( s_CacheDir ) );
+	V_FixSlashes( s_CacheDir );
+	g_bComboCache = true;
+}
+
+
+//-----------------------------------------------------------------------------
+// The source file is the last argument before the output redirection, see
+// InterceptFxc::ExecuteCommand
+//-----------------------------------------------------------------------------
+static bool GetSourceFileName( const char *pCommand, char *pFileName, int nFileNameSize )
+{
+	const char *pRedirect = strstr( pCommand, ">output.txt" );
+	if ( !pRedirect )
+		return false;
+
+	const char *pStart = pRedirect;
+	while ( pStart > pCommand && !V_isspace( pStart[-1] ) )
+		--pStart;
+
+	if ( pStart == pRedirect )
+		return false;
+
+	V_strncpy( pFileName, pStart, MIN( nFileNameSize, pRedirect - pStart + 1 ) );
+	return true;
+}
+
+
+static bool ReadSourceFile( const char *pFileName, CUtlBuffer &buf )
+{
+	FILE *fp = fopen( pFileName, "rb" );
+	if ( !fp )
+		return false;
+
+	fseek( fp, 0, SEEK_END );
+	int nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	buf.EnsureCapacity( nSize );
+	bool bRead = ( nSize >= 0 ) && ( (int)fread( buf.Base(), 1, nSize, fp ) == nSize );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, bRead ? nSize : 0 );
+	fclose( fp );
+
+	return bRead;
+}
+
+
+//-----------------------------------------------------------------------------
+// Matches '#include "name"' and '#include <name>' lines
+//-----------------------------------------------------------------------------
+static bool ParseIncludeLine( const char *p, const char *pEnd, char *pName, int nNameSize )
+{
+	while ( p < pEnd && ( *p == ' ' || *p == '\t' ) )
+		++p;
+	if ( p == pEnd || *p != '#' )
+		return false;
+	++p;
+
+	while ( p < pEnd && ( *p == ' ' || *p == '\t' ) )
+		++p;
+	if ( pEnd - p < 7 || V_strncmp( p, "include", 7 ) )
+		return false;
+	p += 7;
+
+	while ( p < pEnd && ( *p == ' ' || *p == '\t' ) )
+		++p;
+	if ( p == pEnd || ( *p != '"' && *p != '<' ) )
+		return false;
+
+	char chClose = ( *p == '"' ) ? '"' : '>';
+	const char *pNameStart = ++p;
+	while ( p < pEnd && *p != chClose )
+		++p;
+	if ( p == pEnd || p == pNameStart )
+		return false;
+
+	V_strncpy( pName, pNameStart, MIN( nNameSize, p - pNameStart + 1 ) );
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Hashes a file and, depth first, everything it includes. Conditional includes
+// are followed regardless of the defines, which can only cause extra misses.
+//-----------------------------------------------------------------------------
+static void HashSourceFile( MD5Context_t &ctx, const char *pFileName, CUtlStringMap< bool > &visited )
+{
+	char fixedName[MAX_PATH];
+	V_strncpy( fixedName, pFileName, sizeof( fixedName ) );
+	V_FixSlashes( fixedName );
+	V_strlower( fixedName );
+
+	if ( visited.Defined( fixedName ) )
+		return;
+	visited[ fixedName ] = true;
+
+	MD5Update( &ctx, (const unsigned char *)fixedName, V_strlen( fixedName ) + 1 );
+
+	CUtlBuffer buf;
+	if ( !ReadSourceFile( fixedName, buf ) )
+	{
+		// The compile will fail or find it somewhere else, either way the
+		// name alone keeps the key stable
+		int nMissing = -1;
+		MD5Update( &ctx, (const unsigned char *)&nMissing, sizeof( nMissing ) );
+		return;
+	}
+
+	int nSize = buf.TellPut();
+	MD5Update( &ctx, (const unsigned char *)&nSize, sizeof( nSize ) );
+	MD5Update( &ctx, (const unsigned char *)buf.Base(), nSize );
+
+	char dir[MAX_PATH];
+	V_ExtractFilePath( fixedName, dir, sizeof( dir ) );
+
+	const char *p = (const char *)buf.Base();
+	const char *pEnd = p + nSize;
+	while ( p < pEnd )
+	{
+		const char *pLineEnd = (const char *)memchr( p, '\n', pEnd - p );
+		if ( !pLineEnd )
+			pLineEnd = pEnd;
+
+		char includeName[MAX_PATH];
+		if ( ParseIncludeLine( p, pLineEnd, includeName, sizeof( includeName ) ) )
+		{
+			// Same lookup order as the compiler: next to the includer, then the current directory
+			char includePath[MAX_PATH];
+			V_snprintf( includePath, sizeof( includePath ), "%s%s", dir, includeName );
+			if ( !dir[0] || _access( includePath, 0 ) != 0 )
+				V_strncpy( includePath, includeName, sizeof( includePath ) );
+
+			HashSourceFile( ctx, includePath, visited );
+		}
+
+		p = pLineEnd + 1;
+	}
+}
+
+
+bool ComboCache_ComputeKey( const char *pCommand, MD5Value_t &key )
+{
+	char fileName[MAX_PATH];
+	if ( !GetSourceFileName( pCommand, fileName, sizeof( fileName ) ) )
+		return false;
+
+	MD5Value_t sourceHash;
+	{
+		AUTO_LOCK( s_SourceHashMutex );
+
+		UtlSymId_t idx = s_SourceHashes.Find( fileName );
+		if ( idx != s_SourceHashes.InvalidIndex() )
+		{
+			sourceHash = s_SourceHashes[ idx ];
+		}
+		else
+		{
+			MD5Context_t ctx;
+			MD5Init( &ctx );
+
+			CUtlStringMap< bool > visited;
+			HashSourceFile( ctx, fileName, visited );
+
+			MD5Final( sourceHash.bits, &ctx );
+			s_SourceHashes[ fileName ] = sourceHash;
+		}
+	}
+
+	// The command carries the combo's defines, the target and the entry point
+	int version = COMBOCACHE_VERSION;
+
+	MD5Context_t ctx;
+	MD5Init( &ctx );
+	MD5Update( &ctx, (const unsigned char *)&version, sizeof( version ) );
+	MD5Update( &ctx, sourceHash.bits, MD5_DIGEST_LENGTH );
+	MD5Update( &ctx, (const unsigned char *)pCommand, V_strlen( pCommand ) );
+	MD5Final( key.bits, &ctx );
+
+	return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Entries live in <dir>/<first two hex digits>/<the rest>
+//-----------------------------------------------------------------------------
+static void GetEntryPath( const MD5Value_t &key, char *pPath, int nPathSize )
+{
+	char hex[MD5_DIGEST_LENGTH * 2 + 1];
+	V_binarytohex( key.bits, MD5_DIGEST_LENGTH, hex, sizeof( hex ) );
+	V_snprintf( pPath, nPathSize, "%s%c%c%c%s", s_CacheDir, hex[0], hex[1], CORRECT_PATH_SEPARATOR, hex + 2 );
+}
+
+
+CmdSink::IResponse * ComboCache_Get( const MD5Value_t &key )
+{
+	if ( !g_bComboCache )
+		return NULL;
+
+	char path[MAX_PATH];
+	GetEntryPath( key, path, sizeof( path ) );
+
+	FILE *fp = fopen( path, "rb" );
+	if ( !fp )
+	{
+		++s_nMisses;
+		return NULL;
+	}
+
+	combocacheheader_t header;
+	bool bValid = ( fread( &header, sizeof( header ), 1, fp ) == 1 ) &&
+		header.id == COMBOCACHE_ID && header.version == COMBOCACHE_VERSION &&
+		header.key == key && header.resultSize > 0 && header.listingSize >= 0;
+
+	CUtlBuffer buf;
+	if ( bValid )
+	{
+		int nSize = header.resultSize + header.listingSize;
+		buf.EnsureCapacity( nSize );
+		bValid = ( (int)fread( buf.Base(), 1, nSize, fp ) == nSize );
+
+		// The listing is stored with its terminator
+		if ( bValid && header.listingSize )
+			bValid = ( ( (const char *)buf.Base() )[ nSize - 1 ] == 0 );
+	}
+
+	fclose( fp );
+
+	if ( !bValid )
+	{
+		// A damaged entry gets compiled again and replaced
+		++s_nMisses;
+		return NULL;
+	}
+
+	++s_nHits;
+
+	const char *pListing = header.listingSize ? (const char *)buf.Base() + header.resultSize : NULL;
+	return new CmdSink::CResponseBuffer( buf.Base(), header.resultSize, pListing );
+}
+
+
+void ComboCache_Put( const MD5Value_t &key, CmdSink::IResponse *pResponse )
+{
+	if ( !g_bComboCache || !pResponse->Succeeded() || !pResponse->GetResultBufferLen() )
+		return;
+
+	char path[MAX_PATH];
+	GetEntryPath( key, path, sizeof( path ) );
+	CreatePath( path );
+
+	// Write a temporary and rename it into place, so another compile sharing the
+	// cache never reads a partial entry
+	char tmpPath[MAX_PATH];
+	V_snprintf( tmpPath, sizeof( tmpPath ), "%s.%u.tmp", path, (unsigned int)ThreadGetCurrentId() );
+
+	FILE *fp = fopen( tmpPath, "wb" );
+	if ( !fp )
+		return;
+
+	const char *pListing = pResponse->GetListing();
+
+	combocacheheader_t header;
+	header.id = COMBOCACHE_ID;
+	header.version = COMBOCACHE_VERSION;
+	header.resultSize = (int)pResponse->GetResultBufferLen();
+	header.listingSize = ( pListing && *pListing ) ? V_strlen( pListing ) + 1 : 0;
+	header.key = key;
+
+	bool bWritten = ( fwrite( &header, sizeof( header ), 1, fp ) == 1 ) &&
+		( (int)fwrite( pResponse->GetResultBuffer(), 1, header.resultSize, fp ) == header.resultSize ) &&
+		( (int)fwrite( pListing, 1, header.listingSize, fp ) == header.listingSize );
+	fclose( fp );
+
+	// If the rename fails somebody else stored the same entry first
+	if ( !bWritten || rename( tmpPath, path ) != 0 )
+	{
+		remove( tmpPath );
+		return;
+	}
+
+	++s_nStores;
+}
+
+
+void ComboCache_SpewStats( void )
+{
+	if ( !g_bComboCache )
+		return;
+
+	Msg( "combo cache: %d hits, %d misses, %d stored (%s)\n", (int)s_nHits, (int)s_nMisses, (int)s_nStores, s_CacheDir );
+}
@@ -0,0 +1,37 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Content-addressed cache of compiled shader combos (-combocache <dir>).
+//			Each combo is stored under the MD5 of its compile command and of the
+//			shader source together with everything it #includes, so a rebuild
+//			only sends the combos whose inputs changed to the compiler. The
+//			directory can be shared by any number of compiles.
+//
+//=============================================================================//
+
+#ifndef COMBOCACHE_H
+#define COMBOCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/checksum_md5.h"
+#include "cmdsink.h"
+
+
+extern bool g_bComboCache;
+
+void ComboCache_Init( const char *pDir );
+
+// Returns false if the command doesn't name a source file the key can be built from
+bool ComboCache_ComputeKey( const char *pCommand, MD5Value_t &key );
+
+// Returns NULL on a miss, or if the entry was damaged
+CmdSink::IResponse * ComboCache_Get( const MD5Value_t &key );
+
+// Only successful compiles are stored
+void ComboCache_Put( const MD5Value_t &key, CmdSink::IResponse *pResponse );
+
+void ComboCache_SpewStats( void );
+
+
+#endif // COMBOCACHE_H
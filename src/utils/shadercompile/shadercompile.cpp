@@ -48,6 +48,7 @@
 #include "shadercompile_ps3_helpers.h"
 
 #include "cmdsink.h"
+#include "combocache.h"
 #include "d3dxfxc.h"
 #include "subprocess.h"
 #include "cfgprocessor.h"
@@ -1386,7 +1387,8 @@ public:
 
 	void ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo );
 	void ExecuteCompileCommandThreaded( CfgProcessor::ComboHandle hCombo );
-	void HandleCommandResponse( CfgProcessor::ComboHandle hCombo, CmdSink::IResponse *pResponse );
+	bool TryCachedCommand( CfgProcessor::ComboHandle hCombo, char const *szCommand, MD5Value_t &key, bool &bHaveKey );
+	void HandleCommandResponse( CfgProcessor::ComboHandle hCombo, CmdSink::IResponse *pResponse, MD5Value_t const *pCacheKey = NULL );
 
 public:
 	using ThisParallelProcessorBase_t::Run;
@@ -1565,6 +1567,15 @@ void CWorkerAccumState < TMutexType > ::ExecuteCompileCommandThreaded( CfgProces
 {
 	// DebugOut( "threaded: running: \"%s\"\n", szCommand );
 
+	char chBuffer[ 4096 ];
+	Combo_FormatCommand( hCombo, chBuffer );
+
+	// Cached combos never reach a subprocess
+	MD5Value_t key;
+	bool bHaveKey;
+	if ( TryCachedCommand( hCombo, chBuffer, key, bHaveKey ) )
+		return;
+
 	SubProcessKernelObjects *pCommObjs = NULL;
 	PrepareSubProcess( NULL, &pCommObjs );
 
@@ -1575,7 +1586,7 @@ void CWorkerAccumState < TMutexType > ::ExecuteCompileCommandThreaded( CfgProces
 		void *pvMemory = shrmem.Lock();
 		Assert( pvMemory );
 		
-		Combo_FormatCommand( hCombo, ( char * ) pvMemory );
+		strcpy( ( char * ) pvMemory, chBuffer );
 
 		shrmem.Unlock();
 	}
@@ -1599,7 +1610,7 @@ void CWorkerAccumState < TMutexType > ::ExecuteCompileCommandThreaded( CfgProces
 		else
 			pResponse = new CmdSink::CResponseError;
 
-		HandleCommandResponse( hCombo, pResponse );
+		HandleCommandResponse( hCombo, pResponse, bHaveKey ? &key : NULL );
 
 		delete pResponse;
 
@@ -1611,21 +1622,46 @@ template < typename TMutexType >
 void CWorkerAccumState < TMutexType > ::ExecuteCompileCommand( CfgProcessor::ComboHandle hCombo )
 {
 	CmdSink::IResponse *pResponse = NULL;
+	MD5Value_t key;
+	bool bHaveKey;
 	
 	{
 		char chBuffer[ 4096 ];
 		Combo_FormatCommand( hCombo, chBuffer );
 
+		if ( TryCachedCommand( hCombo, chBuffer, key, bHaveKey ) )
+			return;
+
 		DebugOut( "running: \"%s\"\n", chBuffer );
 
 		MySystem( chBuffer, &pResponse );
 	}
 
+	HandleCommandResponse( hCombo, pResponse, bHaveKey ? &key : NULL );
+}
+
+//
+// Looks the command up in the combo cache and handles the cached response on a hit.
+// On a miss bHaveKey tells whether the compiled result can be stored under key.
+//
+template < typename TMutexType >
+bool CWorkerAccumState < TMutexType > ::TryCachedCommand( CfgProcessor::ComboHandle hCombo, char const *szCommand, MD5Value_t &key, bool &bHaveKey )
+{
+	bHaveKey = g_bComboCache && ComboCache_ComputeKey( szCommand, key );
+	if ( !bHaveKey )
+		return false;
+
+	CmdSink::IResponse *pResponse = ComboCache_Get( key );
+	if ( !pResponse )
+		return false;
+
 	HandleCommandResponse( hCombo, pResponse );
+	pResponse->Release();
+	return true;
 }
 
 template < typename TMutexType >
-void CWorkerAccumState < TMutexType > ::HandleCommandResponse( CfgProcessor::ComboHandle hCombo, CmdSink::IResponse *pResponse )
+void CWorkerAccumState < TMutexType > ::HandleCommandResponse( CfgProcessor::ComboHandle hCombo, CmdSink::IResponse *pResponse, MD5Value_t const *pCacheKey )
 {
 	VMPI_HandleSocketErrors();
 
@@ -1645,6 +1681,8 @@ void CWorkerAccumState < TMutexType > ::HandleCommandResponse( CfgProcessor::Com
 		StaticComboFromDictAdd( pEntryInfo->m_szName, nStComboIdx )->AddDynamicCombo( nDyComboIdx , pResponse->GetResultBuffer(), pResponse->GetResultBufferLen() );
 		GLOBAL_DATA_MTX_UNLOCK();
 		
+		if ( pCacheKey )
+			ComboCache_Put( *pCacheKey, pResponse );
 	}
 
 	// Tell the master that this shader failed
@@ -2476,6 +2514,9 @@ int ShaderCompile_Main( int argc, char* argv[] )
 	// This needs to get called before VMPI is setup because in SDK mode, VMPI will change the args around.
 	SetupExeDir( argc, argv );
 
+	if ( char const *szComboCache = CommandLine()->ParmValue( "-combocache", ( char const * ) NULL ) )
+		ComboCache_Init( szComboCache );
+
 	g_bIsX360 = CommandLine()->FindParm( "-x360" ) != 0;
 	g_bIsPS3 = CommandLine()->FindParm( "-ps3" ) != 0;
 	g_bGeneratePS3DebugInfo = CommandLine()->FindParm( "-ps3debug" ) != 0;
@@ -2670,6 +2711,8 @@ int ShaderCompile_Main( int argc, char* argv[] )
 			WriteShaderFiles( g_ShaderByteCode.String(i) );
 		}
 
+		ComboCache_SpewStats();
+
 		// Write all the errors
 		//////////////////////////////////////////////////////////////////////////
 		//
@@ -37,6 +37,8 @@
 #include "keyvalues.h"
 #include "tier1/smartptr.h"
 #include "tier2/p4helpers.h"
+#include "tier1/utlmap.h"
+#include "compilecache.h"
 #include "datamodel/dmattributevar.h"
 #include "datamodel/dmelement.h"
 
@@ -1150,6 +1152,77 @@ struct boundingvolume_t
 };
 
 
+//-----------------------------------------------------------------------------
+// With -cache, remember what every convex was built from, so the collide that
+// CreateCollide builds from them can be looked up in the compile cache
+//-----------------------------------------------------------------------------
+struct convexsource_t
+{
+	MD5Value_t		verts;
+	unsigned int	gameData;
+};
+
+static CUtlMap<CPhysConvex *, convexsource_t> s_ConvexSources( DefLessFunc( CPhysConvex * ) );
+
+static CPhysConvex *ConvexFromVerts( Vector **pVerts, int vertCount )
+{
+	CPhysConvex *pConvex = physcollision->ConvexFromVerts( pVerts, vertCount );
+	if ( pConvex && g_bCompileCache )
+	{
+		MD5Context_t ctx;
+		MD5Init( &ctx );
+		for ( int i = 0; i < vertCount; i++ )
+		{
+			MD5Update( &ctx, (const unsigned char *)pVerts[i]->Base(), sizeof( float ) * 3 );
+		}
+
+		convexsource_t source;
+		MD5Final( source.verts.bits, &ctx );
+		source.gameData = 0;
+		s_ConvexSources.InsertOrReplace( pConvex, source );
+	}
+	return pConvex;
+}
+
+static void SetConvexGameData( CPhysConvex *pConvex, unsigned int gameData )
+{
+	physcollision->SetConvexGameData( pConvex, gameData );
+
+	int i = s_ConvexSources.Find( pConvex );
+	if ( i != s_ConvexSources.InvalidIndex() )
+	{
+		s_ConvexSources[i].gameData = gameData;
+	}
+}
+
+// Returns false if any of the convexes wasn't built by ConvexFromVerts above
+static bool GetCollideCacheKey( CPhysConvex **pElements, int elementCount, const convertconvexparams_t &params, const boundingvolume_t &bv, MD5Value_t &key )
+{
+	MD5Context_t ctx;
+	CompileCache_BeginKey( ctx, VPHYSICS_COLLISION_INTERFACE_VERSION );
+
+	for ( int i = 0; i < elementCount; i++ )
+	{
+		int j = s_ConvexSources.Find( pElements[i] );
+		if ( j == s_ConvexSources.InvalidIndex() )
+			return false;
+
+		const convexsource_t &source = s_ConvexSources[j];
+		MD5Update( &ctx, source.verts.bits, MD5_DIGEST_LENGTH );
+		MD5Update( &ctx, (const unsigned char *)&source.gameData, sizeof( source.gameData ) );
+	}
+
+	bool flags[] = { params.buildOuterConvexHull, params.buildDragAxisAreas, params.buildOptimizedTraceTables,
+		params.checkOptimalTracing, params.bUseFastApproximateInertiaTensor, params.bBuildAABBTree };
+	MD5Update( &ctx, (const unsigned char *)flags, sizeof( flags ) );
+	MD5Update( &ctx, (const unsigned char *)&params.dragAreaEpsilon, sizeof( params.dragAreaEpsilon ) );
+	MD5Update( &ctx, (const unsigned char *)&bv, sizeof( bv ) );
+
+	MD5Final( key.bits, &ctx );
+	return true;
+}
+
+
 void CreateCollide( CPhysCollisionModel *pBase, CPhysConvex **pElements, int elementCount, const boundingvolume_t &bv )
 {
 	int i;
@@ -1208,9 +1281,36 @@ void CreateCollide( CPhysCollisionModel *pBase, CPhysConvex **pElements, int ele
 			pBase->m_rotdamping = 1.0f;
 		}
 	}
+	MD5Value_t cacheKey;
+	bool bCacheable = g_bCompileCache && GetCollideCacheKey( pElements, elementCount, params, bv, cacheKey );
+	for ( i = 0; i < elementCount; i++ )
+	{
+		s_ConvexSources.Remove( pElements[i] );
+	}
+
+	CUtlBuffer cached;
+	if ( bCacheable && CompileCache_Get( cacheKey, cached ) )
+	{
+		for ( i = 0; i < elementCount; i++ )
+		{
+			physcollision->ConvexFree( pElements[i] );
+		}
+		pBase->m_pCollisionData = physcollision->UnserializeCollide( (char *)cached.Base(), cached.TellPut(), 0 );
+		return;
+	}
+
 	// THIS DESTROYS pConvex!!
 	pBase->m_pCollisionData = physcollision->ConvertConvexToCollideParams( pElements, elementCount, params );
 
+	if ( bCacheable && pBase->m_pCollisionData )
+	{
+		int size = physcollision->CollideSize( pBase->m_pCollisionData );
+		cached.EnsureCapacity( size );
+		physcollision->CollideWrite( (char *)cached.Base(), pBase->m_pCollisionData );
+		cached.SeekPut( CUtlBuffer::SEEK_HEAD, size );
+		CompileCache_Put( cacheKey, cached );
+	}
+
 	// debug output for the drag area calculations
 #if 0
 	Msg("Drag epsilon is %.3f\n", params.dragAreaEpsilon );
@@ -1433,11 +1533,11 @@ bool BuildConvexesForLists( CUtlVector<CPhysConvex *> &convexOut, const CUtlVect
 				bValid = false;
 			}
 			// go ahead and build it out
-			CPhysConvex *pConvex = physcollision->ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
+			CPhysConvex *pConvex = ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
 			if ( pConvex )
 			{
 				// Got something valid, attach this convex data to the root model
-				physcollision->SetConvexGameData( pConvex, 0 );
+				SetConvexGameData( pConvex, 0 );
 				convexOut.AddToTail(pConvex);
 			}
 		}
@@ -1546,7 +1646,7 @@ int CJointedModel::ProcessJointedModel()
 			{
 				// Attach this convex data to this particular bone
 				int globalBoneIndex = m_pModel->boneLocalToGlobal[boneIndex];
-				physcollision->SetConvexGameData( convexOut[i], globalBoneIndex + 1 );
+				SetConvexGameData( convexOut[i], globalBoneIndex + 1 );
 			}
 
 			CreateCollide( pPhys, convexOut.Base(), convexOut.Count(), bv );
@@ -1772,11 +1872,11 @@ int CJointedModel::ProcessSingleBody()
 				vertsThisConvex.AddToTail( pVert );
 			}
 	
-			CPhysConvex *pConvex = physcollision->ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
+			CPhysConvex *pConvex = ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
 			if ( pConvex )
 			{
 				// Got something valid, attach this convex data to the root model
-				physcollision->SetConvexGameData( pConvex, 0 );
+				SetConvexGameData( pConvex, 0 );
 				convexOut.AddToTail(pConvex);
 			}
 			else
@@ -1824,11 +1924,11 @@ int CJointedModel::ProcessSingleBody()
 			vertsThisConvex.AddToTail( pVert );
 		}
 	
-		CPhysConvex *pConvex = physcollision->ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
+		CPhysConvex *pConvex = ConvexFromVerts( vertsThisConvex.Base(), vertsThisConvex.Count() );
 		if ( pConvex )
 		{
 			// Got something valid, attach this convex data to the root model
-			physcollision->SetConvexGameData( pConvex, 0 );
+			SetConvexGameData( pConvex, 0 );
 			convexOut.AddToTail(pConvex);
 		}
 		else
@@ -0,0 +1,151 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Content-addressed cache of studiomdl build products
+//
+//=============================================================================//
+
+#include <stdio.h>
+#include "cmdlib.h"
+#include "tier0/threadtools.h"
+#include "tier1/strtools.h"
+#include "compilecache.h"
+
+
+// Bump this whenever the way any product is built changes
+#define COMPILECACHE_VERSION	1
+#define COMPILECACHE_ID			(('C'<<24)+('M'<<16)+('D'<<8)+'S')
+
+struct compilecacheheader_t
+{
+	int id;
+	int version;
+	int size;
+	MD5Value_t key;
+};
+
+bool g_bCompileCache = false;
+
+static char s_CacheDir[MAX_PATH];
+static int s_nHits;
+static int s_nMisses;
+static int s_nStores;
+
+
+void CompileCache_Init( const char *pDir )
+{
+	V_strncpy( s_CacheDir, pDir, sizeof( s_CacheDir ) );
+	V_AppendSlash( s_CacheDir, sizeof( s_CacheDir ) );
+	V_FixSlashes( s_CacheDir );
+	g_bCompileCache = true;
+}
+
+
+void CompileCache_BeginKey( MD5Context_t &ctx, const char *pKind )
+{
+	int version = COMPILECACHE_VERSION;
+
+	MD5Init( &ctx );
+	MD5Update( &ctx, (const unsigned char *)&version, sizeof( version ) );
+	MD5Update( &ctx, (const unsigned char *)pKind, V_strlen( pKind ) + 1 );
+}
+
+
+//-----------------------------------------------------------------------------
+// Entries live in <dir>/<first two hex digits>/<the rest>
+//-----------------------------------------------------------------------------
+static void GetEntryPath( const MD5Value_t &key, char *pPath, int nPathSize )
+{
+	char hex[MD5_DIGEST_LENGTH * 2 + 1];
+	V_binarytohex( key.bits, MD5_DIGEST_LENGTH, hex, sizeof( hex ) );
+	V_snprintf( pPath, nPathSize, "%s%c%c%c%s", s_CacheDir, hex[0], hex[1], CORRECT_PATH_SEPARATOR, hex + 2 );
+}
+
+
+bool CompileCache_Get( const MD5Value_t &key, CUtlBuffer &buf )
+{
+	if ( !g_bCompileCache )
+		return false;
+
+	char path[MAX_PATH];
+	GetEntryPath( key, path, sizeof( path ) );
+
+	FILE *fp = fopen( path, "rb" );
+	if ( !fp )
+	{
+		s_nMisses++;
+		return false;
+	}
+
+	compilecacheheader_t header;
+	bool bValid = ( fread( &header, sizeof( header ), 1, fp ) == 1 ) &&
+		header.id == COMPILECACHE_ID && header.version == COMPILECACHE_VERSION &&
+		header.key == key && header.size >= 0;
+
+	if ( bValid )
+	{
+		buf.Purge();
+		buf.EnsureCapacity( header.size );
+		bValid = ( (int)fread( buf.Base(), 1, header.size, fp ) == header.size );
+		buf.SeekPut( CUtlBuffer::SEEK_HEAD, bValid ? header.size : 0 );
+	}
+
+	fclose( fp );
+
+	if ( !bValid )
+	{
+		// A damaged entry gets rebuilt and replaced
+		s_nMisses++;
+		return false;
+	}
+
+	s_nHits++;
+	return true;
+}
+
+
+void CompileCache_Put( const MD5Value_t &key, const CUtlBuffer &buf )
+{
+	if ( !g_bCompileCache )
+		return;
+
+	char path[MAX_PATH];
+	GetEntryPath( key, path, sizeof( path ) );
+	CreatePath( path );
+
+	// Write a temporary and rename it into place, so another compile sharing the
+	// cache never reads a partial entry
+	char tmpPath[MAX_PATH];
+	V_snprintf( tmpPath, sizeof( tmpPath ), "%s.%u.tmp", path, (unsigned int)ThreadGetCurrentId() );
+
+	FILE *fp = fopen( tmpPath, "wb" );
+	if ( !fp )
+		return;
+
+	compilecacheheader_t header;
+	header.id = COMPILECACHE_ID;
+	header.version = COMPILECACHE_VERSION;
+	header.size = buf.TellPut();
+	header.key = key;
+
+	bool bWritten = ( fwrite( &header, sizeof( header ), 1, fp ) == 1 ) &&
+		( (int)fwrite( buf.Base(), 1, header.size, fp ) == header.size );
+	fclose( fp );
+
+	// If the rename fails somebody else stored the same entry first
+	if ( !bWritten || rename( tmpPath, path ) != 0 )
+	{
+		remove( tmpPath );
+		return;
+	}
+
+	s_nStores++;
+}
+
+
+void CompileCache_SpewStats()
+{
+	if ( !g_bCompileCache )
+		return;
+
+	printf( "compile cache: %d hits, %d misses, %d stored (%s)\n", s_nHits, s_nMisses, s_nStores, s_CacheDir );
+}
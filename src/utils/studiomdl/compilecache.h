@@ -0,0 +1,35 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Content-addressed cache of studiomdl build products (-cache <dir>).
+//			Each product is stored under the MD5 of everything that went into
+//			building it, so rebuilding a model whose inputs didn't change reads
+//			the product back instead of computing it again. The directory can
+//			be shared by any number of compiles.
+//
+//=============================================================================//
+
+#ifndef COMPILECACHE_H
+#define COMPILECACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/checksum_md5.h"
+#include "tier1/utlbuffer.h"
+
+
+extern bool g_bCompileCache;
+
+void CompileCache_Init( const char *pDir );
+
+// Starts a key with the kind of product, so different products never share an entry
+void CompileCache_BeginKey( MD5Context_t &ctx, const char *pKind );
+
+// Returns false on a miss, or if the entry was damaged
+bool CompileCache_Get( const MD5Value_t &key, CUtlBuffer &buf );
+void CompileCache_Put( const MD5Value_t &key, const CUtlBuffer &buf );
+
+void CompileCache_SpewStats();
+
+
+#endif // COMPILECACHE_H
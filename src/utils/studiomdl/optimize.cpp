@@ -40,6 +40,9 @@
 #include "tier1/utllinkedlist.h"
 #include "tier1/smartptr.h"
 #include "tier2/p4helpers.h"
+#include "tier0/threadtools.h"
+#include "vstdlib/jobthread.h"
+#include "perfstats.h"
 
 #define  SUBD_STUDIOMDL
 #include "optimize_subd.h"
@@ -494,10 +497,10 @@ namespace OptimizedModel
 	};
 
 	//-----------------------------------------------------------------------------
-	// Singleton instance
+	// The vtx files are built in parallel, so each one gets its own instance
 	//-----------------------------------------------------------------------------
 
-	static COptimizedModel s_OptimizedModel;
+	static CThreadFastMutex s_OutputMutex;
 
 
 	//-----------------------------------------------------------------------------
@@ -512,6 +515,7 @@ namespace OptimizedModel
 
 	void COptimizedModel::OutputMemoryUsage( void )
 	{
+		AUTO_LOCK( s_OutputMutex );
 		printf( "body parts:   %7d bytes\n", ( int )( m_ModelsOffset - m_BodyPartsOffset ) );
 		printf( "models:       %7d bytes\n", ( int )( m_MeshesOffset - m_ModelsOffset ) );
 		printf( "model LODs:   %7d bytes\n", ( int )( m_MeshesOffset - m_ModelLODsOffset ) );
@@ -803,7 +807,11 @@ namespace OptimizedModel
 		unsigned short numPrimGroups;
 
 		// Be sure to call delete[] on the returned primGroups to avoid leaking memory
-		GenerateStrips( &sourceIndices[0], sourceIndices.Count(), &primGroups, &numPrimGroups );
+		GenerateStrips( &sourceIndices[0], sourceIndices.Count(), &primGroups, &numPrimGroups,
+			m_VertexCacheSize,
+			true,	// stitch strips
+			0,		// min strip size
+			true );	// lists only
 		Assert( numPrimGroups == 1 );
 		*pNumIndices = primGroups->numIndices;
 		*ppIndices = new unsigned short[*pNumIndices];
@@ -2081,14 +2089,6 @@ namespace OptimizedModel
 		bool usesFixedFunction, int maxBonesPerVert, int maxBonesPerFace, 
 		int maxBonesPerStrip, const char *fileName )
 	{
-#ifdef NVTRISTRIP
-		// Tell nvtristrip all of its params
-		SetCacheSize( vertexCacheSize );
-		SetStitchStrips( true );
-		SetMinStripSize( 0 );
-		SetListsOnly( true );
-#endif // NVTRISTRIP
-
 		if( !g_quiet )
 		{
 			printf( "---------------------\n" );
@@ -3156,7 +3156,11 @@ namespace OptimizedModel
 		// ShowStats();
 #endif
 
-		m_FileBuffer->WriteToFile( pFileName, m_EndOfFileOffset );
+		{
+			// p4 isn't thread safe
+			AUTO_LOCK( s_OutputMutex );
+			m_FileBuffer->WriteToFile( pFileName, m_EndOfFileOffset );
+		}
 
 		FileHeader_t *pVtxHeader = ( FileHeader_t * )m_FileBuffer->GetPointer( 0 );
 		SanityCheckVertexBoneLODFlags( pHdr, pVtxHeader );
@@ -3331,8 +3335,6 @@ namespace OptimizedModel
 		Assert( maxBonesPerVert <= MAX_NUM_BONES_PER_VERT );
 		Assert( maxBonesPerStrip <= MAX_NUM_BONES_PER_STRIP );
 
-		MergeLikeBoneIndicesWithinVerts( pHdr );
-
 		// Some initialization
 		SetupMeshProcessing( pHdr, vertCacheSize, usesFixedFunction, maxBonesPerVert,
 			maxBonesPerFace, maxBonesPerStrip, pFileName );
@@ -4388,11 +4390,59 @@ got_one:
 		}
 	}
 
+	//-----------------------------------------------------------------------------
+	// One vtx file to build
+	//-----------------------------------------------------------------------------
+	struct OptimizeJob_t
+	{
+		studiohdr_t *m_pHdr;
+		s_bodypart_t *m_pSrcBodyParts;
+		int m_nVertCacheSize;
+		bool m_bForceSoftwareSkin;
+		bool m_bHWFlex;
+		int m_nMaxBonesPerVert;
+		int m_nMaxBonesPerFace;
+		int m_nMaxBonesPerStrip;
+		char m_FileName[MAX_PATH];
+		char m_GLViewFileName[MAX_PATH];
+	};
+
+	static void RunOptimizeJob( OptimizeJob_t &job )
+	{
+		// Value initialized, like the static instance this used to be
+		COptimizedModel *pOptimizedModel = new COptimizedModel();
+		pOptimizedModel->OptimizeFromStudioHdr( job.m_pHdr, job.m_pSrcBodyParts,
+			job.m_nVertCacheSize,
+			false, /* doesn't use fixed function */
+			job.m_bForceSoftwareSkin,
+			job.m_bHWFlex,
+			job.m_nMaxBonesPerVert,
+			job.m_nMaxBonesPerFace,
+			job.m_nMaxBonesPerStrip,
+			job.m_FileName, job.m_GLViewFileName );
+		delete pOptimizedModel;
+	}
+
+	static void AddOptimizeJob( CUtlVector< OptimizeJob_t > &jobs, studiohdr_t *phdr, s_bodypart_t *pSrcBodyParts,
+		const char *pBaseFileName, const char *pSuffix, int vertCacheSize, bool bForceSoftwareSkin, bool bHWFlex,
+		int maxBonesPerVert, int maxBonesPerFace, int maxBonesPerStrip )
+	{
+		OptimizeJob_t &job = jobs[ jobs.AddToTail() ];
+		job.m_pHdr = phdr;
+		job.m_pSrcBodyParts = pSrcBodyParts;
+		job.m_nVertCacheSize = vertCacheSize;
+		job.m_bForceSoftwareSkin = bForceSoftwareSkin;
+		job.m_bHWFlex = bHWFlex;
+		job.m_nMaxBonesPerVert = maxBonesPerVert;
+		job.m_nMaxBonesPerFace = maxBonesPerFace;
+		job.m_nMaxBonesPerStrip = maxBonesPerStrip;
+		Q_snprintf( job.m_FileName, sizeof( job.m_FileName ), "%s.%s.vtx", pBaseFileName, pSuffix );
+		Q_snprintf( job.m_GLViewFileName, sizeof( job.m_GLViewFileName ), "%s.%s.glview", pBaseFileName, pSuffix );
+	}
+
 	void WriteOptimizedFiles( studiohdr_t *phdr, s_bodypart_t *pSrcBodyParts )
 	{
 		char		filename[MAX_PATH];
-		char		tmpFileName[MAX_PATH];
-		char		glViewFilename[MAX_PATH];
 
 		ValidateLODReplacements( phdr );
 
@@ -4412,56 +4462,58 @@ got_one:
 		strcat( filename, g_outname );
 		Q_StripExtension( filename, filename, sizeof( filename ) );
 
+		CUtlVector< OptimizeJob_t > jobs;
+
 		if ( g_gameinfo.bSupportsDX8 && !g_bFastBuild )
 		{
-			strcpy( tmpFileName, filename );
-			strcat( tmpFileName, ".sw.vtx" );
-			strcpy( glViewFilename, filename );
-			strcat( glViewFilename, ".sw.glview" );
 			bool bForceSoftwareSkinning = phdr->numbones > 0 && !g_staticprop;
-			s_OptimizedModel.OptimizeFromStudioHdr( phdr, pSrcBodyParts,
+			AddOptimizeJob( jobs, phdr, pSrcBodyParts, filename, "sw",
 				512,	//vert cache size FIXME: figure out the correct size for L1
-				false, /* doesn't use fixed function */
 				bForceSoftwareSkinning,	// force software skinning if not static prop
 				false, // No hardware flex
 				3,		// bones/vert
 				3*3,		// bones/tri
-				512,	// bones/strip
-				tmpFileName, glViewFilename );
+				512 );	// bones/strip
 		}
 
 		if ( g_gameinfo.bSupportsDX8 && !g_bFastBuild )
 		{
-			strcpy( tmpFileName, filename );
-			strcat( tmpFileName, ".dx80.vtx" );
-			strcpy( glViewFilename, filename );
-			strcat( glViewFilename, ".dx80.glview" );
-			s_OptimizedModel.OptimizeFromStudioHdr( phdr, pSrcBodyParts,
+			AddOptimizeJob( jobs, phdr, pSrcBodyParts, filename, "dx80",
 				24 /* vert cache size (real size, not effective!)*/, 
-				false, /* doesn't use fixed function */
 				false, // don't force software skinning
 				false, // No hardware flex
 				3  /* bones/vert */, 
 				9  /* bones/tri */, 
-				16  /* bones/strip */,
-				tmpFileName, glViewFilename );
+				16  /* bones/strip */ );
 		}
 
 		if ( true )	// Always process dx90
 		{
-			strcpy( tmpFileName, filename );
-			strcat( tmpFileName, ".dx90.vtx" );
-			strcpy( glViewFilename, filename );
-			strcat( glViewFilename, ".dx90.glview" );
-			s_OptimizedModel.OptimizeFromStudioHdr( phdr, pSrcBodyParts,
+			AddOptimizeJob( jobs, phdr, pSrcBodyParts, filename, "dx90",
 				24 /* vert cache size (real size, not effective!)*/, 
-				false, /* doesn't use fixed function */
 				false, // don't force software skinning
 				true, // Hardware flex on DX9 parts
 				3  /* bones/vert */, 
 				9  /* bones/tri */, 
-				53  /* bones/strip */,
-				tmpFileName, glViewFilename );
+				53  /* bones/strip */ );
+		}
+
+		CPerfPhase phase( "optimize vtx" );
+
+		// This modifies the vertex data that every vtx file reads, so do it up front
+		MergeLikeBoneIndicesWithinVerts( phdr );
+
+		// The GL view files share a bunch of state, so they have to be written one at a time
+		if ( g_bDumpGLViewFiles )
+		{
+			for ( int i = 0; i < jobs.Count(); i++ )
+			{
+				RunOptimizeJob( jobs[i] );
+			}
+		}
+		else
+		{
+			ParallelProcess( jobs.Base(), jobs.Count(), RunOptimizeJob );
 		}
 
 		s_StringTable.Purge();
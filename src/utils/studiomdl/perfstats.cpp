@@ -14,6 +14,8 @@
 #include "studiomdl.h"
 #include "perfstats.h"
 #include "tier1/tier1_logging.h"
+#include "tier1/utlvector.h"
+#include "tier0/platform.h"
 
 extern void MdlError( char const *pMsg, ... );
 
@@ -258,3 +260,51 @@ void SpewPerfStats( studiohdr_t *pStudioHdr, const char *pFilename, unsigned int
 	}
 }
 
+
+//-----------------------------------------------------------------------------
+// Compile phase timing
+//-----------------------------------------------------------------------------
+struct perfphase_t
+{
+	const char *m_pName;
+	int m_nDepth;
+	double m_flSeconds;
+};
+
+static CUtlVector<perfphase_t> s_PerfPhases;
+static int s_nPerfPhaseDepth;
+
+CPerfPhase::CPerfPhase( const char *pName )
+{
+	m_nPhase = -1;
+	if ( !g_bPerf )
+		return;
+
+	m_nPhase = s_PerfPhases.AddToTail();
+	s_PerfPhases[m_nPhase].m_pName = pName;
+	s_PerfPhases[m_nPhase].m_nDepth = s_nPerfPhaseDepth++;
+	s_PerfPhases[m_nPhase].m_flSeconds = 0.0;
+	m_flStartTime = Plat_FloatTime();
+}
+
+CPerfPhase::~CPerfPhase()
+{
+	if ( m_nPhase < 0 )
+		return;
+
+	s_PerfPhases[m_nPhase].m_flSeconds = Plat_FloatTime() - m_flStartTime;
+	s_nPerfPhaseDepth--;
+}
+
+void SpewPerfPhaseTimes()
+{
+	if ( !g_bPerf || !s_PerfPhases.Count() )
+		return;
+
+	printf( "\nCompile phases:\n" );
+	for ( int i = 0; i < s_PerfPhases.Count(); i++ )
+	{
+		const perfphase_t &phase = s_PerfPhases[i];
+		printf( "%*s%-*s %8.3f s\n", 2 + phase.m_nDepth * 2, "", 32 - phase.m_nDepth * 2, phase.m_pName, phase.m_flSeconds );
+	}
+}
@@ -22,4 +22,18 @@ enum
 
 void SpewPerfStats( studiohdr_t *pStudioHdr, const char *pFilename, unsigned int flags );
 
+// Times a phase of the compile for -perf. Phases can nest.
+class CPerfPhase
+{
+public:
+	CPerfPhase( const char *pName );
+	~CPerfPhase();
+
+private:
+	int m_nPhase;
+	double m_flStartTime;
+};
+
+void SpewPerfPhaseTimes();
+
 #endif // PERFSTATS_H
@@ -29,6 +29,8 @@
 #include "mathlib/vmatrix.h"
 #include "mdlobjects/dmeboneflexdriver.h"
 #include "tier1/utlspheretree.h"
+#include "vstdlib/jobthread.h"
+#include "perfstats.h"
 
 
 class CBoneRenderBounds
@@ -1800,30 +1802,28 @@ void ConvertAnimation( const s_source_t *psource, const char *pAnimationName, in
 //-----------------------------------------------------------------------------
 // Purpose: copy the raw animation data from the source files into the individual animations
 //-----------------------------------------------------------------------------
-void RemapAnimations(void)
+static void RemapAnimation( s_animation_t *&panim )
 {
-	int i, j;
+	s_source_t *psource = panim->source;
+	s_sourceanim_t *pSourceAnim = FindSourceAnim( psource, panim->animationname );
+	int size = g_numbones * sizeof( s_bone_t );
 
-	// copy source animations
-	for (i = 0; i < g_numani; i++)
+	int n = panim->startframe - pSourceAnim->startframe;
+	// printf("%s %d:%d\n", panim->filename, panim->startframe, pSourceAnim->startframe );
+	for (int j = 0; j < panim->numframes; j++)
 	{
-		s_animation_t *panim = g_panimation[i];
-
-		s_source_t *psource = panim->source;
-		s_sourceanim_t *pSourceAnim = FindSourceAnim( psource, panim->animationname );
-		int size = g_numbones * sizeof( s_bone_t );
-
-		int n = panim->startframe - pSourceAnim->startframe;
-		// printf("%s %d:%d\n", g_panimation[i]->filename, g_panimation[i]->startframe, pSourceAnim->startframe );
-		for (j = 0; j < panim->numframes; j++)
-		{
-			panim->sanim[j] = (s_bone_t *)calloc( 1, size );
+		panim->sanim[j] = (s_bone_t *)calloc( 1, size );
 
-			ConvertAnimation( psource, panim->animationname, n + j, panim->scale, panim->adjust, panim->rotation, panim->sanim[j] );
-		}
+		ConvertAnimation( psource, panim->animationname, n + j, panim->scale, panim->adjust, panim->rotation, panim->sanim[j] );
 	}
 }
 
+void RemapAnimations(void)
+{
+	// copy source animations, each one only touches its own frames
+	ParallelProcess( g_panimation, g_numani, RemapAnimation );
+}
+
 void buildAnimationWeights()
 {
 	int i, j, k;
@@ -8068,13 +8068,223 @@ static void ProcessIKRules( )
 }
 
 
+//-----------------------------------------------------------------------------
+// Purpose: run length encode an animation's deltas from the default pose
+//-----------------------------------------------------------------------------
+static void ReduceAnimation( s_animation_t *&panim )
+{
+	int j, k, n, m;
+
+	s_source_t *psource = panim->source;
+
+	if (g_bCheckLengths)
+	{
+		printf("%s\n", panim->name ); 
+	}
+
+	// setup animation interior sections
+	int iSectionFrames = panim->numframes;
+	if ( panim->numframes >= g_minSectionFrameLimit )
+	{
+		iSectionFrames = g_sectionFrames;
+		panim->sectionframes = g_sectionFrames;
+		panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
+	}
+	else
+	{
+		panim->sectionframes = 0;
+		panim->numsections = 1;
+	}
+
+	for (int w = 0; w < panim->numsections; w++)
+	{
+		int iStartFrame = w * iSectionFrames;
+		int iEndFrame = (w + 1) * iSectionFrames;
+
+		iStartFrame = MIN( iStartFrame, panim->numframes - 1 );
+		iEndFrame = MIN( iEndFrame, panim->numframes - 1 );
+
+		// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
+
+		for (j = 0; j < g_numbones; j++)
+		{
+			for (k = 0; k < 6; k++)
+			{
+				panim->anim[w][j].num[k] = 0;
+				panim->anim[w][j].data[k] = NULL;
+			}
+
+			// skip bones that are always procedural
+			if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
+			{
+				// panim->weight[j] = 0.0;
+				continue;
+			}
+
+			// skip bones that have no influence
+			if (panim->weight[j] < 0.001)
+				continue;
+
+			int checkmin[6], checkmax[6];
+			for (k = 0; k < 6; k++)
+			{
+				checkmin[k] = 32767;
+				checkmax[k] = -32768;
+			}
+
+			for (k = 0; k < 6; k++)
+			{
+				mstudioanimvalue_t	*pcount, *pvalue;
+				float v;
+				short value[MAXSTUDIOANIMFRAMES];
+				mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
+
+				// find deltas from default pose
+				for (n = 0; n <= iEndFrame - iStartFrame; n++)
+				{
+					s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
+					switch(k)
+					{
+					case 0: /* X Position */
+					case 1: /* Y Position */
+					case 2: /* Z Position */
+						if (panim->flags & STUDIO_DELTA)
+						{
+							value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
+							// pre-scale pos delta since format only has room for "overall" weight
+							float r = panim->posweight[j] / panim->weight[j];
+							value[n] *= r;
+						}
+						else
+						{
+							value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
+						}
+
+						break;
+					case 3: /* X Rotation */
+					case 4: /* Y Rotation */
+					case 5: /* Z Rotation */
+						if (panim->flags & STUDIO_DELTA)
+						{
+							v = psrcdata->rot[k-3]; 
+						}
+						else
+						{
+							v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
+						}
+
+						while (v >= M_PI)
+							v -= M_PI * 2;
+						while (v < -M_PI)
+							v += M_PI * 2;
+
+						value[n] = v / g_bonetable[j].rotscale[k-3]; 
+						break;
+					}
+					checkmin[k] = MIN( value[n], checkmin[k] );
+					checkmax[k] = MAX( value[n], checkmax[k] );
+				}
+				if (n == 0)
+					MdlError("no animation frames: \"%s\"\n", psource->filename );
+
+				// FIXME: this compression algorithm needs work
+
+				// initialize animation RLE block
+				memset( data, 0, sizeof( data ) ); 
+				pcount = data; 
+				pvalue = pcount + 1;
+
+				pcount->num.valid = 1;
+				pcount->num.total = 1;
+				pvalue->value = value[0];
+				pvalue++;
+
+				// build a RLE of deltas from the default pose
+				for (m = 1; m < n; m++)
+				{
+					if (pcount->num.total == 255)
+					{
+						// chain too long, force a new entry
+						pcount = pvalue;
+						pvalue = pcount + 1;
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
+					} 
+					// insert value if they're not equal, 
+					// or if we're not on a run and the run is less than 3 units
+					else if ((value[m] != value[m-1]) 
+						|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
+					{
+						if (pcount->num.total != pcount->num.valid)
+						{
+							//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
+							pcount = pvalue;
+							pvalue = pcount + 1;
+						}
+						pcount->num.valid++;
+						pvalue->value = value[m];
+						pvalue++;
+					}
+					pcount->num.total++;
+				}
+				//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
+
+				panim->anim[w][j].num[k] = pvalue - data;
+				if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
+				{
+					panim->anim[w][j].num[k] = 0;
+				}
+				else
+				{
+					panim->anim[w][j].data[k] = (mstudioanimvalue_t *)calloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
+					memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
+				}
+				// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
+			}
+
+			if (g_bCheckLengths)
+			{
+				char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
+				n = 0;
+				float s = 0.0f;
+				for (k = 0; k < 6; k++)
+				{
+					if (panim->anim[w][j].num[k])
+					{
+						if (n == 0)
+							printf("%30s :", g_bonetable[j].name );
+					
+						// printf("%2s (%8.3f: %8.3f %8.3f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
+						if (k < 3)
+							s = g_bonetable[j].posscale[k]; 
+						else
+							s = g_bonetable[j].rotscale[k-3]; 
+
+						// printf("%2s %8.5f (%d %d)  ", tmp[k], checkmax[k] - checkmin[k] );
+						printf("%2s %8.5f  ", tmp[k], (checkmax[k] - checkmin[k]) * s );
+						n = 1;
+					}
+				}
+				if (n)
+					printf("\n");
+			}
+		}
+	}
+
+	if (panim->numsections == 1)
+	{
+		panim->sectionframes = 0;
+	}
+}
+
 //-----------------------------------------------------------------------------
 // CompressAnimations
 //-----------------------------------------------------------------------------
 
 static void CompressAnimations( )
 {
-	int i, j, k, n, m;
+	int i, j, k, n;
 
 
 	// !!!
@@ -8188,212 +8398,18 @@ static void CompressAnimations( )
 	}
 
 
-	// reduce animations
-	for (i = 0; i < g_numani; i++)
+	// reduce animations. -checklengths prints as it goes, so keep them in order then
+	if (g_bCheckLengths)
 	{
-		s_animation_t *panim = g_panimation[i];
-		s_source_t *psource = panim->source;
-
-		if (g_bCheckLengths)
-		{
-			printf("%s\n", panim->name ); 
-		}
-
-		// setup animation interior sections
-		int iSectionFrames = panim->numframes;
-		if ( panim->numframes >= g_minSectionFrameLimit )
-		{
-			iSectionFrames = g_sectionFrames;
-			panim->sectionframes = g_sectionFrames;
-			panim->numsections = (int)(panim->numframes / panim->sectionframes) + 2;
-		}
-		else
-		{
-			panim->sectionframes = 0;
-			panim->numsections = 1;
-		}
-
-		for (int w = 0; w < panim->numsections; w++)
-		{
-			int iStartFrame = w * iSectionFrames;
-			int iEndFrame = (w + 1) * iSectionFrames;
-
-			iStartFrame = MIN( iStartFrame, panim->numframes - 1 );
-			iEndFrame = MIN( iEndFrame, panim->numframes - 1 );
-
-			// printf("%s : %d %d\n", panim->name, iStartFrame, iEndFrame );
-
-			for (j = 0; j < g_numbones; j++)
-			{
-				for (k = 0; k < 6; k++)
-				{
-					panim->anim[w][j].num[k] = 0;
-					panim->anim[w][j].data[k] = NULL;
-				}
-
-				// skip bones that are always procedural
-				if (g_bonetable[j].flags & BONE_ALWAYS_PROCEDURAL)
-				{
-					// panim->weight[j] = 0.0;
-					continue;
-				}
-
-				// skip bones that have no influence
-				if (panim->weight[j] < 0.001)
-					continue;
-
-				int checkmin[6], checkmax[6];
-				for (k = 0; k < 6; k++)
-				{
-					checkmin[k] = 32767;
-					checkmax[k] = -32768;
-				}
-
-				for (k = 0; k < 6; k++)
-				{
-					mstudioanimvalue_t	*pcount, *pvalue;
-					float v;
-					short value[MAXSTUDIOANIMFRAMES];
-					mstudioanimvalue_t data[MAXSTUDIOANIMFRAMES];
-
-					// find deltas from default pose
-					for (n = 0; n <= iEndFrame - iStartFrame; n++)
-					{
-						s_bone_t *psrcdata = &panim->sanim[n+iStartFrame][j];
-						switch(k)
-						{
-						case 0: /* X Position */
-						case 1: /* Y Position */
-						case 2: /* Z Position */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								value[n] = psrcdata->pos[k] / g_bonetable[j].posscale[k]; 
-								// pre-scale pos delta since format only has room for "overall" weight
-								float r = panim->posweight[j] / panim->weight[j];
-								value[n] *= r;
-							}
-							else
-							{
-								value[n] = ( psrcdata->pos[k] - g_bonetable[j].pos[k] ) / g_bonetable[j].posscale[k]; 
-							}
-
-							break;
-						case 3: /* X Rotation */
-						case 4: /* Y Rotation */
-						case 5: /* Z Rotation */
-							if (panim->flags & STUDIO_DELTA)
-							{
-								v = psrcdata->rot[k-3]; 
-							}
-							else
-							{
-								v = ( psrcdata->rot[k-3] - g_bonetable[j].rot[k-3] ); 
-							}
-
-							while (v >= M_PI)
-								v -= M_PI * 2;
-							while (v < -M_PI)
-								v += M_PI * 2;
-
-							value[n] = v / g_bonetable[j].rotscale[k-3]; 
-							break;
-						}
-						checkmin[k] = MIN( value[n], checkmin[k] );
-						checkmax[k] = MAX( value[n], checkmax[k] );
-					}
-					if (n == 0)
-						MdlError("no animation frames: \"%s\"\n", psource->filename );
-
-					// FIXME: this compression algorithm needs work
-
-					// initialize animation RLE block
-					memset( data, 0, sizeof( data ) ); 
-					pcount = data; 
-					pvalue = pcount + 1;
-
-					pcount->num.valid = 1;
-					pcount->num.total = 1;
-					pvalue->value = value[0];
-					pvalue++;
-
-					// build a RLE of deltas from the default pose
-					for (m = 1; m < n; m++)
-					{
-						if (pcount->num.total == 255)
-						{
-							// chain too long, force a new entry
-							pcount = pvalue;
-							pvalue = pcount + 1;
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
-						} 
-						// insert value if they're not equal, 
-						// or if we're not on a run and the run is less than 3 units
-						else if ((value[m] != value[m-1]) 
-							|| ((pcount->num.total == pcount->num.valid) && ((m < n - 1) && value[m] != value[m+1])))
-						{
-							if (pcount->num.total != pcount->num.valid)
-							{
-								//if (j == 0) printf("%d:%d   ", pcount->num.valid, pcount->num.total ); 
-								pcount = pvalue;
-								pvalue = pcount + 1;
-							}
-							pcount->num.valid++;
-							pvalue->value = value[m];
-							pvalue++;
-						}
-						pcount->num.total++;
-					}
-					//if (j == 0) printf("%d:%d\n", pcount->num.valid, pcount->num.total ); 
-
-					panim->anim[w][j].num[k] = pvalue - data;
-					if (panim->anim[w][j].num[k] == 2 && value[0] == 0)
-					{
-						panim->anim[w][j].num[k] = 0;
-					}
-					else
-					{
-						panim->anim[w][j].data[k] = (mstudioanimvalue_t *)calloc( pvalue - data, sizeof( mstudioanimvalue_t ) );
-						memmove( panim->anim[w][j].data[k], data, (pvalue - data) * sizeof( mstudioanimvalue_t ) );
-					}
-					// printf("%d(%d) ", g_source[i]->panim[q]->numanim[j][k], n );
-				}
-
-				if (g_bCheckLengths)
-				{
-					char *tmp[6] = { "X", "Y", "Z", "XR", "YR", "ZR" };
-					n = 0;
-					float s = 0.0f;
-					for (k = 0; k < 6; k++)
-					{
-						if (panim->anim[w][j].num[k])
-						{
-							if (n == 0)
-								printf("%30s :", g_bonetable[j].name );
-						
-							// printf("%2s (%8.3f: %8.3f %8.3f) ", tmp[k], g_bonetable[j].pos[k], checkmin[k], checkmax[k] );
-							if (k < 3)
-								s = g_bonetable[j].posscale[k]; 
-							else
-								s = g_bonetable[j].rotscale[k-3]; 
-
-							// printf("%2s %8.5f (%d %d)  ", tmp[k], checkmax[k] - checkmin[k] );
-							printf("%2s %8.5f  ", tmp[k], (checkmax[k] - checkmin[k]) * s );
-							n = 1;
-						}
-					}
-					if (n)
-						printf("\n");
-				}
-			}
-		}
-
-		if (panim->numsections == 1)
+		for (i = 0; i < g_numani; i++)
 		{
-			panim->sectionframes = 0;
+			ReduceAnimation( g_panimation[i] );
 		}
 	}
+	else
+	{
+		ParallelProcess( g_panimation, g_numani, ReduceAnimation );
+	}
 }
 
 //-----------------------------------------------------------------------------
@@ -9024,114 +9040,128 @@ void SetupFullBoneRenderBounds( CUtlVector<CBoneRenderBounds> &boneRenderBounds
 }
 
 
-void CalcSequenceBoundingBoxes()
+// Set while CalcAnimationBoundingBox runs
+static const CBoneRenderBounds *s_pSequenceBoneRenderBounds;
+
+//-----------------------------------------------------------------------------
+// Purpose: find the bounding box of every frame of an animation
+//-----------------------------------------------------------------------------
+static void CalcAnimationBoundingBox( s_animation_t *&panim )
 {
-	int i;
 	int	j;
 	int	k;
 	int	n;
 	int	m;
 
-	CUtlVector<CBoneRenderBounds> boneRenderBounds;
-	SetupFullBoneRenderBounds( boneRenderBounds );
+	Vector bmin, bmax;
+	
+	// find intersection box volume for each bone
+	for (j = 0; j < 3; j++)
+	{
+		bmin[j] = 9999.0;
+		bmax[j] = -9999.0;
+	}
 
-	// find bounding box for each g_sequence
-	for (i = 0; i < g_numani; i++)
+	for (j = 0; j < panim->numframes; j++)
 	{
-		Vector bmin, bmax;
-		
-		// find intersection box volume for each bone
-		for (j = 0; j < 3; j++)
+		matrix3x4_t bonetransform[MAXSTUDIOBONES];	// bone transformation matrix
+		matrix3x4_t posetransform[MAXSTUDIOBONES];	// bone transformation matrix
+		matrix3x4_t bonematrix;						// local transformation matrix
+		Vector pos;
+
+		CalcBoneTransforms( panim, j, bonetransform );
+
+		for (k = 0; k < g_numbones; k++)
 		{
-			bmin[j] = 9999.0;
-			bmax[j] = -9999.0;
+			MatrixInvert( g_bonetable[k].boneToPose, bonematrix );
+			ConcatTransforms (bonetransform[k], bonematrix, posetransform[k]);
 		}
 
-		for (j = 0; j < g_panimation[i]->numframes; j++)
+		// include hitboxes as well.
+		if ( !g_bboxonlyverts )
 		{
-			matrix3x4_t bonetransform[MAXSTUDIOBONES];	// bone transformation matrix
-			matrix3x4_t posetransform[MAXSTUDIOBONES];	// bone transformation matrix
-			matrix3x4_t bonematrix;						// local transformation matrix
-			Vector pos;
-
-			CalcBoneTransforms( g_panimation[i], j, bonetransform );
-
 			for (k = 0; k < g_numbones; k++)
 			{
-				MatrixInvert( g_bonetable[k].boneToPose, bonematrix );
-				ConcatTransforms (bonetransform[k], bonematrix, posetransform[k]);
-			}
-
-			// include hitboxes as well.
-			if ( !g_bboxonlyverts )
-			{
-				for (k = 0; k < g_numbones; k++)
+				Vector tmpMin, tmpMax;
+				TransformAABB( bonetransform[k], s_pSequenceBoneRenderBounds[k].m_Mins, s_pSequenceBoneRenderBounds[k].m_Maxs, tmpMin, tmpMax );
+				VectorMin( tmpMin, bmin, bmin );
+				VectorMax( tmpMax, bmax, bmax );
+
+				if ( g_verbose &&
+					(tmpMin.x < g_vecMinWorldspace.x ||
+					 tmpMin.y < g_vecMinWorldspace.y ||
+					 tmpMin.z < g_vecMinWorldspace.z ||
+					 tmpMax.x > g_vecMaxWorldspace.x ||
+					 tmpMax.y > g_vecMaxWorldspace.y ||
+					 tmpMax.z > g_vecMaxWorldspace.z ) )
 				{
-					Vector tmpMin, tmpMax;
-					TransformAABB( bonetransform[k], boneRenderBounds[k].m_Mins, boneRenderBounds[k].m_Maxs, tmpMin, tmpMax );
-					VectorMin( tmpMin, bmin, bmin );
-					VectorMax( tmpMax, bmax, bmax );
-
-					if ( g_verbose &&
-						(tmpMin.x < g_vecMinWorldspace.x ||
-						 tmpMin.y < g_vecMinWorldspace.y ||
-						 tmpMin.z < g_vecMinWorldspace.z ||
-						 tmpMax.x > g_vecMaxWorldspace.x ||
-						 tmpMax.y > g_vecMaxWorldspace.y ||
-						 tmpMax.z > g_vecMaxWorldspace.z ) )
-					{
-						MdlWarning("%s : bone \"%s\" has bounding box out of range : %.0f %.0f %.0f : %.0f %.0f %.0f\n", 
-							g_panimation[i]->name, g_bonetable[k].name,
-							tmpMin.x, tmpMin.y, tmpMin.z, tmpMax.z, tmpMax.y, tmpMax.z );
-					}
+					MdlWarning("%s : bone \"%s\" has bounding box out of range : %.0f %.0f %.0f : %.0f %.0f %.0f\n", 
+						panim->name, g_bonetable[k].name,
+						tmpMin.x, tmpMin.y, tmpMin.z, tmpMax.z, tmpMax.y, tmpMax.z );
 				}
 			}
+		}
 
-			// include vertices
-			for (k = 0; k < g_nummodelsbeforeLOD; k++)
-			{
-				s_loddata_t *pLodData = g_model[k]->m_pLodData;
+		// include vertices
+		for (k = 0; k < g_nummodelsbeforeLOD; k++)
+		{
+			s_loddata_t *pLodData = g_model[k]->m_pLodData;
 
-				// skip blank empty model
-				if ( !pLodData )
-					continue;
+			// skip blank empty model
+			if ( !pLodData )
+				continue;
 
-				for (n = 0; n < pLodData->numvertices; n++)
+			for (n = 0; n < pLodData->numvertices; n++)
+			{
+				Vector tmp;
+				pos = Vector( 0, 0, 0 );
+				for (m = 0; m < pLodData->vertex[n].boneweight.numbones; m++)
 				{
-					Vector tmp;
-					pos = Vector( 0, 0, 0 );
-					for (m = 0; m < pLodData->vertex[n].boneweight.numbones; m++)
-					{
-						VectorTransform( pLodData->vertex[n].position, posetransform[pLodData->vertex[n].boneweight.bone[m]], tmp ); // bug: should use all bones!
-						VectorMA( pos, pLodData->vertex[n].boneweight.weight[m], tmp, pos );
-					}
-
-					VectorMin( pos, bmin, bmin );
-					VectorMax( pos, bmax, bmax );
+					VectorTransform( pLodData->vertex[n].position, posetransform[pLodData->vertex[n].boneweight.bone[m]], tmp ); // bug: should use all bones!
+					VectorMA( pos, pLodData->vertex[n].boneweight.weight[m], tmp, pos );
 				}
+
+				VectorMin( pos, bmin, bmin );
+				VectorMax( pos, bmax, bmax );
 			}
 		}
+	}
 
-		if (bmin.x < g_vecMinWorldspace.x || bmin.y < g_vecMinWorldspace.y || bmin.z < g_vecMinWorldspace.z || bmax.x > g_vecMaxWorldspace.x || bmax.y > g_vecMaxWorldspace.y || bmax.z > g_vecMaxWorldspace.z)
-		{
-			MdlWarning("%s : bounding box out of range : %.0f %.0f %.0f : %.0f %.0f %.0f\n", 
-				g_panimation[i]->name, 
-				bmin.x, bmin.y, bmin.z, bmax.z, bmax.y, bmax.z );
+	if (bmin.x < g_vecMinWorldspace.x || bmin.y < g_vecMinWorldspace.y || bmin.z < g_vecMinWorldspace.z || bmax.x > g_vecMaxWorldspace.x || bmax.y > g_vecMaxWorldspace.y || bmax.z > g_vecMaxWorldspace.z)
+	{
+		MdlWarning("%s : bounding box out of range : %.0f %.0f %.0f : %.0f %.0f %.0f\n", 
+			panim->name, 
+			bmin.x, bmin.y, bmin.z, bmax.z, bmax.y, bmax.z );
 
-			VectorMax( bmin, g_vecMinWorldspace, bmin );
-			VectorMin( bmax, g_vecMaxWorldspace, bmax );
-		}
+		VectorMax( bmin, g_vecMinWorldspace, bmin );
+		VectorMin( bmax, g_vecMaxWorldspace, bmax );
+	}
 
-		VectorCopy( bmin, g_panimation[i]->bmin );
-		VectorCopy( bmax, g_panimation[i]->bmax );
+	VectorCopy( bmin, panim->bmin );
+	VectorCopy( bmax, panim->bmax );
 
-		/*
-		printf("%s : %.0f %.0f %.0f %.0f %.0f %.0f\n", 
-			g_panimation[i]->name, bmin[0], bmax[0], bmin[1], bmax[1], bmin[2], bmax[2] );
-		*/
+	/*
+	printf("%s : %.0f %.0f %.0f %.0f %.0f %.0f\n", 
+		panim->name, bmin[0], bmax[0], bmin[1], bmax[1], bmin[2], bmax[2] );
+	*/
+
+	// printf("%s  %.2f\n", g_sequence[i].name, g_sequence[i].panim[0]->pos[9][0][0] / g_bonetable[9].pos[0] );
+}
 
-		// printf("%s  %.2f\n", g_sequence[i].name, g_sequence[i].panim[0]->pos[9][0][0] / g_bonetable[9].pos[0] );
-	}
+
+void CalcSequenceBoundingBoxes()
+{
+	int i;
+	int	j;
+	int	k;
+
+	CUtlVector<CBoneRenderBounds> boneRenderBounds;
+	SetupFullBoneRenderBounds( boneRenderBounds );
+
+	// find bounding box for each g_sequence
+	s_pSequenceBoneRenderBounds = boneRenderBounds.Base();
+	ParallelProcess( g_panimation, g_numani, CalcAnimationBoundingBox );
+	s_pSequenceBoneRenderBounds = NULL;
 
 	for (i = 0; i < g_sequence.Count(); i++)
 	{
@@ -9189,7 +9219,10 @@ void SimplifyModel()
 
 	// have to load the lod sources before remapping bones so that the remap
 	// happens for all LODs.
-	LoadLODSources();
+	{
+		CPerfPhase phase( "load lod sources" );
+		LoadLODSources();
+	}
 
 	RemapBones();
 
@@ -9243,9 +9276,15 @@ void SimplifyModel()
 	}
 	SpewBoneUsageStats();
 
-	RemapAnimations();
+	{
+		CPerfPhase phase( "remap animations" );
+		RemapAnimations();
+	}
 
-	processAnimations();
+	{
+		CPerfPhase phase( "process animations" );
+		processAnimations();
+	}
 
 	limitBoneRotations();
 
@@ -9293,9 +9332,15 @@ void SimplifyModel()
 
 	SetupHitBoxes();
 
-	CompressAnimations( );
+	{
+		CPerfPhase phase( "compress animations" );
+		CompressAnimations( );
+	}
 
-	CalcSequenceBoundingBoxes();
+	{
+		CPerfPhase phase( "sequence bounds" );
+		CalcSequenceBoundingBoxes();
+	}
 
 	SetIlluminationPosition();
 
@@ -74,6 +74,9 @@
 #include "mathlib/dynamictree.h"
 #include "movieobjects/dmemesh.h"
 #include "tier1/fmtstr.h"
+#include "tier0/threadtools.h"
+#include "vstdlib/jobthread.h"
+#include "compilecache.h"
 
 bool g_parseable_completion_output = false;
 bool g_collapse_bones_message = false;
@@ -301,6 +304,9 @@ void CreateMakefile_OutputMakefile( void )
 
 static bool g_bFirstWarning = true;
 
+// Parts of the compile run on the thread pool, so keep their messages from interleaving
+static CThreadMutex s_MessageMutex;
+
 void TokenError( const char *fmt, ... )
 {
 	static char output[1024];
@@ -333,6 +339,7 @@ void MdlError( const char *fmt, ... )
 	va_list		args;
 
 	Assert( 0 );
+	s_MessageMutex.Lock();
 	if (g_quiet)
 	{
 		if (g_bFirstWarning)
@@ -411,6 +418,7 @@ void MdlWarning( const char *fmt, ... )
 	if (g_bNoWarnings || g_maxWarnings == 0)
 		return;
 
+	AUTO_LOCK( s_MessageMutex );
 	WORD old = SetConsoleTextColor( 1, 1, 0, 1 );
 
 	if (g_quiet)
@@ -11688,6 +11696,8 @@ void UsageAndExit()
 		"[-basedir]\n"
 		"[-tempcontent]\n"
 		"[-nop4]\n"
+		"[-cache <dir>] - reuse collision models built by earlier compiles from the same data\n"
+		"[-singlethreaded] - don't process animations and vtx files in parallel\n"
 		);
 }
 
@@ -12018,6 +12028,17 @@ bool CStudioMDLApp::ParseArguments()
 			continue;
 		}
 
+		if ( !Q_stricmp( pArgv, "-cache" ) )
+		{
+			CompileCache_Init( CommandLine()->GetParm( ++i ) );
+			continue;
+		}
+
+		if ( !Q_stricmp( pArgv, "-singlethreaded" ) )
+		{
+			continue;
+		}
+
 		if ( !Q_stricmp( pArgv, "-printgraph" ) )
 		{
 			g_bDumpGraph = true;
@@ -12239,6 +12260,24 @@ void ParseGameInfo()
 }
 
 
+//-----------------------------------------------------------------------------
+// Animations and vtx files are processed on the thread pool
+//-----------------------------------------------------------------------------
+static void StartThreadPool()
+{
+	const CPUInformation &cpu = GetCPUInformation();
+	if ( cpu.m_nLogicalProcessors <= 1 || CommandLine()->FindParm( "-singlethreaded" ) )
+		return;
+
+	ThreadPoolStartParams_t startParams;
+	startParams.bIOThreads = false;
+	startParams.nThreads = cpu.m_nLogicalProcessors - 1;
+	// The animation code keeps a lot of bone matrices on the stack
+	startParams.nStackSize = 4 * 1024 * 1024;
+	g_pThreadPool->Start( startParams );
+}
+
+
 //-----------------------------------------------------------------------------
 // The application object
 //-----------------------------------------------------------------------------
@@ -12396,11 +12435,14 @@ int CStudioMDLApp::Main()
 	}
 	else
 	{
+		CPerfPhase phase( "parse script" );
 		ParseScript( pExt );
 	}
 
 	if ( !g_bCreateMakefile )
 	{
+		StartThreadPool();
+
 		int nCount = g_numsources;
 		for (int i = 0; i < nCount; i++)
 		{
@@ -12412,16 +12454,27 @@ int CStudioMDLApp::Main()
 	
 		SetSkinValues();
 
-		SimplifyModel();
+		{
+			CPerfPhase phase( "simplify model" );
+			SimplifyModel();
+		}
 
 		ConsistencyCheckSurfaceProp();
 		ConsistencyCheckContents();
 
-		CollisionModel_Build();
+		{
+			CPerfPhase phase( "collision model" );
+			CollisionModel_Build();
+		}
 
 		// ValidateSharedAnimationGroups();
 
-		WriteModelFiles();
+		{
+			CPerfPhase phase( "write model files" );
+			WriteModelFiles();
+		}
+
+		g_pThreadPool->Stop();
 	}
 
 	if ( g_bCreateMakefile )
@@ -12439,6 +12492,9 @@ int CStudioMDLApp::Main()
 		printf("\nCompleted \"%s\"\n", g_path);
 	}
 
+	SpewPerfPhaseTimes();
+	CompileCache_SpewStats();
+
 	if ( g_parseable_completion_output )
 	{
 		printf("\nRESULT: SUCCESS\n");
@@ -13,6 +13,20 @@ int		c_nodes;
 int		c_nonvis;
 int		c_active_brushes;
 
+// Subtrees with at most this many brushes are put aside while deferring (see
+// BeginDeferredSubtrees) so they can be built on all the threads at once
+#define DEFERRED_SUBTREE_BRUSHES	64
+
+struct deferredsubtree_t
+{
+	node_t		*node;
+	bspbrush_t	*brushes;
+	int			numbrushes;
+};
+
+static bool s_bDeferSubtrees;
+static CUtlVector<deferredsubtree_t> s_DeferredSubtrees;
+
 // if a brush just barely pokes onto the other side,
 // let it slide by without chopping
 #define	PLANESIDE_EPSILON	0.001
@@ -316,11 +330,9 @@ node_t *AllocNode (void)
 
 	node = (node_t*)malloc(sizeof(*node));
 	memset (node, 0, sizeof(*node));
-	node->id = s_NodeCount;
+	node->id = ThreadInterlockedIncrement( (int32 volatile *)&s_NodeCount ) - 1;
 	node->diskId = -1;
 
-	s_NodeCount++;
-
 	return node;
 }
 
@@ -340,7 +352,7 @@ bspbrush_t *AllocBrush (int numsides)
 	c = (int)&(((bspbrush_t *)0)->sides[numsides]);
 	bb = (bspbrush_t*)malloc(c);
 	memset (bb, 0, c);
-	bb->id = s_BrushId++;
+	bb->id = ThreadInterlockedIncrement( (int32 volatile *)&s_BrushId ) - 1;
 	if (numthreads == 1)
 		c_active_brushes++;
 	return bb;
@@ -1338,6 +1350,21 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 	int			i;
 	bspbrush_t	*children[2];
 
+	// a subtree only depends on its own brushes and volume, so small ones can be
+	// built later in any order without changing the tree
+	if ( s_bDeferSubtrees )
+	{
+		int numbrushes = CountBrushList (brushes);
+		if ( numbrushes <= DEFERRED_SUBTREE_BRUSHES )
+		{
+			deferredsubtree_t subtree = { node, brushes, numbrushes };
+			ThreadLock ();
+			s_DeferredSubtrees.AddToTail( subtree );
+			ThreadUnlock ();
+			return node;
+		}
+	}
+
 	if (numthreads == 1)
 		c_nodes++;
 
@@ -1383,6 +1410,55 @@ node_t *BuildTree_r (node_t *node, bspbrush_t *brushes)
 
 //===========================================================
 
+/*
+=================
+BeginDeferredSubtrees
+
+Until BuildDeferredSubtrees, BrushBSP only builds the top of each tree and
+leaves its small subtrees for later. Every BrushBSP in between can run on
+its own thread.
+=================
+*/
+void BeginDeferredSubtrees (void)
+{
+	s_bDeferSubtrees = true;
+}
+
+static void BuildDeferredSubtree_Thread (int threadnum, int subtreenum)
+{
+	deferredsubtree_t &subtree = s_DeferredSubtrees[subtreenum];
+	BuildTree_r (subtree.node, subtree.brushes);
+}
+
+/*
+=================
+BuildDeferredSubtrees
+
+Finishes the trees of all the BrushBSP calls since BeginDeferredSubtrees
+=================
+*/
+void BuildDeferredSubtrees (void)
+{
+	s_bDeferSubtrees = false;
+
+	// choosing a split plane is quadratic in the number of brushes
+	CUtlVector<float> costs;
+	costs.SetCount( s_DeferredSubtrees.Count() );
+	for ( int i = 0; i < s_DeferredSubtrees.Count(); i++ )
+	{
+		costs[i] = (float)s_DeferredSubtrees[i].numbrushes * (float)s_DeferredSubtrees[i].numbrushes;
+	}
+
+	qprintf ("%5i deferred subtrees\n", s_DeferredSubtrees.Count());
+	if ( s_DeferredSubtrees.Count() )
+	{
+		SetThreadWorkCosts( costs.Base() );
+		RunThreadsOnIndividual (s_DeferredSubtrees.Count(), false, BuildDeferredSubtree_Thread);
+	}
+
+	s_DeferredSubtrees.Purge();
+}
+
 /*
 =================
 BrushBSP
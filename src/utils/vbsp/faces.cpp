@@ -14,6 +14,7 @@
 #include "mstristrip.h"
 #include "tier1/strtools.h"
 #include "materialpatch.h"
+#include "threads.h"
 /*
 
   some faces will be removed before saving, but still form nodes:
@@ -51,12 +52,43 @@ int		firstmodelface;
 
 int	c_tryedges;
 
-Vector	edge_dir;
-Vector	edge_start;
-vec_t	edge_len;
+// FindEdgeVerts and TestEdge work in one of these for each thread, so the
+// t-junctions of many faces can be found at once
+struct edgescratch_t
+{
+	Vector	edge_dir;
+	Vector	edge_start;
+
+	int		num_edge_verts;
+	int		edge_verts[MAX_MAP_VERTS];
+
+	int		superverts[MAX_SUPERVERTS];
+	int		numsuperverts;
+
+	int		c_degenerate;
+	int		c_tjunctions;
+};
+
+static edgescratch_t *s_pEdgeScratch[MAX_TOOL_THREADS+1];
+
+// A face waiting for FixFaceEdges, with the vertexes found along its edges
+struct tjuncface_t
+{
+	face_t	**pList;
+	face_t	*f;
+
+	int		*superverts;
+	int		numsuperverts;
+	int		count[MAXEDGES], start[MAXEDGES];
 
-int		num_edge_verts;
-int		edge_verts[MAX_MAP_VERTS];
+	int		c_degenerate;
+	int		c_tjunctions;
+};
+
+static CUtlVector<tjuncface_t> s_TjuncFaces;
+
+// The nodes whose faces MakeFaces merges and subdivides
+static CUtlVector<node_t *> s_FaceNodes;
 
 
 float	g_maxLightmapDimension = MAX_BRUSH_LIGHTMAP_DIM_WITHOUT_BORDER;
@@ -339,7 +371,7 @@ FindEdgeVerts
 Uses the hash tables to cut down to a small number
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
+void FindEdgeVerts (edgescratch_t *pScratch, Vector& v1, Vector& v2)
 {
 	int		x1, x2, y1, y2, t;
 	int		x, y;
@@ -348,9 +380,9 @@ void FindEdgeVerts (Vector& v1, Vector& v2)
 #if 0
 {
 	int		i;
-	num_edge_verts = numvertexes-1;
+	pScratch->num_edge_verts = numvertexes-1;
 	for (i=0 ; i<numvertexes-1 ; i++)
-		edge_verts[i] = i+1;
+		pScratch->edge_verts[i] = i+1;
 }
 #endif
 
@@ -385,14 +417,14 @@ void FindEdgeVerts (Vector& v1, Vector& v2)
 	if (y2 >= HASH_SIZE)
 		y2 = HASH_SIZE;
 #endif
-	num_edge_verts = 0;
+	pScratch->num_edge_verts = 0;
 	for (x=x1 ; x <= x2 ; x++)
 	{
 		for (y=y1 ; y <= y2 ; y++)
 		{
 			for (vnum=hashverts[y*HASH_SIZE+x] ; vnum ; vnum=vertexchain[vnum])
 			{
-				edge_verts[num_edge_verts++] = vnum;
+				pScratch->edge_verts[pScratch->num_edge_verts++] = vnum;
 			}
 		}
 	}
@@ -406,13 +438,13 @@ FindEdgeVerts
 Forced a dumb check of everything
 ==========
 */
-void FindEdgeVerts (Vector& v1, Vector& v2)
+void FindEdgeVerts (edgescratch_t *pScratch, Vector& v1, Vector& v2)
 {
 	int		i;
 
-	num_edge_verts = numvertexes-1;
-	for (i=0 ; i<num_edge_verts ; i++)
-		edge_verts[i] = i+1;
+	pScratch->num_edge_verts = numvertexes-1;
+	for (i=0 ; i<pScratch->num_edge_verts ; i++)
+		pScratch->edge_verts[i] = i+1;
 }
 #endif
 
@@ -423,7 +455,7 @@ TestEdge
 Can be recursively reentered
 ==========
 */
-void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
+void TestEdge (edgescratch_t *pScratch, vec_t start, vec_t end, int p1, int p2, int startvert)
 {
 	int		j, k;
 	vec_t	dist;
@@ -435,23 +467,23 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 
 	if (p1 == p2)
 	{
-		c_degenerate++;
+		pScratch->c_degenerate++;
 		return;		// degenerate edge
 	}
 
-	for (k=startvert ; k<num_edge_verts ; k++)
+	for (k=startvert ; k<pScratch->num_edge_verts ; k++)
 	{
-		j = edge_verts[k];
+		j = pScratch->edge_verts[k];
 		if (j==p1 || j == p2)
 			continue;
 
 		VectorCopy (dvertexes[j].point, p);
 
-		VectorSubtract (p, edge_start, delta);
-		dist = DotProduct (delta, edge_dir);
+		VectorSubtract (p, pScratch->edge_start, delta);
+		dist = DotProduct (delta, pScratch->edge_dir);
 		if (dist <=start || dist >= end)
 			continue;		// off an end
-		VectorMA (edge_start, dist, edge_dir, exact);
+		VectorMA (pScratch->edge_start, dist, pScratch->edge_dir, exact);
 		VectorSubtract (p, exact, off);
 		error = off.Length();
 
@@ -459,17 +491,17 @@ void TestEdge (vec_t start, vec_t end, int p1, int p2, int startvert)
 			continue;		// not on the edge
 
 		// break the edge
-		c_tjunctions++;
-		TestEdge (start, dist, p1, j, k+1);
-		TestEdge (dist, end, j, p2, k+1);
+		pScratch->c_tjunctions++;
+		TestEdge (pScratch, start, dist, p1, j, k+1);
+		TestEdge (pScratch, dist, end, j, p2, k+1);
 		return;
 	}
 
 	// the edge p1 to p2 is now free of tjunctions
-	if (numsuperverts >= MAX_SUPERVERTS)
+	if (pScratch->numsuperverts >= MAX_SUPERVERTS)
 		Error ("Edge with too many vertices due to t-junctions.  Max %d verts along an edge!\n", MAX_SUPERVERTS);
-	superverts[numsuperverts] = p1;
-	numsuperverts++;
+	pScratch->superverts[pScratch->numsuperverts] = p1;
+	pScratch->numsuperverts++;
 }
 
 
@@ -580,44 +612,86 @@ void Triangulate_r( CUtlVector<int> &out, const CUtlVector<int> &inIndices, cons
 
 /*
 ==================
-FixFaceEdges
+FindFaceTjuncs
 
+Finds the vertexes along the edges of a face. This only reads the vertexes,
+so it runs on all the faces at once.
 ==================
 */
-void FixFaceEdges (face_t **pList, face_t *f)
+void FindFaceTjuncs (edgescratch_t *pScratch, tjuncface_t *pFace)
 {
 	int		p1, p2;
 	int		i;
 	Vector	e2;
 	vec_t	len;
-	int		count[MAX_SUPERVERTS], start[MAX_SUPERVERTS];
-	int		base;
+	face_t	*f = pFace->f;
 
-	if (f->merged || f->split[0] || f->split[1])
-		return;
-
-	numsuperverts = 0;
+	pScratch->numsuperverts = 0;
+	pScratch->c_degenerate = 0;
+	pScratch->c_tjunctions = 0;
 
-	int originalPoints = f->numpoints;
 	for (i=0 ; i<f->numpoints ; i++)
 	{
 		p1 = f->vertexnums[i];
 		p2 = f->vertexnums[(i+1)%f->numpoints];
 
-		VectorCopy (dvertexes[p1].point, edge_start);
+		VectorCopy (dvertexes[p1].point, pScratch->edge_start);
 		VectorCopy (dvertexes[p2].point, e2);
 
-		FindEdgeVerts (edge_start, e2);
+		FindEdgeVerts (pScratch, pScratch->edge_start, e2);
 
-		VectorSubtract (e2, edge_start, edge_dir);
-		len = VectorNormalize (edge_dir);
+		VectorSubtract (e2, pScratch->edge_start, pScratch->edge_dir);
+		len = VectorNormalize (pScratch->edge_dir);
 
-		start[i] = numsuperverts;
-		TestEdge (0, len, p1, p2, 0);
+		pFace->start[i] = pScratch->numsuperverts;
+		TestEdge (pScratch, 0, len, p1, p2, 0);
 
-		count[i] = numsuperverts - start[i];
+		pFace->count[i] = pScratch->numsuperverts - pFace->start[i];
 	}
 
+	pFace->numsuperverts = pScratch->numsuperverts;
+	pFace->superverts = (int *)malloc( pScratch->numsuperverts * sizeof(int) );
+	memcpy( pFace->superverts, pScratch->superverts, pScratch->numsuperverts * sizeof(int) );
+	pFace->c_degenerate = pScratch->c_degenerate;
+	pFace->c_tjunctions = pScratch->c_tjunctions;
+}
+
+static void FindFaceTjuncs_Thread (int iThread, int iFace)
+{
+	if ( !s_pEdgeScratch[iThread] )
+	{
+		s_pEdgeScratch[iThread] = new edgescratch_t;
+	}
+
+	FindFaceTjuncs( s_pEdgeScratch[iThread], &s_TjuncFaces[iFace] );
+}
+
+/*
+==================
+FixFaceEdges
+
+Rebuilds a face from the vertexes FindFaceTjuncs found. The faces have to
+be done in order, because this adds to the face lists and the primitives.
+==================
+*/
+void FixFaceEdges (tjuncface_t *pFace)
+{
+	int		i;
+	int		*count = pFace->count, *start = pFace->start;
+	int		base;
+	face_t	**pList = pFace->pList;
+	face_t	*f = pFace->f;
+
+	c_degenerate += pFace->c_degenerate;
+	c_tjunctions += pFace->c_tjunctions;
+
+	numsuperverts = pFace->numsuperverts;
+	memcpy( superverts, pFace->superverts, numsuperverts * sizeof(int) );
+	free( pFace->superverts );
+	pFace->superverts = NULL;
+
+	int originalPoints = f->numpoints;
+
 	if (numsuperverts < 3)
 	{	// entire face collapsed
 		f->numpoints = 0;
@@ -694,6 +768,47 @@ void FixFaceEdges (face_t **pList, face_t *f)
 	}
 }
 
+//-----------------------------------------------------------------------------
+// Purpose: Queue a list of faces for FixQueuedFaceEdges
+//-----------------------------------------------------------------------------
+static void QueueFaceEdges( face_t **pList )
+{
+	for ( face_t *f = *pList; f; f = f->next )
+	{
+		if ( f->merged || f->split[0] || f->split[1] )
+			continue;
+
+		int i = s_TjuncFaces.AddToTail();
+		memset( &s_TjuncFaces[i], 0, sizeof(tjuncface_t) );
+		s_TjuncFaces[i].pList = pList;
+		s_TjuncFaces[i].f = f;
+	}
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Fix the t-junctions on all the queued faces, in the order they were queued
+//-----------------------------------------------------------------------------
+static void FixQueuedFaceEdges()
+{
+	if ( s_TjuncFaces.Count() )
+	{
+		RunThreadsOnIndividual( s_TjuncFaces.Count(), false, FindFaceTjuncs_Thread );
+	}
+
+	for ( int i = 0; i < s_TjuncFaces.Count(); i++ )
+	{
+		FixFaceEdges( &s_TjuncFaces[i] );
+	}
+
+	s_TjuncFaces.Purge();
+
+	for ( int i = 0; i < ARRAYSIZE( s_pEdgeScratch ); i++ )
+	{
+		delete s_pEdgeScratch[i];
+		s_pEdgeScratch[i] = NULL;
+	}
+}
+
 /*
 ==================
 FixEdges_r
@@ -702,15 +817,13 @@ FixEdges_r
 void FixEdges_r (node_t *node)
 {
 	int		i;
-	face_t	*f;
 
 	if (node->planenum == PLANENUM_LEAF)
 	{
 		return;
 	}
 
-	for (f=node->faces ; f ; f=f->next)
-		FixFaceEdges (&node->faces, f);
+	QueueFaceEdges (&node->faces);
 
 	for (i=0 ; i<2 ; i++)
 		FixEdges_r (node->children[i]);
@@ -722,12 +835,7 @@ void FixEdges_r (node_t *node)
 //-----------------------------------------------------------------------------
 void FixLeafFaceEdges( face_t **ppLeafFaceList )
 {
-	face_t *f;
-
-	for ( f = *ppLeafFaceList; f; f = f->next )
-	{
-		FixFaceEdges( ppLeafFaceList, f );
-	}
+	QueueFaceEdges( ppLeafFaceList );
 }
 
 /*
@@ -757,11 +865,15 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 	c_facecollapse = 0;
 	c_tjunctions = 0;
 	
+	// the edges are searched on all the threads, so the vertexes can't change
+	// while the faces are queued
 	if ( g_bAllowDetailCracks )
 	{
 		FixEdges_r (headnode);
+		FixQueuedFaceEdges ();
 		EmitLeafFaceVertexes( &pLeafFaceList );
 		FixLeafFaceEdges( &pLeafFaceList );
+		FixQueuedFaceEdges ();
 	}
 	else
 	{
@@ -770,6 +882,7 @@ face_t *FixTjuncs (node_t *headnode, face_t *pLeafFaceList)
 		{
 			FixEdges_r (headnode);
 			FixLeafFaceEdges( &pLeafFaceList );
+			FixQueuedFaceEdges ();
 		}
 	}
 
@@ -797,10 +910,9 @@ face_t	*AllocFace (void)
 
 	f = (face_t*)malloc(sizeof(*f));
 	memset (f, 0, sizeof(*f));
-	f->id = s_FaceId;
-	++s_FaceId;
+	f->id = ThreadInterlockedIncrement( (int32 volatile *)&s_FaceId ) - 1;
 
-	c_faces++;
+	ThreadInterlockedIncrement( (int32 volatile *)&c_faces );
 
 	return f;
 }
@@ -822,7 +934,7 @@ void FreeFace (face_t *f)
 	if (f->w)
 		FreeWinding (f->w);
 	free (f);
-	c_faces--;
+	ThreadInterlockedDecrement( (int32 volatile *)&c_faces );
 }
 
 
@@ -1107,7 +1219,7 @@ face_t *TryMerge (face_t *f1, face_t *f2, Vector& planenormal)
 	if (!nw)
 		return NULL;
 
-	c_merge++;
+	ThreadInterlockedIncrement( (int32 volatile *)&c_merge );
 	newf = NewFaceFromFace (f1);
 	newf->w = nw;
 
@@ -1230,7 +1342,7 @@ void SubdivideFace (face_t **pFaceList, face_t *f)
 				break;
 			
 		// split it
-			c_subdivide++;
+			ThreadInterlockedIncrement( (int32 volatile *)&c_subdivide );
 			
 			luxelsPerWorldUnit = VectorNormalize (temp);	
 
@@ -1442,11 +1554,8 @@ void MakeFaces_r (node_t *node)
 		MakeFaces_r (node->children[0]);
 		MakeFaces_r (node->children[1]);
 
-		// merge together all visible faces on the node
-		if (!nomerge)
-			MergeFaceList(&node->faces);
-		if (!nosubdiv)
-			SubdivideFaceList(&node->faces);
+		// all the faces on a node come from the leafs below it, so it's done now
+		s_FaceNodes.AddToTail( node );
 
 		return;
 	}
@@ -1809,6 +1918,17 @@ void SplitSubdividedFaces( face_t *pLeafFaceList, node_t *headnode )
 
 #pragma optimize( "", on )
 
+static void MergeNodeFaces_Thread (int iThread, int iNode)
+{
+	node_t *node = s_FaceNodes[iNode];
+
+	// merge together all visible faces on the node
+	if (!nomerge)
+		MergeFaceList(&node->faces);
+	if (!nosubdiv)
+		SubdivideFaceList(&node->faces);
+}
+
 /*
 ============
 MakeFaces
@@ -1823,6 +1943,13 @@ void MakeFaces (node_t *node)
 
 	MakeFaces_r (node);
 
+	// the nodes' faces don't share anything, so they're merged on all the threads
+	if ( s_FaceNodes.Count() && ( !nomerge || !nosubdiv ) )
+	{
+		RunThreadsOnIndividual (s_FaceNodes.Count(), false, MergeNodeFaces_Thread);
+	}
+	s_FaceNodes.Purge();
+
 	qprintf ("%5i makefaces\n", c_nodefaces);
 	qprintf ("%5i merged\n", c_merge);
 	qprintf ("%5i subdivided\n", c_subdivide);
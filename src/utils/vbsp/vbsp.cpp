@@ -173,6 +173,21 @@ ProcessBlock_Thread
 ============
 */
 int			brush_start, brush_end;
+static bspbrush_t **s_ppBlockBrushes;	// from PrepareBlocks, or NULL
+
+static void GetBlockBounds (int blocknum, int *xblock, int *yblock, Vector& mins, Vector& maxs)
+{
+	*yblock = block_yl + blocknum / (block_xh-block_xl+1);
+	*xblock = block_xl + blocknum % (block_xh-block_xl+1);
+
+	mins[0] = *xblock*g_nBlockSize;
+	mins[1] = *yblock*g_nBlockSize;
+	mins[2] = MIN_COORD_INTEGER;
+	maxs[0] = (*xblock+1)*g_nBlockSize;
+	maxs[1] = (*yblock+1)*g_nBlockSize;
+	maxs[2] = MAX_COORD_INTEGER;
+}
+
 void ProcessBlock_Thread (int threadnum, int blocknum)
 {
 	int		xblock, yblock;
@@ -181,20 +196,22 @@ void ProcessBlock_Thread (int threadnum, int blocknum)
 	tree_t		*tree;
 	node_t		*node;
 
-	yblock = block_yl + blocknum / (block_xh-block_xl+1);
-	xblock = block_xl + blocknum % (block_xh-block_xl+1);
+	GetBlockBounds (blocknum, &xblock, &yblock, mins, maxs);
 
 	qprintf ("############### block %2i,%2i ###############\n", xblock, yblock);
 
-	mins[0] = xblock*g_nBlockSize;
-	mins[1] = yblock*g_nBlockSize;
-	mins[2] = MIN_COORD_INTEGER;
-	maxs[0] = (xblock+1)*g_nBlockSize;
-	maxs[1] = (yblock+1)*g_nBlockSize;
-	maxs[2] = MAX_COORD_INTEGER;
-
 	// the makelist and chopbrushes could be cached between the passes...
-	brushes = MakeBspBrushList (brush_start, brush_end, mins, maxs, NO_DETAIL);
+	if (s_ppBlockBrushes)
+	{
+		brushes = s_ppBlockBrushes[blocknum];
+	}
+	else
+	{
+		brushes = MakeBspBrushList (brush_start, brush_end, mins, maxs, NO_DETAIL);
+		if (brushes)
+			FixupAreaportalWaterBrushes( brushes );
+	}
+
 	if (!brushes)
 	{
 		node = AllocNode ();
@@ -204,7 +221,6 @@ void ProcessBlock_Thread (int threadnum, int blocknum)
 		return;
 	}    
 
-	FixupAreaportalWaterBrushes( brushes );
 	if (!nocsg)
 		brushes = ChopBrushes (brushes);
 
@@ -214,6 +230,146 @@ void ProcessBlock_Thread (int threadnum, int blocknum)
 }
 
 
+/*
+============
+PrepareBlocks
+
+Makes the brush lists of all the blocks up front, in block order, so the
+blocks can be processed in parallel. Making a list creates the block's
+clip planes, and areaportals in water pick up the water's contents and
+textures, so both have to happen in the same order as before.
+
+Returns false, with everything put back, if an areaportal picks up new
+contents in a block after an earlier block has already used it. The
+earlier block has to see the old contents then, so the blocks have to be
+processed one after the other.
+============
+*/
+struct areaportalbackup_t
+{
+	mapbrush_t		*brush;
+	int				contents;
+	CUtlVector<int>	texinfos;
+};
+
+static bool PrepareBlocks (int numblocks)
+{
+	CUtlVector<areaportalbackup_t> backups;
+	for (int i = brush_start; i < brush_end; i++)
+	{
+		mapbrush_t *mb = &g_MainMap->mapbrushes[i];
+		if (!(mb->contents & CONTENTS_AREAPORTAL))
+			continue;
+
+		areaportalbackup_t &backup = backups[backups.AddToTail()];
+		backup.brush = mb;
+		backup.contents = mb->contents;
+		for (int j = 0; j < mb->numsides; j++)
+		{
+			backup.texinfos.AddToTail( mb->original_sides[j].texinfo );
+			backup.texinfos.AddToTail( mb->original_sides[j].original ? mb->original_sides[j].original->texinfo : 0 );
+		}
+	}
+
+	CUtlVector<int> firstBlock;
+	firstBlock.SetCount( brush_end - brush_start );
+	for (int i = 0; i < firstBlock.Count(); i++)
+		firstBlock[i] = -1;
+
+	s_ppBlockBrushes = new bspbrush_t *[numblocks];
+
+	bool bParallel = true;
+	CUtlVector<int> oldContents;
+	for (int blocknum = 0; blocknum < numblocks && bParallel; blocknum++)
+	{
+		int xblock, yblock;
+		Vector mins, maxs;
+		GetBlockBounds (blocknum, &xblock, &yblock, mins, maxs);
+
+		bspbrush_t *brushes = MakeBspBrushList (brush_start, brush_end, mins, maxs, NO_DETAIL);
+		s_ppBlockBrushes[blocknum] = brushes;
+
+		oldContents.RemoveAll();
+		for (bspbrush_t *b = brushes; b; b = b->next)
+			oldContents.AddToTail( b->original->contents );
+
+		FixupAreaportalWaterBrushes( brushes );
+
+		int i = 0;
+		for (bspbrush_t *b = brushes; b; b = b->next, i++)
+		{
+			int *pFirst = &firstBlock[b->original - &g_MainMap->mapbrushes[brush_start]];
+			if (b->original->contents != oldContents[i] && *pFirst >= 0 && *pFirst != blocknum)
+			{
+				bParallel = false;
+			}
+			if (*pFirst < 0)
+			{
+				*pFirst = blocknum;
+			}
+		}
+	}
+
+	if (bParallel)
+		return true;
+
+	// start over
+	for (int blocknum = 0; blocknum < numblocks; blocknum++)
+	{
+		if (s_ppBlockBrushes[blocknum])
+			FreeBrushList (s_ppBlockBrushes[blocknum]);
+	}
+	delete[] s_ppBlockBrushes;
+	s_ppBlockBrushes = NULL;
+
+	for (int i = 0; i < backups.Count(); i++)
+	{
+		mapbrush_t *mb = backups[i].brush;
+		mb->contents = backups[i].contents;
+		for (int j = 0; j < mb->numsides; j++)
+		{
+			if (mb->original_sides[j].original)
+				mb->original_sides[j].original->texinfo = backups[i].texinfos[j*2+1];
+			mb->original_sides[j].texinfo = backups[i].texinfos[j*2];
+		}
+	}
+
+	return false;
+}
+
+/*
+============
+ProcessBlocks
+
+Builds the tree of every block. The blocks are independent once their brush
+lists are made, so each one is chopped and gets the top of its tree built on
+its own thread, and then all their small subtrees are built on all threads.
+============
+*/
+static void ProcessBlocks (void)
+{
+	int numblocks = (block_xh-block_xl+1)*(block_yh-block_yl+1);
+
+	if (numthreads == 1 || !PrepareBlocks (numblocks))
+	{
+		if (numthreads != 1)
+			qprintf ("areaportals in water cross blocks, building the blocks one at a time\n");
+
+		// RunThreadsOnIndividual would run the blocks in any order
+		for (int blocknum = 0; blocknum < numblocks; blocknum++)
+			ProcessBlock_Thread (0, blocknum);
+		return;
+	}
+
+	BeginDeferredSubtrees ();
+	RunThreadsOnIndividual (numblocks, !verbose, ProcessBlock_Thread);
+	BuildDeferredSubtrees ();
+
+	delete[] s_ppBlockBrushes;
+	s_ppBlockBrushes = NULL;
+}
+
+
 /*
 ============
 ProcessWorldModel
@@ -283,8 +439,7 @@ void ProcessWorldModel (void)
 	{
 		qprintf ("--------------------------------------------\n");
 
-		RunThreadsOnIndividual ((block_xh-block_xl+1)*(block_yh-block_yl+1),
-			!verbose, ProcessBlock_Thread);
+		ProcessBlocks ();
 
 		//
 		// build the division tree
@@ -1592,7 +1747,6 @@ int RunVBSP( int argc, char **argv )
 	}
 
 	ThreadSetDefault ();
-	numthreads = 1;		// multiple threads aren't helping...
 
 	// Setup the logfile.
 	char logFile[512];
@@ -1727,6 +1881,8 @@ int RunVBSP( int argc, char **argv )
 		ProcessModels ();
 	}
 
+	PrintThreadPhaseTimes();
+
 	end = Plat_FloatTime();
 	
 	char str[512];
@@ -503,6 +503,8 @@ void FreeBrushList (bspbrush_t *brushes);
 node_t	*PointInLeaf (node_t *node, Vector& point);
 
 tree_t *BrushBSP (bspbrush_t *brushlist, Vector& mins, Vector& maxs);
+void BeginDeferredSubtrees (void);
+void BuildDeferredSubtrees (void);
 
 #define	PSIDE_FRONT			1
 #define	PSIDE_BACK			2
@@ -0,0 +1,1107 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: The -incremental light cache (see lightcache.h)
+//
+//			The cache file holds, in order:
+//				- the hashes of the lighting options and of the bsp tree
+//				- a hash and the bounds of every shadow-casting triangle
+//				- for every lit face: its hash, the hash of the lights in the
+//				  PVS of its samples, its lightstyles, the clusters its samples
+//				  fall in and its direct lighting
+//				- the patch hashes, the bounced light and the transfers
+//
+//			Everything the cache knows about a face is keyed on the face's
+//			own hash rather than its index, so faces survive being renumbered
+//			by vbsp.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "lightcache.h"
+#include "tier1/generichash.h"
+
+
+#define LIGHTCACHE_ID		MAKEID( 'V', 'R', 'L', 'C' )
+#define LIGHTCACHE_VERSION	1
+
+extern int GetVisCache( int lastoffset, int cluster, byte *pvs );
+extern int total_transfer;
+extern int max_transfer;
+
+
+bool g_bLightCache = false;
+bool g_bLightCacheRecordClusters = false;
+
+
+// Why a face was lit this run
+enum LightCacheReason_t
+{
+	LIGHTCACHE_REUSED = 0,
+	LIGHTCACHE_NO_CACHE,
+	LIGHTCACHE_SETTINGS,
+	LIGHTCACHE_BSP_TREE,
+	LIGHTCACHE_NEW_FACE,
+	LIGHTCACHE_LIGHTS,
+	LIGHTCACHE_GEOMETRY,
+	LIGHTCACHE_UNLIT,			// no lightmap, so there's nothing to cache
+
+	LIGHTCACHE_NUM_REASONS
+};
+
+static const char *s_pReasonNames[LIGHTCACHE_NUM_REASONS] =
+{
+	"reused",
+	"no usable cache",
+	"lighting options changed",
+	"bsp tree changed",
+	"new or changed face",
+	"lights changed",
+	"geometry in view changed",
+	"no lightmap",
+};
+
+struct TraceTriangle_t
+{
+	uint64	m_nHash;
+	Vector	m_vecMins;
+	Vector	m_vecMaxs;
+};
+
+struct CachedFace_t
+{
+	uint64	m_nHash;
+	uint64	m_nLightSignature;
+	byte	m_Styles[MAXLIGHTMAPS];
+	int		m_nClusters;
+	int		m_nClusterOffset;	// into s_OldCache
+	int		m_nDataSize;
+	int		m_nDataOffset;
+	bool	m_bUsed;
+};
+
+struct CachedFaceIndex_t
+{
+	uint64	m_nHash;
+	int		m_iCachedFace;
+};
+
+
+// This run
+static char s_szCacheFile[MAX_PATH];
+static char s_szTempFile[MAX_PATH];
+static uint64 s_nSettingsHash;
+static uint64 s_nTreeHash;
+static uint64 s_nPatchHash;
+static uint64 s_nWorldHash;
+static bool s_bPatchHashesValid;
+static CUtlVector<TraceTriangle_t> s_TraceTriangles;		// sorted by hash
+static CUtlVector<uint64> s_FaceHashes;
+static CUtlVector<uint64> s_FaceLightSignatures;
+static CUtlVector<byte> s_FaceReasons;
+static CUtlVector< CUtlVector<int> > s_FaceSampleClusters;
+static CUtlVector<uint64> s_LightHashes;
+static CUtlVector< CUtlVector<int> > s_ClusterLights;		// the lights in each cluster's PVS
+static CUtlVector<int> s_LightStamps;
+static int s_nLightStamp;
+static FileHandle_t s_hNewCache;
+static bool s_bBounceSaved;
+
+// The previous run
+static CUtlBuffer s_OldCache;
+static bool s_bOldCacheValid;
+static uint64 s_nOldSettingsHash;
+static uint64 s_nOldTreeHash;
+static CUtlVector<TraceTriangle_t> s_OldTraceTriangles;
+static CUtlVector<CachedFace_t> s_OldFaces;
+static uint64 s_nOldPatchHash;
+static uint64 s_nOldWorldHash;
+static int s_nOldPatches;
+static bool s_bOldBounceConverged;
+static int s_nOldBounceOffset;
+static int s_nOldTransfersOffset;
+static CUtlVector<bumplights_t> s_PreviousBounce;
+
+
+//-----------------------------------------------------------------------------
+// Hashing
+//-----------------------------------------------------------------------------
+template<class T> static inline void HashPut( CUtlBuffer &buf, const T &value )
+{
+	buf.Put( &value, sizeof( value ) );
+}
+
+static uint64 HashAndReset( CUtlBuffer &buf )
+{
+	uint64 nHash = MurmurHash64( buf.Base(), buf.TellPut(), LIGHTCACHE_VERSION );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, 0 );
+	return nHash;
+}
+
+static int FaceVertex( dface_t *f, int iEdge )
+{
+	int se = dsurfedges[f->firstedge + iEdge];
+	return ( se < 0 ) ? dedges[-se].v[1] : dedges[se].v[0];
+}
+
+// Everything BuildFacelights looks at on the face itself
+static uint64 HashFace( int iFace, CUtlBuffer &buf )
+{
+	dface_t *f = &g_pFaces[iFace];
+	dplane_t *pPlane = &dplanes[f->planenum];
+	texinfo_t *tx = &texinfo[f->texinfo];
+	dtexdata_t *pTexData = &dtexdata[tx->texdata];
+
+	HashPut( buf, pPlane->normal );
+	HashPut( buf, pPlane->dist );
+	HashPut( buf, f->side );
+	HashPut( buf, f->onNode );
+	HashPut( buf, f->m_LightmapTextureMinsInLuxels );
+	HashPut( buf, f->m_LightmapTextureSizeInLuxels );
+	HashPut( buf, face_offset[iFace] );
+	HashPut( buf, tx->textureVecsTexelsPerWorldUnits );
+	HashPut( buf, tx->lightmapVecsLuxelsPerWorldUnits );
+	HashPut( buf, tx->flags );
+	HashPut( buf, pTexData->reflectivity );
+	buf.PutString( TexDataStringTable_GetString( pTexData->nameStringTableID ) );
+
+	faceneighbor_t *fn = &faceneighbor[iFace];
+	for ( int i = 0; i < f->numedges; i++ )
+	{
+		HashPut( buf, dvertexes[FaceVertex( f, i )].point );
+		if ( fn->normal )
+		{
+			HashPut( buf, fn->normal[i] );
+		}
+	}
+
+	if ( f->dispinfo != -1 )
+	{
+		ddispinfo_t *pDisp = &g_dispinfo[f->dispinfo];
+		HashPut( buf, pDisp->startPosition );
+		HashPut( buf, pDisp->power );
+		HashPut( buf, pDisp->minTess );
+		HashPut( buf, pDisp->smoothingAngle );
+		HashPut( buf, pDisp->contents );
+		HashPut( buf, pDisp->m_AllowedVerts );
+		buf.Put( &g_DispVerts[pDisp->m_iDispVertStart], pDisp->NumVerts() * sizeof( CDispVert ) );
+		buf.Put( &g_DispTris[pDisp->m_iDispTriStart], pDisp->NumTris() * sizeof( CDispTri ) );
+	}
+
+	return HashAndReset( buf );
+}
+
+static uint64 HashLight( directlight_t *dl, CUtlBuffer &buf )
+{
+	// Not the cluster, texinfo or owner, which are indices
+	dworldlight_t *wl = &dl->light;
+	HashPut( buf, wl->origin );
+	HashPut( buf, wl->intensity );
+	HashPut( buf, wl->normal );
+	HashPut( buf, wl->shadow_cast_offset );
+	HashPut( buf, wl->type );
+	HashPut( buf, wl->style );
+	HashPut( buf, wl->stopdot );
+	HashPut( buf, wl->stopdot2 );
+	HashPut( buf, wl->exponent );
+	HashPut( buf, wl->radius );
+	HashPut( buf, wl->constant_attn );
+	HashPut( buf, wl->linear_attn );
+	HashPut( buf, wl->quadratic_attn );
+	HashPut( buf, wl->flags );
+
+	HashPut( buf, dl->snormal );
+	HashPut( buf, dl->tnormal );
+	HashPut( buf, dl->sscale );
+	HashPut( buf, dl->tscale );
+	HashPut( buf, dl->soffset );
+	HashPut( buf, dl->toffset );
+	HashPut( buf, dl->m_bSkyLightIsDirectionalLight );
+	HashPut( buf, dl->m_flSkyLightSunAngularExtent );
+	HashPut( buf, dl->m_flStartFadeDistance );
+	HashPut( buf, dl->m_flEndFadeDistance );
+	HashPut( buf, dl->m_flCapDist );
+
+	return HashAndReset( buf );
+}
+
+// Which cluster a point lands in is all BuildFacelights wants from the tree
+static uint64 HashTree( CUtlBuffer &buf )
+{
+	HashPut( buf, dvis->numclusters );
+	for ( int i = 0; i < numnodes; i++ )
+	{
+		dplane_t *pPlane = &dplanes[dnodes[i].planenum];
+		HashPut( buf, pPlane->normal );
+		HashPut( buf, pPlane->dist );
+		HashPut( buf, dnodes[i].children );
+	}
+	for ( int i = 0; i < numleafs; i++ )
+	{
+		HashPut( buf, dleafs[i].cluster );
+	}
+	return HashAndReset( buf );
+}
+
+static int CompareTraceTriangles( const TraceTriangle_t *a, const TraceTriangle_t *b )
+{
+	if ( a->m_nHash != b->m_nHash )
+		return ( a->m_nHash < b->m_nHash ) ? -1 : 1;
+	return 0;
+}
+
+static int CompareCachedFaceIndices( const CachedFaceIndex_t *a, const CachedFaceIndex_t *b )
+{
+	if ( a->m_nHash != b->m_nHash )
+		return ( a->m_nHash < b->m_nHash ) ? -1 : 1;
+	return a->m_iCachedFace - b->m_iCachedFace;
+}
+
+
+//-----------------------------------------------------------------------------
+// Command line
+//-----------------------------------------------------------------------------
+void LightCache_Init( int argc, char **argv )
+{
+	// These don't change the lighting
+	static const char *s_pIgnoredArgs[] =
+	{
+		"-v", "-verbose", "-low", "-incremental", "-novconfig", "-rederror",
+		"-stoponexit", "-FullMinidumps", "-dump", "-dumpnormals", "-dumptrace",
+	};
+
+	CUtlBuffer buf;
+	HashPut( buf, g_bHDR );
+
+	// The last argument is the map
+	for ( int i = 1; i < argc - 1; i++ )
+	{
+		if ( !Q_stricmp( argv[i], "-threads" ) )
+		{
+			++i;
+			continue;
+		}
+
+		bool bIgnored = false;
+		for ( int j = 0; j < ARRAYSIZE( s_pIgnoredArgs ); j++ )
+		{
+			bIgnored = bIgnored || !Q_stricmp( argv[i], s_pIgnoredArgs[j] );
+		}
+
+		if ( !bIgnored )
+		{
+			char szArg[1024];
+			Q_strncpy( szArg, argv[i], sizeof( szArg ) );
+			Q_strlower( szArg );
+			buf.PutString( szArg );
+		}
+	}
+
+	s_nSettingsHash = HashAndReset( buf );
+}
+
+
+//-----------------------------------------------------------------------------
+// Shadow casters
+//-----------------------------------------------------------------------------
+void LightCache_HashTraceGeometry()
+{
+	int nTriangles = g_RtEnv.OptimizedTriangleList.Count();
+	s_TraceTriangles.SetCount( nTriangles );
+
+	CUtlBuffer buf;
+	for ( int i = 0; i < nTriangles; i++ )
+	{
+		CacheOptimizedTriangle &tri = g_RtEnv.OptimizedTriangleList[i];
+		TraceTriangle_t &entry = s_TraceTriangles[i];
+
+		ClearBounds( entry.m_vecMins, entry.m_vecMaxs );
+		for ( int k = 0; k < 3; k++ )
+		{
+			HashPut( buf, tri.Vertex( k ) );
+			AddPointToBounds( tri.Vertex( k ), entry.m_vecMins, entry.m_vecMaxs );
+		}
+
+		// The low bits of the id are prop and patch indices
+		HashPut( buf, tri.m_Data.m_GeometryData.m_nTriangleID & 0xff000000 );
+		HashPut( buf, tri.m_Data.m_GeometryData.m_nFlags );
+		HashPut( buf, g_RtEnv.TriangleColors[i] );
+		if ( i < g_RtEnv.TriangleMaterials.Count() )
+		{
+			HashPut( buf, g_RtEnv.TriangleMaterials[i] );
+		}
+
+		entry.m_nHash = HashAndReset( buf );
+	}
+
+	s_TraceTriangles.Sort( CompareTraceTriangles );
+}
+
+
+//-----------------------------------------------------------------------------
+// Clusters
+//-----------------------------------------------------------------------------
+void LightCache_RecordSampleClusters()
+{
+	if ( g_bLightCacheRecordClusters )
+		return;
+
+	s_FaceSampleClusters.SetCount( numfaces );
+	g_bLightCacheRecordClusters = true;
+}
+
+void LightCache_NoteSampleClusters( int iFace, const int *pClusters, int nClusters )
+{
+	// Only one thread lights a face
+	CUtlVector<int> &clusters = s_FaceSampleClusters[iFace];
+	for ( int i = 0; i < nClusters; i++ )
+	{
+		if ( clusters.Find( pClusters[i] ) == clusters.InvalidIndex() )
+		{
+			clusters.AddToTail( pClusters[i] );
+		}
+	}
+}
+
+void LightCache_PutSampleClusters( int iFace, CUtlBuffer &buf )
+{
+	CUtlVector<int> &clusters = s_FaceSampleClusters[iFace];
+	buf.PutInt( clusters.Count() );
+	buf.Put( clusters.Base(), clusters.Count() * sizeof( int ) );
+}
+
+bool LightCache_GetSampleClusters( int iFace, CUtlBuffer &buf )
+{
+	CUtlVector<int> &clusters = s_FaceSampleClusters[iFace];
+	int nClusters = buf.GetInt();
+	if ( !buf.IsValid() || nClusters < 0 || nClusters > buf.GetBytesRemaining() / (int)sizeof( int ) )
+		return false;
+
+	clusters.SetCount( nClusters );
+	buf.Get( clusters.Base(), nClusters * sizeof( int ) );
+
+	// Samples outside the map are in cluster -1
+	for ( int i = 0; i < nClusters; i++ )
+	{
+		if ( clusters[i] < -1 || clusters[i] >= dvis->numclusters )
+		{
+			clusters.RemoveAll();
+			return false;
+		}
+	}
+	return buf.IsValid();
+}
+
+// Marks the clusters of every leaf the box touches
+static void MarkClustersInBox_r( int iNode, const Vector &vecCenter, const Vector &vecExtents, CUtlVector<byte> &clusters )
+{
+	while ( iNode >= 0 )
+	{
+		dnode_t *pNode = &dnodes[iNode];
+		dplane_t *pPlane = &dplanes[pNode->planenum];
+
+		float flDist = DotProduct( vecCenter, pPlane->normal ) - pPlane->dist;
+		float flRadius = fabs( vecExtents.x * pPlane->normal.x ) + fabs( vecExtents.y * pPlane->normal.y ) + fabs( vecExtents.z * pPlane->normal.z );
+
+		if ( flDist > flRadius )
+		{
+			iNode = pNode->children[0];
+		}
+		else if ( flDist < -flRadius )
+		{
+			iNode = pNode->children[1];
+		}
+		else
+		{
+			MarkClustersInBox_r( pNode->children[0], vecCenter, vecExtents, clusters );
+			iNode = pNode->children[1];
+		}
+	}
+
+	int iCluster = dleafs[-1 - iNode].cluster;
+	if ( iCluster >= 0 )
+	{
+		clusters[iCluster >> 3] |= 1 << ( iCluster & 7 );
+	}
+}
+
+static void MarkChangedTriangle( const TraceTriangle_t &tri, CUtlVector<byte> &changedClusters )
+{
+	// Pad it so the empty leaves next to it are included
+	Vector vecMins = tri.m_vecMins - Vector( 1, 1, 1 );
+	Vector vecMaxs = tri.m_vecMaxs + Vector( 1, 1, 1 );
+	MarkClustersInBox_r( dmodels[0].headnode, ( vecMins + vecMaxs ) * 0.5f, ( vecMaxs - vecMins ) * 0.5f, changedClusters );
+}
+
+// Finds the clusters that can see a shadow caster that was added, moved or removed.
+// Returns the number of changed triangles.
+static int FindClustersSeeingChanges( CUtlVector<bool> &seesChange )
+{
+	int nClusters = dvis->numclusters;
+	CUtlVector<byte> changedClusters;
+	changedClusters.SetCount( ( nClusters / 8 ) + 1 );
+	memset( changedClusters.Base(), 0, changedClusters.Count() );
+
+	// Both lists are sorted by hash
+	int nChanged = 0;
+	int iOld = 0, iNew = 0;
+	while ( iOld < s_OldTraceTriangles.Count() || iNew < s_TraceTriangles.Count() )
+	{
+		if ( iOld == s_OldTraceTriangles.Count() )
+		{
+			MarkChangedTriangle( s_TraceTriangles[iNew++], changedClusters );
+			++nChanged;
+		}
+		else if ( iNew == s_TraceTriangles.Count() )
+		{
+			MarkChangedTriangle( s_OldTraceTriangles[iOld++], changedClusters );
+			++nChanged;
+		}
+		else if ( s_OldTraceTriangles[iOld].m_nHash == s_TraceTriangles[iNew].m_nHash )
+		{
+			++iOld;
+			++iNew;
+		}
+		else if ( s_OldTraceTriangles[iOld].m_nHash < s_TraceTriangles[iNew].m_nHash )
+		{
+			MarkChangedTriangle( s_OldTraceTriangles[iOld++], changedClusters );
+			++nChanged;
+		}
+		else
+		{
+			MarkChangedTriangle( s_TraceTriangles[iNew++], changedClusters );
+			++nChanged;
+		}
+	}
+
+	seesChange.SetCount( nClusters );
+	byte pvs[MAX_MAP_CLUSTERS/8];
+	for ( int iCluster = 0; iCluster < nClusters; iCluster++ )
+	{
+		seesChange[iCluster] = false;
+		if ( !nChanged )
+			continue;
+
+		GetVisCache( -1, iCluster, pvs );
+		for ( int i = 0; i < changedClusters.Count() && !seesChange[iCluster]; i++ )
+		{
+			seesChange[iCluster] = ( pvs[i] & changedClusters[i] ) != 0;
+		}
+	}
+
+	return nChanged;
+}
+
+
+//-----------------------------------------------------------------------------
+// Lights
+//-----------------------------------------------------------------------------
+static void BuildClusterLights()
+{
+	CUtlBuffer buf;
+	CUtlVector<directlight_t *> lights;
+	for ( directlight_t *dl = activelights; dl != NULL; dl = dl->next )
+	{
+		lights.AddToTail( dl );
+		s_LightHashes.AddToTail( HashLight( dl, buf ) );
+	}
+
+	s_ClusterLights.SetCount( dvis->numclusters );
+	for ( int iCluster = 0; iCluster < dvis->numclusters; iCluster++ )
+	{
+		for ( int i = 0; i < lights.Count(); i++ )
+		{
+			if ( PVSCheck( lights[i]->pvs, iCluster ) )
+			{
+				s_ClusterLights[iCluster].AddToTail( i );
+			}
+		}
+	}
+
+	s_LightStamps.SetCount( lights.Count() );
+	memset( s_LightStamps.Base(), 0, lights.Count() * sizeof( int ) );
+	s_nLightStamp = 0;
+}
+
+// Hashes the set of lights GatherSampleLight will consider for samples in these
+// clusters. The order doesn't matter.
+static uint64 ComputeLightSignature( const int *pClusters, int nClusters )
+{
+	++s_nLightStamp;
+
+	uint64 nSignature = 0;
+	for ( int i = 0; i < nClusters; i++ )
+	{
+		// Samples outside the map see every light (see PVSCheck)
+		if ( pClusters[i] < 0 || pClusters[i] >= s_ClusterLights.Count() )
+		{
+			nSignature = 0;
+			for ( int j = 0; j < s_LightHashes.Count(); j++ )
+			{
+				nSignature += s_LightHashes[j];
+			}
+			return nSignature;
+		}
+
+		CUtlVector<int> &lights = s_ClusterLights[pClusters[i]];
+		for ( int j = 0; j < lights.Count(); j++ )
+		{
+			if ( s_LightStamps[lights[j]] != s_nLightStamp )
+			{
+				s_LightStamps[lights[j]] = s_nLightStamp;
+				nSignature += s_LightHashes[lights[j]];
+			}
+		}
+	}
+	return nSignature;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reading the previous run's cache
+//-----------------------------------------------------------------------------
+static bool SkipBytes( CUtlBuffer &buf, int nBytes )
+{
+	if ( nBytes < 0 || nBytes > buf.GetBytesRemaining() )
+		return false;
+
+	buf.SeekGet( CUtlBuffer::SEEK_CURRENT, nBytes );
+	return true;
+}
+
+static bool ParseCache()
+{
+	CUtlBuffer &buf = s_OldCache;
+
+	if ( buf.GetInt() != LIGHTCACHE_ID || buf.GetInt() != LIGHTCACHE_VERSION )
+		return false;
+
+	buf.Get( &s_nOldSettingsHash, sizeof( s_nOldSettingsHash ) );
+	buf.Get( &s_nOldTreeHash, sizeof( s_nOldTreeHash ) );
+
+	int nTriangles = buf.GetInt();
+	if ( !buf.IsValid() || nTriangles < 0 || nTriangles > buf.GetBytesRemaining() / (int)sizeof( TraceTriangle_t ) )
+		return false;
+
+	s_OldTraceTriangles.SetCount( nTriangles );
+	buf.Get( s_OldTraceTriangles.Base(), nTriangles * sizeof( TraceTriangle_t ) );
+
+	int nFaces = buf.GetInt();
+	if ( !buf.IsValid() || nFaces < 0 || nFaces > buf.GetBytesRemaining() / 32 )
+		return false;
+
+	s_OldFaces.SetCount( nFaces );
+	for ( int i = 0; i < nFaces; i++ )
+	{
+		CachedFace_t &face = s_OldFaces[i];
+		buf.Get( &face.m_nHash, sizeof( face.m_nHash ) );
+		buf.Get( &face.m_nLightSignature, sizeof( face.m_nLightSignature ) );
+		buf.Get( face.m_Styles, sizeof( face.m_Styles ) );
+		face.m_bUsed = false;
+
+		face.m_nClusters = buf.GetInt();
+		face.m_nClusterOffset = buf.TellGet();
+		if ( !buf.IsValid() || !SkipBytes( buf, face.m_nClusters * sizeof( int ) ) )
+			return false;
+
+		face.m_nDataSize = buf.GetInt();
+		face.m_nDataOffset = buf.TellGet();
+		if ( !buf.IsValid() || !SkipBytes( buf, face.m_nDataSize ) )
+			return false;
+	}
+
+	buf.Get( &s_nOldPatchHash, sizeof( s_nOldPatchHash ) );
+	buf.Get( &s_nOldWorldHash, sizeof( s_nOldWorldHash ) );
+	s_nOldPatches = buf.GetInt();
+	s_bOldBounceConverged = buf.GetUnsignedChar() != 0;
+	s_nOldBounceOffset = buf.TellGet();
+	if ( !buf.IsValid() || s_nOldPatches < 0 || !SkipBytes( buf, s_nOldPatches * sizeof( bumplights_t ) ) )
+		return false;
+
+	s_nOldTransfersOffset = -1;
+	if ( buf.GetUnsignedChar() )
+	{
+		s_nOldTransfersOffset = buf.TellGet();
+	}
+
+	return buf.IsValid();
+}
+
+static void LoadCache()
+{
+	s_bOldCacheValid = false;
+	if ( !g_pFileSystem->FileExists( s_szCacheFile ) )
+	{
+		Msg( "No light cache at %s yet, lighting every face.\n", s_szCacheFile );
+		return;
+	}
+
+	if ( !g_pFileSystem->ReadFile( s_szCacheFile, NULL, s_OldCache ) || !ParseCache() )
+	{
+		Warning( "Ignoring the light cache at %s, it's from another version of vrad or corrupt.\n", s_szCacheFile );
+		s_OldFaces.Purge();
+		s_OldTraceTriangles.Purge();
+		s_OldCache.Purge();
+		return;
+	}
+
+	s_bOldCacheValid = true;
+}
+
+// Finds an unused cached face with this hash
+static CachedFace_t *FindCachedFace( const CUtlVector<CachedFaceIndex_t> &index, uint64 nHash )
+{
+	int nLow = 0, nHigh = index.Count();
+	while ( nLow < nHigh )
+	{
+		int nMid = ( nLow + nHigh ) / 2;
+		if ( index[nMid].m_nHash < nHash )
+		{
+			nLow = nMid + 1;
+		}
+		else
+		{
+			nHigh = nMid;
+		}
+	}
+
+	for ( int i = nLow; i < index.Count() && index[i].m_nHash == nHash; i++ )
+	{
+		CachedFace_t *pFace = &s_OldFaces[index[i].m_iCachedFace];
+		if ( !pFace->m_bUsed )
+			return pFace;
+	}
+	return NULL;
+}
+
+static bool FaceNeedsLighting( int iFace )
+{
+	// The same early outs as BuildFacelights
+	if ( texinfo[g_pFaces[iFace].texinfo].flags & TEX_SPECIAL )
+		return false;
+
+	return g_FacePatches.Element( iFace ) != g_FacePatches.InvalidIndex();
+}
+
+static void RestoreFace( int iFace, CachedFace_t *pCached )
+{
+	dface_t *f = &g_pFaces[iFace];
+	f->lightofs = -1;
+	memcpy( f->styles, pCached->m_Styles, sizeof( f->styles ) );
+
+	s_OldCache.SeekGet( CUtlBuffer::SEEK_HEAD, pCached->m_nDataOffset );
+	if ( !UnserializeFaceLight( &facelight[iFace], s_OldCache ) || s_OldCache.TellGet() != pCached->m_nDataOffset + pCached->m_nDataSize )
+	{
+		Error( "The light cache at %s is corrupt, delete it and run vrad again.\n", s_szCacheFile );
+	}
+
+	CUtlVector<int> &clusters = s_FaceSampleClusters[iFace];
+	clusters.SetCount( pCached->m_nClusters );
+	s_OldCache.SeekGet( CUtlBuffer::SEEK_HEAD, pCached->m_nClusterOffset );
+	s_OldCache.Get( clusters.Base(), pCached->m_nClusters * sizeof( int ) );
+
+	pCached->m_bUsed = true;
+}
+
+void LightCache_Begin( CUtlVector<int> &facesToLight )
+{
+	LightCache_RecordSampleClusters();
+
+	char szBase[MAX_PATH];
+	Q_StripExtension( source, szBase, sizeof( szBase ) );
+	Q_snprintf( s_szCacheFile, sizeof( s_szCacheFile ), "%s%s.lightcache", szBase, g_bHDR ? "_hdr" : "" );
+	Q_snprintf( s_szTempFile, sizeof( s_szTempFile ), "%s.tmp", s_szCacheFile );
+
+	CUtlBuffer buf;
+	s_nTreeHash = HashTree( buf );
+	s_FaceHashes.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		s_FaceHashes[i] = HashFace( i, buf );
+	}
+
+	BuildClusterLights();
+	LoadCache();
+
+	LightCacheReason_t reasonForAll = LIGHTCACHE_REUSED;
+	if ( !s_bOldCacheValid )
+	{
+		reasonForAll = LIGHTCACHE_NO_CACHE;
+	}
+	else if ( s_nOldSettingsHash != s_nSettingsHash )
+	{
+		reasonForAll = LIGHTCACHE_SETTINGS;
+	}
+	else if ( s_nOldTreeHash != s_nTreeHash )
+	{
+		// The cached sample clusters would be wrong
+		reasonForAll = LIGHTCACHE_BSP_TREE;
+	}
+
+	CUtlVector<bool> seesChange;
+	CUtlVector<CachedFaceIndex_t> index;
+	int nChangedTriangles = 0;
+	if ( reasonForAll == LIGHTCACHE_REUSED )
+	{
+		nChangedTriangles = FindClustersSeeingChanges( seesChange );
+
+		index.SetCount( s_OldFaces.Count() );
+		for ( int i = 0; i < s_OldFaces.Count(); i++ )
+		{
+			index[i].m_nHash = s_OldFaces[i].m_nHash;
+			index[i].m_iCachedFace = i;
+		}
+		index.Sort( CompareCachedFaceIndices );
+	}
+
+	s_FaceReasons.SetCount( numfaces );
+	s_FaceLightSignatures.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		LightCacheReason_t reason = reasonForAll;
+		CachedFace_t *pCached = NULL;
+
+		if ( !FaceNeedsLighting( i ) )
+		{
+			reason = LIGHTCACHE_UNLIT;
+		}
+		else if ( reason == LIGHTCACHE_REUSED )
+		{
+			pCached = FindCachedFace( index, s_FaceHashes[i] );
+			if ( !pCached )
+			{
+				reason = LIGHTCACHE_NEW_FACE;
+			}
+			else
+			{
+				// The face is the same, so its samples land in the same clusters as last time
+				int *pClusters = (int *)( (byte *)s_OldCache.Base() + pCached->m_nClusterOffset );
+				s_FaceLightSignatures[i] = ComputeLightSignature( pClusters, pCached->m_nClusters );
+				if ( s_FaceLightSignatures[i] != pCached->m_nLightSignature )
+				{
+					reason = LIGHTCACHE_LIGHTS;
+				}
+
+				for ( int j = 0; j < pCached->m_nClusters && reason == LIGHTCACHE_REUSED; j++ )
+				{
+					int iCluster = pClusters[j];
+					bool bOutside = iCluster < 0 || iCluster >= seesChange.Count();
+					if ( bOutside ? ( nChangedTriangles != 0 ) : seesChange[iCluster] )
+					{
+						reason = LIGHTCACHE_GEOMETRY;
+					}
+				}
+			}
+		}
+
+		s_FaceReasons[i] = reason;
+		if ( reason == LIGHTCACHE_REUSED )
+		{
+			RestoreFace( i, pCached );
+		}
+		else
+		{
+			facesToLight.AddToTail( i );
+		}
+	}
+
+	// Whatever's left of the cache is the bounce data
+	s_OldTraceTriangles.Purge();
+	s_OldFaces.Purge();
+
+	int nCounts[LIGHTCACHE_NUM_REASONS] = { 0 };
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		nCounts[s_FaceReasons[i]]++;
+	}
+
+	int nLitFaces = numfaces - nCounts[LIGHTCACHE_UNLIT];
+	Msg( "Light cache: reusing %d of %d lit faces", nCounts[LIGHTCACHE_REUSED], nLitFaces );
+	if ( nChangedTriangles )
+	{
+		Msg( ", %d shadow-casting triangles changed", nChangedTriangles );
+	}
+	Msg( "\n" );
+	for ( int i = LIGHTCACHE_REUSED + 1; i < LIGHTCACHE_UNLIT; i++ )
+	{
+		if ( nCounts[i] )
+		{
+			Msg( "    %6d relit: %s\n", nCounts[i], s_pReasonNames[i] );
+		}
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Writing this run's cache
+//-----------------------------------------------------------------------------
+static void WriteToCache( CUtlBuffer &buf )
+{
+	if ( s_hNewCache && buf.TellPut() )
+	{
+		if ( g_pFileSystem->Write( buf.Base(), buf.TellPut(), s_hNewCache ) != buf.TellPut() )
+		{
+			Warning( "Couldn't write the light cache to %s.\n", s_szTempFile );
+			g_pFileSystem->Close( s_hNewCache );
+			g_pFullFileSystem->RemoveFile( s_szTempFile );
+			s_hNewCache = NULL;
+		}
+	}
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, 0 );
+}
+
+void LightCache_SaveFaceLights()
+{
+	s_hNewCache = g_pFileSystem->Open( s_szTempFile, "wb" );
+	if ( !s_hNewCache )
+	{
+		Warning( "Couldn't open %s, the light cache won't be updated.\n", s_szTempFile );
+		return;
+	}
+	s_bBounceSaved = false;
+
+	CUtlBuffer buf;
+	buf.PutInt( LIGHTCACHE_ID );
+	buf.PutInt( LIGHTCACHE_VERSION );
+	HashPut( buf, s_nSettingsHash );
+	HashPut( buf, s_nTreeHash );
+	buf.PutInt( s_TraceTriangles.Count() );
+	buf.Put( s_TraceTriangles.Base(), s_TraceTriangles.Count() * sizeof( TraceTriangle_t ) );
+
+	int nLitFaces = 0;
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		nLitFaces += ( s_FaceReasons[i] != LIGHTCACHE_UNLIT );
+	}
+	buf.PutInt( nLitFaces );
+	WriteToCache( buf );
+
+	CUtlBuffer data;
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		if ( s_FaceReasons[i] == LIGHTCACHE_UNLIT )
+			continue;
+
+		CUtlVector<int> &clusters = s_FaceSampleClusters[i];
+		if ( s_FaceReasons[i] != LIGHTCACHE_REUSED )
+		{
+			s_FaceLightSignatures[i] = ComputeLightSignature( clusters.Base(), clusters.Count() );
+		}
+
+		HashPut( buf, s_FaceHashes[i] );
+		HashPut( buf, s_FaceLightSignatures[i] );
+		buf.Put( g_pFaces[i].styles, sizeof( g_pFaces[i].styles ) );
+		LightCache_PutSampleClusters( i, buf );
+
+		SerializeFaceLight( &facelight[i], data );
+		buf.PutInt( data.TellPut() );
+		buf.Put( data.Base(), data.TellPut() );
+		data.SeekPut( CUtlBuffer::SEEK_HEAD, 0 );
+
+		WriteToCache( buf );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// Bouncing
+//-----------------------------------------------------------------------------
+static void ComputePatchHashes()
+{
+	if ( s_bPatchHashesValid )
+		return;
+
+	CUtlBuffer buf;
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+		HashPut( buf, patch->origin );
+		HashPut( buf, patch->normal );
+		HashPut( buf, patch->area );
+		HashPut( buf, patch->reflectivity );
+		HashPut( buf, patch->parent );
+		HashPut( buf, patch->child1 );
+		HashPut( buf, patch->child2 );
+		HashPut( buf, patch->clusterNumber );
+		HashPut( buf, patch->staticPropIdx );
+		HashPut( buf, ( patch->faceNumber >= 0 ) ? s_FaceHashes[patch->faceNumber] : 0 );
+
+		bool bSky = patch->sky, bNeedsBumpmap = patch->needsBumpmap;
+		HashPut( buf, bSky );
+		HashPut( buf, bNeedsBumpmap );
+	}
+	s_nPatchHash = HashAndReset( buf );
+
+	// The transfers depend on all the patches, everything that can block them and vis
+	HashPut( buf, s_nSettingsHash );
+	HashPut( buf, s_nTreeHash );
+	HashPut( buf, s_nPatchHash );
+	for ( int i = 0; i < s_TraceTriangles.Count(); i++ )
+	{
+		HashPut( buf, s_TraceTriangles[i].m_nHash );
+	}
+	buf.Put( dvisdata, visdatasize );
+	s_nWorldHash = HashAndReset( buf );
+
+	s_bPatchHashesValid = true;
+}
+
+bool LightCache_LoadTransfers()
+{
+	ComputePatchHashes();
+
+	if ( !s_bOldCacheValid || s_nOldTransfersOffset < 0 || s_nOldWorldHash != s_nWorldHash || s_nOldPatches != g_Patches.Count() )
+		return false;
+
+	CUtlBuffer &buf = s_OldCache;
+	buf.SeekGet( CUtlBuffer::SEEK_HEAD, s_nOldTransfersOffset );
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+		int nTransfers = buf.GetInt();
+		if ( !buf.IsValid() || nTransfers < 0 || nTransfers > buf.GetBytesRemaining() / (int)sizeof( transfer_t ) )
+			Error( "The light cache at %s is corrupt, delete it and run vrad again.\n", s_szCacheFile );
+
+		patch->numtransfers = nTransfers;
+		if ( nTransfers )
+		{
+			patch->transfers = (transfer_t *)calloc( nTransfers, sizeof( transfer_t ) );
+			if ( !patch->transfers )
+				Error( "Memory allocation failure" );
+
+			buf.Get( patch->transfers, nTransfers * sizeof( transfer_t ) );
+		}
+
+		total_transfer += nTransfers;
+		max_transfer = Max( max_transfer, nTransfers );
+	}
+
+	Msg( "transfers %d, max %d (from the light cache)\n", total_transfer, max_transfer );
+	return true;
+}
+
+const bumplights_t *LightCache_GetPreviousBounce()
+{
+	ComputePatchHashes();
+
+	// Only a converged solution is a good starting point, since -bounce <n> asks for
+	// exactly n bounces otherwise
+	if ( !s_bOldCacheValid || !s_bOldBounceConverged || s_nOldSettingsHash != s_nSettingsHash ||
+		 s_nOldPatchHash != s_nPatchHash || s_nOldPatches != g_Patches.Count() )
+		return NULL;
+
+	s_PreviousBounce.SetCount( s_nOldPatches );
+	s_OldCache.SeekGet( CUtlBuffer::SEEK_HEAD, s_nOldBounceOffset );
+	s_OldCache.Get( s_PreviousBounce.Base(), s_nOldPatches * sizeof( bumplights_t ) );
+
+	Msg( "Bouncing from the cached solution\n" );
+	return s_PreviousBounce.Base();
+}
+
+static void SaveBounceSection( bool bConverged, bool bSavePatches )
+{
+	CUtlBuffer buf;
+	int nPatches = bSavePatches ? g_Patches.Count() : 0;
+	HashPut( buf, bSavePatches ? s_nPatchHash : 0 );
+	HashPut( buf, bSavePatches ? s_nWorldHash : 0 );
+	buf.PutInt( nPatches );
+	buf.PutUnsignedChar( bConverged );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		HashPut( buf, g_Patches[i].totallight );
+	}
+
+	buf.PutUnsignedChar( bSavePatches );
+	for ( int i = 0; i < nPatches; i++ )
+	{
+		CPatch *patch = &g_Patches[i];
+		buf.PutInt( patch->numtransfers );
+		buf.Put( patch->transfers, patch->numtransfers * sizeof( transfer_t ) );
+
+		if ( buf.TellPut() > 16 * 1024 * 1024 )
+		{
+			WriteToCache( buf );
+		}
+	}
+
+	WriteToCache( buf );
+	s_bBounceSaved = true;
+}
+
+void LightCache_SaveBounce( bool bConverged )
+{
+	ComputePatchHashes();
+	SaveBounceSection( bConverged, true );
+}
+
+
+//-----------------------------------------------------------------------------
+// Report
+//-----------------------------------------------------------------------------
+static void WriteReport()
+{
+	char szReport[MAX_PATH];
+	Q_snprintf( szReport, sizeof( szReport ), "%s.log", s_szCacheFile );
+
+	FileHandle_t hReport = g_pFileSystem->Open( szReport, "w" );
+	if ( !hReport )
+	{
+		Warning( "Couldn't write the light cache report to %s.\n", szReport );
+		return;
+	}
+
+	int nRelit = 0;
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		nRelit += ( s_FaceReasons[i] != LIGHTCACHE_REUSED && s_FaceReasons[i] != LIGHTCACHE_UNLIT );
+	}
+
+	CmdLib_FPrintf( hReport, "%s: %d faces relit\n\n", source, nRelit );
+	CmdLib_FPrintf( hReport, "face   center                          reason\n" );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		if ( s_FaceReasons[i] == LIGHTCACHE_REUSED || s_FaceReasons[i] == LIGHTCACHE_UNLIT )
+			continue;
+
+		dface_t *f = &g_pFaces[i];
+		Vector vecCenter( 0, 0, 0 );
+		for ( int j = 0; j < f->numedges; j++ )
+		{
+			vecCenter += dvertexes[FaceVertex( f, j )].point;
+		}
+		vecCenter /= Max( (int)f->numedges, 1 );
+
+		CmdLib_FPrintf( hReport, "%-6d %9.1f %9.1f %9.1f    %s\n", i, vecCenter.x, vecCenter.y, vecCenter.z, s_pReasonNames[s_FaceReasons[i]] );
+	}
+
+	g_pFileSystem->Close( hReport );
+}
+
+void LightCache_End()
+{
+	if ( s_hNewCache )
+	{
+		// No bounce (-bounce 0), so nothing to start from next time
+		if ( !s_bBounceSaved )
+		{
+			SaveBounceSection( false, false );
+		}
+
+		g_pFileSystem->Close( s_hNewCache );
+		s_hNewCache = NULL;
+
+		g_pFullFileSystem->RemoveFile( s_szCacheFile );
+		if ( !g_pFullFileSystem->RenameFile( s_szTempFile, s_szCacheFile ) )
+		{
+			Warning( "Couldn't rename %s to %s.\n", s_szTempFile, s_szCacheFile );
+		}
+	}
+
+	WriteReport();
+
+	s_OldCache.Purge();
+	s_PreviousBounce.Purge();
+	s_ClusterLights.Purge();
+	s_FaceSampleClusters.Purge();
+	g_bLightCacheRecordClusters = false;
+}
@@ -0,0 +1,65 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: Keeps the direct lighting of every face, the radiosity transfers
+//			and the bounced light between runs (-incremental), so a rerun
+//			only relights the faces whose lights or surroundings changed.
+//
+//			A face's cached lighting is reused when the face itself is the
+//			same, the lights that are in the PVS of its samples are the
+//			same, and none of the shadow-casting geometry in that PVS
+//			changed. Bouncing restarts from the previous solution when the
+//			patches are the same, and the transfers are reused when the
+//			whole world is.
+//
+//=============================================================================//
+
+#ifndef LIGHTCACHE_H
+#define LIGHTCACHE_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+#include "tier1/utlvector.h"
+#include "tier1/utlbuffer.h"
+
+
+extern bool g_bLightCache;					// -incremental was given (false in pool workers)
+extern bool g_bLightCacheRecordClusters;	// remember the clusters each face's samples fall in
+
+// Hashes the lighting options on the command line.
+void LightCache_Init( int argc, char **argv );
+
+// Hashes the shadow casters. Call this after everything has been added to g_RtEnv,
+// but before its acceleration structure is built.
+void LightCache_HashTraceGeometry();
+
+// Loads the previous run's cache, restores the lighting of every face that is still
+// valid and returns the faces that have to be lit.
+void LightCache_Begin( CUtlVector<int> &facesToLight );
+
+// Called by BuildFacelights for every group of samples.
+void LightCache_RecordSampleClusters();
+void LightCache_NoteSampleClusters( int iFace, const int *pClusters, int nClusters );
+
+// The worker pool sends the clusters back along with the face. Get returns false if
+// they're malformed or name a cluster the map doesn't have.
+void LightCache_PutSampleClusters( int iFace, CUtlBuffer &buf );
+bool LightCache_GetSampleClusters( int iFace, CUtlBuffer &buf );
+
+// Writes out the direct lighting. Call this before BuildPatchLights adds the ambient term.
+void LightCache_SaveFaceLights();
+
+// Restores the transfers if the world hasn't changed, in place of MakeAllScales.
+bool LightCache_LoadTransfers();
+
+// The previous run's bounced light for each patch, or NULL if the patches changed.
+const bumplights_t *LightCache_GetPreviousBounce();
+
+// Writes out the transfers and the bounced light. Call this right after BounceLight.
+void LightCache_SaveBounce( bool bConverged );
+
+// Finishes the cache file and writes the report of which faces were relit and why.
+void LightCache_End();
+
+
+#endif // LIGHTCACHE_H
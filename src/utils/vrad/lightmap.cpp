@@ -2711,6 +2711,9 @@ static void ComputeIlluminationPointAndNormalsSSE( lightinfo_t const& l, FourVec
 	// TODO: this may slow things down a bit ( using Vec )
 	for ( int i = 0; i < 4; ++i )
 		pInfo->m_Clusters[i] = ClusterFromPoint( pos.Vec( i ) );
+
+	if ( g_bLightCacheRecordClusters )
+		LightCache_NoteSampleClusters( pInfo->m_FaceNum, pInfo->m_Clusters, 4 );
 }
 
 //-----------------------------------------------------------------------------
@@ -2749,6 +2752,9 @@ static void ComputeIlluminationPointAndNormalsForDisp( lightinfo_t const& l, Fou
 	// TODO: this may slow things down a bit ( using Vec )
 	for ( int j = 0; j < 4; j++ )
 		pInfo->m_Clusters[ j ] = ClusterFromPoint( pos.Vec( j ) );
+
+	if ( g_bLightCacheRecordClusters )
+		LightCache_NoteSampleClusters( pInfo->m_FaceNum, pInfo->m_Clusters, 4 );
 }
 
 //-----------------------------------------------------------------------------
@@ -3517,10 +3523,11 @@ void BuildFacelights (int iThread, int facenum)
 		}
 	}
 
-	if (!g_bUseMPI) 
+	if ( !g_bUseMPI && !g_bWorkerPool && !g_bLightCache ) 
 	{
 		//
-		// This is done on the master node when MPI is used
+		// This is done on the master node when MPI or the worker pool is used,
+		// and after the light cache has been written with -incremental
 		//
 		BuildPatchLights( facenum );
 	}
@@ -3536,6 +3543,100 @@ void BuildFacelights (int iThread, int facenum)
 
 }
 
+//-----------------------------------------------------------------------------
+// Moves a face's direct lighting between processes and runs
+//-----------------------------------------------------------------------------
+template<class T> static void PutFaceLightValues( CUtlBuffer &buf, T const *pSrc, int nNumValues )
+{
+	buf.Put( pSrc, sizeof( pSrc[0] ) * nNumValues );
+}
+
+template<class T> static T *GetFaceLightValues( CUtlBuffer &buf, int nNumValues )
+{
+	T *pDest = (T *)calloc( nNumValues, sizeof( T ) );
+	buf.Get( pDest, sizeof( T ) * nNumValues );
+	return pDest;
+}
+
+void SerializeFaceLight( facelight_t *fl, CUtlBuffer &buf )
+{
+	buf.Put( fl, sizeof( facelight_t ) );
+	PutFaceLightValues( buf, fl->sample, fl->numsamples );
+
+	for ( int i = 0; i < MAXLIGHTMAPS; ++i )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; ++n )
+		{
+			if ( fl->light[i][n] )
+			{
+				PutFaceLightValues( buf, fl->light[i][n], fl->numsamples );
+			}
+		}
+	}
+
+	if ( fl->luxel )
+		PutFaceLightValues( buf, fl->luxel, fl->numluxels );
+
+	if ( fl->luxelNormals )
+		PutFaceLightValues( buf, fl->luxelNormals, fl->numluxels );
+}
+
+bool UnserializeFaceLight( facelight_t *fl, CUtlBuffer &buf )
+{
+	buf.Get( fl, sizeof( facelight_t ) );
+	if ( !buf.IsValid() || fl->numsamples < 0 || fl->numluxels < 0 )
+	{
+		memset( fl, 0, sizeof( facelight_t ) );
+		return false;
+	}
+
+	// Don't allocate anything the buffer can't hold
+	int64 nBytes = (int64)fl->numsamples * sizeof( sample_t );
+	for ( int i = 0; i < MAXLIGHTMAPS; ++i )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; ++n )
+		{
+			if ( fl->light[i][n] )
+			{
+				nBytes += (int64)fl->numsamples * sizeof( LightingValue_t );
+			}
+		}
+	}
+	nBytes += ( fl->luxel ) ? (int64)fl->numluxels * sizeof( Vector ) : 0;
+	nBytes += ( fl->luxelNormals ) ? (int64)fl->numluxels * sizeof( Vector ) : 0;
+	if ( nBytes > buf.GetBytesRemaining() )
+	{
+		memset( fl, 0, sizeof( facelight_t ) );
+		return false;
+	}
+
+	// The pointers are from another process; non-NULL just says the array follows
+	fl->sample = GetFaceLightValues<sample_t>( buf, fl->numsamples );
+	for ( int i = 0; i < fl->numsamples; ++i )
+	{
+		fl->sample[i].w = NULL;
+	}
+
+	for ( int i = 0; i < MAXLIGHTMAPS; ++i )
+	{
+		for ( int n = 0; n < NUM_BUMP_VECTS+1; ++n )
+		{
+			if ( fl->light[i][n] )
+			{
+				fl->light[i][n] = GetFaceLightValues<LightingValue_t>( buf, fl->numsamples );
+			}
+		}
+	}
+
+	if ( fl->luxel )
+		fl->luxel = GetFaceLightValues<Vector>( buf, fl->numluxels );
+
+	if ( fl->luxelNormals )
+		fl->luxelNormals = GetFaceLightValues<Vector>( buf, fl->numluxels );
+
+	return buf.IsValid();
+}
+
 void BuildPatchLights( int facenum )
 {
 	int i, k;
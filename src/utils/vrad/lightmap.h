@@ -18,6 +18,8 @@
 #include "mathlib/bumpvects.h"
 #include "bsplib.h"
 
+class CUtlBuffer;
+
 typedef struct
 {
 	dface_t		*faces[2];
@@ -137,6 +139,11 @@ void FreeDLights();
 
 void ExportDirectLightsToWorldLights();
 
+// Copies a face's direct lighting to and from a buffer. The sample windings are
+// left out.
+void SerializeFaceLight( facelight_t *fl, CUtlBuffer &buf );
+bool UnserializeFaceLight( facelight_t *fl, CUtlBuffer &buf );
+
 float CalculateAmbientOcclusion( Vector *pPosition, Vector *pNormal );
 fltx4 CalculateAmbientOcclusion4( const FourVectors &position4, const FourVectors &normal4, int static_prop_index_to_ignore );
 
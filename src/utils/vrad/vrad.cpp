@@ -20,6 +20,7 @@
 #include "loadcmdline.h"
 #include "byteswap.h"
 #include "iscratchpad3d.h"
+#include "vstdlib/random.h"
 
 #define ALLOWDEBUGOPTIONS (0 || _DEBUG)
 
@@ -58,6 +59,7 @@ float		g_MaxDispPatchRadius = 1500.0f;			// Maximum radius allowed for displacem
 qboolean	g_bDumpPatches;
 bool	    bDumpNormals = false;
 bool		g_bDumpRtEnv = false;
+bool		g_bRayTraceBenchmark = false;
 bool		bRed2Black = true;
 bool		g_bFastAmbient = false;
 bool        g_bNoSkyRecurse = false;
@@ -1363,6 +1365,104 @@ void WriteRTEnv (char *name)
 	g_pFileSystem->Close( out );
 }
 
+//-----------------------------------------------------------------------------
+// -raytracebench: traces the same packets of rays through the map with the
+// 4-wide and the 8-wide tracer and reports the throughput of each.
+//-----------------------------------------------------------------------------
+#define RAYTRACE_BENCH_PACKETS		( 256 * 1024 )
+#define RAYTRACE_BENCH_JITTER		16.0f
+
+static void RayTraceBenchmark()
+{
+	// Packets of 8 nearly parallel rays, like a group of neighbouring luxels
+	// tracing towards a light.
+	CUtlVector<FourRays> rays;
+	CUtlVector<fltx4> rayLengths;
+	CUtlVector<int> signMasks;
+	rays.SetCount( 2 * RAYTRACE_BENCH_PACKETS );
+	rayLengths.SetCount( 2 * RAYTRACE_BENCH_PACKETS );
+	signMasks.SetCount( RAYTRACE_BENCH_PACKETS );
+
+	CUniformRandomStream random;
+	random.SetSeed( 1 );
+	const Vector &vecMins = g_RtEnv.m_MinBound;
+	const Vector &vecMaxs = g_RtEnv.m_MaxBound;
+	for ( int p = 0; p < RAYTRACE_BENCH_PACKETS; p++ )
+	{
+		Vector vecOrigin( random.RandomFloat( vecMins.x, vecMaxs.x ), random.RandomFloat( vecMins.y, vecMaxs.y ), random.RandomFloat( vecMins.z, vecMaxs.z ) );
+		Vector vecTarget( random.RandomFloat( vecMins.x, vecMaxs.x ), random.RandomFloat( vecMins.y, vecMaxs.y ), random.RandomFloat( vecMins.z, vecMaxs.z ) );
+		for ( int r = 0; r < 8; r++ )
+		{
+			FourRays &bundle = rays[2 * p + ( r >> 2 )];
+			int nLane = r & 3;
+			Vector vecStart = vecOrigin + Vector( random.RandomFloat( -RAYTRACE_BENCH_JITTER, RAYTRACE_BENCH_JITTER ), random.RandomFloat( -RAYTRACE_BENCH_JITTER, RAYTRACE_BENCH_JITTER ), random.RandomFloat( -RAYTRACE_BENCH_JITTER, RAYTRACE_BENCH_JITTER ) );
+			Vector vecDir = vecTarget - vecStart;
+			float flLength = VectorNormalize( vecDir );
+			bundle.origin.X( nLane ) = vecStart.x;
+			bundle.origin.Y( nLane ) = vecStart.y;
+			bundle.origin.Z( nLane ) = vecStart.z;
+			bundle.direction.X( nLane ) = vecDir.x;
+			bundle.direction.Y( nLane ) = vecDir.y;
+			bundle.direction.Z( nLane ) = vecDir.z;
+			SubFloat( rayLengths[2 * p + ( r >> 2 )], nLane ) = flLength;
+		}
+
+		int nMask0 = rays[2 * p].CalculateDirectionSignMask();
+		int nMask1 = rays[2 * p + 1].CalculateDirectionSignMask();
+		signMasks[p] = ( nMask0 == nMask1 ) ? nMask0 : -1;
+	}
+
+	CUtlVector<int32> hits4, hits8;
+	hits4.SetCount( 8 * RAYTRACE_BENCH_PACKETS );
+	hits8.SetCount( 8 * RAYTRACE_BENCH_PACKETS );
+	fltx4 zeros[2] = { Four_Zeros, Four_Zeros };
+	RayTracingResult results[2];
+
+	double flStart = Plat_FloatTime();
+	for ( int p = 0; p < RAYTRACE_BENCH_PACKETS; p++ )
+	{
+		for ( int b = 0; b < 2; b++ )
+		{
+			g_RtEnv.Trace4Rays( rays[2 * p + b], Four_Zeros, rayLengths[2 * p + b], &results[b] );
+			memcpy( &hits4[8 * p + 4 * b], results[b].HitIds, 4 * sizeof( int32 ) );
+		}
+	}
+	double flTime4 = Plat_FloatTime() - flStart;
+
+	flStart = Plat_FloatTime();
+	for ( int p = 0; p < RAYTRACE_BENCH_PACKETS; p++ )
+	{
+		if ( signMasks[p] != -1 )
+		{
+			g_RtEnv.Trace8Rays( &rays[2 * p], zeros, &rayLengths[2 * p], signMasks[p], results );
+		}
+		else
+		{
+			g_RtEnv.Trace4Rays( rays[2 * p], Four_Zeros, rayLengths[2 * p], &results[0] );
+			g_RtEnv.Trace4Rays( rays[2 * p + 1], Four_Zeros, rayLengths[2 * p + 1], &results[1] );
+		}
+		memcpy( &hits8[8 * p], results[0].HitIds, 4 * sizeof( int32 ) );
+		memcpy( &hits8[8 * p + 4], results[1].HitIds, 4 * sizeof( int32 ) );
+	}
+	double flTime8 = Plat_FloatTime() - flStart;
+
+	int nMismatches = 0;
+	for ( int i = 0; i < hits4.Count(); i++ )
+	{
+		if ( hits4[i] != hits8[i] )
+			nMismatches++;
+	}
+
+	float flRays = 8.0f * RAYTRACE_BENCH_PACKETS;
+	Msg( "\nRay trace benchmark: %d triangles, %d kd-tree nodes, %d rays in packets of 8, 1 thread\n",
+		g_RtEnv.OptimizedTriangleList.Count(), g_RtEnv.OptimizedKDTree.Count(), (int)flRays );
+	Msg( "  Trace4Rays x2 : %6.2f s, %6.2f Mrays/s\n", flTime4, flRays / flTime4 * 1.0e-6f );
+	Msg( "  Trace8Rays    : %6.2f s, %6.2f Mrays/s (%s)\n", flTime8, flRays / flTime8 * 1.0e-6f,
+		RayTracingEnvironment::IsUsingWidePackets() ? "AVX2" : "no AVX2, two 4-wide traces" );
+	if ( nMismatches )
+		Warning( "  %d rays hit a different triangle with the 8-wide tracer!\n", nMismatches );
+}
+
 void WriteWinding (FileHandle_t out, winding_t *w, Vector& color )
 {
 	int			i;
@@ -1674,12 +1774,30 @@ void GatherLight (int threadnum, void *pUserData)
 #endif
 
 
+static void SumBounceChange( Vector &total )
+{
+	// A restarted bounce sends out corrections, which can be negative
+	VectorFill( total, 0 );
+	for ( int i = 0; i < g_Patches.Count(); i++ )
+	{
+		if ( g_Patches[i].child1 == g_Patches.InvalidIndex() && !g_Patches[i].sky )
+		{
+			total.x += fabs( emitlight[i].x );
+			total.y += fabs( emitlight[i].y );
+			total.z += fabs( emitlight[i].z );
+		}
+	}
+}
+
 /*
 =============
 BounceLight
+
+pPrevBounce is the bounced light of an earlier solution (see LightCache_GetPreviousBounce),
+or NULL to start from the direct light alone. Returns true if the bounces converged.
 =============
 */
-void BounceLight (void)
+bool BounceLight( const bumplights_t *pPrevBounce )
 {
 	unsigned i;
 	Vector	added;
@@ -1694,6 +1812,13 @@ void BounceLight (void)
 
 		// NOTE: This means that only the bounced light is integrated into totallight!
 		VectorFill( g_Patches[i].totallight.light[0], 0 );
+
+		// Send out the old bounced light along with the direct light, so the first
+		// bounce already lands close to the solution
+		if ( pPrevBounce && !g_Patches[i].sky )
+		{
+			VectorAdd( emitlight[i], pPrevBounce[i].light[0], emitlight[i] );
+		}
 	}
 
 #if 0
@@ -1729,6 +1854,7 @@ void BounceLight (void)
 	}
 #endif
 
+	bool bConverged = !bouncing;
 	i = 0;
 	while ( bouncing )
 	{
@@ -1741,10 +1867,34 @@ void BounceLight (void)
 		// light is always received to leaf patches
 		CollectLight( added );
 
+		if ( pPrevBounce )
+		{
+			// totallight is now the new estimate of the bounced light; from here on only
+			// its difference from the old one has to be bounced around
+			if ( i == 0 )
+			{
+				for ( int j = 0; j < g_Patches.Count(); j++ )
+				{
+					if ( !g_Patches[j].sky )
+					{
+						VectorSubtract( emitlight[j], pPrevBounce[j].light[0], emitlight[j] );
+					}
+				}
+			}
+			SumBounceChange( added );
+		}
+
 		qprintf ("\tBounce #%i added RGB(%.0f, %.0f, %.0f)\n", i+1, added[0], added[1], added[2] );
 
-		if ( i+1 == numbounce || (added[0] < 1.0 && added[1] < 1.0 && added[2] < 1.0) )
+		if ( added[0] < 1.0 && added[1] < 1.0 && added[2] < 1.0 )
+		{
+			bConverged = true;
 			bouncing = false;
+		}
+		else if ( i+1 == numbounce )
+		{
+			bouncing = false;
+		}
 
 		i++;
 		if ( g_bDumpPatches && !bouncing && i != 1)
@@ -1753,6 +1903,8 @@ void BounceLight (void)
 			WriteWorld (name, 0);
 		}
 	}
+
+	return bConverged;
 }
 
 
@@ -2047,10 +2199,35 @@ void MakeAllScales (void)
 #endif
 
 
+//-----------------------------------------------------------------------------
+// Lighting a face costs roughly its luxel count; big faces go out to the
+// threads first so they don't end up as the last item of a phase.
+//-----------------------------------------------------------------------------
+static void BuildFaceLightingCosts( CUtlVector<float> &costs )
+{
+	costs.SetCount( numfaces );
+	for ( int i = 0; i < numfaces; i++ )
+	{
+		costs[i] = (float)( ( dfaces[i].m_LightmapTextureSizeInLuxels[0] + 1 ) * ( dfaces[i].m_LightmapTextureSizeInLuxels[1] + 1 ) );
+	}
+}
+
+extern void BuildPatchLights( int facenum );
+
+static CUtlVector<int> *s_pFacesToLight;
+
+static void BuildFacelightsInList( int iThread, int iListEntry )
+{
+	BuildFacelights( iThread, s_pFacesToLight->Element( iListEntry ) );
+}
+
 bool RadWorld_Go()
 {
 	g_iCurFace = 0;
 
+	CUtlVector<float> faceCosts;
+	BuildFaceLightingCosts( faceCosts );
+
 	InitMacroTexture( source );
 
 	if( g_pIncremental )
@@ -2068,6 +2245,21 @@ bool RadWorld_Go()
 		BuildFacesVisibleToLights( true );
 	}
 
+	// With -incremental, only the faces the light cache couldn't restore get lit
+	CUtlVector<int> facesToLight;
+	if ( g_bLightCache )
+	{
+		LightCache_Begin( facesToLight );
+	}
+	else
+	{
+		facesToLight.SetCount( numfaces );
+		for ( int i = 0; i < numfaces; i++ )
+		{
+			facesToLight[i] = i;
+		}
+	}
+
 	// build initial facelights
 	if (g_bUseMPI) 
 	{
@@ -2078,8 +2270,45 @@ bool RadWorld_Go()
 			RunThreadsOnIndividual( g_Patches.Count(), true, BuildStaticPropPatchlights );
 		}
 	}
+	else if ( g_bWorkerPool || g_bLightCache )
+	{
+		if ( g_bWorkerPool )
+		{
+			RunWorkerPoolBuildFacelights( facesToLight );
+		}
+		else
+		{
+			LightCache_RecordSampleClusters();
+			CUtlVector<float> listCosts;
+			listCosts.SetCount( facesToLight.Count() );
+			for ( int i = 0; i < facesToLight.Count(); i++ )
+			{
+				listCosts[i] = faceCosts[facesToLight[i]];
+			}
+			s_pFacesToLight = &facesToLight;
+			SetThreadWorkCosts( listCosts.Base() );
+			RunThreadsOnIndividual( facesToLight.Count(), true, BuildFacelightsInList );
+		}
+
+		if ( g_bLightCache )
+		{
+			LightCache_SaveFaceLights();
+		}
+
+		// BuildFacelights leaves this to us, since the faces can come from anywhere
+		for ( int i = 0; i < numfaces; ++i )
+		{
+			BuildPatchLights( i );
+		}
+
+		if ( g_bStaticPropBounce )
+		{
+			RunThreadsOnIndividual( g_Patches.Count(), true, BuildStaticPropPatchlights );
+		}
+	}
 	else 
 	{
+		SetThreadWorkCosts( faceCosts.Base() );
 		RunThreadsOnIndividual( numfaces, true, BuildFacelights );
 		if ( g_bStaticPropBounce )
 		{
@@ -2148,10 +2377,23 @@ bool RadWorld_Go()
 			addlight.SetSize( g_Patches.Count() );
 			memset( addlight.Base(), 0, g_Patches.Count() * sizeof( bumplights_t ) );
 
-			MakeAllScales ();
+			if ( !g_bLightCache || !LightCache_LoadTransfers() )
+			{
+				MakeAllScales ();
+			}
 
 			// spread light around
-			BounceLight ();
+			bool bConverged = BounceLight( g_bLightCache ? LightCache_GetPreviousBounce() : NULL );
+
+			if ( g_bLightCache )
+			{
+				LightCache_SaveBounce( bConverged );
+			}
+		}
+
+		if ( g_bLightCache )
+		{
+			LightCache_End();
 		}
 
 		//
@@ -2165,7 +2407,10 @@ bool RadWorld_Go()
 		// blend bounced light into direct light and save
 		VMPI_SetCurrentStage( "FinalLightFace" );
 		if ( !g_bUseMPI || g_bMPIMaster )
+		{
+			SetThreadWorkCosts( faceCosts.Base() );
 			RunThreadsOnIndividual (numfaces, true, FinalLightFace);
+		}
 		
 		// Distribute the lighting data to workers.
 		VMPI_DistributeLightData();
@@ -2225,7 +2470,7 @@ void VRAD_LoadBSP( char const *pFilename )
 	// so we prepend qdir here.
 	strcpy( source, ExpandPath( source ) );
 
-	if ( !g_bUseMPI )
+	if ( !g_bUseMPI && ( !g_bWorkerPool || g_bWorkerPoolMaster ) )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -2355,11 +2600,21 @@ void VRAD_LoadBSP( char const *pFilename )
 	// Build acceleration structure
 	printf ( "Setting up ray-trace acceleration structure... ");
 	float start = Plat_FloatTime();
+	if ( g_bLightCache )
+	{
+		LightCache_HashTraceGeometry();
+	}
 	g_RtEnv.SetupAccelerationStructure();
 	g_RtEnv_LightBlockers.SetupAccelerationStructure();
 	float end = Plat_FloatTime();
 	printf ( "Done (%.2f seconds)\n", end-start );
 
+	if ( g_bRayTraceBenchmark )
+	{
+		RayTraceBenchmark();
+		exit( 0 );
+	}
+
 #if 0  // To test only k-d build
 	exit(0);
 #endif
@@ -2426,6 +2681,8 @@ void VRAD_Finish()
 
 	StaticPropMgr()->Shutdown();
 
+	PrintThreadPhaseTimes();
+
 	double end = Plat_FloatTime();
 	
 	char str[512];
@@ -2518,6 +2775,15 @@ int ParseCommandLine( int argc, char **argv, bool *onlydetail )
 		{
 			g_bDumpRtEnv = true;
 		}
+		else if ( !Q_stricmp( argv[i], "-raytracebench" ) )
+		{
+			g_bRayTraceBenchmark = true;
+		}
+		else if ( !Q_stricmp( argv[i], "-incremental" ) )
+		{
+			// Only the master of a worker pool keeps the cache
+			g_bLightCache = !g_bWorkerPool || g_bWorkerPoolMaster;
+		}
 		else if ( !Q_stricmp( argv[i], "-LargeDispSampleRadius" ) )
 		{
 			g_bLargeDispSampleRadius = true;
@@ -2961,6 +3227,12 @@ void PrintUsage( int argc, char **argv )
 		"  -dump           : Write debugging .txt files.\n"
 		"  -dumpnormals    : Write normals to debug files.\n"
 		"  -dumptrace      : Write ray-tracing environment to debug files.\n"
+		"  -raytracebench  : Build the ray-tracing environment, benchmark 4 and 8 wide\n"
+		"                    ray packets against it and exit.\n"
+		"  -incremental    : Keep the lighting in <bspfile>.lightcache and only relight\n"
+		"                    the faces whose lights or surroundings changed since the\n"
+		"                    last run. Says which faces were relit, and why, in\n"
+		"                    <bspfile>.lightcache.log. Doesn't notice texture edits.\n"
 		"  -threads        : Control the number of threads vbsp uses (defaults to the #\n"
 		"                    or processors on your machine).\n"
 		"  -lights <file>  : Load a lights file in addition to lights.rad and the\n"
@@ -3031,6 +3303,8 @@ void PrintUsage( int argc, char **argv )
 		}
 	}
 #endif
+
+	WorkerPool_PrintUsage();
 }
 
 
@@ -3055,6 +3329,15 @@ int RunVRAD( int argc, char **argv )
 		Plat_ExitProcess( 0 );
 	}
 
+	if ( g_bLightCache )
+	{
+		if ( g_bUseMPI )
+		{
+			Error( "-incremental and -mpi can't be used together.\n" );
+		}
+		LightCache_Init( argc, argv );
+	}
+
 	VRAD_LoadBSP( argv[i] );
 
 	if ( (! onlydetail) && (! g_bOnlyStaticProps ) )
@@ -3082,6 +3365,11 @@ int VRAD_Main(int argc, char **argv)
 
 	// This must come first.
 	VRAD_SetupMPI( argc, argv );
+	WorkerPool_Init( argc, argv );
+	if ( g_bUseMPI && g_bWorkerPool )
+	{
+		Error( "-mpi and the worker pool can't be used together.\n" );
+	}
 
 	// Initialize the filesystem, so additional commandline options can be loaded
 	Q_StripExtension( argv[ argc - 1 ], source, sizeof( source ) );
@@ -324,6 +324,9 @@ extern RayTracingEnvironment g_RtEnv_LightBlockers;
 extern RayTracingEnvironment g_RtEnv_RadiosityPatches;	// Contains patches for final gather of indirect light for static prop lighting.
 
 #include "mpivrad.h"
+#include "workerpool.h"
+#include "workerpoolvrad.h"
+#include "lightcache.h"
 
 void MakeShadowSplits (void);
 
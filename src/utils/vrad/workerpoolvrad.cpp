@@ -0,0 +1,139 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vrad phases run through the worker pool (see workerpool.h)
+//
+//			Each face's direct lighting only depends on the map and the
+//			lights, so any worker can light any face and the result doesn't
+//			depend on how many workers there are. The workers stop after
+//			BuildFacelights; the master does the rest, starting with
+//			BuildPatchLights.
+//
+//=============================================================================//
+
+#include "vrad.h"
+#include "lightmap.h"
+#include "pacifier.h"
+#include "workerpool.h"
+#include "workerpoolvrad.h"
+#include "lightcache.h"
+
+
+static CUtlVector<int> *s_pFacesToLight;
+
+
+static void ProcessFace( int iThread, uint64 iWorkUnit, CUtlBuffer *pBuf )
+{
+	int iFace = s_pFacesToLight->Element( (int)iWorkUnit );
+	BuildFacelights( iThread, iFace );
+
+	if ( !pBuf )
+		return;
+
+	pBuf->Put( &g_pFaces[iFace], sizeof( dface_t ) );
+	SerializeFaceLight( &facelight[iFace], *pBuf );
+	LightCache_PutSampleClusters( iFace, *pBuf );
+}
+
+
+// Checks a face light from a worker against what BuildFacelights can make for the
+// face, so nothing later indexes past the face's lightmap or its light arrays
+static bool IsValidFaceLight( int iFace, const facelight_t *fl, const byte *styles )
+{
+	const dface_t *f = &g_pFaces[iFace];
+	int nWidth = f->m_LightmapTextureSizeInLuxels[0] + 1;
+	int nHeight = f->m_LightmapTextureSizeInLuxels[1] + 1;
+	int nLuxels = nWidth * nHeight;
+
+	if ( fl->numsamples > nLuxels || ( fl->numluxels != 0 && fl->numluxels != nLuxels ) )
+		return false;
+
+	for ( int i = 0; i < fl->numsamples; i++ )
+	{
+		const sample_t &sample = fl->sample[i];
+		if ( sample.s < 0 || sample.s >= nWidth || sample.t < 0 || sample.t >= nHeight )
+			return false;
+	}
+
+	int nNormals = ( texinfo[f->texinfo].flags & SURF_BUMPLIGHT ) ? NUM_BUMP_VECTS + 1 : 1;
+	for ( int k = 0; k < MAXLIGHTMAPS; k++ )
+	{
+		if ( styles[k] == 255 )
+		{
+			// Styles are packed at the front
+			for ( int j = k + 1; j < MAXLIGHTMAPS; j++ )
+			{
+				if ( styles[j] != 255 )
+					return false;
+			}
+			break;
+		}
+
+		if ( fl->numluxels != nLuxels || !fl->luxel || ( f->dispinfo != -1 && !fl->luxelNormals ) )
+			return false;
+
+		for ( int n = 0; n < nNormals; n++ )
+		{
+			if ( !fl->light[k][n] )
+				return false;
+		}
+	}
+	return true;
+}
+
+static void ReceiveFace( uint64 iWorkUnit, CUtlBuffer &buf, int iWorker )
+{
+	int iFace = s_pFacesToLight->Element( (int)iWorkUnit );
+
+	// BuildFacelights only sets the face's styles and clears its lightofs, so the
+	// rest of the worker's copy of the face is ignored
+	dface_t workerFace;
+	buf.Get( &workerFace, sizeof( dface_t ) );
+
+	bool bValid = buf.IsValid() && UnserializeFaceLight( &facelight[iFace], buf );
+	bValid = bValid && LightCache_GetSampleClusters( iFace, buf );
+	bValid = bValid && buf.GetBytesRemaining() == 0 && IsValidFaceLight( iFace, &facelight[iFace], workerFace.styles );
+
+	if ( !bValid )
+		Error( "Invalid BuildFacelights result for face %d from worker %d.\n", iFace, iWorker );
+
+	g_pFaces[iFace].lightofs = -1;
+	memcpy( g_pFaces[iFace].styles, workerFace.styles, sizeof( workerFace.styles ) );
+}
+
+
+void RunWorkerPoolBuildFacelights( CUtlVector<int> &facesToLight )
+{
+	// The master decides which faces get lit (see LightCache_Begin)
+	CUtlBuffer buf;
+	if ( g_bWorkerPoolMaster )
+	{
+		buf.PutInt( facesToLight.Count() );
+		buf.Put( facesToLight.Base(), facesToLight.Count() * sizeof( int ) );
+	}
+
+	WorkerPool_Broadcast( buf );
+
+	if ( !g_bWorkerPoolMaster )
+	{
+		facesToLight.SetCount( buf.GetInt() );
+		buf.Get( facesToLight.Base(), facesToLight.Count() * sizeof( int ) );
+	}
+
+	s_pFacesToLight = &facesToLight;
+	LightCache_RecordSampleClusters();
+
+	Msg( "%-20s ", "BuildFaceLights:" );
+	if ( g_bWorkerPoolMaster )
+		StartPacifier( "" );
+
+	double elapsed = WorkerPool_DistributeWork( facesToLight.Count(), ProcessFace, ReceiveFace );
+
+	if ( !g_bWorkerPoolMaster )
+	{
+		Msg( "VRAD worker finished. Over and out.\n" );
+		Plat_ExitProcess( 0 );
+	}
+
+	EndPacifier( false );
+	Msg( " (%d)\n", (int)elapsed );
+}
@@ -0,0 +1,18 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vrad phases run through the worker pool (see workerpool.h)
+//
+//=============================================================================//
+
+#ifndef WORKERPOOLVRAD_H
+#define WORKERPOOLVRAD_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+// Lights the faces in the master's list; the workers get the list from the master.
+void RunWorkerPoolBuildFacelights( CUtlVector<int> &facesToLight );
+
+
+#endif // WORKERPOOLVRAD_H
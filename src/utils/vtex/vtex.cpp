@@ -87,6 +87,8 @@ static char g_ForcedOutputDir[MAX_PATH];
 
 static bool g_bOldCubemapPath = false;
 
+static bool g_bDXTBench = false;
+
 
 #define MAX_VMT_PARAMS	16
 
@@ -2981,6 +2983,8 @@ void Usage( void )
 		"  -nopsd            : skip .psd files (e.g. use this with \"vtex *.*\")\n"
 		"  -notga            : skip .tga files (e.g. use this with \"vtex *.*\")\n"
 		"  -oldcubepath      : old cubemap method, expects 6 input files, suffixed: 'up', 'dn', 'lf', 'rt', 'ft', 'bk'\n"
+		"  -dxtquality <q>   : compress with the built-in DXT encoder at quality fast, normal or high\n"
+		"  -dxtbench         : time the built-in DXT encoder on the given .tga files and report PSNR, writes nothing\n"
 		"\n"
 		"\teg: -vmtparam $ignorez 1 -vmtparam $translucent 1\n"
 		"\n"
@@ -3747,6 +3751,119 @@ bool CSuggestGameDirHelper::MySuggestFn( CFSSteamSetupInfo const *pFsSteamSetupI
 	return false;
 }
 
+//-----------------------------------------------------------------------------
+// Releases the pool VTex() splits image work across
+//-----------------------------------------------------------------------------
+static void ShutdownVTexThreadPool( IThreadPool *pPool )
+{
+	FloatBitMap_t::SetThreadPool( NULL );
+	ImageLoader::SetThreadPool( NULL );
+	DestroyThreadPool( pPool );
+}
+
+
+//-----------------------------------------------------------------------------
+// -dxtbench: compresses each .tga with the built-in encoder at every quality,
+// decodes it again and reports throughput and PSNR
+//-----------------------------------------------------------------------------
+static double ComputePSNR( const uint8 *pSrc, const uint8 *pDecoded, int nPixels, const int *pChannels, int nChannels )
+{
+	// pSrc is RGBA8888, pDecoded BGRA8888 (the only format ATI2N decodes to)
+	static const int s_nBGRAOffset[4] = { 2, 1, 0, 3 };
+
+	double flError = 0.0;
+	for ( int i = 0; i < nPixels; ++i )
+	{
+		for ( int c = 0; c < nChannels; ++c )
+		{
+			double d = (double)pSrc[i * 4 + pChannels[c]] - (double)pDecoded[i * 4 + s_nBGRAOffset[pChannels[c]]];
+			flError += d * d;
+		}
+	}
+	flError /= (double)nPixels * nChannels;
+	return ( flError > 0.0 ) ? 10.0 * log10( 255.0 * 255.0 / flError ) : 99.99;
+}
+
+static void BenchmarkDXTEncoder( int nFiles, char **ppFiles )
+{
+	struct BenchFormat_t
+	{
+		ImageFormat m_Format;
+		int m_nChannels;
+		int m_pChannels[4];
+	};
+	static const BenchFormat_t s_Formats[] =
+	{
+		{ IMAGE_FORMAT_DXT1,  3, { 0, 1, 2 } },
+		{ IMAGE_FORMAT_DXT5,  4, { 0, 1, 2, 3 } },
+		{ IMAGE_FORMAT_ATI2N, 2, { 0, 1 } },
+	};
+	static const char *s_pQualityNames[] = { "fast", "normal", "high" };
+
+	VTexMsg( "DXT encoder benchmark, %d worker threads\n", ImageLoader::GetThreadPool()->NumThreads() );
+	VTexMsg( "%-32s %-6s %-6s %10s %8s\n", "file", "format", "quality", "MPixels/s", "PSNR" );
+
+	for ( int i = 0; i < nFiles; ++i )
+	{
+		if ( ppFiles[i][0] == '-' )
+			continue;
+
+		CUtlBuffer fileBuffer;
+		FILE *fp = fopen( ppFiles[i], "rb" );
+		if ( fp )
+		{
+			fseek( fp, 0, SEEK_END );
+			int nSize = ftell( fp );
+			fseek( fp, 0, SEEK_SET );
+			fileBuffer.EnsureCapacity( nSize );
+			int nRead = fread( fileBuffer.Base(), 1, nSize, fp );
+			fileBuffer.SeekPut( CUtlBuffer::SEEK_HEAD, nRead );
+			fclose( fp );
+		}
+
+		CUtlMemory<unsigned char> src;
+		int nWidth, nHeight;
+		if ( !fp || !TGALoader::LoadRGBA8888( fileBuffer, src, nWidth, nHeight ) )
+		{
+			VTexWarningNoPause( "Can't load %s, only .tga files can be benchmarked\n", ppFiles[i] );
+			continue;
+		}
+
+		int nPixels = nWidth * nHeight;
+		CUtlMemory<unsigned char> decoded;
+		decoded.EnsureCapacity( nPixels * 4 );
+
+		for ( int f = 0; f < ARRAYSIZE( s_Formats ); ++f )
+		{
+			const BenchFormat_t &format = s_Formats[f];
+			CUtlMemory<unsigned char> compressed;
+			compressed.EnsureCapacity( ImageLoader::GetMemRequired( nWidth, nHeight, 1, format.m_Format, false ) );
+
+			for ( int q = ImageLoader::DXT_ENCODE_FAST; q <= ImageLoader::DXT_ENCODE_HIGH; ++q )
+			{
+				// Repeat small images until the timing means something
+				int nPasses = 0;
+				double flStart = Plat_FloatTime();
+				double flElapsed;
+				do
+				{
+					ImageLoader::CompressDXT( src.Base(), IMAGE_FORMAT_RGBA8888, compressed.Base(), format.m_Format,
+						nWidth, nHeight, (ImageLoader::DXTEncodeQuality_t)q );
+					++nPasses;
+					flElapsed = Plat_FloatTime() - flStart;
+				} while ( flElapsed < 0.25 );
+
+				ImageLoader::ConvertImageFormat( compressed.Base(), format.m_Format, decoded.Base(), IMAGE_FORMAT_BGRA8888, nWidth, nHeight );
+
+				VTexMsg( "%-32s %-6s %-6s %10.2f %8.2f\n", V_UnqualifiedFileName( ppFiles[i] ), ImageLoader::GetName( format.m_Format ),
+					s_pQualityNames[q], (double)nPixels * nPasses / ( flElapsed * 1000000.0 ),
+					ComputePSNR( src.Base(), decoded.Base(), nPixels, format.m_pChannels, format.m_nChannels ) );
+			}
+		}
+	}
+}
+
+
 int CVTex::VTex( int argc, char **argv )
 {
 	CommandLine()->CreateCmdLine( argc, argv );
@@ -3880,6 +3997,29 @@ int CVTex::VTex( int argc, char **argv )
 			g_bOldCubemapPath = true;
 			i++;
 		}
+		else if ( stricmp( argv[i], "-dxtquality" ) == 0 && i + 1 < argc )
+		{
+			ImageLoader::DXTEncodeQuality_t nQuality = ImageLoader::DXT_ENCODE_NORMAL;
+			if ( !Q_stricmp( argv[i+1], "fast" ) )
+			{
+				nQuality = ImageLoader::DXT_ENCODE_FAST;
+			}
+			else if ( !Q_stricmp( argv[i+1], "high" ) )
+			{
+				nQuality = ImageLoader::DXT_ENCODE_HIGH;
+			}
+			else if ( Q_stricmp( argv[i+1], "normal" ) )
+			{
+				VTexWarningNoPause( "Unknown -dxtquality \"%s\", using normal\n", argv[i+1] );
+			}
+			ImageLoader::SetDXTEncoder( true, nQuality );
+			i += 2;
+		}
+		else if ( stricmp( argv[i], "-dxtbench" ) == 0 )
+		{
+			g_bDXTBench = true;
+			i++;
+		}
 		else if( argv[i][0] == '-' )
 		{
 			// Just assuming that these are valid flags with no args
@@ -3891,6 +4031,21 @@ int CVTex::VTex( int argc, char **argv )
 		}
 	}
 
+	// Resampling and block compression are split across all the cores
+	IThreadPool *pVTexThreadPool = CreateNewThreadPool();
+	ThreadPoolStartParams_t startParams;
+	startParams.fDistribute = TRS_TRUE;
+	pVTexThreadPool->Start( startParams );
+	FloatBitMap_t::SetThreadPool( pVTexThreadPool );
+	ImageLoader::SetThreadPool( pVTexThreadPool );
+
+	if ( g_bDXTBench )
+	{
+		BenchmarkDXTEncoder( argc - i, argv + i );
+		ShutdownVTexThreadPool( pVTexThreadPool );
+		return 0;
+	}
+
 	// Set the suggest game info directory helper
 	g_suggestGameDirHelper.m_pszInputFiles = argv + i;
 	g_suggestGameDirHelper.m_numInputFiles = argc - i;
@@ -3929,6 +4084,7 @@ int CVTex::VTex( int argc, char **argv )
 		if ( !pModule )
 		{
 			VTexMsg( "Can't load %s.\n", pModuleName );
+			ShutdownVTexThreadPool( pVTexThreadPool );
 			return -1;
 		}
 		CreateInterfaceFn fn = Sys_GetFactory( pModule );
@@ -3936,6 +4092,7 @@ int CVTex::VTex( int argc, char **argv )
 		{
 			VTexMsg( "Can't get factory from %s.\n", pModuleName );
 			Sys_UnloadModule( pModule );
+			ShutdownVTexThreadPool( pVTexThreadPool );
 			return -1;
 		}
 		p4 = (IP4 *)fn( P4_INTERFACE_VERSION, NULL );
@@ -4011,6 +4168,8 @@ int CVTex::VTex( int argc, char **argv )
 		p4->Disconnect();
 	}
 
+	ShutdownVTexThreadPool( pVTexThreadPool );
+
 	Pause();
 
 	if ( g_bUsedAsLaunchableDLL )
@@ -4144,6 +4303,7 @@ CDmeTexture *CVTexCompiler::CompileResource( CDmePrecompiledTexture *pPrecompile
 	pVTexThreadPool->Start( startParams );
 
 	FloatBitMap_t::SetThreadPool( pVTexThreadPool );
+	ImageLoader::SetThreadPool( pVTexThreadPool );
 	int nCount = pPrecompiledResource->m_Processors.Count();
 	for ( int i = 0; i < nCount; ++i )
 	{
@@ -4168,6 +4328,7 @@ CDmeTexture *CVTexCompiler::CompileResource( CDmePrecompiledTexture *pPrecompile
 	}
 
 	FloatBitMap_t::SetThreadPool( NULL );
+	ImageLoader::SetThreadPool( NULL );
 	DestroyThreadPool( pVTexThreadPool );
 
 	return pTexture;
@@ -10,6 +10,7 @@
 
 int g_TraceClusterStart = -1;
 int g_TraceClusterStop = -1;
+bool g_bDeferPortalFlowDone = false;
 /*
 
   each portal will have a list of all possible to see from first portal
@@ -29,19 +30,85 @@ int g_TraceClusterStop = -1;
   void CalcMightSee (leaf_t *leaf, 
 */
 
+static inline int PopCount64( uint64 x )
+{
+	x = x - ( ( x >> 1 ) & 0x5555555555555555ull );
+	x = ( x & 0x3333333333333333ull ) + ( ( x >> 2 ) & 0x3333333333333333ull );
+	x = ( x + ( x >> 4 ) ) & 0x0f0f0f0f0f0f0f0full;
+	return (int)( ( x * 0x0101010101010101ull ) >> 56 );
+}
+
 int CountBits (byte *bits, int numbits)
 {
 	int		i;
 	int		c;
 
+	// a qword at a time, then whatever bits are left over
 	c = 0;
-	for (i=0 ; i<numbits ; i++)
+	for (i=0 ; i+64<=numbits ; i+=64)
+	{
+		uint64 q;
+		memcpy( &q, bits + (i >> 3), sizeof( q ) );
+		c += PopCount64( q );
+	}
+	for ( ; i<numbits ; i++)
 		if ( CheckBit( bits, i ) )
 			c++;
 
 	return c;
 }
 
+
+//-----------------------------------------------------------------------------
+// Bit string operations for the flow. The might bits get sparser the deeper the
+// flow goes, so each stack level keeps the range of qwords that can still be set
+// and only that range gets looked at.
+//-----------------------------------------------------------------------------
+static bool FlowAndBits( uint64 *dest, const uint64 *a, const uint64 *b, const uint64 *vis, int &first, int &last )
+{
+	uint64 more = 0;
+	int newFirst = -1, newLast = -1;
+	for ( int j = first; j < last; j++ )
+	{
+		uint64 w = a[j] & b[j];
+		dest[j] = w;
+		if ( w )
+		{
+			if ( newFirst < 0 )
+				newFirst = j;
+			newLast = j + 1;
+			more |= w & ~vis[j];
+		}
+	}
+
+	first = ( newFirst < 0 ) ? 0 : newFirst;
+	last = ( newFirst < 0 ) ? 0 : newLast;
+	return more != 0;
+}
+
+// flow_avx2.cpp
+bool FlowAndBitsAVX2( uint64 *dest, const uint64 *a, const uint64 *b, const uint64 *vis, int &first, int &last );
+
+static inline bool MightSee( const pstack_t *stack, int pnum )
+{
+	int q = pnum >> 6;
+	return q >= stack->mightfirst && q < stack->mightlast && CheckBit( stack->mightsee, pnum );
+}
+
+static void SetFlowRange( pstack_t *stack )
+{
+	const uint64 *might = (const uint64 *)stack->mightsee;
+	int nQwords = portalbytes >> 3;
+
+	stack->mightfirst = 0;
+	while ( stack->mightfirst < nQwords && !might[stack->mightfirst] )
+		stack->mightfirst++;
+
+	stack->mightlast = nQwords;
+	while ( stack->mightlast > stack->mightfirst && !might[stack->mightlast-1] )
+		stack->mightlast--;
+}
+
 int		c_fullskip;
 int		c_portalskip, c_leafskip;
 int		c_vistest, c_mighttest;
@@ -467,6 +534,15 @@ void WritePortalTrace( const char *source )
 	Warning("Wrote %s!!!\n", filename);
 }
 
+static inline void MarkVisible( threaddata_t *thread, int pnum )
+{
+	if ( !CheckBit( thread->base->portalvis, pnum ) )
+	{
+		SetBit( thread->base->portalvis, pnum );
+		thread->c_cansee++;
+	}
+}
+
 /*
 ==================
 RecursiveLeafFlow
@@ -481,8 +557,9 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	portal_t	*p;
 	plane_t		backplane;
 	leaf_t 		*leaf;
-	int			i, j;
-	long		*test, *might, *vis, more;
+	int			i;
+	uint64		*test, *might, *vis;
+	bool		more;
 	int			pnum;
 
 	// Early-out if we're a VMPI worker that's told to exit. If we don't do this here, then the
@@ -506,37 +583,53 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 	stack.leaf = leaf;
 	stack.portal = NULL;
 
-	might = (long *)stack.mightsee;
-	vis = (long *)thread->base->portalvis;
+	might = (uint64 *)stack.mightsee;
+	vis = (uint64 *)thread->base->portalvis;
 	
 	// check all portals for flowing into other leafs	
 	for (i=0 ; i<leaf->portals.Count() ; i++)
 	{
+		// once every portal the base might see is visible, there's nothing left to find
+		if ( thread->c_cansee == thread->c_stopat )
+			return;
 
 		p = leaf->portals[i];
 		pnum = p - portals;
 
-		if ( ! (prevstack->mightsee[pnum >> 3] & (1<<(pnum&7)) ) )
+		if ( !MightSee( prevstack, pnum ) )
 		{
 			continue;	// can't possibly see it
 		}
 
+		// the portal is entirely behind the base portal, or the base portal is entirely
+		// in front of it; these don't depend on the bits, so test them first
+		float dpass = DotProduct (p->origin, thread->pstack_head.portalplane.normal);
+		dpass -= thread->pstack_head.portalplane.dist;
+		if (dpass < -p->radius)
+		{
+			continue;
+		}
+
+		float dsource = DotProduct (thread->base->origin, p->plane.normal);
+		dsource -= p->plane.dist;
+		if (dsource > thread->base->radius)
+		{
+			continue;
+		}
+
 		// if the portal can't see anything we haven't allready seen, skip it
 		if (p->status == stat_done)
 		{
-			test = (long *)p->portalvis;
+			test = (uint64 *)p->portalvis;
 		}
 		else
 		{
-			test = (long *)p->portalflood;
+			test = (uint64 *)p->portalflood;
 		}
 
-		more = 0;
-		for (j=0 ; j<portallongs ; j++)
-		{
-			might[j] = ((long *)prevstack->mightsee)[j] & test[j];
-			more |= (might[j] & ~vis[j]);
-		}
+		stack.mightfirst = prevstack->mightfirst;
+		stack.mightlast = prevstack->mightlast;
+		more = thread->pfnAndBits( might, (const uint64 *)prevstack->mightsee, test, vis, stack.mightfirst, stack.mightlast );
 		
 		if ( !more && CheckBit( thread->base->portalvis, pnum ) )
 		{	// can't see anything new
@@ -554,13 +647,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		stack.freewindings[1] = 1;
 		stack.freewindings[2] = 1;
 		
-		float d = DotProduct (p->origin, thread->pstack_head.portalplane.normal);
-		d -= thread->pstack_head.portalplane.dist;
-		if (d < -p->radius)
-		{
-			continue;
-		}
-		else if (d > p->radius)
+		if (dpass > p->radius)
 		{
 			stack.pass = p->winding;
 		}
@@ -572,13 +659,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		}
 
 
-		d = DotProduct (thread->base->origin, p->plane.normal);
-		d -= p->plane.dist;
-		if (d > thread->base->radius)
-		{
-			continue;
-		}
-		else if (d < -thread->base->radius)
+		if (dsource < -thread->base->radius)
 		{
 			stack.source = prevstack->source;
 		}
@@ -594,7 +675,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 		{	// the second leaf can only be blocked if coplanar
 
 			// mark the portal as visible
-			SetBit( thread->base->portalvis, pnum );
+			MarkVisible( thread, pnum );
 
 			RecursiveLeafFlow (p->leaf, thread, &stack);
 			continue;
@@ -609,7 +690,7 @@ void RecursiveLeafFlow (int leafnum, threaddata_t *thread, pstack_t *prevstack)
 			continue;
 
 		// mark the portal as visible
-		SetBit( thread->base->portalvis, pnum );
+		MarkVisible( thread, pnum );
 
 		// flow through it for real
 		RecursiveLeafFlow (p->leaf, thread, &stack);
@@ -627,7 +708,6 @@ generates the portalvis bit vector
 void PortalFlow (int iThread, int portalnum)
 {
 	threaddata_t	data;
-	int				i;
 	portal_t		*p;
 	int				c_might, c_can;
 
@@ -642,13 +722,23 @@ void PortalFlow (int iThread, int portalnum)
 	data.pstack_head.portal = p;
 	data.pstack_head.source = p->winding;
 	data.pstack_head.portalplane = p->plane;
-	for (i=0 ; i<portallongs ; i++)
-		((long *)data.pstack_head.mightsee)[i] = ((long *)p->portalflood)[i];
+	memcpy( data.pstack_head.mightsee, p->portalflood, portalbytes );
+	SetFlowRange( &data.pstack_head );
+
+	data.pfnAndBits = GetCPUInformation().m_bAVX2 ? FlowAndBitsAVX2 : FlowAndBits;
+
+	// Only portals in portalflood can become visible, so the flow can stop once they all
+	// are. The cluster trace has to see the whole flow.
+	data.c_cansee = CountBits (p->portalvis, g_numportals*2);
+	data.c_stopat = ( g_TraceClusterStop >= 0 ) ? -1 : c_might;
 
 	RecursiveLeafFlow (p->leaf, &data, &data.pstack_head);
 
 
-	p->status = stat_done;
+	if ( !g_bDeferPortalFlowDone )
+	{
+		p->status = stat_done;
+	}
 
 	c_can = CountBits (p->portalvis, g_numportals*2);
 
@@ -0,0 +1,64 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: AVX2 version of the flow's bit string operations (see FlowAndBits in
+//			flow.cpp). Only called when the CPU reports AVX2 support, so this is
+//			compiled for AVX2 function by function and the rest of vvis keeps its
+//			instruction set.
+//
+//=============================================================================//
+
+#include "vis.h"
+
+#include <immintrin.h>
+
+#if defined( GNUC )
+#define AVX2_FUNC __attribute__(( target( "avx2" ) ))
+#else
+#define AVX2_FUNC
+#endif
+
+
+AVX2_FUNC bool FlowAndBitsAVX2( uint64 *dest, const uint64 *a, const uint64 *b, const uint64 *vis, int &first, int &last )
+{
+	__m256i more = _mm256_setzero_si256();
+	int newFirst = -1, newLast = -1;
+
+	// 4 qwords at a time. The range only narrows to a block, which is fine since
+	// all of it gets written.
+	int j = first;
+	for ( ; j + 4 <= last; j += 4 )
+	{
+		__m256i w = _mm256_and_si256( _mm256_loadu_si256( (const __m256i *)( a + j ) ), _mm256_loadu_si256( (const __m256i *)( b + j ) ) );
+		_mm256_storeu_si256( (__m256i *)( dest + j ), w );
+		if ( !_mm256_testz_si256( w, w ) )
+		{
+			if ( newFirst < 0 )
+				newFirst = j;
+			newLast = j + 4;
+			more = _mm256_or_si256( more, _mm256_andnot_si256( _mm256_loadu_si256( (const __m256i *)( vis + j ) ), w ) );
+		}
+	}
+
+	uint64 moreTail = 0;
+	for ( ; j < last; j++ )
+	{
+		uint64 w = a[j] & b[j];
+		dest[j] = w;
+		if ( w )
+		{
+			if ( newFirst < 0 )
+				newFirst = j;
+			newLast = j + 1;
+			moreTail |= w & ~vis[j];
+		}
+	}
+
+	bool bMore = moreTail != 0 || !_mm256_testz_si256( more, more );
+
+	// the caller is plain SSE code; avoid the AVX to SSE transition penalty
+	_mm256_zeroupper();
+
+	first = ( newFirst < 0 ) ? 0 : newFirst;
+	last = ( newFirst < 0 ) ? 0 : newLast;
+	return bMore;
+}
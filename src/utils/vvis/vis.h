@@ -67,6 +67,7 @@ struct leaf_t
 struct pstack_t
 {
 	byte		mightsee[MAX_PORTALS/8];		// bit string
+	int			mightfirst, mightlast;		// the qwords of mightsee that can be non-zero
 	pstack_t	*next;
 	leaf_t		*leaf;
 	portal_t	*portal;	// portal exiting
@@ -79,10 +80,17 @@ struct pstack_t
 	plane_t		portalplane;
 };
 
+// dest = a & b over the qwords [first, last) of the bit strings. Narrows first and last down
+// to the qwords of dest that can be non-zero and returns whether dest has a bit vis doesn't.
+typedef bool (*FlowAndBitsFn)( uint64 *dest, const uint64 *a, const uint64 *b, const uint64 *vis, int &first, int &last );
+
 struct threaddata_t
 {
 	portal_t	*base;
 	int			c_chains;
+	int			c_cansee;		// bits set in base->portalvis
+	int			c_stopat;		// the flow is done when c_cansee gets here (-1 = never)
+	FlowAndBitsFn	pfnAndBits;
 	pstack_t	pstack_head;
 };
 
@@ -113,6 +121,7 @@ void LeafFlow (int leafnum);
 void BasePortalVis (int iThread, int portalnum);
 void BetterPortalVis (int portalnum);
 void PortalFlow (int iThread, int portalnum);
+extern bool g_bDeferPortalFlowDone;	// PortalFlow leaves the status at stat_working
 void WritePortalTrace( const char *source );
 
 extern	portal_t	*sorted_portals[MAX_MAP_PORTALS*2];
@@ -14,6 +14,8 @@
 #include "pacifier.h"
 #include "vmpi.h"
 #include "mpivis.h"
+#include "workerpool.h"
+#include "workerpoolvis.h"
 #include "tier1/strtools.h"
 #include "collisionutils.h"
 #include "tier0/icommandline.h"
@@ -306,6 +308,10 @@ void CalcPortalVis (void)
 	{
  		RunMPIPortalFlow();
 	}
+	else if ( g_bWorkerPool )
+	{
+		RunWorkerPoolPortalFlow();
+	}
 	else 
 	{
 		RunThreadsOnIndividual (g_numportals*2, true, PortalFlow);
@@ -335,11 +341,21 @@ void CalcVis (void)
 	{
 		RunMPIBasePortalVis();
 	}
+	else if ( g_bWorkerPool )
+	{
+		RunWorkerPoolBasePortalVis();
+	}
 	else 
 	{
 	    RunThreadsOnIndividual (g_numportals*2, true, BasePortalVis);
 	}
 
+	// -fast has no work for the pool's workers after BasePortalVis
+	if ( fastvis && g_bWorkerPool && !g_bWorkerPoolMaster )
+	{
+		Plat_ExitProcess( 0 );
+	}
+
 	SortPortals ();
 
 	CalcPortalVis ();
@@ -1069,6 +1085,8 @@ void PrintUsage( int argc, char **argv )
 		}
 	}
 #endif
+
+	WorkerPool_PrintUsage();
 }
 
 
@@ -1105,7 +1123,7 @@ int RunVVis( int argc, char **argv )
 	start = Plat_FloatTime();
 
 
-	if (!g_bUseMPI)
+	if ( !g_bUseMPI && ( !g_bWorkerPool || g_bWorkerPoolMaster ) )
 	{
 		// Setup the logfile.
 		char logFile[512];
@@ -1188,10 +1206,17 @@ int RunVVis( int argc, char **argv )
 		{
 			Warning("Can't compile trace in MPI mode\n");
 		}
+		if ( g_bWorkerPool && !g_bWorkerPoolMaster )
+		{
+			// The master traces by itself
+			Plat_ExitProcess( 0 );
+		}
 		CalcVisTrace ();
 		WritePortalTrace(source);
 	}
 	
+	PrintThreadPhaseTimes();
+
 	end = Plat_FloatTime();
 	
 	char str[512];
@@ -1219,6 +1244,11 @@ int main (int argc, char **argv)
 	InstallSpewFunction();
 
 	VVIS_SetupMPI( argc, argv );
+	WorkerPool_Init( argc, argv );
+	if ( g_bUseMPI && g_bWorkerPool )
+	{
+		Error( "-mpi and the worker pool can't be used together.\n" );
+	}
 
 	// Install an exception handler.
 	if ( g_bUseMPI && !g_bMPIMaster )
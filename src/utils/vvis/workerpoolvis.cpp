@@ -0,0 +1,221 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vvis phases run through the worker pool (see workerpool.h)
+//
+//			PortalFlow normally uses the results of any portal another thread
+//			has already finished to cut its own flow short, which makes the
+//			output depend on timing. Here the sorted portals are flowed in a
+//			fixed number of waves instead: a portal only sees the results of
+//			earlier waves, so the output is the same for any number of workers.
+//
+//=============================================================================//
+
+#include "vis.h"
+#include "threads.h"
+#include "pacifier.h"
+#include "workerpool.h"
+#include "workerpoolvis.h"
+
+
+#define PORTALFLOW_WAVES	32
+
+// The flood bits are numportals^2 / 8 bytes in all, so big maps share them in pieces
+#define BASEPORTALVIS_BROADCAST_BYTES	( 64 * 1024 * 1024 )
+
+extern bool fastvis;
+
+static int g_iWaveFirstPortal;
+
+
+// Bit strings from a worker are padded to whole qwords; a bit past the last portal
+// would send the flow off the end of portals[]
+static bool HasBitsPastPortals( const byte *pBits )
+{
+	int nPortals = g_numportals * 2;
+	for ( int i = nPortals; i < portalbytes * 8; i++ )
+	{
+		if ( pBits[i >> 3] & ( 1 << ( i & 7 ) ) )
+			return true;
+	}
+	return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// BasePortalVis
+//-----------------------------------------------------------------------------
+static void ProcessBasePortalVis( int iThread, uint64 iPortal, CUtlBuffer *pBuf )
+{
+	BasePortalVis( iThread, iPortal );
+
+	if ( pBuf )
+	{
+		portal_t *p = &portals[iPortal];
+		pBuf->Put( p->portalfront, portalbytes );
+		pBuf->Put( p->portalflood, portalbytes );
+	}
+}
+
+// Workers only get the flood bits of portals they didn't do themselves; PortalFlow
+// doesn't use the front bits
+static void AllocPortalBits( portal_t *p, bool bFront )
+{
+	if ( bFront && !p->portalfront )
+	{
+		p->portalfront = (byte*)malloc( portalbytes );
+	}
+
+	if ( !p->portalflood )
+	{
+		p->portalflood = (byte*)malloc( portalbytes );
+		p->portalvis = (byte*)malloc( portalbytes );
+		memset( p->portalvis, 0, portalbytes );
+	}
+}
+
+static void ReceiveBasePortalVis( uint64 iPortal, CUtlBuffer &buf, int iWorker )
+{
+	const byte *pBits = (const byte *)buf.PeekGet();
+	if ( buf.GetBytesRemaining() != portalbytes * 2 || HasBitsPastPortals( pBits ) || HasBitsPastPortals( pBits + portalbytes ) )
+		Error( "Invalid BasePortalVis result from worker %d.\n", iWorker );
+
+	portal_t *p = &portals[iPortal];
+	AllocPortalBits( p, true );
+	buf.Get( p->portalfront, portalbytes );
+	buf.Get( p->portalflood, portalbytes );
+}
+
+void RunWorkerPoolBasePortalVis()
+{
+	Msg( "%-20s ", "BasePortalVis:" );
+	if ( g_bWorkerPoolMaster )
+		StartPacifier( "" );
+
+	double elapsed = WorkerPool_DistributeWork( g_numportals * 2, ProcessBasePortalVis, ReceiveBasePortalVis );
+
+	if ( g_bWorkerPoolMaster )
+	{
+		EndPacifier( false );
+		Msg( " (%d)\n", (int)elapsed );
+	}
+
+	if ( fastvis )
+		return;
+
+	// Everybody needs every portal's flood bits for PortalFlow
+	int nPortals = g_numportals * 2;
+	int nPiecePortals = Max( BASEPORTALVIS_BROADCAST_BYTES / portalbytes, 1 );
+	for ( int iFirst = 0; iFirst < nPortals; iFirst += nPiecePortals )
+	{
+		int nPieceEnd = Min( iFirst + nPiecePortals, nPortals );
+
+		CUtlBuffer buf;
+		if ( g_bWorkerPoolMaster )
+		{
+			buf.EnsureCapacity( ( nPieceEnd - iFirst ) * portalbytes );
+			for ( int i = iFirst; i < nPieceEnd; i++ )
+			{
+				buf.Put( portals[i].portalflood, portalbytes );
+			}
+		}
+
+		WorkerPool_Broadcast( buf );
+
+		if ( !g_bWorkerPoolMaster )
+		{
+			for ( int i = iFirst; i < nPieceEnd; i++ )
+			{
+				AllocPortalBits( &portals[i], false );
+				buf.Get( portals[i].portalflood, portalbytes );
+			}
+		}
+	}
+
+	for ( int i = 0; i < nPortals; i++ )
+	{
+		portals[i].nummightsee = CountBits( portals[i].portalflood, nPortals );
+	}
+}
+
+
+//-----------------------------------------------------------------------------
+// PortalFlow
+//-----------------------------------------------------------------------------
+static void ProcessPortalFlow( int iThread, uint64 iWorkUnit, CUtlBuffer *pBuf )
+{
+	int iPortal = g_iWaveFirstPortal + (int)iWorkUnit;
+	PortalFlow( iThread, iPortal );
+
+	if ( pBuf )
+	{
+		pBuf->Put( sorted_portals[iPortal]->portalvis, portalbytes );
+	}
+}
+
+static void ReceivePortalFlow( uint64 iWorkUnit, CUtlBuffer &buf, int iWorker )
+{
+	if ( buf.GetBytesRemaining() != portalbytes || HasBitsPastPortals( (const byte *)buf.PeekGet() ) )
+		Error( "Invalid PortalFlow result from worker %d.\n", iWorker );
+
+	buf.Get( sorted_portals[g_iWaveFirstPortal + (int)iWorkUnit]->portalvis, portalbytes );
+}
+
+void RunWorkerPoolPortalFlow()
+{
+	Msg( "%-20s ", "PortalFlow:" );
+	if ( g_bWorkerPoolMaster )
+		StartPacifier( "" );
+
+	// Finished portals only become visible to the flow when their wave is over
+	g_bDeferPortalFlowDone = true;
+
+	double elapsed = 0;
+	int nPortals = g_numportals * 2;
+	int nWaveSize = Max( ( nPortals + PORTALFLOW_WAVES - 1 ) / PORTALFLOW_WAVES, 1 );
+	for ( g_iWaveFirstPortal = 0; g_iWaveFirstPortal < nPortals; g_iWaveFirstPortal += nWaveSize )
+	{
+		int nWavePortals = Min( nWaveSize, nPortals - g_iWaveFirstPortal );
+		WorkerPool_SetPacifierRange( (float)g_iWaveFirstPortal / (float)nPortals, (float)( g_iWaveFirstPortal + nWavePortals ) / (float)nPortals );
+		elapsed += WorkerPool_DistributeWork( nWavePortals, ProcessPortalFlow, ReceivePortalFlow );
+
+		// Share the wave's results. Nobody needs the last one.
+		bool bLastWave = ( g_iWaveFirstPortal + nWavePortals >= nPortals );
+		if ( !bLastWave )
+		{
+			CUtlBuffer buf;
+			if ( g_bWorkerPoolMaster )
+			{
+				for ( int i = 0; i < nWavePortals; i++ )
+				{
+					buf.Put( sorted_portals[g_iWaveFirstPortal + i]->portalvis, portalbytes );
+				}
+			}
+
+			WorkerPool_Broadcast( buf );
+
+			if ( !g_bWorkerPoolMaster )
+			{
+				for ( int i = 0; i < nWavePortals; i++ )
+				{
+					buf.Get( sorted_portals[g_iWaveFirstPortal + i]->portalvis, portalbytes );
+				}
+			}
+		}
+
+		for ( int i = 0; i < nWavePortals; i++ )
+		{
+			sorted_portals[g_iWaveFirstPortal + i]->status = stat_done;
+		}
+	}
+
+	g_bDeferPortalFlowDone = false;
+
+	if ( !g_bWorkerPoolMaster )
+	{
+		Msg( "VVIS worker finished. Over and out.\n" );
+		Plat_ExitProcess( 0 );
+	}
+
+	EndPacifier( false );
+	Msg( " (%d)\n", (int)elapsed );
+}
@@ -0,0 +1,18 @@
+//========= Copyright Valve Corporation, All rights reserved. ============//
+//
+// Purpose: vvis phases run through the worker pool (see workerpool.h)
+//
+//=============================================================================//
+
+#ifndef WORKERPOOLVIS_H
+#define WORKERPOOLVIS_H
+#ifdef _WIN32
+#pragma once
+#endif
+
+
+void RunWorkerPoolBasePortalVis();
+void RunWorkerPoolPortalFlow();
+
+
+#endif // WORKERPOOLVIS_H
@@ -13,6 +13,9 @@
 #include "tier0/threadtools.h"
 #include "tier1/memstack.h"
 #include "tier1/convar.h"
+#include "tier1/keyvaluesdocument.h"
+#include "tier1/utlbuffer.h"
+#include <stdio.h>
 
 #ifdef _PS3
 #include "ps3/ps3_core.h"
@@ -118,16 +121,26 @@ private:
 	3a) for case-insensitive lookup return the found stringIndex
 	3b) for case-sensitive lookup keep walking the list of alternative
 		capitalizations using strcmp until exact case match is found
+
+	The table is insert-only: strings never move (m_Strings reserves its full
+	range up front), items are never freed and the bucket array never resizes.
+	So case-insensitive lookups walk the buckets without the mutex; items are
+	fully written before being linked in. Each item keeps its full hash so the
+	walk only stricmp's real candidates. Inserts, and case-sensitive lookups
+	that need the alternative capitalization chain, take the mutex.
 	*/
 	CMemoryStack m_Strings;
 	struct hash_item_t
 	{
 		int stringIndex;
-		hash_item_t *next;
+		unsigned int hash;
+		hash_item_t * volatile next;
 	};
 	CUtlMemoryPool m_HashItemMemPool;
 	CUtlVector<hash_item_t> m_HashTable;
-	int CaseInsensitiveHash(const char *string, int iBounds);
+	static unsigned int CaseInsensitiveHash( const char *string );
+	int FindStringIndex( const char *name, unsigned int hash );
+	int AddStringToBucket( hash_item_t *pTail, const char *name, unsigned int hash );
 
 	struct MemoryLeakTracker_t
 	{
@@ -167,10 +180,15 @@ CKeyValuesSystem::CKeyValuesSystem() :
 {
 	MEM_ALLOC_CREDIT();
 	// initialize hash table
+#ifdef _GAMECONSOLE
 	m_HashTable.AddMultipleToTail(2047);
+#else
+	m_HashTable.AddMultipleToTail(8191);
+#endif
 	for (int i = 0; i < m_HashTable.Count(); i++)
 	{
 		m_HashTable[i].stringIndex = 0;
+		m_HashTable[i].hash = 0;
 		m_HashTable[i].next = NULL;
 	}
 
@@ -279,58 +297,82 @@ HKeySymbol CKeyValuesSystem::GetSymbolForString( const char *name, bool bCreate
 		return (-1);
 	}
 
+	unsigned int hash = CaseInsensitiveHash( name );
+	int stringIndex = FindStringIndex( name, hash );
+	if ( stringIndex != -1 || !bCreate )
+	{
+		return (HKeySymbol)stringIndex;
+	}
+
 	AUTO_LOCK( m_mutex );
 	MEM_ALLOC_CREDIT();
 
-	int hash = CaseInsensitiveHash(name, m_HashTable.Count());
-	int i = 0;
-	hash_item_t *item = &m_HashTable[hash];
-	while (1)
+	// somebody may have added it since we looked
+	stringIndex = FindStringIndex( name, hash );
+	if ( stringIndex != -1 )
 	{
-		if (!stricmp(name, (char *)m_Strings.GetBase() + item->stringIndex ))
-		{
-			return (HKeySymbol)item->stringIndex;
-		}
+		return (HKeySymbol)stringIndex;
+	}
 
-		i++;
+	hash_item_t *item = &m_HashTable[hash % m_HashTable.Count()];
+	while ( item->next )
+	{
+		item = item->next;
+	}
+	return (HKeySymbol)AddStringToBucket( item, name, hash );
+}
 
-		if (item->next == NULL)
+//-----------------------------------------------------------------------------
+// Purpose: case-insensitive lookup, safe without the mutex. Returns -1 if not found
+//-----------------------------------------------------------------------------
+int CKeyValuesSystem::FindStringIndex( const char *name, unsigned int hash )
+{
+	const char *pBase = (const char *)m_Strings.GetBase();
+	for ( hash_item_t *item = &m_HashTable[hash % m_HashTable.Count()]; item; item = item->next )
+	{
+		// stringIndex is published after hash, so read it first
+		int stringIndex = item->stringIndex;
+		if ( item->hash == hash && !stricmp( name, pBase + stringIndex ) )
 		{
-			if ( !bCreate )
-			{
-				// not found
-				return -1;
-			}
-
-			// we're not in the table
-			if (item->stringIndex != 0)
-			{
-				// first item is used, an new item
-				item->next = (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
-				item = item->next;
-			}
-
-			// build up the new item
-			item->next = NULL;
-			int numStringBytes = strlen(name);
-			char *pString = (char *)m_Strings.Alloc( numStringBytes + 1 + 3 );
-			if ( !pString )
-			{
-				Error( "Out of keyvalue string space" );
-				return -1;
-			}
-			item->stringIndex = pString - (char *)m_Strings.GetBase();
-			Q_memcpy( pString, name, numStringBytes );
-			* reinterpret_cast< uint32 * >( pString + numStringBytes ) = 0;	// string null-terminator + 3 alternative spelling bytes
-			return (HKeySymbol)item->stringIndex;
+			return stringIndex;
 		}
+	}
+	return -1;
+}
 
-		item = item->next;
+//-----------------------------------------------------------------------------
+// Purpose: appends a new string after the last item in a bucket. Mutex must be held
+//-----------------------------------------------------------------------------
+int CKeyValuesSystem::AddStringToBucket( hash_item_t *pTail, const char *name, unsigned int hash )
+{
+	int numStringBytes = strlen(name);
+	char *pString = (char *)m_Strings.Alloc( numStringBytes + 1 + 3 );
+	if ( !pString )
+	{
+		Error( "Out of keyvalue string space" );
+		return -1;
 	}
+	int stringIndex = pString - (char *)m_Strings.GetBase();
+	Q_memcpy( pString, name, numStringBytes );
+	* reinterpret_cast< uint32 * >( pString + numStringBytes ) = 0;	// string null-terminator + 3 alternative spelling bytes
 
-	// shouldn't be able to get here
-	Assert(0);
-	return (-1);
+	if ( pTail->stringIndex != 0 )
+	{
+		// first item is used, link in a new item once it's complete
+		hash_item_t *item = (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
+		item->stringIndex = stringIndex;
+		item->hash = hash;
+		item->next = NULL;
+		ThreadMemoryBarrier();
+		pTail->next = item;
+	}
+	else
+	{
+		pTail->hash = hash;
+		ThreadMemoryBarrier();
+		pTail->stringIndex = stringIndex;
+	}
+	return stringIndex;
 }
 
 //-----------------------------------------------------------------------------
@@ -343,15 +385,31 @@ HKeySymbol CKeyValuesSystem::GetSymbolForStringCaseSensitive( HKeySymbol &hCaseI
 		return (-1);
 	}
 
+	// the first spelling is the common case and doesn't need the mutex
+	unsigned int hash = CaseInsensitiveHash( name );
+	int stringIndex = FindStringIndex( name, hash );
+	if ( stringIndex != -1 && !strcmp( name, (const char *)m_Strings.GetBase() + stringIndex ) )
+	{
+		hCaseInsensitiveSymbol = (HKeySymbol)stringIndex;
+		return (HKeySymbol)stringIndex;
+	}
+
 	AUTO_LOCK( m_mutex );
 	MEM_ALLOC_CREDIT();
 
-	int hash = CaseInsensitiveHash(name, m_HashTable.Count());
 	int numNameStringBytes = -1;
 	int i = 0;
-	hash_item_t *item = &m_HashTable[hash];
+	hash_item_t *item = &m_HashTable[hash % m_HashTable.Count()];
 	while (1)
 	{
+		if ( item->hash != hash )
+		{
+			if ( item->next == NULL )
+				break;
+			item = item->next;
+			continue;
+		}
+
 		char *pCompareString = (char *)m_Strings.GetBase() + item->stringIndex;
 		int iResult = _V_stricmp_NegativeForUnequal( name, pCompareString );
 		if ( iResult == 0 )
@@ -409,42 +467,21 @@ HKeySymbol CKeyValuesSystem::GetSymbolForStringCaseSensitive( HKeySymbol &hCaseI
 
 		if (item->next == NULL)
 		{
-			if ( !bCreate )
-			{
-				// not found
-				return -1;
-			}
-
-			// we're not in the table
-			if (item->stringIndex != 0)
-			{
-				// first item is used, an new item
-				item->next = (hash_item_t *)m_HashItemMemPool.Alloc(sizeof(hash_item_t));
-				item = item->next;
-			}
-
-			// build up the new item
-			item->next = NULL;
-			int numStringBytes = strlen(name);
-			char *pString = (char *)m_Strings.Alloc( numStringBytes + 1 + 3 );
-			if ( !pString )
-			{
-				Error( "Out of keyvalue string space" );
-				return -1;
-			}
-			item->stringIndex = pString - (char *)m_Strings.GetBase();
-			Q_memcpy( pString, name, numStringBytes );
-			* reinterpret_cast< uint32 * >( pString + numStringBytes ) = 0;	// string null-terminator + 3 alternative spelling bytes
-			hCaseInsensitiveSymbol = (HKeySymbol)item->stringIndex;
-			return (HKeySymbol)item->stringIndex;
+			break;
 		}
 
 		item = item->next;
 	}
 
-	// shouldn't be able to get here
-	Assert(0);
-	return (-1);
+	if ( !bCreate )
+	{
+		// not found
+		return -1;
+	}
+
+	// we're not in the table
+	hCaseInsensitiveSymbol = (HKeySymbol)AddStringToBucket( item, name, hash );
+	return hCaseInsensitiveSymbol;
 }
 
 //-----------------------------------------------------------------------------
@@ -485,25 +522,24 @@ void CKeyValuesSystem::RemoveKeyValuesFromMemoryLeakList(void *pMem)
 }
 
 //-----------------------------------------------------------------------------
-// Purpose: generates a simple hash value for a string
+// Purpose: generates a case-insensitive hash value for a string, the empty
+//			string hashes to 0 (matching the unused bucket heads)
 //-----------------------------------------------------------------------------
-int CKeyValuesSystem::CaseInsensitiveHash(const char *string, int iBounds)
+unsigned int CKeyValuesSystem::CaseInsensitiveHash( const char *string )
 {
 	unsigned int hash = 0;
 
 	for ( ; *string != 0; string++ )
 	{
-		if (*string >= 'A' && *string <= 'Z')
+		unsigned int c = (unsigned char)*string;
+		if ( c >= 'A' && c <= 'Z' )
 		{
-			hash = (hash << 1) + (*string - 'A' + 'a');
-		}
-		else
-		{
-			hash = (hash << 1) + *string;
+			c += 'a' - 'A';
 		}
+		hash = ( hash ^ c ) * 16777619;
 	}
-	  
-	return hash % iBounds;
+
+	return hash ^ ( hash >> 15 );
 }
 
 //-----------------------------------------------------------------------------
@@ -618,3 +654,347 @@ bool CKeyValuesSystem::GetKeyValuesExpressionSymbol( const char *name )
 	Warning( "KV Conditional: Unknown symbol %s\n", name );
 	return false;
 }
+
+//-----------------------------------------------------------------------------
+// KeyValues benchmarks. They live here rather than in tier1 because tier1 is
+// linked into every module and its commands would be registered once per DLL.
+// vstdlib has no filesystem, so they take a path to the file on disk.
+//-----------------------------------------------------------------------------
+static bool KVBenchReadFile( const char *pszCommand, const char *pszPath, CUtlBuffer &buf )
+{
+	FILE *fp = fopen( pszPath, "rb" );
+	if ( !fp )
+	{
+		Warning( "%s: couldn't read %s\n", pszCommand, pszPath );
+		return false;
+	}
+
+	fseek( fp, 0, SEEK_END );
+	int nSize = ftell( fp );
+	fseek( fp, 0, SEEK_SET );
+
+	buf.EnsureCapacity( nSize + 1 );
+	int nRead = ( nSize > 0 ) ? (int)fread( buf.Base(), 1, nSize, fp ) : 0;
+	fclose( fp );
+	buf.SeekPut( CUtlBuffer::SEEK_HEAD, nRead );
+	buf.PutChar( 0 );
+	return true;
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: KeyValues symbol table benchmark. Each thread parses its own copy of
+//			items_game.txt and then walks every item definition, looking keys up
+//			by string (hashing through the symbol table) and by interned symbol.
+//-----------------------------------------------------------------------------
+struct KVSymbolBenchThread_t
+{
+	const char	*m_pszBuffer;
+	int			m_nIterations;
+	double		m_flParseTime;
+	double		m_flStringLookupTime;
+	double		m_flSymbolLookupTime;
+	int64		m_nLookups;
+};
+
+static int KVSymbolBenchWalk( KeyValues *pItems, bool bBySymbol )
+{
+	static CKeyValuesSymbol s_keyName( "name" );
+	static CKeyValuesSymbol s_keyPrefab( "prefab" );
+	static CKeyValuesSymbol s_keyItemClass( "item_class" );
+	static CKeyValuesSymbol s_keyAttributes( "attributes" );
+
+	int nLookups = 0;
+	for ( KeyValues *pItem = pItems->GetFirstTrueSubKey(); pItem; pItem = pItem->GetNextTrueSubKey() )
+	{
+		if ( bBySymbol )
+		{
+			pItem->GetString( s_keyName );
+			pItem->GetString( s_keyPrefab );
+			pItem->GetString( s_keyItemClass );
+			pItem->FindKey( s_keyAttributes );
+		}
+		else
+		{
+			pItem->GetString( "name" );
+			pItem->GetString( "prefab" );
+			pItem->GetString( "item_class" );
+			pItem->FindKey( "attributes" );
+		}
+		nLookups += 4;
+	}
+	return nLookups;
+}
+
+static uintp KVSymbolBenchThread( void *pParam )
+{
+	KVSymbolBenchThread_t *pInfo = (KVSymbolBenchThread_t *)pParam;
+
+	double flStart = Plat_FloatTime();
+	KeyValuesAD pItemsGameKV( "items_game" );
+	pItemsGameKV->LoadFromBuffer( "scripts/items/items_game.txt", pInfo->m_pszBuffer );
+	pInfo->m_flParseTime = Plat_FloatTime() - flStart;
+
+	KeyValues *pItems = pItemsGameKV->FindKey( "items" );
+	if ( !pItems )
+		return 0;
+
+	for ( int nSymbol = 0; nSymbol < 2; ++nSymbol )
+	{
+		flStart = Plat_FloatTime();
+		for ( int i = 0; i < pInfo->m_nIterations; ++i )
+		{
+			pInfo->m_nLookups += KVSymbolBenchWalk( pItems, nSymbol != 0 );
+		}
+		( nSymbol ? pInfo->m_flSymbolLookupTime : pInfo->m_flStringLookupTime ) = Plat_FloatTime() - flStart;
+	}
+	return 0;
+}
+
+CON_COMMAND( kv_symbol_bench, "Parses items_game.txt on several threads and times key lookups by string and by interned symbol. Arguments: <path to items_game.txt> [threads] [iterations]" )
+{
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: kv_symbol_bench <path to items_game.txt> [threads] [iterations]\n" );
+		return;
+	}
+
+	int nThreads = clamp( ( args.ArgC() > 2 ) ? atoi( args[2] ) : 4, 1, MAX_THREADS_SUPPORTED - 2 );
+	int nIterations = ( args.ArgC() > 3 ) ? atoi( args[3] ) : 20;
+
+	CUtlBuffer buf;
+	if ( !KVBenchReadFile( "kv_symbol_bench", args[1], buf ) )
+		return;
+
+	KVSymbolBenchThread_t info[MAX_THREADS_SUPPORTED];
+	ThreadHandle_t hThreads[MAX_THREADS_SUPPORTED];
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		V_memset( &info[i], 0, sizeof( info[i] ) );
+		info[i].m_pszBuffer = (const char *)buf.Base();
+		info[i].m_nIterations = nIterations;
+		hThreads[i] = CreateSimpleThread( KVSymbolBenchThread, &info[i] );
+	}
+
+	double flParse = 0.0, flString = 0.0, flSymbol = 0.0;
+	int64 nLookups = 0;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+		flParse = MAX( flParse, info[i].m_flParseTime );
+		flString = MAX( flString, info[i].m_flStringLookupTime );
+		flSymbol = MAX( flSymbol, info[i].m_flSymbolLookupTime );
+		nLookups += info[i].m_nLookups;
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	Msg( "kv_symbol_bench: %d threads, %.1f ms total\n", nThreads, flElapsed * 1000.0 );
+	Msg( "   parse (slowest thread) : %.1f ms\n", flParse * 1000.0 );
+	Msg( "   lookups by string      : %.1f ms, %.2f M/sec\n", flString * 1000.0, flString > 0.0 ? ( nLookups / 2 / flString ) * 1e-6 : 0.0 );
+	Msg( "   lookups by symbol      : %.1f ms, %.2f M/sec\n", flSymbol * 1000.0, flSymbol > 0.0 ? ( nLookups / 2 / flSymbol ) * 1e-6 : 0.0 );
+}
+
+//-----------------------------------------------------------------------------
+// Purpose: Compares load time, free time and heap growth of items_game.txt as
+//			KeyValues, as a KeyValuesDocument and as a KeyValuesDocument binary.
+//-----------------------------------------------------------------------------
+CON_COMMAND( kv_document_bench, "Times loading and freeing items_game.txt as KeyValues and as a KeyValuesDocument (text and binary). Arguments: <path to items_game.txt>" )
+{
+	if ( args.ArgC() < 2 )
+	{
+		Msg( "Usage: kv_document_bench <path to items_game.txt>\n" );
+		return;
+	}
+
+	CUtlBuffer buf;
+	if ( !KVBenchReadFile( "kv_document_bench", args[1], buf ) )
+		return;
+	const char *pszText = (const char *)buf.Base();
+
+	size_t nUsedBefore, nUsedAfter, nFree;
+
+	g_pMemAlloc->GlobalMemoryStatus( &nUsedBefore, &nFree );
+	double flStart = Plat_FloatTime();
+	KeyValues *pKV = new KeyValues( "items_game" );
+	pKV->LoadFromBuffer( "scripts/items/items_game.txt", pszText );
+	double flLoad = Plat_FloatTime() - flStart;
+	g_pMemAlloc->GlobalMemoryStatus( &nUsedAfter, &nFree );
+	flStart = Plat_FloatTime();
+	pKV->deleteThis();
+	double flFree = Plat_FloatTime() - flStart;
+	Msg( "KeyValues           : load %7.1f ms, free %6.1f ms, heap +%s\n", flLoad * 1000.0, flFree * 1000.0, V_pretifymem( (float)( nUsedAfter - nUsedBefore ), 2, true ) );
+
+	KeyValuesDocument doc;
+	g_pMemAlloc->GlobalMemoryStatus( &nUsedBefore, &nFree );
+	flStart = Plat_FloatTime();
+	doc.LoadFromBuffer( "scripts/items/items_game.txt", pszText, buf.TellPut() - 1 );
+	flLoad = Plat_FloatTime() - flStart;
+	g_pMemAlloc->GlobalMemoryStatus( &nUsedAfter, &nFree );
+	Msg( "KeyValuesDocument   : load %7.1f ms, %d keys, %s, heap +%s\n", flLoad * 1000.0, doc.GetKeyCount(), V_pretifymem( (float)doc.GetMemoryUsage(), 2, true ), V_pretifymem( (float)( nUsedAfter - nUsedBefore ), 2, true ) );
+
+	CUtlBuffer binary;
+	flStart = Plat_FloatTime();
+	doc.SaveBinary( binary );
+	double flSave = Plat_FloatTime() - flStart;
+	flStart = Plat_FloatTime();
+	doc.Purge();
+	flFree = Plat_FloatTime() - flStart;
+	Msg( "                      free %6.1f ms, binary save %6.1f ms, %s\n", flFree * 1000.0, flSave * 1000.0, V_pretifymem( (float)binary.TellPut(), 2, true ) );
+
+	flStart = Plat_FloatTime();
+	bool bLoaded = doc.LoadBinary( binary.Base(), binary.TellPut(), false );
+	flLoad = Plat_FloatTime() - flStart;
+	KeyValuesDocument::KeyHandle_t hItems = doc.FindKey( doc.GetFirstKey(), "items" );
+	int nItems = 0;
+	for ( KeyValuesDocument::KeyHandle_t hItem = doc.GetFirstSubKey( hItems ); hItem != KeyValuesDocument::INVALID_KEY; hItem = doc.GetNextKey( hItem ) )
+	{
+		nItems++;
+	}
+	Msg( "KeyValuesDocument bin: load %7.1f ms in place (%s), %d items\n", flLoad * 1000.0, bLoaded ? "ok" : "failed", nItems );
+}
+
+//-----------------------------------------------------------------------------
+// Contention benchmark: threads looking up names the way shaders and proxies
+// look up material var names, in the lock free symbol table and in a copy of
+// the old one that serialized Find behind its write lock. It lives here with the
+// KeyValues benchmarks for the same reason: tier1 would register it per DLL.
+//-----------------------------------------------------------------------------
+class CLockedSymbolTableBench
+{
+public:
+	CLockedSymbolTableBench( int growSize, int initSize, bool caseInsensitive ) : m_Table( growSize, initSize, caseInsensitive ) {}
+
+	CUtlSymbol AddString( const char *pString )
+	{
+		m_lock.LockForWrite();
+		CUtlSymbol result = m_Table.AddString( pString );
+		m_lock.UnlockWrite();
+		return result;
+	}
+
+	CUtlSymbol Find( const char *pString ) const
+	{
+		m_lock.LockForWrite();
+		CUtlSymbol result = m_Table.Find( pString );
+		m_lock.UnlockWrite();
+		return result;
+	}
+
+	const char *String( CUtlSymbol id ) const
+	{
+		m_lock.LockForRead();
+		const char *pszResult = m_Table.String( id );
+		m_lock.UnlockRead();
+		return pszResult;
+	}
+
+private:
+	CUtlSymbolTable m_Table;
+#ifdef WIN32
+	mutable CThreadSpinRWLock m_lock;
+#else
+	mutable CThreadRWLock m_lock;
+#endif
+};
+
+struct SymbolBenchThread_t
+{
+	void		*m_pTable;
+	int			m_nThread;
+	int			m_nNames;
+	int			m_nIterations;
+	int64		m_nLookups;
+	bool		m_bMismatch;
+};
+
+// One lookup in 64 adds a name no other thread uses
+#define SYMBOL_BENCH_ADD_INTERVAL	64
+
+template < class T >
+static uintp SymbolBenchThread( void *pParam )
+{
+	SymbolBenchThread_t *pInfo = (SymbolBenchThread_t *)pParam;
+	T *pTable = (T *)pInfo->m_pTable;
+	unsigned nRand = pInfo->m_nThread + 1;
+	char name[64];
+
+	for ( int i = 0; i < pInfo->m_nIterations; ++i )
+	{
+		if ( ( i % SYMBOL_BENCH_ADD_INTERVAL ) == SYMBOL_BENCH_ADD_INTERVAL - 1 )
+		{
+			Q_snprintf( name, sizeof( name ), "$bench_t%d_%d", pInfo->m_nThread, i / SYMBOL_BENCH_ADD_INTERVAL );
+			pTable->AddString( name );
+			continue;
+		}
+
+		nRand = nRand * 1103515245 + 12345;
+		Q_snprintf( name, sizeof( name ), "$BENCH_VAR_%d", ( nRand >> 8 ) % pInfo->m_nNames );
+		CUtlSymbol sym = pTable->Find( name );
+		if ( !sym.IsValid() || Q_stricmp( pTable->String( sym ), name ) )
+		{
+			pInfo->m_bMismatch = true;
+		}
+		++pInfo->m_nLookups;
+	}
+	return 0;
+}
+
+template < class T >
+static void RunSymbolBench( const char *pszName, int nThreads, int nIterations, int nNames )
+{
+	// Case insensitive like s_MaterialVarSymbols
+	T *pTable = new T( 0, 32, true );
+	char name[64];
+	for ( int i = 0; i < nNames; ++i )
+	{
+		Q_snprintf( name, sizeof( name ), "$bench_var_%d", i );
+		pTable->AddString( name );
+	}
+
+	SymbolBenchThread_t info[MAX_THREADS_SUPPORTED];
+	ThreadHandle_t hThreads[MAX_THREADS_SUPPORTED];
+
+	double flStart = Plat_FloatTime();
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		info[i].m_pTable = pTable;
+		info[i].m_nThread = i;
+		info[i].m_nNames = nNames;
+		info[i].m_nIterations = nIterations;
+		info[i].m_nLookups = 0;
+		info[i].m_bMismatch = false;
+		hThreads[i] = CreateSimpleThread( SymbolBenchThread< T >, &info[i] );
+	}
+
+	int64 nLookups = 0;
+	bool bMismatch = false;
+	for ( int i = 0; i < nThreads; ++i )
+	{
+		ThreadJoin( hThreads[i] );
+		ReleaseThreadHandle( hThreads[i] );
+		nLookups += info[i].m_nLookups;
+		bMismatch = bMismatch || info[i].m_bMismatch;
+	}
+	double flElapsed = Plat_FloatTime() - flStart;
+
+	Msg( "utlsymbol_contention_bench: %s, %d threads x %d iterations over %d names: %.1f ms, %.2f M lookups/sec%s\n",
+		pszName, nThreads, nIterations, nNames, flElapsed * 1000.0, flElapsed > 0.0 ? ( nLookups / flElapsed ) * 1e-6 : 0.0,
+		bMismatch ? " (LOOKUPS RETURNED THE WRONG STRING)" : "" );
+
+	delete pTable;
+}
+
+CON_COMMAND( utlsymbol_contention_bench, "Times threads doing symbol lookups in the lock free symbol table and in a locked one. Arguments: [threads] [iterations] [names]" )
+{
+	int nThreads = clamp( ( args.ArgC() > 1 ) ? atoi( args[1] ) : 4, 1, MAX_THREADS_SUPPORTED - 2 );
+	int nIterations = MAX( ( args.ArgC() > 2 ) ? atoi( args[2] ) : 100000, 1 );
+	int nNames = clamp( ( args.ArgC() > 3 ) ? atoi( args[3] ) : 2048, 1, 16384 );
+
+	// Keep the names each thread adds inside the 16 bit symbol range
+	nIterations = MIN( nIterations, ( ( UTL_INVAL_SYMBOL - 1 - nNames ) / nThreads ) * SYMBOL_BENCH_ADD_INTERVAL );
+
+	RunSymbolBench< CLockedSymbolTableBench >( "locked   ", nThreads, nIterations, nNames );
+	RunSymbolBench< CUtlSymbolTableMT >( "lock free", nThreads, nIterations, nNames );
+}